@@ -0,0 +1,100 @@
+#include "blurhash.h"
+#include "error.h"
+
+#include <math.h>
+
+static const char BASE83[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz#$%*+,-.:;=?@[]^_{|}~";
+
+/**
+ * @brief Writes value in base 83 on length characters, most significant first.
+ */
+static void encode83(unsigned int value, int length, char *out)
+{
+    for (int i = length - 1; i >= 0; --i) {
+        out[i] = BASE83[value % 83];
+        value /= 83;
+    }
+}
+
+static float srgb_to_linear(unsigned char value)
+{
+    const float v = (float) value / 255.f;
+    return v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f);
+}
+
+static unsigned int linear_to_srgb(float value)
+{
+    const float v = fmaxf(0.f, fminf(1.f, value));
+    return v <= 0.0031308f ? (unsigned int) (v * 12.92f * 255.f + 0.5f)
+           : (unsigned int) ((1.055f * powf(v, 1.f / 2.4f) - 0.055f) * 255.f + 0.5f);
+}
+
+static float sign_pow(float value, float exponent)
+{
+    return copysignf(powf(fabsf(value), exponent), value);
+}
+
+/**
+ * @brief Quantizes a component of an AC factor to 0..18.
+ */
+static unsigned int quantize_ac(float value, float maximum)
+{
+    const float q = fmaxf(0.f, fminf(18.f, floorf(sign_pow(value / maximum, 0.5f) * 9.f + 9.5f)));
+    return (unsigned int) q;
+}
+
+int blurhash_encode(const unsigned char *pixels, uint32_t width, uint32_t height, uint32_t bands, char *out)
+{
+    M_REQUIRE_NON_NULL(pixels);
+    M_REQUIRE_NON_NULL(out);
+    if (width == 0 || height == 0 || bands == 0) return ERR_INVALID_ARGUMENT;
+
+    // Cosines of each component, for each column and each row
+    float factors[BLURHASH_X * BLURHASH_Y][3] = {{0}};
+    const float pi = 3.14159265358979f;
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            const unsigned char *const pixel = pixels + ((size_t) y * width + x) * bands;
+            const float rgb[3] = {
+                srgb_to_linear(pixel[0]),
+                srgb_to_linear(pixel[bands >= 3 ? 1 : 0]),
+                srgb_to_linear(pixel[bands >= 3 ? 2 : 0])
+            };
+            for (int j = 0; j < BLURHASH_Y; ++j) {
+                const float cos_y = cosf(pi * (float) j * (float) y / (float) height);
+                for (int i = 0; i < BLURHASH_X; ++i) {
+                    const float basis = cosf(pi * (float) i * (float) x / (float) width) * cos_y;
+                    for (int c = 0; c < 3; ++c) factors[j * BLURHASH_X + i][c] += basis * rgb[c];
+                }
+            }
+        }
+    }
+    for (int k = 0; k < BLURHASH_X * BLURHASH_Y; ++k) {
+        const float normalisation = (k == 0 ? 1.f : 2.f) / ((float) width * (float) height);
+        for (int c = 0; c < 3; ++c) factors[k][c] *= normalisation;
+    }
+
+    // Number of components, then the scale of the AC components
+    encode83((BLURHASH_X - 1) + (BLURHASH_Y - 1) * 9, 1, out);
+    float maximum = 0.f;
+    for (int k = 1; k < BLURHASH_X * BLURHASH_Y; ++k) {
+        for (int c = 0; c < 3; ++c) maximum = fmaxf(maximum, fabsf(factors[k][c]));
+    }
+    const float clamped_maximum = fmaxf(0.f, fminf(82.f, floorf(maximum * 166.f - 0.5f)));
+    const int quantised_maximum = (int) clamped_maximum;
+    encode83((unsigned int) quantised_maximum, 1, out + 1);
+    maximum = (float) (quantised_maximum + 1) / 166.f;
+
+    // DC component: the average colour
+    encode83(linear_to_srgb(factors[0][0]) << 16 | linear_to_srgb(factors[0][1]) << 8 | linear_to_srgb(factors[0][2]),
+             4, out + 2);
+
+    for (int k = 1; k < BLURHASH_X * BLURHASH_Y; ++k) {
+        const unsigned int value = quantize_ac(factors[k][0], maximum) * 19 * 19 +
+                                   quantize_ac(factors[k][1], maximum) * 19 + quantize_ac(factors[k][2], maximum);
+        encode83(value, 2, out + 6 + 2 * (k - 1));
+    }
+    out[BLURHASH_LENGTH] = '\0';
+
+    return ERR_NONE;
+}
@@ -0,0 +1,26 @@
+/**
+ * @file blurhash.h
+ * @brief BlurHash encoding of images: a few characters clients decode into a blurred preview.
+ *
+ * The image is summed up by the first components of its discrete cosine transform,
+ * BLURHASH_X horizontally by BLURHASH_Y vertically, each quantized and written in
+ * base 83 (see https://github.com/woltapp/blurhash for the format).
+ */
+
+#pragma once
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t
+
+#define BLURHASH_X 4
+#define BLURHASH_Y 3
+#define BLURHASH_LENGTH (6 + 2 * (BLURHASH_X * BLURHASH_Y - 1)) // characters of a hash, without null byte
+
+/**
+ * @brief Writes the BlurHash of an image of width by height pixels, each of bands bytes (sRGB),
+ * row after row, to out (of at least BLURHASH_LENGTH + 1 bytes, null-terminated).
+ * Images with 1 or 2 bands are grey (with alpha); with more, only the first 3 are used.
+ *
+ * @return Some error code. 0 if no error.
+ */
+int blurhash_encode(const unsigned char *pixels, uint32_t width, uint32_t height, uint32_t bands, char *out);
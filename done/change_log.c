@@ -0,0 +1,131 @@
+#include "change_log.h"
+#include "error.h"
+#include "util.h" // for MIN()
+
+#include <stdlib.h> // for malloc
+#include <string.h> // for strncpy
+#include <unistd.h> // for ftruncate
+
+/**
+ * @brief Empties the log, which now starts at base_version
+ */
+static int reset(struct change_log *log, uint32_t base_version)
+{
+    struct change_log_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHANGE_LOG_MAGIC, sizeof(header.magic));
+    header.base_version = base_version;
+
+    if (fflush(log->file) != 0 || ftruncate(fileno(log->file), 0) != 0) return ERR_IO;
+    if (fseek(log->file, 0, SEEK_SET) != 0 ||
+        fwrite(&header, sizeof(header), 1, log->file) != 1 || fflush(log->file) != 0) {
+        return ERR_IO;
+    }
+
+    log->base_version = base_version;
+    log->nb_records = 0;
+    return ERR_NONE;
+}
+
+int change_log_open(struct change_log *log, const char *imgfs_filename, uint32_t version)
+{
+    M_REQUIRE_NON_NULL(log);
+    M_REQUIRE_NON_NULL(imgfs_filename);
+
+    char *const filename = malloc(strlen(imgfs_filename) + sizeof(CHANGE_LOG_SUFFIX));
+    if (filename == NULL) return ERR_OUT_OF_MEMORY;
+    strcpy(filename, imgfs_filename);
+    strcat(filename, CHANGE_LOG_SUFFIX);
+
+    memset(log, 0, sizeof(*log));
+    log->file = fopen(filename, "r+b");
+    if (log->file == NULL) {
+        log->file = fopen(filename, "w+b");
+    }
+    free(filename);
+    if (log->file == NULL) return ERR_IO;
+
+    // Keeping the records only if they are those of the imgFS up to its current version
+    struct change_log_header header;
+    long size = -1;
+    if (fread(&header, sizeof(header), 1, log->file) == 1 &&
+        memcmp(header.magic, CHANGE_LOG_MAGIC, sizeof(header.magic)) == 0 &&
+        fseek(log->file, 0, SEEK_END) == 0) {
+        size = ftell(log->file);
+    }
+    if (size >= (long) sizeof(header) && (size - (long) sizeof(header)) % (long) sizeof(struct change_record) == 0) {
+        log->base_version = header.base_version;
+        log->nb_records = (uint32_t) ((size_t) (size - (long) sizeof(header)) / sizeof(struct change_record));
+        if (change_log_version(log) == version) return ERR_NONE;
+    }
+
+    const int ret = reset(log, version);
+    if (ret != ERR_NONE) change_log_close(log);
+    return ret;
+}
+
+int change_log_append(struct change_log *log, uint32_t version, enum change_op op, const char *img_id)
+{
+    M_REQUIRE_NON_NULL(log);
+    M_REQUIRE_NON_NULL(log->file);
+    M_REQUIRE_NON_NULL(img_id);
+
+    if (version != change_log_version(log) + 1) {
+        const int ret = reset(log, version - 1);
+        if (ret != ERR_NONE) return ret;
+    }
+
+    struct change_record record;
+    memset(&record, 0, sizeof(record));
+    record.version = version;
+    record.op = (uint32_t) op;
+    strncpy(record.img_id, img_id, MAX_IMG_ID);
+
+    const long offset = (long) (sizeof(struct change_log_header) + log->nb_records * sizeof(record));
+    if (fseek(log->file, offset, SEEK_SET) != 0 ||
+        fwrite(&record, sizeof(record), 1, log->file) != 1 || fflush(log->file) != 0) {
+        return ERR_IO;
+    }
+
+    log->nb_records++;
+    return ERR_NONE;
+}
+
+int change_log_read(struct change_log *log, uint32_t since, struct change_record *records, size_t max, size_t *nb)
+{
+    M_REQUIRE_NON_NULL(log);
+    M_REQUIRE_NON_NULL(log->file);
+    M_REQUIRE_NON_NULL(records);
+    M_REQUIRE_NON_NULL(nb);
+
+    *nb = 0;
+    if (since < log->base_version || since > change_log_version(log)) {
+        return ERR_INVALID_ARGUMENT;
+    }
+
+    // Versions being consecutive, the change to since + 1 is the record since - base_version
+    const uint32_t first = since - log->base_version;
+    const size_t count = MIN((size_t) (log->nb_records - first), max);
+    if (count == 0) return ERR_NONE;
+
+    const long offset = (long) (sizeof(struct change_log_header) + first * sizeof(struct change_record));
+    if (fseek(log->file, offset, SEEK_SET) != 0 ||
+        fread(records, sizeof(struct change_record), count, log->file) != count) {
+        return ERR_IO;
+    }
+
+    *nb = count;
+    return ERR_NONE;
+}
+
+uint32_t change_log_version(const struct change_log *log)
+{
+    return log->base_version + log->nb_records;
+}
+
+void change_log_close(struct change_log *log)
+{
+    if (log == NULL || log->file == NULL) return;
+    fclose(log->file);
+    log->file = NULL;
+}
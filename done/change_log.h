@@ -0,0 +1,84 @@
+/**
+ * @file change_log.h
+ * @brief Append-only log of the changes made to an imgFS, in a sidecar file.
+ *
+ * Every insertion and deletion increments the version of an imgFS by one: the
+ * log keeps, for each version from some base version on, which image was
+ * inserted or deleted, so that clients knowing some version of the imgFS can
+ * catch up with its changes only. Records have a fixed size and consecutive
+ * versions, so the changes since any version are found by their position.
+ */
+
+#pragma once
+
+#include "imgfs.h" // for MAX_IMG_ID
+
+#include <stdio.h>  // for FILE
+#include <stdint.h> // for uint32_t
+
+#define CHANGE_LOG_SUFFIX ".changes" // appended to the name of the imgFS file
+#define CHANGE_LOG_MAGIC  "IMGFSCHG"
+
+enum change_op {
+    CHANGE_INSERT = 1,
+    CHANGE_DELETE = 2
+};
+
+/**
+ * @brief Header of the log file
+ */
+struct change_log_header {
+    char magic[8];          // CHANGE_LOG_MAGIC, without null byte
+    uint32_t base_version;  // version of the imgFS before the first record
+    uint32_t unused_32;
+};
+
+/**
+ * @brief A change, as stored in the log file
+ */
+struct change_record {
+    uint32_t version;             // of the imgFS once the change was made
+    uint32_t op;                  // enum change_op
+    char img_id[MAX_IMG_ID + 1];
+};
+
+struct change_log {
+    FILE *file;
+    uint32_t base_version;
+    uint32_t nb_records;
+};
+
+/**
+ * @brief Opens (or creates) the log of the imgFS imgfs_filename, which is at version.
+ *
+ * A log that does not end at version (e.g. the imgFS was changed without it) is started again,
+ * empty, from version: changes before it are not known anymore.
+ *
+ * @return Some error code. 0 if no error.
+ */
+int change_log_open(struct change_log *log, const char *imgfs_filename, uint32_t version);
+
+/**
+ * @brief Records that the change op of image img_id brought the imgFS to version.
+ *
+ * If version does not follow the last recorded one, the log is started again from version - 1.
+ *
+ * @return Some error code. 0 if no error.
+ */
+int change_log_append(struct change_log *log, uint32_t version, enum change_op op, const char *img_id);
+
+/**
+ * @brief Reads at most max changes made after version since, in order, into records.
+ *
+ * @param nb Where to write the number of changes read.
+ * @return Some error code. 0 if no error, ERR_INVALID_ARGUMENT if the changes since that version
+ *         are not all known (since is before the base version of the log, or after its last one).
+ */
+int change_log_read(struct change_log *log, uint32_t since, struct change_record *records, size_t max, size_t *nb);
+
+/**
+ * @brief Version of the imgFS once the last recorded change was made.
+ */
+uint32_t change_log_version(const struct change_log *log);
+
+void change_log_close(struct change_log *log);
@@ -0,0 +1,105 @@
+#include "crc32c.h"
+
+#include <pthread.h> // for pthread_once
+#include <string.h>  // for memcpy
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h> // for _mm_crc32_u64
+#define CRC32C_SSE42
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h> // for __crc32cd
+#define CRC32C_ARM
+#endif
+
+#define POLYNOMIAL 0x82f63b78u // of CRC32C, bits reversed
+
+// table[k][b]: CRC of byte b followed by k zero bytes, to process 8 bytes at a time ("slicing-by-8")
+static uint32_t table[8][256];
+static pthread_once_t table_once = PTHREAD_ONCE_INIT;
+
+static void table_init(void)
+{
+    for (uint32_t b = 0; b < 256; ++b) {
+        uint32_t crc = b;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ ((crc & 1) ? POLYNOMIAL : 0);
+        }
+        table[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; ++b) {
+        for (int k = 1; k < 8; ++k) {
+            table[k][b] = (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xff];
+        }
+    }
+}
+
+/**
+ * @brief Goes through the bytes of data from the state crc (the CRC inverted), with the table.
+ */
+static uint32_t update_portable(uint32_t crc, const unsigned char *bytes, size_t size)
+{
+    pthread_once(&table_once, table_init);
+
+    for (; size >= 8; size -= 8, bytes += 8) {
+        uint32_t low, high;
+        memcpy(&low, bytes, sizeof(low));
+        memcpy(&high, bytes + 4, sizeof(high));
+        low ^= crc; // little endian, as on the processors this runs on
+        crc = table[7][low & 0xff] ^ table[6][(low >> 8) & 0xff] ^
+              table[5][(low >> 16) & 0xff] ^ table[4][low >> 24] ^
+              table[3][high & 0xff] ^ table[2][(high >> 8) & 0xff] ^
+              table[1][(high >> 16) & 0xff] ^ table[0][high >> 24];
+    }
+    for (; size > 0; --size, ++bytes) {
+        crc = (crc >> 8) ^ table[0][(crc ^ *bytes) & 0xff];
+    }
+    return crc;
+}
+
+#ifdef CRC32C_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t update_hardware(uint32_t crc, const unsigned char *bytes, size_t size)
+{
+    uint64_t crc64 = crc;
+    for (; size >= 8; size -= 8, bytes += 8) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t) crc64;
+    for (; size > 0; --size, ++bytes) {
+        crc = _mm_crc32_u8(crc, *bytes);
+    }
+    return crc;
+}
+#elif defined(CRC32C_ARM)
+static uint32_t update_hardware(uint32_t crc, const unsigned char *bytes, size_t size)
+{
+    for (; size >= 8; size -= 8, bytes += 8) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+    for (; size > 0; --size, ++bytes) {
+        crc = __crc32cb(crc, *bytes);
+    }
+    return crc;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t size)
+{
+#ifdef CRC32C_SSE42
+    if (__builtin_cpu_supports("sse4.2")) {
+        return ~update_hardware(~crc, data, size);
+    }
+#elif defined(CRC32C_ARM)
+    return ~update_hardware(~crc, data, size);
+#endif
+    return ~update_portable(~crc, data, size);
+}
+
+uint32_t crc32c_portable(uint32_t crc, const void *data, size_t size)
+{
+    return ~update_portable(~crc, data, size);
+}
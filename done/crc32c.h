@@ -0,0 +1,24 @@
+/**
+ * @file crc32c.h
+ * @brief CRC32C (Castagnoli) checksums, as used by iSCSI, ext4 or SSE4.2: of the header and of each
+ * metadata entry of an imgFS, to detect the ones torn or corrupted on disk.
+ *
+ * The CRC instruction of the processor is used when it has one (SSE4.2 on x86-64, the CRC extension
+ * on AArch64), a lookup table otherwise.
+ */
+
+#pragma once
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t
+
+/**
+ * @brief CRC32C of the size bytes of data following those whose CRC32C is crc (0 to start with):
+ * crc32c(crc32c(0, a, n), b, m) is the CRC32C of a then b.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t size);
+
+/**
+ * @brief crc32c() without the CRC instruction (for comparison).
+ */
+uint32_t crc32c_portable(uint32_t crc, const void *data, size_t size);
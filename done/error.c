@@ -22,5 +22,6 @@ const char* const ERR_MESSAGES[] = {
     "Existing image ID",
     "Image manipulation library error",
     "Debug",
+    "Corrupted imgFS",
     "no error (shall not be displayed)" // ERR_LAST
 };
@@ -40,6 +40,7 @@ enum error_codes {
     ERR_DUPLICATE_ID,
     ERR_IMGLIB,
     ERR_DEBUG,
+    ERR_CORRUPTED,
     ERR_LAST // not an actual error but to have e.g. the total number of errors
 };
 
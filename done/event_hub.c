@@ -0,0 +1,276 @@
+#include "event_hub.h"
+#include "error.h"
+#include "util.h" // for MIN()
+
+#include <errno.h>
+#include <fcntl.h>    // for fcntl
+#include <poll.h>
+#include <stdio.h>    // for perror
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define KEEPALIVE_COMMENT ": keepalive\n\n"
+
+int event_queue_init(struct event_queue *queue, size_t size)
+{
+    M_REQUIRE_NON_NULL(queue);
+
+    memset(queue, 0, sizeof(*queue));
+    queue->data = malloc(size);
+    if (queue->data == NULL) return ERR_OUT_OF_MEMORY;
+    queue->size = size;
+    return ERR_NONE;
+}
+
+int event_queue_push(struct event_queue *queue, const char *data, size_t len)
+{
+    M_REQUIRE_NON_NULL(queue);
+    M_REQUIRE_NON_NULL(data);
+
+    if (len > queue->size - queue->len) return ERR_OUT_OF_MEMORY;
+
+    // up to the end of the buffer, then from its start
+    const size_t tail = (queue->head + queue->len) % queue->size;
+    const size_t first = MIN(len, queue->size - tail);
+    memcpy(queue->data + tail, data, first);
+    memcpy(queue->data, data + first, len - first);
+    queue->len += len;
+    return ERR_NONE;
+}
+
+size_t event_queue_peek(const struct event_queue *queue, const char **data)
+{
+    *data = queue->data + queue->head;
+    return MIN(queue->len, queue->size - queue->head);
+}
+
+void event_queue_pop(struct event_queue *queue, size_t len)
+{
+    len = MIN(len, queue->len);
+    queue->head = queue->len == len ? 0 : (queue->head + len) % queue->size;
+    queue->len -= len;
+}
+
+void event_queue_free(struct event_queue *queue)
+{
+    if (queue == NULL) return;
+    free(queue->data);
+    memset(queue, 0, sizeof(*queue));
+}
+
+/**
+ * @brief Has the thread of hub look again at what there is to send.
+ */
+static void wake_up(struct event_hub *hub)
+{
+    // the pipe being full, the thread is to wake up anyway
+    const char byte = 0;
+    if (write(hub->wake[1], &byte, 1) < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        perror("write() in wake_up()");
+    }
+}
+
+/**
+ * @brief Sends what subscriber has in its queue, as much as its connection takes without waiting.
+ */
+static void send_queued(struct event_subscriber *subscriber)
+{
+    while (subscriber->queue.len > 0) {
+        const char *data = NULL;
+        const size_t len = event_queue_peek(&subscriber->queue, &data);
+        const ssize_t sent = send(subscriber->connection, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) subscriber->dropped = 1;
+            return;
+        }
+        event_queue_pop(&subscriber->queue, (size_t) sent);
+    }
+}
+
+/**
+ * @brief Whether the client of subscriber closed its connection (what it sends otherwise is ignored).
+ */
+static int is_closed(const struct event_subscriber *subscriber)
+{
+    char ignored[256];
+    const ssize_t received = recv(subscriber->connection, ignored, sizeof(ignored), MSG_DONTWAIT);
+    return received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+}
+
+/**
+ * @brief Closes the connections of the dropped subscribers, and forgets them (with the lock held).
+ */
+static void remove_dropped(struct event_hub *hub)
+{
+    size_t kept = 0;
+    for (size_t i = 0; i < hub->nb_subscribers; ++i) {
+        struct event_subscriber *subscriber = &hub->subscribers[i];
+        if (subscriber->dropped) {
+            close(subscriber->connection);
+            event_queue_free(&subscriber->queue);
+        } else {
+            if (kept != i) hub->subscribers[kept] = *subscriber;
+            ++kept;
+        }
+    }
+    hub->nb_subscribers = kept;
+}
+
+/**
+ * @brief Appends len bytes to the queue of every subscriber, dropping those with no room left
+ * (with the lock held).
+ */
+static void push_all(struct event_hub *hub, const char *data, size_t len)
+{
+    for (size_t i = 0; i < hub->nb_subscribers; ++i) {
+        struct event_subscriber *subscriber = &hub->subscribers[i];
+        if (!subscriber->dropped && event_queue_push(&subscriber->queue, data, len) != ERR_NONE) {
+            subscriber->dropped = 1;
+        }
+    }
+}
+
+/**
+ * @brief Thread serving all the subscribers of hub, until event_hub_stop().
+ *
+ * Only this thread removes subscribers, and others only add some at the end of the
+ * array: the subscribers polled are still at the same place once poll() returns.
+ */
+static void *serve(void *arg)
+{
+    struct event_hub *hub = arg;
+    struct pollfd fds[EVENT_HUB_MAX_SUBSCRIBERS + 1];
+    time_t last_keepalive = time(NULL);
+
+    pthread_mutex_lock(&hub->lock);
+    while (hub->running) {
+        remove_dropped(hub);
+
+        // Comments are ignored by clients, but show them (and proxies) that the connection is alive
+        const time_t now = time(NULL);
+        if (now - last_keepalive >= EVENT_HUB_KEEPALIVE) {
+            push_all(hub, KEEPALIVE_COMMENT, strlen(KEEPALIVE_COMMENT));
+            last_keepalive = now;
+        }
+
+        fds[0].fd = hub->wake[0];
+        fds[0].events = POLLIN;
+        const size_t nb_polled = hub->nb_subscribers;
+        for (size_t i = 0; i < nb_polled; ++i) {
+            fds[i + 1].fd = hub->subscribers[i].connection;
+            fds[i + 1].events = (short) (POLLIN | (hub->subscribers[i].queue.len > 0 ? POLLOUT : 0));
+            fds[i + 1].revents = 0;
+        }
+        const int timeout = (int) (last_keepalive + EVENT_HUB_KEEPALIVE - now) * 1000;
+
+        pthread_mutex_unlock(&hub->lock);
+        const int nb_ready = poll(fds, (nfds_t) nb_polled + 1, timeout > 0 ? timeout : 0);
+        pthread_mutex_lock(&hub->lock);
+
+        if (nb_ready < 0) {
+            if (errno != EINTR) perror("poll() in event hub");
+            continue;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            char bytes[64];
+            while (read(hub->wake[0], bytes, sizeof(bytes)) > 0);
+        }
+
+        for (size_t i = 0; i < nb_polled; ++i) {
+            struct event_subscriber *subscriber = &hub->subscribers[i];
+            const short revents = fds[i + 1].revents;
+            if (revents & (POLLERR | POLLHUP | POLLNVAL) || ((revents & POLLIN) && is_closed(subscriber))) {
+                subscriber->dropped = 1;
+            }
+            if (!subscriber->dropped) send_queued(subscriber);
+        }
+    }
+    pthread_mutex_unlock(&hub->lock);
+
+    return NULL;
+}
+
+int event_hub_start(struct event_hub *hub)
+{
+    M_REQUIRE_NON_NULL(hub);
+
+    memset(hub, 0, sizeof(*hub));
+    if (pipe(hub->wake) != 0) return ERR_IO;
+    if (fcntl(hub->wake[0], F_SETFL, O_NONBLOCK) != 0 || fcntl(hub->wake[1], F_SETFL, O_NONBLOCK) != 0 ||
+        pthread_mutex_init(&hub->lock, NULL) != 0) {
+        close(hub->wake[0]);
+        close(hub->wake[1]);
+        return ERR_RUNTIME;
+    }
+
+    hub->running = 1;
+    if (pthread_create(&hub->thread, NULL, serve, hub) != 0) {
+        hub->running = 0;
+        pthread_mutex_destroy(&hub->lock);
+        close(hub->wake[0]);
+        close(hub->wake[1]);
+        return ERR_RUNTIME;
+    }
+    return ERR_NONE;
+}
+
+int event_hub_subscribe(struct event_hub *hub, int connection, const char *initial, size_t len)
+{
+    M_REQUIRE_NON_NULL(hub);
+    M_REQUIRE_NON_NULL(initial);
+
+    pthread_mutex_lock(&hub->lock);
+    if (!hub->running || hub->nb_subscribers >= EVENT_HUB_MAX_SUBSCRIBERS) {
+        pthread_mutex_unlock(&hub->lock);
+        return ERR_RUNTIME;
+    }
+
+    // initial comes on top of the events the subscriber may be late
+    struct event_subscriber *subscriber = &hub->subscribers[hub->nb_subscribers];
+    int ret = event_queue_init(&subscriber->queue, EVENT_QUEUE_SIZE + len);
+    if (ret == ERR_NONE) {
+        ret = event_queue_push(&subscriber->queue, initial, len);
+        subscriber->connection = connection;
+        subscriber->dropped = 0;
+        ++hub->nb_subscribers;
+    }
+    pthread_mutex_unlock(&hub->lock);
+
+    if (ret == ERR_NONE) wake_up(hub);
+    return ret;
+}
+
+void event_hub_publish(struct event_hub *hub, const char *event, size_t len)
+{
+    if (hub == NULL || event == NULL) return;
+
+    pthread_mutex_lock(&hub->lock);
+    const int running = hub->running;
+    if (running) push_all(hub, event, len);
+    pthread_mutex_unlock(&hub->lock);
+
+    if (running) wake_up(hub);
+}
+
+void event_hub_stop(struct event_hub *hub)
+{
+    if (hub == NULL || !hub->running) return;
+
+    pthread_mutex_lock(&hub->lock);
+    hub->running = 0;
+    pthread_mutex_unlock(&hub->lock);
+    wake_up(hub);
+    pthread_join(hub->thread, NULL);
+
+    for (size_t i = 0; i < hub->nb_subscribers; ++i) {
+        hub->subscribers[i].dropped = 1;
+    }
+    remove_dropped(hub);
+    pthread_mutex_destroy(&hub->lock);
+    close(hub->wake[0]);
+    close(hub->wake[1]);
+}
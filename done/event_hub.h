@@ -0,0 +1,102 @@
+/**
+ * @file event_hub.h
+ * @brief Pushes events to subscribed connections ("Server-Sent Events").
+ *
+ * Subscribed connections are all served by one thread, which waits with
+ * poll() until some of them can be written to (or are closed by their
+ * client): subscribers cost no thread each. Every subscriber has a queue
+ * of bounded size: a subscriber too slow to read its events has its
+ * connection closed when its queue is full, instead of making the server
+ * keep ever more events for it (a client then connects again, and asks
+ * for the events it missed).
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h> // size_t
+
+#define EVENT_HUB_MAX_SUBSCRIBERS 256
+#define EVENT_QUEUE_SIZE        65536 // bytes of events a subscriber may be late
+#define EVENT_HUB_KEEPALIVE        15 // seconds between two comments sent to all subscribers
+
+/**
+ * @brief Circular buffer of the bytes still to be sent to a subscriber
+ */
+struct event_queue {
+    char *data;
+    size_t size;  // of data
+    size_t head;  // first byte to be sent
+    size_t len;   // bytes to be sent
+};
+
+struct event_subscriber {
+    int connection;
+    int dropped;  // the connection is to be closed (its queue overflowed)
+    struct event_queue queue;
+};
+
+struct event_hub {
+    pthread_t thread;
+    pthread_mutex_t lock;   // of what follows
+    int running;
+    int wake[2];            // pipe to wake the thread up, when there is something new to send
+    size_t nb_subscribers;
+    struct event_subscriber subscribers[EVENT_HUB_MAX_SUBSCRIBERS];
+};
+
+/**
+ * @brief Initializes an empty queue of size bytes.
+ *
+ * @return Some error code. 0 if no error.
+ */
+int event_queue_init(struct event_queue *queue, size_t size);
+
+/**
+ * @brief Appends the len bytes of data to queue, if they fit.
+ *
+ * @return Some error code. 0 if no error, ERR_OUT_OF_MEMORY if the queue has no room for them
+ *         (nothing is then appended).
+ */
+int event_queue_push(struct event_queue *queue, const char *data, size_t len);
+
+/**
+ * @brief Where the bytes to be sent next are; they are contiguous up to the returned length.
+ */
+size_t event_queue_peek(const struct event_queue *queue, const char **data);
+
+/**
+ * @brief Removes the first len (sent) bytes of queue.
+ */
+void event_queue_pop(struct event_queue *queue, size_t len);
+
+void event_queue_free(struct event_queue *queue);
+
+/**
+ * @brief Starts the thread serving the subscribers of hub (none at first).
+ *
+ * @return Some error code. 0 if no error.
+ */
+int event_hub_start(struct event_hub *hub);
+
+/**
+ * @brief Hands connection over to hub, which sends it the len bytes of initial (e.g. the headers
+ * of the response), then every event published, until the client closes it. initial does not count
+ * in the EVENT_QUEUE_SIZE bytes the subscriber may be late.
+ *
+ * The connection belongs to hub, which closes it, once this returns ERR_NONE.
+ *
+ * @return Some error code. 0 if no error, ERR_RUNTIME if hub already has as many subscribers as it may.
+ */
+int event_hub_subscribe(struct event_hub *hub, int connection, const char *initial, size_t len);
+
+/**
+ * @brief Sends the len bytes of event to all the subscribers (without waiting for them to be sent).
+ * Subscribers that have no room for it left in their queue are disconnected.
+ */
+void event_hub_publish(struct event_hub *hub, const char *event, size_t len);
+
+/**
+ * @brief Stops the thread of hub and closes the connections of all its subscribers.
+ */
+void event_hub_stop(struct event_hub *hub);
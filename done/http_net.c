@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <signal.h>
 #include <pthread.h>
@@ -19,6 +20,9 @@
 
 static int passive_socket = -1;
 static EventCallback cb;
+static StreamCallback stream_cb;
+
+#define HTTP_CONTINUE_LINE HTTP_PROTOCOL_ID HTTP_CONTINUE HTTP_HDR_END_DELIM
 
 #define MK_OUR_ERR(X) \
 static int our_ ## X = X
@@ -41,6 +45,45 @@ void safe_free_(void* ptr)
     }
 }
 
+/*******************************************************************
+ * @brief Give the body of the message whose headers were parsed by parser to stream,
+ * first the bytes of it already in rcvbuf, then straight from the socket.
+ *
+ * @return ERR_NONE once the whole body was written, an error code otherwise.
+ */
+static int stream_body(int client_fd, const struct http_parser *parser, const char *rcvbuf, size_t read_bytes,
+                       const struct http_body_stream *stream)
+{
+    size_t remaining = parser->content_len;
+
+    const size_t buffered = read_bytes - parser->header_len;
+    if (buffered > 0) {
+        const int err = stream->write(stream->ctx, rcvbuf + parser->header_len, buffered);
+        if (err < 0) return err;
+        remaining -= buffered;
+    }
+    if (remaining == 0) return ERR_NONE;
+
+    char *chunk = malloc(HTTP_STREAM_CHUNK);
+    if (chunk == NULL) return ERR_OUT_OF_MEMORY;
+
+    int err = ERR_NONE;
+    while (remaining > 0 && err == ERR_NONE) {
+        // never reading past the body: a pipelined request stays in the socket
+        const ssize_t num_bytes_read = tcp_read(client_fd, chunk,
+                                                remaining < HTTP_STREAM_CHUNK ? remaining : HTTP_STREAM_CHUNK);
+        if (num_bytes_read <= 0) {
+            err = ERR_IO;
+        } else {
+            err = stream->write(stream->ctx, chunk, (size_t) num_bytes_read);
+            remaining -= (size_t) num_bytes_read;
+        }
+    }
+
+    safe_free_(chunk);
+    return err < 0 ? err : ERR_NONE;
+}
+
 /*******************************************************************
  * @brief Handle the client connection and process the HTTP message.
  *
@@ -61,82 +104,151 @@ static void *handle_connection(void *arg)
     pthread_sigmask(SIG_BLOCK, &mask, NULL);
 
     int client_fd = *(int *)arg;
+    safe_free_(arg);
+
+    // Idle persistent connections are closed after HTTP_IDLE_TIMEOUT seconds without a request
+    if (tcp_set_timeout(client_fd, HTTP_IDLE_TIMEOUT) < 0) {
+        close(client_fd);
+        return &our_ERR_IO;
+    }
 
-    ssize_t read_bytes = 0;
-    int content_len = 0;
+    size_t read_bytes = 0;
 
     struct http_message message;
+    struct http_parser parser;
     int parse_result ;
     ssize_t num_bytes_read ;
 
     // using max_buffer_size for dynamic resizing
     size_t max_buff_sz = MAX_HEADER_SIZE;
 
-    char *rcvbuf = calloc(1,max_buff_sz);
+    char *rcvbuf = malloc(max_buff_sz);
 
     if (rcvbuf == NULL) {
-        safe_free_(arg);
+        close(client_fd);
         return &our_ERR_OUT_OF_MEMORY;
     }
 
-    //While loop on every connection set by the client
-    do {
+    //While loop on every message sent by the client on this connection
+    int keep_alive = 1;
+    while (keep_alive) {
+        http_parser_init(&parser);
+        int streaming = HTTP_BODY_BUFFERED;
+        int body_asked = 0;
+        struct http_body_stream stream;
 
-        do {
+        //Pipelined requests: (part of) the next message may already be in the buffer
+        parse_result = read_bytes > 0 ? http_parse_incremental(&parser, rcvbuf, read_bytes, &message) : 0;
 
-            num_bytes_read = tcp_read(client_fd, rcvbuf + read_bytes,
-                                      max_buff_sz - read_bytes - 1);
+        while (parse_result == 0) {
+            const size_t message_len = http_parser_message_len(&parser);
 
-            if (num_bytes_read < 0) {
+            //Headers too long, or body too big to ever be accepted
+            if (message_len > MAX_HEADER_SIZE + MAX_REQUEST_SIZE ||
+                (message_len == 0 && read_bytes + 1 >= max_buff_sz)) {
+                close(client_fd);
                 safe_free_(rcvbuf);
                 return &our_ERR_IO;
             }
-            read_bytes += num_bytes_read;
-            rcvbuf[read_bytes] = '\0'; // null terminate string for safety
-
-            //Parsing the message until parsed completely
-            parse_result = http_parse_message(rcvbuf, read_bytes, &message, &content_len);
 
-            //Error in parsing
-            if (parse_result < 0) {
-                safe_free_(rcvbuf);
-                return &our_ERR_IO;
+            //Headers just received: the body may be streamed, refused, and the client may wait to send it
+            if (message_len > 0 && !body_asked) {
+                body_asked = 1;
+                if (stream_cb != NULL) {
+                    streaming = stream_cb(&message, parser.content_len, client_fd, &stream);
+                }
+                if (streaming < 0 || streaming == HTTP_BODY_ANSWERED) {
+                    close(client_fd);
+                    safe_free_(rcvbuf);
+                    return streaming < 0 ? &our_ERR_IO : &our_ERR_NONE;
+                }
+                if (http_expects_continue(&message) &&
+                    tcp_send(client_fd, HTTP_CONTINUE_LINE, strlen(HTTP_CONTINUE_LINE)) < 0) {
+                    if (streaming) stream.end(stream.ctx, client_fd, ERR_IO);
+                    close(client_fd);
+                    safe_free_(rcvbuf);
+                    return &our_ERR_IO;
+                }
+                if (streaming) break;
             }
 
-            //Message not complete
-            if (parse_result == 0 && content_len > 0 && read_bytes < content_len) {
-                max_buff_sz = MAX_HEADER_SIZE + content_len;
+            //Message not complete: make room for the whole body at once
+            if (message_len + 1 > max_buff_sz) {
+                max_buff_sz = message_len + 1;
                 char *new_buf = realloc(rcvbuf, max_buff_sz);
                 if (!new_buf) {
+                    close(client_fd);
                     safe_free_(rcvbuf);
-                    return &our_ERR_IO;
+                    return &our_ERR_OUT_OF_MEMORY;
                 }
                 rcvbuf = new_buf;
             }
 
-        } while (parse_result == 0 && read_bytes < max_buff_sz);
+            num_bytes_read = tcp_read(client_fd, rcvbuf + read_bytes,
+                                      max_buff_sz - read_bytes - 1);
 
-        //Completely parsed message
-        if (parse_result > 0) {
-            if (cb) {
-                int callback_result = cb(&message, client_fd);
-                if (callback_result < 0) {
-                    safe_free_(rcvbuf);
-                    return &our_ERR_IO;
-                }
+            //Connection closed by the client, or idle for too long
+            if (num_bytes_read == 0 || (num_bytes_read < 0 && read_bytes == 0 &&
+                                        (errno == EAGAIN || errno == EWOULDBLOCK))) {
+                close(client_fd);
+                safe_free_(rcvbuf);
+                return &our_ERR_NONE;
             }
+            if (num_bytes_read < 0) {
+                close(client_fd);
+                safe_free_(rcvbuf);
+                return &our_ERR_IO;
+            }
+            read_bytes += (size_t) num_bytes_read;
+            rcvbuf[read_bytes] = '\0'; // null terminate string for safety
+
+            //Parsing only the newly received bytes, until the message is complete
+            parse_result = http_parse_incremental(&parser, rcvbuf, read_bytes, &message);
+        }
+
+        //Error in parsing
+        if (parse_result < 0) {
+            close(client_fd);
+            safe_free_(rcvbuf);
+            return &our_ERR_IO;
+        }
+
+        keep_alive = !http_wants_close(&message);
 
+        if (streaming) {
+            const int err = stream_body(client_fd, &parser, rcvbuf, read_bytes, &stream);
+            if (stream.end(stream.ctx, client_fd, err) < 0 || err != ERR_NONE) {
+                close(client_fd);
+                safe_free_(rcvbuf);
+                return &our_ERR_IO;
+            }
+        }
+        //Completely parsed message
+        else if (cb) {
+            int callback_result = cb(&message, client_fd);
+            if (callback_result < 0) {
+                close(client_fd);
+                safe_free_(rcvbuf);
+                return &our_ERR_IO;
+            }
+            if (callback_result == HTTP_CONNECTION_TAKEN) {
+                safe_free_(rcvbuf);
+                return &our_ERR_NONE;
+            }
         }
-        //resetting buffer for another round of tcp_read
-        read_bytes = 0;
-        content_len = 0;
-        memset(rcvbuf,0,max_buff_sz);
 
-    } while( num_bytes_read != 0);
+        //Starting over for the next message with the bytes received after this one;
+        //no need to clear the buffer as parsing is length-bounded
+        //(a streamed body was not kept in the buffer)
+        const size_t message_len = http_parser_message_len(&parser);
+        const size_t consumed = message_len < read_bytes ? message_len : read_bytes;
+        read_bytes -= consumed;
+        memmove(rcvbuf, rcvbuf + consumed, read_bytes);
+    }
 
     //Closing socket after use
     close(client_fd);
-    safe_free_(arg);
+    safe_free_(rcvbuf);
 
     return &our_ERR_NONE;
 }
@@ -151,6 +263,14 @@ int http_init(uint16_t port, EventCallback callback)
     return passive_socket;
 }
 
+/*******************************************************************
+ * Set the callback for streamed bodies
+ */
+void http_set_stream_callback(StreamCallback callback)
+{
+    stream_cb = callback;
+}
+
 /*******************************************************************
  * Close connection
  */
@@ -273,31 +393,53 @@ int http_serve_file(int connection, const char* filename)
 /*******************************************************************
  * Create and send HTTP reply
  */
+/**
+ * @brief Writes the status line and headers of a response with a body of body_len bytes to buffer.
+ * Returns their length, or a negative value if buffer (of size bytes) is too small.
+ */
+static int write_head(char *buffer, size_t size, const char *status, const char *headers, size_t body_len)
+{
+    int header_len;
+    // Ensuring  status string starts with space after HTTP version
+    if (strncmp(status, HTTP_NOT_MODIFIED, 3) == 0) {
+        // a 304 has no body, and no Content-Length (which would be the one of the full content)
+        header_len = snprintf(buffer, size, "%s%s%s%s%s",
+                              HTTP_PROTOCOL_ID, status, HTTP_LINE_DELIM, headers, HTTP_LINE_DELIM);
+    } else {
+        header_len = snprintf(buffer, size, "%s%s%s%sContent-Length: %zu%s",
+                              HTTP_PROTOCOL_ID, status, HTTP_LINE_DELIM, headers, body_len, HTTP_HDR_END_DELIM);
+    }
+    return header_len < 0 || (size_t) header_len >= size ? -1 : header_len;
+}
+
+/**
+ * @brief Size of a buffer large enough for the status line and headers given to write_head()
+ */
+static size_t head_size(const char *status, const char *headers)
+{
+    const size_t EXTRA_LENGTH = 20;
+    return strlen(HTTP_PROTOCOL_ID) + strlen(status) + strlen(HTTP_LINE_DELIM) +
+           strlen(headers) + strlen("Content-Length: ") + EXTRA_LENGTH + strlen(HTTP_HDR_END_DELIM);
+}
+
 int http_reply(int connection, const char* status, const char* headers, const char *body, size_t body_len)
 {
     //Argument validity check
     M_REQUIRE_NON_NULL(status);
     M_REQUIRE_NON_NULL(headers);
-    const int EXTRA_LENGTH = 20;
 
     if (body == NULL && body_len > 0) {
         return ERR_INVALID_ARGUMENT; // body can be null for responses with empty body, but then length should be 0
     }
 
     // Computing required buffer size
-    size_t est_header_len = strlen(HTTP_PROTOCOL_ID) + strlen(status) + strlen(HTTP_LINE_DELIM) +
-                            strlen(headers) + strlen("Content-Length: ") + EXTRA_LENGTH + strlen(HTTP_HDR_END_DELIM);
-
-    size_t max_total_size = est_header_len + body_len;
+    size_t max_total_size = head_size(status, headers) + body_len;
 
     char *buffer = malloc(max_total_size + 1);  // +1 for null terminator
     if (!buffer) return ERR_OUT_OF_MEMORY;
 
-    // Ensuring  status string starts with space after HTTP version
-    int header_len = snprintf(buffer, max_total_size + 1, "%s%s%s%sContent-Length: %zu%s",
-                              HTTP_PROTOCOL_ID, status, HTTP_LINE_DELIM, headers, body_len, HTTP_HDR_END_DELIM);
-
-    if (header_len < 0 || (size_t)header_len >= max_total_size + 1) {
+    const int header_len = write_head(buffer, max_total_size + 1, status, headers, body_len);
+    if (header_len < 0) {
         safe_free_(buffer);
         return ERR_RUNTIME;
     }
@@ -313,3 +455,74 @@ int http_reply(int connection, const char* status, const char* headers, const ch
     safe_free_(buffer);
     return (sent_len == total_len) ? ERR_NONE : ERR_IO;
 }
+
+int http_reply_file(int connection, const char* status, const char* headers, int fd, off_t offset, size_t body_len)
+{
+    //Argument validity check
+    M_REQUIRE_NON_NULL(status);
+    M_REQUIRE_NON_NULL(headers);
+    if (fd < 0 || offset < 0) return ERR_INVALID_ARGUMENT;
+
+    const size_t size = head_size(status, headers) + 1;
+    char *buffer = malloc(size);
+    if (!buffer) return ERR_OUT_OF_MEMORY;
+
+    const int header_len = write_head(buffer, size, status, headers, body_len);
+    if (header_len < 0) {
+        safe_free_(buffer);
+        return ERR_RUNTIME;
+    }
+
+    const ssize_t sent_len = tcp_send(connection, buffer, (size_t) header_len);
+    safe_free_(buffer);
+    if (sent_len != header_len) return ERR_IO;
+
+    // The body goes from the file to the socket directly
+    return tcp_send_file(connection, fd, offset, body_len) == (ssize_t) body_len ? ERR_NONE : ERR_IO;
+}
+
+int http_reply_chunked(int connection, const char* status, const char* headers)
+{
+    //Argument validity check
+    M_REQUIRE_NON_NULL(status);
+    M_REQUIRE_NON_NULL(headers);
+
+    const size_t size = head_size(status, headers) + strlen("Transfer-Encoding: chunked") + 1;
+    char *buffer = malloc(size);
+    if (!buffer) return ERR_OUT_OF_MEMORY;
+
+    const int header_len = snprintf(buffer, size, "%s%s%s%sTransfer-Encoding: chunked%s",
+                                    HTTP_PROTOCOL_ID, status, HTTP_LINE_DELIM, headers, HTTP_HDR_END_DELIM);
+    if (header_len < 0 || (size_t) header_len >= size) {
+        safe_free_(buffer);
+        return ERR_RUNTIME;
+    }
+
+    const ssize_t sent_len = tcp_send(connection, buffer, (size_t) header_len);
+    safe_free_(buffer);
+    return sent_len == header_len ? ERR_NONE : ERR_IO;
+}
+
+int http_send_chunk(int connection, const char* data, size_t len)
+{
+    if (data == NULL && len > 0) return ERR_INVALID_ARGUMENT;
+
+    // chunk size in hexadecimal, the data, then a line delimiter; an empty chunk ends the body
+    const size_t size = 32 + len;
+    char *buffer = malloc(size);
+    if (!buffer) return ERR_OUT_OF_MEMORY;
+
+    const int size_len = snprintf(buffer, size, "%zx%s", len, HTTP_LINE_DELIM);
+    if (size_len < 0) {
+        safe_free_(buffer);
+        return ERR_RUNTIME;
+    }
+    if (len > 0) memcpy(buffer + size_len, data, len);
+    memcpy(buffer + (size_t) size_len + len, HTTP_LINE_DELIM, strlen(HTTP_LINE_DELIM));
+
+    // sent at once, not to wait for the acknowledgement of a first small segment
+    const size_t total_len = (size_t) size_len + len + strlen(HTTP_LINE_DELIM);
+    const ssize_t sent_len = tcp_send(connection, buffer, total_len);
+    safe_free_(buffer);
+    return sent_len == (ssize_t) total_len ? ERR_NONE : ERR_IO;
+}
@@ -8,20 +8,75 @@
 #pragma once
 
 #include <stdint.h>
+#include <sys/types.h> // off_t
 #include "http_prot.h" // for structs
 
 #define MAX_REQUEST_SIZE 8388608 // 2^23 -> to handle images up to 8MB
 #define MAX_HEADER_SIZE    16384 // 2^14 -> to handle http headers
+#define HTTP_IDLE_TIMEOUT     10 // seconds a persistent connection may stay without a request
+#define HTTP_STREAM_CHUNK  65536 // bytes of a streamed body read from the socket at once
 
 // Defined as specified in handout of week 11
 typedef int (*EventCallback)(struct http_message*, int);
 
+// Returned by an EventCallback which took the connection over (e.g. to push events on it):
+// it is neither read from nor closed anymore by the HTTP layer
+#define HTTP_CONNECTION_TAKEN 1
+
+/**
+ * @brief Receiver of the body of a request, chunk by chunk as it arrives, instead of in the http_message.
+ */
+struct http_body_stream {
+    void *ctx;
+    // called for each chunk of the body, in order; a negative return value aborts the transfer
+    int (*write)(void *ctx, const char *chunk, size_t chunk_len);
+    // called once, with ERR_NONE if the whole body was given to write, an error code otherwise:
+    // replies to the request and releases ctx
+    int (*end)(void *ctx, int connection, int err);
+};
+
+// What becomes of the body of a request, as decided by a StreamCallback
+#define HTTP_BODY_BUFFERED 0 // received in the http_message given to the EventCallback
+#define HTTP_BODY_STREAMED 1 // given chunk by chunk to the http_body_stream
+#define HTTP_BODY_ANSWERED 2 // not wanted: the request was answered, the connection is closed
+
+/**
+ * @brief Called once the headers of a request with a body of content_len bytes are received,
+ * before the body is asked for if the client expects a "100 Continue".
+ *
+ * Returns one of HTTP_BODY_BUFFERED, HTTP_BODY_STREAMED (after filling stream) and
+ * HTTP_BODY_ANSWERED, or a negative error code to close the connection.
+ */
+typedef int (*StreamCallback)(const struct http_message *msg, size_t content_len, int connection,
+                              struct http_body_stream *stream);
+
 int http_init(uint16_t port, EventCallback cb);
 
+/**
+ * @brief Sets the callback choosing which request bodies are streamed (none by default).
+ */
+void http_set_stream_callback(StreamCallback callback);
+
 int http_receive(void);
 
 int http_serve_file(int connection, const char* filename);
 
 int http_reply(int connection, const char* status, const char* headers, const char* body, size_t body_len);
 
+/**
+ * @brief As http_reply(), with the body_len bytes of file fd from offset on as body (sent with sendfile()).
+ */
+int http_reply_file(int connection, const char* status, const char* headers, int fd, off_t offset, size_t body_len);
+
+/**
+ * @brief Sends the status line and headers of a response whose body follows in chunks
+ * ("Transfer-Encoding: chunked"), sent with http_send_chunk().
+ */
+int http_reply_chunked(int connection, const char* status, const char* headers);
+
+/**
+ * @brief Sends the next len bytes of a chunked body; a chunk with len 0 (data may then be NULL) ends it.
+ */
+int http_send_chunk(int connection, const char* data, size_t len);
+
 void http_close(void);
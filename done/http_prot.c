@@ -1,8 +1,91 @@
 #include "http_prot.h"
 #include <string.h>
+#include <strings.h> // for strncasecmp
 #include <stdlib.h> // for malloc
+#include <stdint.h> // for SIZE_MAX
+#include <limits.h> // for INT_MAX
 #include "error.h"
 
+#define DELIM_BATCH 64
+#define HEADER_DELIMS (HTTP_SCAN(HTTP_DELIM_CRLF) | HTTP_SCAN(HTTP_DELIM_KV))
+#define MAX_CONTENT_LENGTH_DIGITS 20 // significant ones of SIZE_MAX, on 64 bits
+
+/**
+ * @brief Walks, in order, the delimiters of a buffer found by the http_scan kernel,
+ *        scanning the buffer once, DELIM_BATCH delimiters at a time.
+ *        The first delimiters may come from a previous scan (see delim_cursor_preload).
+ */
+struct delim_cursor {
+    const char *buf;
+    size_t len;
+    unsigned mask;
+    size_t resume;                  // where the next batch starts
+    const struct http_delim *delims; // current batch
+    size_t count;                   // delimiters in the current batch
+    size_t next;                    // next delimiter of the current batch
+    struct http_delim batch[DELIM_BATCH];
+};
+
+/**
+ * @brief Length of a delimiter
+ */
+static size_t delim_width(enum http_delim_kind kind)
+{
+    return (kind == HTTP_DELIM_CRLF || kind == HTTP_DELIM_KV) ? 2 : 1;
+}
+
+static void delim_cursor_init(struct delim_cursor *cursor, const char *buf, size_t len, unsigned mask)
+{
+    cursor->buf = buf;
+    cursor->len = len;
+    cursor->mask = mask;
+    cursor->resume = 0;
+    cursor->delims = cursor->batch;
+    cursor->count = 0;
+    cursor->next = 0;
+}
+
+/**
+ * @brief Starts the cursor with count delimiters already found in buf, before resume
+ */
+static void delim_cursor_preload(struct delim_cursor *cursor, const char *buf, size_t len, unsigned mask,
+                                 const struct http_delim *delims, size_t count, size_t resume)
+{
+    delim_cursor_init(cursor, buf, len, mask);
+    cursor->delims = delims;
+    cursor->count = count;
+    cursor->resume = resume;
+}
+
+/**
+ * @brief Writes the next delimiter (with its position relative to buf) to delim. Returns 0 if there is none.
+ */
+static int delim_cursor_next(struct delim_cursor *cursor, struct http_delim *delim)
+{
+    if (cursor->next == cursor->count) {
+        if (cursor->resume >= cursor->len) return 0;
+
+        cursor->count = http_scan_delims(cursor->buf + cursor->resume, cursor->len - cursor->resume,
+                                         cursor->mask, cursor->batch, DELIM_BATCH);
+        cursor->delims = cursor->batch;
+        cursor->next = 0;
+        for (size_t i = 0; i < cursor->count; ++i) {
+            cursor->batch[i].pos += cursor->resume;
+        }
+
+        if (cursor->count < DELIM_BATCH) {
+            cursor->resume = cursor->len; // the whole buffer has been scanned
+        } else {
+            const struct http_delim *last = &cursor->batch[cursor->count - 1];
+            cursor->resume = last->pos + delim_width(last->kind);
+        }
+        if (cursor->count == 0) return 0;
+    }
+
+    *delim = cursor->delims[cursor->next++];
+    return 1;
+}
+
 
 /**
  * @brief Checks whether the `message` URI starts with the provided `target_uri`.
@@ -60,43 +143,337 @@ int http_get_var(const struct http_string *url, const char *name, char *out, siz
 
     if (out_len <= 0) return ERR_INVALID_ARGUMENT;
 
-    //Copy of name into new string and append "=" (and null terminator)
-    size_t name_length = strlen(name);
+    const size_t name_length = strlen(name);
+
+    // One pass over the URL (and only the URL) to find '?', '&' and '='
+    struct delim_cursor cursor;
+    delim_cursor_init(&cursor, url->val, url->len,
+                      HTTP_SCAN(HTTP_DELIM_QUERY) | HTTP_SCAN(HTTP_DELIM_AMP) | HTTP_SCAN(HTTP_DELIM_EQ));
+
+    struct http_delim delim;
+    do {
+        if (!delim_cursor_next(&cursor, &delim)) return 0; // no query string
+    } while (delim.kind != HTTP_DELIM_QUERY);
+
+    // Each parameter is "key=value", up to the next '&' or the end of the URL
+    size_t param = delim.pos + 1;
+    int more = 1;
+    while (more) {
+        size_t eq = 0;
+        int has_eq = 0;
+        size_t param_end = url->len;
+        while ((more = delim_cursor_next(&cursor, &delim))) {
+            if (delim.kind == HTTP_DELIM_AMP) {
+                param_end = delim.pos;
+                break;
+            }
+            if (delim.kind == HTTP_DELIM_EQ && !has_eq) {
+                eq = delim.pos;
+                has_eq = 1;
+            }
+        }
+
+        if (has_eq && eq - param == name_length && memcmp(url->val + param, name, name_length) == 0) {
+            const size_t value_length = param_end - (eq + 1);
+            if (value_length >= out_len) {
+                return ERR_RUNTIME;
+            }
+            memcpy(out, url->val + eq + 1, value_length);
+            out[value_length] = '\0';
+            return (int) value_length;
+        }
+        param = param_end + 1;
+    }
+
+    return 0; // parameter not found in URL -> return 0 (handout)
+}
+
+const struct http_string *http_get_header(const struct http_message *message, const char *key)
+{
+    if (message == NULL || key == NULL) return NULL;
+
+    const size_t key_length = strlen(key);
+    for (size_t i = 0; i < message->num_headers; ++i) {
+        const struct http_string *header_key = &message->headers[i].key;
+        if (header_key->len == key_length && strncasecmp(header_key->val, key, key_length) == 0) {
+            return &message->headers[i].value;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Returns 1 if token is one of the comma-separated tokens of value (case-insensitive), 0 otherwise.
+ */
+static int has_token(const struct http_string *value, const char *token)
+{
+    if (value == NULL) return 0;
+
+    const size_t token_length = strlen(token);
+    size_t pos = 0;
+    while (pos < value->len) {
+        // one token of the list, without the surrounding spaces
+        while (pos < value->len && (value->val[pos] == ' ' || value->val[pos] == '\t' || value->val[pos] == ',')) ++pos;
+        const size_t start = pos;
+        while (pos < value->len && value->val[pos] != ',') ++pos;
+        size_t end = pos;
+        while (end > start && (value->val[end - 1] == ' ' || value->val[end - 1] == '\t')) --end;
+
+        if (end - start == token_length && strncasecmp(value->val + start, token, token_length) == 0) return 1;
+    }
+    return 0;
+}
+
+int http_wants_close(const struct http_message *message)
+{
+    const struct http_string *connection = http_get_header(message, "Connection");
+    if (has_token(connection, "close")) return 1;
+
+    // HTTP/1.1 connections are persistent by default, HTTP/1.0 ones (and older) are not
+    static const char prefix[] = "HTTP/";
+    const size_t prefix_length = strlen(prefix);
+    const int persistent = message->version.len >= prefix_length + strlen("1.1") &&
+                           strncmp(message->version.val, prefix, prefix_length) == 0 &&
+                           strncmp(message->version.val + prefix_length, "1.1", strlen("1.1")) >= 0;
+    return !persistent && !has_token(connection, "keep-alive");
+}
+
+int http_expects_continue(const struct http_message *message)
+{
+    const struct http_string *expect = http_get_header(message, "Expect");
+
+    return expect != NULL && expect->len == strlen("100-continue") &&
+           strncasecmp(expect->val, "100-continue", expect->len) == 0;
+}
+
+int http_etag_matches(const struct http_string *condition, const char *etag)
+{
+    if (condition == NULL || etag == NULL) return 0;
+
+    const size_t etag_length = strlen(etag);
+    size_t pos = 0;
+    while (pos < condition->len) {
+        // one tag of the comma-separated list, without the surrounding spaces
+        while (pos < condition->len && (condition->val[pos] == ' ' || condition->val[pos] == ',')) ++pos;
+        size_t end = pos;
+        while (end < condition->len && condition->val[end] != ',') ++end;
+        size_t tag_end = end;
+        while (tag_end > pos && condition->val[tag_end - 1] == ' ') --tag_end;
+
+        const char *tag = condition->val + pos;
+        size_t tag_length = tag_end - pos;
+        if (tag_length == 1 && tag[0] == '*') return 1;
+        if (tag_length > 2 && tag[0] == 'W' && tag[1] == '/') {
+            tag += 2; // weak comparison: W/"x" matches "x"
+            tag_length -= 2;
+        }
+        if (tag_length == etag_length && memcmp(tag, etag, etag_length) == 0) return 1;
+
+        pos = end;
+    }
+    return 0;
+}
+
+int http_accepts(const struct http_message *message, const char *media_type)
+{
+    const struct http_string *accept = http_get_header(message, "Accept");
+    if (accept == NULL || media_type == NULL) return 0;
+
+    const size_t type_length = strlen(media_type);
+    size_t pos = 0;
+    while (pos < accept->len) {
+        // one media range of the comma-separated list, and its parameters up to the next comma
+        while (pos < accept->len && (accept->val[pos] == ' ' || accept->val[pos] == ',')) ++pos;
+        size_t end = pos;
+        while (end < accept->len && accept->val[end] != ',') ++end;
+        size_t type_end = pos;
+        while (type_end < end && accept->val[type_end] != ';' && accept->val[type_end] != ' ') ++type_end;
+
+        if (type_end - pos == type_length && strncasecmp(accept->val + pos, media_type, type_length) == 0) {
+            // "q=0" (or "q=0.0", etc.) refuses it
+            int refused = 0;
+            for (size_t i = type_end; i + 3 <= end; ++i) {
+                if ((accept->val[i] == 'q' || accept->val[i] == 'Q') && accept->val[i + 1] == '=' &&
+                    (i == type_end || accept->val[i - 1] == ';' || accept->val[i - 1] == ' ')) {
+                    size_t digit = i + 2;
+                    refused = 1;
+                    while (digit < end && (accept->val[digit] == '0' || accept->val[digit] == '.')) ++digit;
+                    if (digit < end && accept->val[digit] >= '1' && accept->val[digit] <= '9') refused = 0;
+                }
+            }
+            if (!refused) return 1;
+        }
+
+        pos = end;
+    }
+    return 0;
+}
+
+/**
+ * @brief Finds parameter param ("name=value" or "name=\"value\"") among those of a header value
+ * and writes its value to out. Returns 1 if it is there, 0 otherwise.
+ */
+static int header_param(const struct http_string *header, const char *param, struct http_string *out)
+{
+    const size_t param_length = strlen(param);
+    for (size_t pos = 0; pos + param_length + 1 <= header->len; ++pos) {
+        // a whole parameter name ("name" is not the end of "filename")
+        if ((pos > 0 && header->val[pos - 1] != ';' && header->val[pos - 1] != ' ') ||
+            strncasecmp(header->val + pos, param, param_length) != 0 || header->val[pos + param_length] != '=') {
+            continue;
+        }
+
+        size_t start = pos + param_length + 1;
+        size_t end = start;
+        if (start < header->len && header->val[start] == '"') {
+            end = ++start;
+            while (end < header->len && header->val[end] != '"') ++end;
+        } else {
+            while (end < header->len && header->val[end] != ';' && header->val[end] != ' ') ++end;
+        }
+        out->val = header->val + start;
+        out->len = end - start;
+        return 1;
+    }
+    return 0;
+}
 
-    char *param_eq = (char *) calloc(1,name_length + 2); // 1 for "=" and 1 for the nul terminator ('\0')
-    if (!param_eq) {
-        return ERR_OUT_OF_MEMORY;
+int http_multipart_boundary(const struct http_message *message, struct http_string *boundary)
+{
+    static const char multipart[] = "multipart/";
+    const struct http_string *type = http_get_header(message, "Content-Type");
+    if (type == NULL || boundary == NULL || type->len < strlen(multipart) ||
+        strncasecmp(type->val, multipart, strlen(multipart)) != 0) {
+        return 0;
     }
-    strcpy(param_eq, name);
-    strcat(param_eq, "=\0");
+    return header_param(type, "boundary", boundary) && boundary->len > 0;
+}
 
-    //find parameter position in URL
-    char *start = strstr(url->val, param_eq);
-    if (!start) {
-        free(param_eq);
-        param_eq = NULL;
-        return 0; // parameter not found in URL -> return 0 (handout)
+/**
+ * @brief Offset in buf (of length len) of the first "\r\n--" followed by boundary, len if there is none.
+ */
+static size_t find_delimiter(const char *buf, size_t len, const struct http_string *boundary)
+{
+    const size_t delimiter_length = strlen(HTTP_LINE_DELIM "--") + boundary->len;
+    size_t pos = 0;
+    while (pos + delimiter_length <= len) {
+        pos += http_scan_next(buf + pos, len - pos, HTTP_SCAN(HTTP_DELIM_CRLF), NULL);
+        if (pos + delimiter_length > len) break;
+        if (buf[pos + 2] == '-' && buf[pos + 3] == '-' &&
+            memcmp(buf + pos + 4, boundary->val, boundary->len) == 0) {
+            return pos;
+        }
+        pos += delim_width(HTTP_DELIM_CRLF);
     }
+    return len;
+}
 
-    start += name_length + 1;
-    char *end = strchr(start, '&');
-    if (!end) {
-        end = (char *) url->val + url->len;  //if no & is found, the value goes until the end of the URL (handout)
+int http_multipart_next(const struct http_string *boundary, struct http_string *body,
+                        struct http_string *name, struct http_string *content)
+{
+    M_REQUIRE_NON_NULL(boundary);
+    M_REQUIRE_NON_NULL(body);
+    M_REQUIRE_NON_NULL(name);
+    M_REQUIRE_NON_NULL(content);
+
+    const char *const end = body->val + body->len;
+    const size_t line_length = strlen(HTTP_LINE_DELIM);
+
+    // The delimiter of the part: at the very start of the body, or after some preamble
+    size_t pos = 0;
+    if (body->len < 2 + boundary->len || body->val[0] != '-' || body->val[1] != '-' ||
+        memcmp(body->val + 2, boundary->val, boundary->len) != 0) {
+        pos = find_delimiter(body->val, body->len, boundary);
+        if (pos == body->len) return ERR_INVALID_ARGUMENT;
+        pos += line_length;
+    }
+    const char *cur = body->val + pos + 2 + boundary->len;
+    if (end - cur >= 2 && cur[0] == '-' && cur[1] == '-') {
+        // close delimiter
+        body->val = end;
+        body->len = 0;
+        return 0;
     }
+    if (end - cur < (long) line_length || strncmp(cur, HTTP_LINE_DELIM, line_length) != 0) {
+        return ERR_INVALID_ARGUMENT;
+    }
+    cur += line_length;
+
+    // Headers of the part, up to an empty line
+    name->val = cur;
+    name->len = 0;
+    while (1) {
+        const size_t line_len = http_scan_next(cur, (size_t) (end - cur), HTTP_SCAN(HTTP_DELIM_CRLF), NULL);
+        if (cur + line_len == end) return ERR_INVALID_ARGUMENT;
+        if (line_len == 0) break;
+
+        static const char disposition[] = "Content-Disposition:";
+        const struct http_string line = { cur, line_len };
+        if (line_len > strlen(disposition) && strncasecmp(cur, disposition, strlen(disposition)) == 0) {
+            if (!header_param(&line, "filename", name)) header_param(&line, "name", name);
+        }
+        cur += line_len + line_length;
+    }
+    cur += line_length;
+
+    const size_t content_len = find_delimiter(cur, (size_t) (end - cur), boundary);
+    if (cur + content_len == end) return ERR_INVALID_ARGUMENT;
+    content->val = cur;
+    content->len = content_len;
+
+    // What is left starts with the delimiter of the next part
+    body->val = cur + content_len + line_length;
+    body->len = (size_t) (end - body->val);
+    return 1;
+}
 
-    size_t value_length = end - start;
-    if (value_length >= out_len) {
-        free(param_eq);
-        param_eq = NULL;
-        return ERR_RUNTIME;
+/**
+ * @brief Reads the decimal number at the beginning of str (of length len) into value.
+ * Returns the number of digits read, 0 if there are none or if the number is too big.
+ */
+static size_t parse_size(const char *str, size_t len, size_t *value)
+{
+    size_t i = 0;
+    *value = 0;
+    while (i < len && str[i] >= '0' && str[i] <= '9') {
+        if (*value > (SIZE_MAX - 9) / 10) return 0;
+        *value = *value * 10 + (size_t) (str[i] - '0');
+        ++i;
     }
+    return i;
+}
 
-    strncpy(out, start, value_length);
-    out[value_length] = '\0';
+int http_parse_range(const struct http_string *range, size_t size, size_t *first, size_t *last)
+{
+    M_REQUIRE_NON_NULL(first);
+    M_REQUIRE_NON_NULL(last);
+    if (range == NULL) return 0;
+
+    static const char unit[] = "bytes=";
+    if (range->len < strlen(unit) || strncasecmp(range->val, unit, strlen(unit)) != 0) return 0;
+    const char *spec = range->val + strlen(unit);
+    const size_t spec_len = range->len - strlen(unit);
+
+    size_t start = 0, end = 0;
+    const size_t start_digits = parse_size(spec, spec_len, &start);
+    if (start_digits >= spec_len || spec[start_digits] != '-') return 0;
+    const size_t end_digits = parse_size(spec + start_digits + 1, spec_len - start_digits - 1, &end);
+    if (start_digits + 1 + end_digits != spec_len) return 0; // several ranges, or garbage
+    if (start_digits == 0 && end_digits == 0) return 0;
+
+    if (start_digits == 0) {
+        // the last end bytes
+        if (end == 0 || size == 0) return ERR_INVALID_ARGUMENT;
+        *first = end < size ? size - end : 0;
+        *last = size - 1;
+        return 1;
+    }
 
-    free(param_eq);
-    param_eq = NULL;
-    return value_length;
+    if (end_digits > 0 && end < start) return 0;
+    if (start >= size) return ERR_INVALID_ARGUMENT;
+    *first = start;
+    *last = end_digits > 0 && end < size ? end : size - 1;
+    return 1;
 }
 
 //==================================================================================================================
@@ -104,42 +481,95 @@ int http_get_var(const struct http_string *url, const char *name, char *out, siz
 //==================================================================================================================
 
 /**
- * @brief: Extract the first substring (prefix) of a the string before some delimiter
+ * @brief: Delimiter mask of the http_scan kernel corresponding to a delimiter string, 0 if it has none
  */
+static unsigned delim_mask(const char *delimiter)
+{
+    if (strcmp(delimiter, HTTP_LINE_DELIM) == 0) return HTTP_SCAN(HTTP_DELIM_CRLF);
+    if (strcmp(delimiter, HTTP_HDR_KV_DELIM) == 0) return HTTP_SCAN(HTTP_DELIM_KV);
+    if (strcmp(delimiter, " ") == 0) return HTTP_SCAN(HTTP_DELIM_SP);
+    if (strcmp(delimiter, "?") == 0) return HTTP_SCAN(HTTP_DELIM_QUERY);
+    if (strcmp(delimiter, "&") == 0) return HTTP_SCAN(HTTP_DELIM_AMP);
+    if (strcmp(delimiter, "=") == 0) return HTTP_SCAN(HTTP_DELIM_EQ);
+    return 0;
+}
+
+/**
+ * @brief: Extract the prefix of the first len characters of message before the first delimiter of mask
+ */
+static const char *get_next_token_n(const char *message, size_t len, unsigned mask, struct http_string *output)
+{
+    enum http_delim_kind kind;
+    const size_t pos = http_scan_next(message, len, mask, &kind);
+
+    output->val = message;
+    output->len = pos;
+    if (pos == len) {
+        return message + len;
+    }
+    return message + pos + delim_width(kind);
+}
 
+/**
+ * @brief: Extract the first substring (prefix) of a the string before some delimiter
+ */
 const char *get_next_token(const char *message, const char *delimiter, struct http_string *output)
 {
+    const size_t len = strlen(message);
+    const unsigned mask = delim_mask(delimiter);
+    if (mask != 0) {
+        return get_next_token_n(message, len, mask, output);
+    }
 
+    // Not a delimiter known to the scanning kernel
     const char *delim_pos = strstr(message, delimiter);
-
+    output->val = message;
     if (delim_pos) {
-        output->val = message;
-        output->len = delim_pos - message;
-
+        output->len = (size_t) (delim_pos - message);
         return delim_pos + strlen(delimiter);
     }
-    output->val = message;
-    output->len = strlen(message);
+    output->len = len;
 
-    return message + strlen(message);
+    return message + len;
 }
 
 /**
- * @brief: Fill all headers key-value pairs of output
+ * @brief: Fill all headers key-value pairs of output from the lines of buf starting at offset line,
+ *         taking the ": " and "\r\n" delimiters from cursor. Returns the offset right after the last header line.
  */
-const char *http_parse_headers(const char *header_start, struct http_message *output)
+static size_t parse_header_lines(const char *buf, size_t line, struct delim_cursor *cursor,
+                                 struct http_message *output)
 {
-
-    const char *current = header_start;
-    struct http_string key, value;
+    const size_t len = cursor->len;
+    struct http_delim delim;
     size_t idx = 0;
 
-    while (*current && idx < MAX_HEADERS) {
-        current = get_next_token(current, HTTP_HDR_KV_DELIM, &key);
-        // extract the value using  end-of-line as the delimiter.
-        current = get_next_token(current, HTTP_LINE_DELIM, &value);
+    while (line < len && idx < MAX_HEADERS) {
+        // the key ends at the first ": " of the line
+        if (!delim_cursor_next(cursor, &delim)) {
+            line = len;
+            break;
+        }
+        if (delim.kind != HTTP_DELIM_KV) {
+            // empty line (end of headers) or line without key
+            line = delim.pos + delim_width(delim.kind);
+            break;
+        }
+        const struct http_string key = { buf + line, delim.pos - line };
+        const size_t value_start = delim.pos + delim_width(delim.kind);
+
+        // extract the value using end-of-line as the delimiter (it may contain ": ")
+        size_t value_end = len;
+        while (delim_cursor_next(cursor, &delim)) {
+            if (delim.kind == HTTP_DELIM_CRLF) {
+                value_end = delim.pos;
+                break;
+            }
+        }
+        const struct http_string value = { buf + value_start, value_end - value_start };
+        line = value_end < len ? value_end + delim_width(HTTP_DELIM_CRLF) : len;
 
-        // break if key or value are empty (meaning a parsing issue or end of headers)
+        // break if key or value are empty (meaning a parsing issue)
         if (key.len == 0 || value.len == 0) {
             break;
         }
@@ -153,67 +583,209 @@ const char *http_parse_headers(const char *header_start, struct http_message *ou
     output->num_headers = idx;
 
     // return position right after end of the last header line.
-    return current;
+    return line;
 }
 
 /**
- * @see {http_prot.h#http_parse_message}
+ * @brief: Fill all headers key-value pairs of output
  */
-int http_parse_message(const char *stream, size_t bytes_received, struct http_message *out, int *content_len)
+const char *http_parse_headers(const char *header_start, struct http_message *output)
 {
+    // One pass over the headers to find every ": " and "\r\n"
+    struct delim_cursor cursor;
+    delim_cursor_init(&cursor, header_start, strlen(header_start), HEADER_DELIMS);
 
-    //Argument validity check
-    M_REQUIRE_NON_NULL(stream);
-    M_REQUIRE_NON_NULL(out);
-    M_REQUIRE_NON_NULL(content_len);
-
-    // Check that header has been completely received
-    const char *header_end = strstr(stream, HTTP_HDR_END_DELIM);
-    if (!header_end) {
-        return 0;  // headers incomplete
-    }
+    return header_start + parse_header_lines(header_start, 0, &cursor, output);
+}
 
-    const char *current = stream;
-    current = get_next_token(current, " ", &out->method);
-    current = get_next_token(current, " ", &out->uri);
+/**
+ * @brief: Records in parser the "\r\n" and ": " of the bytes of stream not scanned yet,
+ *         until the end of the headers. Returns 1 if it was found (header_len is then set), 0 otherwise.
+ */
+static int scan_header_delims(struct http_parser *parser, const char *stream, size_t bytes_received)
+{
+    struct http_delim overflow[DELIM_BATCH]; // for headers with too many delimiters to be remembered
+    size_t pos = parser->scanned;
+
+    while (pos < bytes_received) {
+        const int record = parser->nb_delims < HTTP_PARSER_MAX_DELIMS;
+        struct http_delim *const batch = record ? parser->delims + parser->nb_delims : overflow;
+        const size_t room = record ? HTTP_PARSER_MAX_DELIMS - parser->nb_delims : DELIM_BATCH;
+
+        const size_t count = http_scan_delims(stream + pos, bytes_received - pos, HEADER_DELIMS, batch, room);
+        for (size_t i = 0; i < count; ++i) {
+            batch[i].pos += pos;
+            if (batch[i].kind != HTTP_DELIM_CRLF) continue;
+
+            if (batch[i].pos == parser->line_end) {
+                // empty line: end of the headers
+                parser->header_len = parser->line_end + delim_width(HTTP_DELIM_CRLF);
+                parser->scanned = parser->header_len;
+                if (record) parser->nb_delims += i + 1;
+                return 1;
+            }
+            parser->line_end = batch[i].pos + delim_width(HTTP_DELIM_CRLF);
+        }
+        if (record) parser->nb_delims += count;
 
-    struct http_string http_version;
-    current = get_next_token(current, HTTP_LINE_DELIM, &http_version);
+        if (count < room) {
+            pos = bytes_received;
+        } else {
+            pos = batch[count - 1].pos + delim_width(batch[count - 1].kind);
+        }
+    }
 
+    // the last byte received may be the first one of a delimiter split across two reads
+    if (pos > 0 && (stream[pos - 1] == '\r' || stream[pos - 1] == ':')) {
+        --pos;
+    }
+    parser->scanned = pos;
+    return 0;
+}
 
+/**
+ * @brief: Parse the request line and headers of the complete header block of stream into out,
+ *         using the delimiters recorded in parser, and writes the body length to content_len.
+ *         Returns ERR_INVALID_ARGUMENT if the Content-Length overflows or has too many digits.
+ */
+static int parse_header_block(const struct http_parser *parser, const char *stream, struct http_message *out,
+                              size_t *content_len)
+{
+    // delimiters not recorded (if there were too many) are scanned again after the last recorded one
+    size_t resume = parser->header_len;
+    if (parser->nb_delims == HTTP_PARSER_MAX_DELIMS) {
+        const struct http_delim *last = &parser->delims[parser->nb_delims - 1];
+        resume = last->pos + delim_width(last->kind);
+    }
+    struct delim_cursor cursor;
+    delim_cursor_preload(&cursor, stream, parser->header_len, HEADER_DELIMS,
+                         parser->delims, parser->nb_delims, resume);
+
+    // request line
+    struct http_delim delim;
+    size_t line_end = parser->header_len;
+    while (delim_cursor_next(&cursor, &delim)) {
+        if (delim.kind == HTTP_DELIM_CRLF) {
+            line_end = delim.pos;
+            break;
+        }
+    }
+    const char *const end = stream + line_end;
+    const char *current = stream;
+    current = get_next_token_n(current, (size_t) (end - current), HTTP_SCAN(HTTP_DELIM_SP), &out->method);
+    current = get_next_token_n(current, (size_t) (end - current), HTTP_SCAN(HTTP_DELIM_SP), &out->uri);
+    get_next_token_n(current, (size_t) (end - current), HTTP_SCAN(HTTP_DELIM_SP), &out->version);
 
     // Parse headers
-    http_parse_headers(current, out);
-
-    if (out->num_headers == 0) {
-        return 0;  // no headers parsed
-    }
+    parse_header_lines(stream, line_end + delim_width(HTTP_DELIM_CRLF), &cursor, out);
 
-    // extract content length from headers
+    // extract content length from headers (value is not null-terminated)
     *content_len = 0;
     for (size_t i = 0; i < out->num_headers; i++) {
-        if (strncmp(out->headers[i].key.val, "Content-Length", out->headers[i].key.len) == 0) {
-            *content_len = atoi(out->headers[i].value.val);
+        if (http_match_verb(&out->headers[i].key, "Content-Length")) {
+            const struct http_string *value = &out->headers[i].value;
+            const size_t digits = parse_size(value->val, value->len, content_len);
+            size_t zeros = 0; // leading ones do not count
+            while (zeros < digits && value->val[zeros] == '0') ++zeros;
+            // no digit parsed from a value starting with one: it overflows
+            if ((digits == 0 && value->len > 0 && value->val[0] >= '0' && value->val[0] <= '9') ||
+                digits - zeros > MAX_CONTENT_LENGTH_DIGITS) {
+                *content_len = 0;
+                return ERR_INVALID_ARGUMENT;
+            }
             break;
         }
     }
+    // the length of the whole message must be one too
+    if (*content_len > SIZE_MAX - parser->header_len) {
+        *content_len = 0;
+        return ERR_INVALID_ARGUMENT;
+    }
+    return ERR_NONE;
+}
+
+void http_parser_init(struct http_parser *parser)
+{
+    if (parser == NULL) return;
+
+    parser->scanned = 0;
+    parser->header_len = 0;
+    parser->content_len = 0;
+    parser->base = NULL;
+    parser->line_end = (size_t) -1;
+    parser->nb_delims = 0;
+}
+
+size_t http_parser_message_len(const struct http_parser *parser)
+{
+    if (parser == NULL || parser->header_len == 0) return 0;
+
+    return parser->header_len + parser->content_len;
+}
+
+/**
+ * @see {http_prot.h#http_parse_incremental}
+ */
+int http_parse_incremental(struct http_parser *parser, const char *stream, size_t bytes_received,
+                           struct http_message *out)
+{
+    //Argument validity check
+    M_REQUIRE_NON_NULL(parser);
+    M_REQUIRE_NON_NULL(stream);
+    M_REQUIRE_NON_NULL(out);
 
-    size_t header_length = header_end + strlen(HTTP_HDR_END_DELIM) - stream;
-    size_t total_length = header_length + *content_len;
-    if (*content_len > 0 && bytes_received < total_length) {
-        return 0; // Message is incomplete (body not fully received)
+    if (bytes_received < parser->scanned) {
+        return ERR_INVALID_ARGUMENT;
     }
 
-    // Dandling body (if any)
-    if (*content_len > 0) {
-        if (bytes_received < total_length) {
-            out->body.val = NULL;
-            out->body.len = 0;  //incomplete body
-            return 0;
-        } else {
-            out->body.val = header_end + strlen(HTTP_HDR_END_DELIM);
-            out->body.len = *content_len;
+    if (parser->header_len == 0) {
+        // Only the new bytes are scanned
+        if (!scan_header_delims(parser, stream, bytes_received)) {
+            return 0;  // headers incomplete
         }
+        const int ret = parse_header_block(parser, stream, out, &parser->content_len);
+        parser->base = stream;
+        if (ret != ERR_NONE) return ret;
     }
-    return 1;  // msg fully received and parsed w/o a body
+
+    if (bytes_received < parser->header_len + parser->content_len) {
+        out->body.val = NULL;
+        out->body.len = 0;  //incomplete body
+        return 0;
+    }
+
+    // Receive buffer was moved since the headers were parsed: point into the new one
+    if (parser->base != stream) {
+        size_t content_len = 0;
+        parse_header_block(parser, stream, out, &content_len);
+        parser->base = stream;
+    }
+
+    out->body.val = parser->content_len > 0 ? stream + parser->header_len : NULL;
+    out->body.len = parser->content_len;
+    return 1;  // msg fully received and parsed
+}
+
+/**
+ * @see {http_prot.h#http_parse_message}
+ */
+int http_parse_message(const char *stream, size_t bytes_received, struct http_message *out, int *content_len)
+{
+
+    //Argument validity check
+    M_REQUIRE_NON_NULL(stream);
+    M_REQUIRE_NON_NULL(out);
+    M_REQUIRE_NON_NULL(content_len);
+
+    struct http_parser parser;
+    http_parser_init(&parser);
+
+    const int ret = http_parse_incremental(&parser, stream, bytes_received, out);
+    if (ret >= 0 && parser.content_len > INT_MAX) {
+        *content_len = 0;
+        return ERR_INVALID_ARGUMENT;
+    }
+    *content_len = (int) parser.content_len;
+
+    return ret;
 }
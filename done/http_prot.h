@@ -19,10 +19,18 @@
 #define HTTP_LINE_DELIM    "\r\n"
 #define HTTP_HDR_END_DELIM HTTP_LINE_DELIM HTTP_LINE_DELIM
 #define HTTP_PROTOCOL_ID   "HTTP/1.1 "
+#define HTTP_CONTINUE      "100 Continue"
 #define HTTP_OK            "200 OK"
+#define HTTP_PARTIAL       "206 Partial Content"
+#define HTTP_NOT_MODIFIED  "304 Not Modified"
 #define HTTP_BAD_REQUEST   "400 Bad Request"
+#define HTTP_BAD_RANGE     "416 Range Not Satisfiable"
 
 #include <stddef.h>
+#include "http_scan.h"
+
+// "\r\n" and ": " an http_parser remembers; headers with more are scanned again when parsed
+#define HTTP_PARSER_MAX_DELIMS (2 * MAX_HEADERS + 2)
 
 struct http_string {
     const char *val; // Warning! This is *NOT* null-terminated (thus len field below)
@@ -37,11 +45,31 @@ struct http_header {
 struct http_message {
     struct http_string method;
     struct http_string uri;
+    struct http_string version; // of the protocol, as in the request line (e.g. "HTTP/1.1")
     struct http_header headers[MAX_HEADERS];
     size_t num_headers;
     struct http_string body;
 };
 
+/**
+ * @brief State of an incremental parse over one (growing) receive buffer.
+ *
+ * Remembers how far the end of the headers has already been searched for, the
+ * line delimiters and key-value separators found on the way (the headers are
+ * parsed from those, not scanned again), and, once the headers are complete,
+ * where the body starts and how long it is, so that successive calls never scan
+ * the same bytes twice.
+ */
+struct http_parser {
+    size_t scanned;      // bytes already searched for delimiters
+    size_t header_len;   // length of the header block, 0 while incomplete
+    size_t content_len;  // value of "Content-Length", valid once header_len > 0
+    const char *base;    // stream the headers of out were parsed from
+    size_t line_end;     // end of the last HTTP_LINE_DELIM found, a new one there ends the headers
+    size_t nb_delims;    // number of entries of delims
+    struct http_delim delims[HTTP_PARSER_MAX_DELIMS]; // offsets relative to stream, in order
+};
+
 const char *get_next_token(const char *message, const char *delimiter, struct http_string *output);
 const char *http_parse_headers(const char *header_start, struct http_message *output);
 
@@ -57,19 +85,47 @@ int http_match_uri(const struct http_message *message, const char *target_uri);
 /**
  * @brief Accepts a potentially partial TCP stream and parses an HTTP message.
  *
- * Assumes that all characters of stream that are not filled by reading are set to 0.
+ * Stateless wrapper around http_parse_incremental(): stream is parsed from scratch.
  *
  * Places the complete HTTP message in out.
  * Also writes the content of header "Content Length" to content_len upon parsing the header in the stream.
  * content_len can be used by the caller to allocate memory to receive the whole HTTP message.
  *
  * Returns:
- *  a negative int if there was an error
+ *  a negative int if there was an error, ERR_INVALID_ARGUMENT for a length above INT_MAX
  *  0 if the message has not been received completely (partial treatment)
  *  1 if the message was fully received and parsed
  */
 int http_parse_message(const char *stream, size_t bytes_received, struct http_message *out, int *content_len);
 
+/**
+ * @brief Resets parser so that it is ready for a new message.
+ */
+void http_parser_init(struct http_parser *parser);
+
+/**
+ * @brief Incremental variant of http_parse_message().
+ *
+ * stream must contain the same bytes as in the previous call on the same parser,
+ * possibly followed by new ones (it may however have been moved, e.g. by realloc()).
+ * Only the newly received bytes are searched for the end of the headers, and once
+ * the headers have been parsed, the body is only checked for completeness.
+ * stream does not need to be null-terminated past bytes_received.
+ *
+ * Returns:
+ *  a negative int if there was an error
+ *  0 if the message has not been received completely
+ *  1 if the message was fully received and parsed into out; the message then
+ *    occupies the first http_parser_message_len() bytes of stream
+ */
+int http_parse_incremental(struct http_parser *parser, const char *stream, size_t bytes_received,
+                           struct http_message *out);
+
+/**
+ * @brief Total length (headers and body) of the message being parsed, or 0 if its headers are incomplete.
+ */
+size_t http_parser_message_len(const struct http_parser *parser);
+
 /**
  * @brief Writes the value of parameter `name` from URL in message to buffer out.
  *
@@ -78,6 +134,67 @@ int http_parse_message(const char *stream, size_t bytes_received, struct http_me
  */
 int http_get_var(const struct http_string* url, const char* name, char* out, size_t out_len);
 
+/**
+ * @brief Returns the value of the first header of message named key (case-insensitive), NULL if there is none.
+ */
+const struct http_string *http_get_header(const struct http_message *message, const char *key);
+
+/**
+ * @brief Returns 1 if the connection is to be closed after the response to message, 0 if it may be
+ * kept alive for further requests: closed if the client asked for it (with "Connection: close"), or
+ * if it speaks HTTP/1.0 and did not ask otherwise (with "Connection: keep-alive").
+ */
+int http_wants_close(const struct http_message *message);
+
+/**
+ * @brief Returns 1 if the client waits (with "Expect: 100-continue") for an interim response
+ * before sending the body of message, 0 otherwise.
+ */
+int http_expects_continue(const struct http_message *message);
+
+/**
+ * @brief Returns 1 if etag (with its quotes) is one of the entity tags listed in condition, the value
+ * of an "If-None-Match" header (weak comparison, as for such headers; "*" matches any tag), 0 otherwise.
+ */
+int http_etag_matches(const struct http_string *condition, const char *etag);
+
+/**
+ * @brief Returns 1 if the "Accept" header of message lists media_type itself (case-insensitive; wildcard
+ * ranges do not count) without refusing it with "q=0", 0 otherwise.
+ */
+int http_accepts(const struct http_message *message, const char *media_type);
+
+/**
+ * @brief Writes to boundary the boundary of the parts of the body of message, if it is "multipart/..."
+ * (the "boundary" parameter of its "Content-Type" header). Returns 1 if it is, 0 otherwise.
+ */
+int http_multipart_boundary(const struct http_message *message, struct http_string *boundary);
+
+/**
+ * @brief Reads the next part of a "multipart/form-data" body whose parts are separated by boundary.
+ *
+ * @param body What is left of the body; moved past the part read.
+ * @param name Where to write the name of the part: its "filename", or else its "name" (from its
+ *             "Content-Disposition" header), empty if it has none.
+ * @param content Where to write the content of the part.
+ * @return 1 if a part was read, 0 once the body is over, ERR_INVALID_ARGUMENT if it is malformed.
+ */
+int http_multipart_next(const struct http_string *boundary, struct http_string *body,
+                        struct http_string *name, struct http_string *content);
+
+/**
+ * @brief Reads range, the value of a "Range" header, for a content of size bytes.
+ *
+ * Only single byte ranges ("bytes=first-last", "bytes=first-" and "bytes=-suffix_length") are
+ * supported; anything else is ignored, as the whole content may always be sent instead.
+ *
+ * Returns:
+ *  1 if the range is satisfiable, with its first and last (included) bytes in first and last
+ *  0 if range is NULL or is to be ignored
+ *  ERR_INVALID_ARGUMENT if the range starts past the content (to be answered with HTTP_BAD_RANGE)
+ */
+int http_parse_range(const struct http_string *range, size_t size, size_t *first, size_t *last);
+
 /**
  * @brief Compare method with verb and return 1 if they are equal, 0 otherwise
  */
@@ -0,0 +1,261 @@
+/**
+ * @file http_scan.c
+ * @brief Delimiter scanning kernel for the HTTP parser (see http_scan.h).
+ *
+ * The SIMD versions compare blocks of 16 (SSE2) or 32 (AVX2) bytes against the
+ * first character of every selected delimiter at once; candidates are then
+ * confirmed one by one (second character of "\r\n" and ": ").
+ */
+
+#include "http_scan.h"
+#include "error.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h> // memcpy
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCAN_X86
+#endif
+
+typedef size_t (*scan_fn)(const char *buf, size_t len, unsigned mask,
+                          struct http_delim *delims, size_t max_delims);
+
+// First character of each delimiter, indexed by enum http_delim_kind
+static const char delim_first[NB_HTTP_DELIMS] = { '\r', ':', ' ', '?', '&', '=' };
+
+/**********************************************************************
+ * Checks whether a delimiter of mask starts at buf[i]; returns its length (0 if none).
+ */
+static size_t delim_at(const char *buf, size_t len, size_t i, unsigned mask, enum http_delim_kind *kind)
+{
+    switch (buf[i]) {
+    case '\r':
+        *kind = HTTP_DELIM_CRLF;
+        return (mask & HTTP_SCAN(HTTP_DELIM_CRLF)) && i + 1 < len && buf[i + 1] == '\n' ? 2 : 0;
+    case ':':
+        *kind = HTTP_DELIM_KV;
+        return (mask & HTTP_SCAN(HTTP_DELIM_KV)) && i + 1 < len && buf[i + 1] == ' ' ? 2 : 0;
+    case ' ':
+        *kind = HTTP_DELIM_SP;
+        break;
+    case '?':
+        *kind = HTTP_DELIM_QUERY;
+        break;
+    case '&':
+        *kind = HTTP_DELIM_AMP;
+        break;
+    case '=':
+        *kind = HTTP_DELIM_EQ;
+        break;
+    default:
+        return 0;
+    }
+    return (mask & HTTP_SCAN(*kind)) ? 1 : 0;
+}
+
+/**********************************************************************
+ * Byte per byte scanning.
+ */
+static size_t scan_scalar(const char *buf, size_t len, unsigned mask,
+                          struct http_delim *delims, size_t max_delims)
+{
+    // First characters of the selected delimiters, as a bitmap
+    uint64_t first_chars[4] = { 0 };
+    for (int k = 0; k < NB_HTTP_DELIMS; ++k) {
+        if (mask & HTTP_SCAN(k)) {
+            const unsigned char c = (unsigned char) delim_first[k];
+            first_chars[c >> 6] |= UINT64_C(1) << (c & 63);
+        }
+    }
+
+    size_t n = 0;
+    size_t i = 0;
+    while (i < len && n < max_delims) {
+        const unsigned char c = (unsigned char) buf[i];
+        enum http_delim_kind kind;
+        size_t width;
+        if ((first_chars[c >> 6] >> (c & 63)) & 1 && (width = delim_at(buf, len, i, mask, &kind)) > 0) {
+            delims[n].pos = i;
+            delims[n].kind = kind;
+            ++n;
+            i += width;
+        } else {
+            ++i;
+        }
+    }
+    return n;
+}
+
+/**********************************************************************
+ * Confirms the candidates of a block (bit b set for buf[base + b]); returns the updated count.
+ * *next is the first offset not covered by an already recorded delimiter.
+ */
+static size_t confirm_candidates(const char *buf, size_t len, size_t base, uint32_t bits, unsigned mask,
+                                 struct http_delim *delims, size_t n, size_t max_delims, size_t *next)
+{
+    while (bits != 0 && n < max_delims) {
+        const size_t i = base + (size_t) __builtin_ctz(bits);
+        bits &= bits - 1;
+
+        enum http_delim_kind kind;
+        size_t width;
+        if (i >= *next && (width = delim_at(buf, len, i, mask, &kind)) > 0) {
+            delims[n].pos = i;
+            delims[n].kind = kind;
+            ++n;
+            *next = i + width;
+        }
+    }
+    return n;
+}
+
+#ifdef HTTP_SCAN_X86
+
+__attribute__((target("sse2")))
+static size_t scan_sse2(const char *buf, size_t len, unsigned mask,
+                        struct http_delim *delims, size_t max_delims)
+{
+    __m128i targets[NB_HTTP_DELIMS];
+    int nb_targets = 0;
+    for (int k = 0; k < NB_HTTP_DELIMS; ++k) {
+        if (mask & HTTP_SCAN(k)) targets[nb_targets++] = _mm_set1_epi8(delim_first[k]);
+    }
+
+    size_t n = 0;
+    size_t next = 0;
+    for (size_t i = 0; i < len && n < max_delims; i += 16) {
+        __m128i block;
+        if (i + 16 <= len) {
+            block = _mm_loadu_si128((const __m128i *) (const void *) (buf + i));
+        } else {
+            // last partial block: padded with zeros, which match no delimiter
+            char tail[16] = { 0 };
+            memcpy(tail, buf + i, len - i);
+            block = _mm_loadu_si128((const __m128i *) (const void *) tail);
+        }
+        __m128i hits = _mm_setzero_si128();
+        for (int t = 0; t < nb_targets; ++t) {
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, targets[t]));
+        }
+        const uint32_t bits = (uint32_t) _mm_movemask_epi8(hits);
+        if (bits != 0) {
+            n = confirm_candidates(buf, len, i, bits, mask, delims, n, max_delims, &next);
+        }
+    }
+    return n;
+}
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(const char *buf, size_t len, unsigned mask,
+                        struct http_delim *delims, size_t max_delims)
+{
+    __m256i targets[NB_HTTP_DELIMS];
+    int nb_targets = 0;
+    for (int k = 0; k < NB_HTTP_DELIMS; ++k) {
+        if (mask & HTTP_SCAN(k)) targets[nb_targets++] = _mm256_set1_epi8(delim_first[k]);
+    }
+
+    size_t n = 0;
+    size_t next = 0;
+    for (size_t i = 0; i < len && n < max_delims; i += 32) {
+        __m256i block;
+        if (i + 32 <= len) {
+            block = _mm256_loadu_si256((const __m256i *) (const void *) (buf + i));
+        } else {
+            // last partial block: padded with zeros, which match no delimiter
+            char tail[32] = { 0 };
+            memcpy(tail, buf + i, len - i);
+            block = _mm256_loadu_si256((const __m256i *) (const void *) tail);
+        }
+        __m256i hits = _mm256_setzero_si256();
+        for (int t = 0; t < nb_targets; ++t) {
+            hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, targets[t]));
+        }
+        const uint32_t bits = (uint32_t) _mm256_movemask_epi8(hits);
+        if (bits != 0) {
+            n = confirm_candidates(buf, len, i, bits, mask, delims, n, max_delims, &next);
+        }
+    }
+    return n;
+}
+
+#endif // HTTP_SCAN_X86
+
+static scan_fn scan_impl = scan_scalar;
+static const char *scan_impl_name = "scalar";
+static pthread_once_t scan_once = PTHREAD_ONCE_INIT;
+
+/**********************************************************************
+ * Runtime dispatch: best implementation supported by the CPU.
+ */
+static void scan_autoselect(void)
+{
+#ifdef HTTP_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        scan_impl = scan_avx2;
+        scan_impl_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        scan_impl = scan_sse2;
+        scan_impl_name = "sse2";
+    }
+#endif
+}
+
+int http_scan_select(enum http_scan_isa isa)
+{
+    pthread_once(&scan_once, scan_autoselect);
+
+    switch (isa) {
+    case HTTP_SCAN_AUTO:
+        scan_impl = scan_scalar;
+        scan_impl_name = "scalar";
+        scan_autoselect();
+        return ERR_NONE;
+    case HTTP_SCAN_SCALAR:
+        scan_impl = scan_scalar;
+        scan_impl_name = "scalar";
+        return ERR_NONE;
+#ifdef HTTP_SCAN_X86
+    case HTTP_SCAN_SSE2:
+        if (!__builtin_cpu_supports("sse2")) break;
+        scan_impl = scan_sse2;
+        scan_impl_name = "sse2";
+        return ERR_NONE;
+    case HTTP_SCAN_AVX2:
+        if (!__builtin_cpu_supports("avx2")) break;
+        scan_impl = scan_avx2;
+        scan_impl_name = "avx2";
+        return ERR_NONE;
+#endif
+    default:
+        break;
+    }
+    return ERR_INVALID_ARGUMENT;
+}
+
+const char *http_scan_isa_name(void)
+{
+    pthread_once(&scan_once, scan_autoselect);
+    return scan_impl_name;
+}
+
+size_t http_scan_delims(const char *buf, size_t len, unsigned mask,
+                        struct http_delim *delims, size_t max_delims)
+{
+    if (buf == NULL || delims == NULL || max_delims == 0) return 0;
+
+    pthread_once(&scan_once, scan_autoselect);
+    return scan_impl(buf, len, mask, delims, max_delims);
+}
+
+size_t http_scan_next(const char *buf, size_t len, unsigned mask, enum http_delim_kind *kind)
+{
+    struct http_delim delim;
+    if (http_scan_delims(buf, len, mask, &delim, 1) == 0) return len;
+
+    if (kind != NULL) *kind = delim.kind;
+    return delim.pos;
+}
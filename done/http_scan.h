@@ -0,0 +1,69 @@
+/**
+ * @file http_scan.h
+ * @brief Delimiter scanning kernel for the HTTP parser.
+ *
+ * Finds, in a single pass over a length-bounded buffer (no null terminator
+ * needed), the positions of the delimiters used by the HTTP parser. SSE2 and
+ * AVX2 implementations are selected at runtime, with a scalar fallback.
+ */
+
+#pragma once
+
+#include <stddef.h> // size_t
+
+enum http_delim_kind {
+    HTTP_DELIM_CRLF,  // "\r\n"  (HTTP_LINE_DELIM)
+    HTTP_DELIM_KV,    // ": "    (HTTP_HDR_KV_DELIM)
+    HTTP_DELIM_SP,    // " "     (request line)
+    HTTP_DELIM_QUERY, // "?"
+    HTTP_DELIM_AMP,   // "&"
+    HTTP_DELIM_EQ,    // "="
+    NB_HTTP_DELIMS
+};
+
+#define HTTP_SCAN(kind) (1u << (kind))
+
+struct http_delim {
+    size_t pos;                // offset of the first character of the delimiter
+    enum http_delim_kind kind;
+};
+
+/**
+ * @brief Implementations of the kernel; HTTP_SCAN_AUTO picks the best one for this CPU.
+ */
+enum http_scan_isa {
+    HTTP_SCAN_AUTO,
+    HTTP_SCAN_SCALAR,
+    HTTP_SCAN_SSE2,
+    HTTP_SCAN_AVX2
+};
+
+/**
+ * @brief Records, in increasing order, the delimiters selected by mask (a bitwise or of HTTP_SCAN(kind))
+ * found in the first len characters of buf. Delimiters never overlap: the space of ": " is not
+ * reported as HTTP_DELIM_SP.
+ *
+ * Returns the number of delimiters written to delims. Scanning stops once max_delims are found;
+ * it can be resumed after the end of the last one.
+ */
+size_t http_scan_delims(const char *buf, size_t len, unsigned mask,
+                        struct http_delim *delims, size_t max_delims);
+
+/**
+ * @brief Offset of the first delimiter selected by mask in the first len characters of buf, or len if none.
+ *
+ * If kind is not NULL, the kind of the delimiter found is written to it.
+ */
+size_t http_scan_next(const char *buf, size_t len, unsigned mask, enum http_delim_kind *kind);
+
+/**
+ * @brief Forces the implementation used by the kernel (for tests and benchmarks).
+ *
+ * Returns ERR_INVALID_ARGUMENT if isa is not supported by this CPU.
+ */
+int http_scan_select(enum http_scan_isa isa);
+
+/**
+ * @brief Name of the implementation currently in use.
+ */
+const char *http_scan_isa_name(void);
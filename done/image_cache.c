@@ -0,0 +1,231 @@
+#include "image_cache.h"
+#include "error.h"
+#include <stdlib.h> // for calloc, free
+#include <string.h> // for memset
+
+/**
+ * @brief All the contents of a metadata entry are in the same shard (see image_cache_invalidate())
+ */
+static struct image_cache_shard *shard_of(struct image_cache *cache, uint32_t index)
+{
+    return &cache->shards[index % IMAGE_CACHE_SHARDS];
+}
+
+static size_t bucket_of(const struct image_cache_key *key)
+{
+    const uint64_t h = (key->index / IMAGE_CACHE_SHARDS) * 0x9E3779B97F4A7C15ULL ^
+                       (key->offset + (uint64_t) key->resolution) * 0xC2B2AE3D27D4EB4FULL;
+    return (size_t) (h >> 32) % IMAGE_CACHE_BUCKETS;
+}
+
+static int same_key(const struct image_cache_key *a, const struct image_cache_key *b)
+{
+    return a->index == b->index && a->resolution == b->resolution && a->offset == b->offset;
+}
+
+static void free_entry(struct image_cache_entry *entry)
+{
+    free(entry->data);
+    free(entry);
+}
+
+/**
+ * @brief Moves entry to the front of the LRU list of shard (adds it if it is not there yet)
+ */
+static void lru_push_front(struct image_cache_shard *shard, struct image_cache_entry *entry)
+{
+    entry->prev = NULL;
+    entry->next = shard->head;
+    if (shard->head != NULL) shard->head->prev = entry;
+    shard->head = entry;
+    if (shard->tail == NULL) shard->tail = entry;
+}
+
+static void lru_remove(struct image_cache_shard *shard, struct image_cache_entry *entry)
+{
+    if (entry->prev != NULL) entry->prev->next = entry->next;
+    else shard->head = entry->next;
+    if (entry->next != NULL) entry->next->prev = entry->prev;
+    else shard->tail = entry->prev;
+    entry->prev = entry->next = NULL;
+}
+
+/**
+ * @brief Takes entry out of shard; it is freed now if unused, by its last user otherwise
+ */
+static void unlink_entry(struct image_cache_shard *shard, struct image_cache_entry *entry)
+{
+    struct image_cache_entry **link = &shard->buckets[bucket_of(&entry->key)];
+    while (*link != entry) link = &(*link)->bucket_next;
+    *link = entry->bucket_next;
+    lru_remove(shard, entry);
+
+    entry->linked = 0;
+    shard->stats.entries--;
+    shard->stats.bytes -= entry->size;
+    if (entry->refcount == 0) free_entry(entry);
+}
+
+/**
+ * @brief Evicts least recently used (and unused) contents until shard fits in its budget
+ */
+static void evict(struct image_cache_shard *shard)
+{
+    struct image_cache_entry *entry = shard->tail;
+    while (shard->stats.bytes > shard->budget && entry != NULL) {
+        struct image_cache_entry *const prev = entry->prev;
+        if (entry->refcount == 0) {
+            unlink_entry(shard, entry);
+            shard->stats.evictions++;
+        }
+        entry = prev;
+    }
+}
+
+int image_cache_init(struct image_cache *cache, size_t budget)
+{
+    M_REQUIRE_NON_NULL(cache);
+
+    memset(cache, 0, sizeof(*cache));
+    for (size_t i = 0; i < IMAGE_CACHE_SHARDS; ++i) {
+        if (pthread_mutex_init(&cache->shards[i].lock, NULL) != 0) {
+            while (i-- > 0) pthread_mutex_destroy(&cache->shards[i].lock);
+            return ERR_THREADING;
+        }
+        cache->shards[i].budget = budget / IMAGE_CACHE_SHARDS;
+    }
+    return ERR_NONE;
+}
+
+void image_cache_free(struct image_cache *cache)
+{
+    if (cache == NULL) return;
+
+    for (size_t i = 0; i < IMAGE_CACHE_SHARDS; ++i) {
+        struct image_cache_shard *shard = &cache->shards[i];
+        while (shard->head != NULL) {
+            unlink_entry(shard, shard->head);
+        }
+        pthread_mutex_destroy(&shard->lock);
+    }
+}
+
+const struct image_cache_entry *image_cache_get(struct image_cache *cache, const struct image_cache_key *key)
+{
+    if (cache == NULL || key == NULL) return NULL;
+
+    struct image_cache_shard *shard = shard_of(cache, key->index);
+    pthread_mutex_lock(&shard->lock);
+
+    struct image_cache_entry *entry = shard->buckets[bucket_of(key)];
+    while (entry != NULL && !same_key(&entry->key, key)) {
+        entry = entry->bucket_next;
+    }
+
+    if (entry != NULL) {
+        entry->refcount++;
+        lru_remove(shard, entry);
+        lru_push_front(shard, entry);
+        shard->stats.hits++;
+    } else {
+        shard->stats.misses++;
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+    return entry;
+}
+
+const struct image_cache_entry *image_cache_put(struct image_cache *cache, const struct image_cache_key *key,
+                                                char *data, uint32_t size)
+{
+    if (cache == NULL || key == NULL || data == NULL) return NULL;
+
+    struct image_cache_entry *entry = calloc(1, sizeof(*entry));
+    if (entry == NULL) return NULL;
+
+    entry->key = *key;
+    entry->data = data;
+    entry->size = size;
+    entry->refcount = 1;
+
+    struct image_cache_shard *shard = shard_of(cache, key->index);
+    if (size > shard->budget) {
+        return entry; // too big to be kept, only lives until released
+    }
+
+    pthread_mutex_lock(&shard->lock);
+
+    // The same content may have been added in the meantime by another reader
+    struct image_cache_entry **bucket = &shard->buckets[bucket_of(key)];
+    for (struct image_cache_entry *other = *bucket; other != NULL; other = other->bucket_next) {
+        if (same_key(&other->key, key)) {
+            unlink_entry(shard, other);
+            break;
+        }
+    }
+
+    entry->linked = 1;
+    entry->bucket_next = *bucket;
+    *bucket = entry;
+    lru_push_front(shard, entry);
+    shard->stats.entries++;
+    shard->stats.bytes += size;
+    evict(shard);
+
+    pthread_mutex_unlock(&shard->lock);
+    return entry;
+}
+
+void image_cache_release(struct image_cache *cache, const struct image_cache_entry *entry)
+{
+    if (cache == NULL || entry == NULL) return;
+
+    struct image_cache_shard *shard = shard_of(cache, entry->key.index);
+    pthread_mutex_lock(&shard->lock);
+
+    // entries are only given const to users, so that they do not modify them
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-qual"
+    struct image_cache_entry *const owned = (struct image_cache_entry *) entry;
+#pragma GCC diagnostic pop
+    const int unused = --owned->refcount == 0 && !owned->linked;
+
+    pthread_mutex_unlock(&shard->lock);
+    if (unused) free_entry(owned);
+}
+
+void image_cache_invalidate(struct image_cache *cache, uint32_t index)
+{
+    if (cache == NULL) return;
+
+    struct image_cache_shard *shard = shard_of(cache, index);
+    pthread_mutex_lock(&shard->lock);
+
+    struct image_cache_entry *entry = shard->head;
+    while (entry != NULL) {
+        struct image_cache_entry *const next = entry->next;
+        if (entry->key.index == index) {
+            unlink_entry(shard, entry);
+        }
+        entry = next;
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+}
+
+void image_cache_stats(struct image_cache *cache, struct image_cache_stats *stats)
+{
+    if (cache == NULL || stats == NULL) return;
+
+    memset(stats, 0, sizeof(*stats));
+    for (size_t i = 0; i < IMAGE_CACHE_SHARDS; ++i) {
+        struct image_cache_shard *shard = &cache->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        stats->hits += shard->stats.hits;
+        stats->misses += shard->stats.misses;
+        stats->evictions += shard->stats.evictions;
+        stats->entries += shard->stats.entries;
+        stats->bytes += shard->stats.bytes;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
@@ -0,0 +1,100 @@
+/**
+ * @file image_cache.h
+ * @brief In-memory cache of image contents read from an imgFS, for the server.
+ *
+ * Contents are keyed by the metadata entry they belong to, the resolution and
+ * the offset of the content in the imgFS file (which changes whenever the entry
+ * gets another content), and evicted in least-recently-used order once the
+ * cache holds more than its byte budget. The cache is split into shards, each
+ * with its own lock, so that concurrent lookups rarely wait for each other.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t, uint64_t
+
+#define IMAGE_CACHE_SHARDS  16
+#define IMAGE_CACHE_BUCKETS 64 // per shard
+
+struct image_cache_key {
+    uint32_t index;   // of the metadata entry
+    int resolution;
+    uint64_t offset;  // of the content, as in the metadata entry
+};
+
+struct image_cache_entry {
+    struct image_cache_key key;
+    char *data;
+    uint32_t size;
+    unsigned int refcount;   // users of the entry (see image_cache_release())
+    int linked;              // whether the entry is in its shard (it may be released only)
+    struct image_cache_entry *prev, *next; // LRU list of the shard, most recently used first
+    struct image_cache_entry *bucket_next; // hash bucket of the shard
+};
+
+struct image_cache_stats {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t entries;
+    size_t bytes;
+};
+
+struct image_cache_shard {
+    pthread_mutex_t lock;
+    struct image_cache_entry *buckets[IMAGE_CACHE_BUCKETS];
+    struct image_cache_entry *head, *tail;
+    size_t budget;
+    struct image_cache_stats stats;
+};
+
+struct image_cache {
+    struct image_cache_shard shards[IMAGE_CACHE_SHARDS];
+};
+
+/**
+ * @brief Initializes an empty cache holding at most budget bytes of content.
+ *
+ * @return Some error code. 0 if no error.
+ */
+int image_cache_init(struct image_cache *cache, size_t budget);
+
+/**
+ * @brief Frees all the contents of the cache. No entry may still be in use.
+ */
+void image_cache_free(struct image_cache *cache);
+
+/**
+ * @brief Looks key up. On a hit, the entry is marked as most recently used and must be given
+ * back with image_cache_release() once its content is not needed anymore.
+ *
+ * @return The entry, or NULL if the content is not in the cache.
+ */
+const struct image_cache_entry *image_cache_get(struct image_cache *cache, const struct image_cache_key *key);
+
+/**
+ * @brief Adds the content (allocated with malloc()) of key to the cache, which takes ownership of it,
+ * evicting least recently used contents if needed. Contents bigger than a shard are not kept once released.
+ *
+ * @return The entry, to be given back with image_cache_release(), or NULL (if out of memory;
+ *         data is then still owned by the caller).
+ */
+const struct image_cache_entry *image_cache_put(struct image_cache *cache, const struct image_cache_key *key,
+                                                char *data, uint32_t size);
+
+/**
+ * @brief Gives back an entry obtained from image_cache_get() or image_cache_put().
+ */
+void image_cache_release(struct image_cache *cache, const struct image_cache_entry *entry);
+
+/**
+ * @brief Removes all the contents of the metadata entry index from the cache (e.g. once it is deleted).
+ */
+void image_cache_invalidate(struct image_cache *cache, uint32_t index);
+
+/**
+ * @brief Sums the counters of all shards into stats.
+ */
+void image_cache_stats(struct image_cache *cache, struct image_cache_stats *stats);
@@ -2,15 +2,67 @@
 #include <string.h> // for strncpy
 #include <stdlib.h> // for calloc
 #include "image_content.h"
+#include "imgfs_durability.h" // for imgfs_sync()
+#include "blurhash.h" // for blurhash_encode()
 #include <vips/vips.h>
 
+_Static_assert(BLURHASH_LENGTH <= MAX_PLACEHOLDER, "a BlurHash must fit in the placeholder of an image");
+
+#define PLACEHOLDER_WIDTH 32 // pixels across of the image a placeholder is computed from
+
+/**
+ * @brief Computes the placeholder (see blurhash.h) of image, whatever its interpretation and format.
+ */
+static int placeholder_of(VipsImage *image, char *placeholder)
+{
+    VipsImage *srgb = NULL;
+    if (vips_colourspace(image, &srgb, VIPS_INTERPRETATION_sRGB, NULL) != 0) return ERR_IMGLIB;
+    VipsImage *bytes = NULL;
+    if (vips_cast_uchar(srgb, &bytes, NULL) != 0) {
+        g_object_unref(srgb);
+        return ERR_IMGLIB;
+    }
+
+    const uint32_t width = (uint32_t) vips_image_get_width(bytes);
+    const uint32_t height = (uint32_t) vips_image_get_height(bytes);
+    const uint32_t bands = (uint32_t) vips_image_get_bands(bytes);
+    size_t size = 0;
+    unsigned char *const pixels = vips_image_write_to_memory(bytes, &size);
+    const int ret = pixels == NULL || size < (size_t) width * height * bands ? ERR_IMGLIB :
+                    blurhash_encode(pixels, width, height, bands, placeholder);
+
+    g_free(pixels);
+    g_object_unref(bytes);
+    g_object_unref(srgb);
+    return ret;
+}
+
+int image_placeholder(const char *image_buffer, size_t image_size, char *placeholder)
+{
+    M_REQUIRE_NON_NULL(image_buffer);
+    M_REQUIRE_NON_NULL(placeholder);
+
+    // decoded at a fraction of its size: only its broad colours matter
+    VipsImage *image = NULL;
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-qual"
+    if (vips_thumbnail_buffer((void *) image_buffer, image_size, &image, PLACEHOLDER_WIDTH, NULL) != 0) {
+        return ERR_IMGLIB;
+    }
+#pragma GCC diagnostic pop
+
+    const int ret = placeholder_of(image, placeholder);
+    g_object_unref(image);
+    return ret;
+}
+
 int lazily_resize(int resolution, struct imgfs_file* imgfs_file, size_t index)
 {
     //File validity check
     M_REQUIRE_NON_NULL(imgfs_file);
 
     //Resolution validity check
-    if (resolution != THUMB_RES && resolution != SMALL_RES && resolution != ORIG_RES) {
+    if (resolution < 0 || resolution >= imgfs_nb_resolutions(imgfs_file)) {
         return ERR_INVALID_ARGUMENT; // Return appropriate error value
     }
 
@@ -20,7 +72,11 @@ int lazily_resize(int resolution, struct imgfs_file* imgfs_file, size_t index)
     }
 
     //Image already in the wanted resolution, no need to resize
-    if (imgfs_file->metadata[index].offset[resolution] != 0) {
+    uint64_t variant_offset = 0;
+    uint32_t variant_size = 0;
+    int ret = imgfs_variant(imgfs_file, index, resolution, &variant_offset, &variant_size);
+    if (ret != ERR_NONE) return ret;
+    if (variant_offset != 0) {
         return ERR_NONE;
     }
 
@@ -37,10 +93,14 @@ int lazily_resize(int resolution, struct imgfs_file* imgfs_file, size_t index)
         // Use small image width and height from imgfs_header
         target_width = imgfs_file->header.resized_res[2]; // Small image width
         target_height = imgfs_file->header.resized_res[3]; // Small image height
-    } else {
+    } else if (resolution == ORIG_RES) {
         // Keep original width and height for original resolution
         target_width = imgfs_file->metadata->orig_res[0];
         target_height = imgfs_file->metadata->orig_res[1];
+    } else {
+        // One of the resolutions of the extension file
+        target_width = imgfs_file->ext->resolutions[resolution - NB_RES].width;
+        target_height = imgfs_file->ext->resolutions[resolution - NB_RES].height;
     }
 
     // Reading the original resolution and size
@@ -116,22 +176,39 @@ int lazily_resize(int resolution, struct imgfs_file* imgfs_file, size_t index)
     // Updating metadata for the new image
     long end_offset = ftell(imgfs_file->file);
 
-    imgfs_file->metadata[index].offset[resolution] = (uint64_t) ((uint64_t) end_offset - buffer_size);
-    imgfs_file->metadata[index].size[resolution] = (uint32_t) buffer_size;
     imgfs_file->metadata[index].is_valid = 1; // Mark the image as valid
 
-    // Writing metadata changes to disk
-    long metadata_offset = (long)(sizeof(struct imgfs_header) + index * sizeof(struct img_metadata));
-    fseek(imgfs_file->file, metadata_offset, SEEK_SET);
-    if (fwrite(&imgfs_file->metadata[index], sizeof(struct img_metadata), 1, imgfs_file->file) !=1) {
+    // The resized content must be on disk before the entry referring to it
+    ret = imgfs_sync_contents(imgfs_file);
+    if (ret != ERR_NONE) {
         g_object_unref(orig_image);
         g_object_unref(resized_image);
         free(img_data);
         img_data = NULL;
         g_free(buffer);
-        return ERR_IO;
+        return ret;
     }
 
+    // Writing metadata changes to disk (or to the extension file)
+    ret = imgfs_set_variant(imgfs_file, index, resolution,
+                            (uint64_t) ((uint64_t) end_offset - buffer_size), (uint32_t) buffer_size);
+    if (ret != ERR_NONE) {
+        g_object_unref(orig_image);
+        g_object_unref(resized_image);
+        free(img_data);
+        img_data = NULL;
+        g_free(buffer);
+        return ret;
+    }
+
+
+    // The thumbnail being at hand, the placeholder is computed from it if the image has none yet
+    // (it is only a preview: the image is resized even if this fails)
+    char placeholder[MAX_PLACEHOLDER + 1];
+    if (resolution == THUMB_RES && imgfs_placeholder(imgfs_file, index) == NULL &&
+        placeholder_of(resized_image, placeholder) == ERR_NONE) {
+        (void) imgfs_set_placeholder(imgfs_file, index, placeholder);
+    }
 
     // Cleanup
     g_object_unref(orig_image);
@@ -139,13 +216,9 @@ int lazily_resize(int resolution, struct imgfs_file* imgfs_file, size_t index)
     free(img_data);
     img_data = NULL;
     g_free(buffer);
-    fflush(imgfs_file->file);
-
-
-
 
-    // Everything went well
-    return ERR_NONE;
+    // Making the variant durable, as the durability mode of the imgFS says
+    return imgfs_sync(imgfs_file);
 }
 
 //======================================================================================================================
@@ -171,3 +244,118 @@ int get_resolution(uint32_t *height, uint32_t *width,
     g_object_unref(VIPS_OBJECT(original));
     return ERR_NONE;
 }
+
+//======================================================================================================================
+
+enum jpeg_probe_state {
+    PROBE_SOI,          // expecting the start of image marker
+    PROBE_SOI_CODE,
+    PROBE_MARKER,       // expecting the marker of the next segment
+    PROBE_MARKER_CODE,
+    PROBE_LENGTH_HI,    // length of the segment (big-endian, includes itself)
+    PROBE_LENGTH_LO,
+    PROBE_SKIP,         // inside a segment that does not matter
+    PROBE_FRAME,        // inside the start of frame segment
+    PROBE_FOUND,
+    PROBE_FAILED
+};
+
+/**
+ * @brief Whether marker starts a frame: SOF0 to SOF15, except DHT (C4), JPG (C8) and DAC (CC)
+ */
+static int is_start_of_frame(uint8_t marker)
+{
+    return marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+}
+
+void jpeg_probe_init(struct jpeg_probe *probe)
+{
+    if (probe == NULL) return;
+
+    memset(probe, 0, sizeof(*probe));
+    probe->state = PROBE_SOI;
+}
+
+void jpeg_probe_update(struct jpeg_probe *probe, const char *chunk, size_t chunk_size)
+{
+    if (probe == NULL || chunk == NULL) return;
+
+    size_t i = 0;
+    while (i < chunk_size && probe->state != PROBE_FOUND && probe->state != PROBE_FAILED) {
+        if (probe->state == PROBE_SKIP) {
+            // skipping the rest of the segment (or of the chunk) at once
+            const size_t skip = probe->remaining < chunk_size - i ? probe->remaining : chunk_size - i;
+            probe->remaining -= (uint32_t) skip;
+            i += skip;
+            if (probe->remaining == 0) probe->state = PROBE_MARKER;
+            continue;
+        }
+
+        const uint8_t byte = (uint8_t) chunk[i++];
+        switch (probe->state) {
+        case PROBE_SOI:
+            probe->state = byte == 0xFF ? PROBE_SOI_CODE : PROBE_FAILED;
+            break;
+        case PROBE_SOI_CODE:
+            probe->state = byte == 0xD8 ? PROBE_MARKER : PROBE_FAILED;
+            break;
+        case PROBE_MARKER:
+            probe->state = byte == 0xFF ? PROBE_MARKER_CODE : PROBE_FAILED;
+            break;
+        case PROBE_MARKER_CODE:
+            if (byte == 0xFF) break; // fill byte
+            if (byte == 0x01 || (byte >= 0xD0 && byte <= 0xD7)) {
+                probe->state = PROBE_MARKER; // markers without a segment
+            } else if (byte == 0xD9 || byte == 0xDA) {
+                probe->state = PROBE_FAILED; // end of image or image data before any frame
+            } else {
+                probe->marker = byte;
+                probe->state = PROBE_LENGTH_HI;
+            }
+            break;
+        case PROBE_LENGTH_HI:
+            probe->remaining = (uint32_t) byte << 8;
+            probe->state = PROBE_LENGTH_LO;
+            break;
+        case PROBE_LENGTH_LO:
+            probe->remaining |= byte;
+            if (probe->remaining < 2) {
+                probe->state = PROBE_FAILED;
+                break;
+            }
+            probe->remaining -= 2;
+            if (is_start_of_frame(probe->marker)) {
+                probe->state = probe->remaining >= sizeof(probe->frame) ? PROBE_FRAME : PROBE_FAILED;
+            } else {
+                probe->state = probe->remaining > 0 ? PROBE_SKIP : PROBE_MARKER;
+            }
+            break;
+        case PROBE_FRAME:
+            probe->frame[probe->frame_len++] = byte;
+            if (probe->frame_len == sizeof(probe->frame)) {
+                probe->height = (uint32_t) probe->frame[1] << 8 | probe->frame[2];
+                probe->width  = (uint32_t) probe->frame[3] << 8 | probe->frame[4];
+                probe->state = PROBE_FOUND;
+            }
+            break;
+        default:
+            probe->state = PROBE_FAILED;
+            break;
+        }
+    }
+}
+
+int jpeg_probe_resolution(const struct jpeg_probe *probe, uint32_t *height, uint32_t *width)
+{
+    M_REQUIRE_NON_NULL(probe);
+    M_REQUIRE_NON_NULL(height);
+    M_REQUIRE_NON_NULL(width);
+
+    if (probe->state != PROBE_FOUND || probe->height == 0 || probe->width == 0) {
+        return ERR_IMGLIB;
+    }
+
+    *height = probe->height;
+    *width = probe->width;
+    return ERR_NONE;
+}
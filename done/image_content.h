@@ -26,9 +26,38 @@ extern "C" {
  */
 int get_resolution(uint32_t *height, uint32_t *width, const char *image_buffer, size_t image_size);
 
+/**
+ * @brief Prepares probe to find the dimensions of a JPEG image fed to jpeg_probe_update().
+ */
+void jpeg_probe_init(struct jpeg_probe *probe);
+
+/**
+ * @brief Looks for the dimensions of the image in the next chunk of its content.
+ *
+ * Only the JPEG markers are followed, the image data itself is not decoded.
+ */
+void jpeg_probe_update(struct jpeg_probe *probe, const char *chunk, size_t chunk_size);
+
+/**
+ * @brief Gets the resolution found by jpeg_probe_update().
+ *
+ * @return ERR_IMGLIB if the content seen so far is not a JPEG image with a frame header, 0 otherwise.
+ */
+int jpeg_probe_resolution(const struct jpeg_probe *probe, uint32_t *height, uint32_t *width);
+
+/**
+ * @brief Computes the placeholder of an image: its BlurHash (see blurhash.h), of at most
+ * MAX_PLACEHOLDER characters, written null-terminated to placeholder.
+ *
+ * @return Some error code. 0 if no error.
+ */
+int image_placeholder(const char *image_buffer, size_t image_size, char *placeholder);
+
 /**
  * @brief Calls the create_resized_img function and updates the metadata on the disk
  *
+ * A new thumbnail also gives the image its placeholder, if it has none yet.
+ *
  * @param resolution
  * @param imgfs_file The main in-memory structure
  * @param index The index of the image in the metadata array
@@ -0,0 +1,131 @@
+#include "image_sprite.h"
+#include "image_content.h" // for lazily_resize()
+
+#include <stdlib.h> // for free
+#include <string.h> // for strncpy
+#include <vips/vips.h>
+
+int sprite_locate(struct sprite *sprite, size_t page, struct imgfs_file *imgfs_file)
+{
+    M_REQUIRE_NON_NULL(sprite);
+    M_REQUIRE_NON_NULL(imgfs_file);
+
+    memset(sprite, 0, sizeof(*sprite));
+    sprite->version = imgfs_file->header.version;
+    sprite->cell_width = imgfs_file->header.resized_res[2 * THUMB_RES];
+    sprite->cell_height = imgfs_file->header.resized_res[2 * THUMB_RES + 1];
+
+    // The images of the page, in the order of the listing
+    const size_t first = page * SPRITE_PAGE_SIZE;
+    size_t seen = 0;
+    for (uint32_t i = 0; i < imgfs_file->header.max_files; ++i) {
+        const struct img_metadata *const metadata = &imgfs_file->metadata[i];
+        if (metadata->is_valid == EMPTY || seen++ < first) continue;
+        if (sprite->nb_tiles == SPRITE_PAGE_SIZE) {
+            sprite->more = 1;
+            break;
+        }
+
+        struct sprite_tile *const tile = &sprite->tiles[sprite->nb_tiles];
+        struct imgfs_read_request *const thumb = &sprite->thumbs[sprite->nb_tiles];
+        strncpy(tile->img_id, metadata->img_id, MAX_IMG_ID);
+        thumb->img_id = tile->img_id;
+        thumb->resolution = THUMB_RES;
+        thumb->status = ERR_NONE;
+        if (metadata->offset[THUMB_RES] == 0 || metadata->size[THUMB_RES] == 0) {
+            thumb->status = lazily_resize(THUMB_RES, imgfs_file, i);
+            thumb->resized = thumb->status == ERR_NONE;
+        }
+        thumb->offset = metadata->offset[THUMB_RES];
+        thumb->size = metadata->size[THUMB_RES];
+        ++sprite->nb_tiles;
+    }
+
+    if (page > 0 && sprite->nb_tiles == 0) return ERR_INVALID_ARGUMENT;
+    return fflush(imgfs_file->file) == 0 ? ERR_NONE : ERR_IO;
+}
+
+/**
+ * @brief Makes the cell of the i-th thumbnail of sprite: the thumbnail centered on a black background,
+ * or only the background if the thumbnail cannot be read. Records where the thumbnail is in the sprite.
+ */
+static int make_cell(struct sprite *sprite, size_t i, size_t cols, VipsImage **cell)
+{
+    struct sprite_tile *const tile = &sprite->tiles[i];
+    const struct imgfs_read_request *const thumb = &sprite->thumbs[i];
+    const uint32_t cell_width = sprite->cell_width;
+    const uint32_t cell_height = sprite->cell_height;
+
+    VipsImage *image = NULL;
+    if (thumb->status == ERR_NONE && thumb->data != NULL &&
+        vips_jpegload_buffer((void *) (uintptr_t) thumb->data, thumb->size, &image, NULL) == 0) {
+        const uint32_t width = (uint32_t) vips_image_get_width(image);
+        const uint32_t height = (uint32_t) vips_image_get_height(image);
+
+        // a thumbnail always fits in the thumbnail resolution of the imgFS
+        if (width <= cell_width && height <= cell_height) {
+            const uint32_t x = (cell_width - width) / 2;
+            const uint32_t y = (cell_height - height) / 2;
+            if (vips_embed(image, cell, (int) x, (int) y, (int) cell_width, (int) cell_height, NULL) == 0) {
+                g_object_unref(image);
+                tile->x = (uint32_t) (i % cols) * cell_width + x;
+                tile->y = (uint32_t) (i / cols) * cell_height + y;
+                tile->width = width;
+                tile->height = height;
+                return ERR_NONE;
+            }
+        }
+        g_object_unref(image);
+    }
+
+    tile->x = tile->y = tile->width = tile->height = 0;
+    return vips_black(cell, (int) cell_width, (int) cell_height, NULL) == 0 ? ERR_NONE : ERR_IMGLIB;
+}
+
+int sprite_compose(struct sprite *sprite, size_t cols, int fd)
+{
+    M_REQUIRE_NON_NULL(sprite);
+
+    if (cols == 0 || cols > SPRITE_MAX_COLS) return ERR_INVALID_ARGUMENT;
+    if (sprite->nb_tiles == 0) return ERR_NONE;
+
+    char *contents = NULL;
+    int ret = do_read_batch(sprite->thumbs, sprite->nb_tiles, fd, &contents);
+    if (ret != ERR_NONE) return ret;
+
+    // The contents are read by vips only when the sprite is saved: they are kept until then
+    VipsImage *cells[SPRITE_PAGE_SIZE] = { NULL };
+    for (size_t i = 0; i < sprite->nb_tiles && ret == ERR_NONE; ++i) {
+        ret = make_cell(sprite, i, cols, &cells[i]);
+    }
+
+    VipsImage *grid = NULL;
+    if (ret == ERR_NONE && vips_arrayjoin(cells, &grid, (int) sprite->nb_tiles, "across", (int) cols, NULL) != 0) {
+        ret = ERR_IMGLIB;
+    }
+    if (ret == ERR_NONE && vips_jpegsave_buffer(grid, &sprite->jpeg, &sprite->jpeg_size, NULL) != 0) {
+        sprite->jpeg = NULL;
+        ret = ERR_IMGLIB;
+    }
+    if (ret == ERR_NONE) {
+        sprite->width = (uint32_t) vips_image_get_width(grid);
+        sprite->height = (uint32_t) vips_image_get_height(grid);
+    }
+
+    if (grid != NULL) g_object_unref(grid);
+    for (size_t i = 0; i < sprite->nb_tiles; ++i) {
+        if (cells[i] != NULL) g_object_unref(cells[i]);
+    }
+    free(contents);
+    for (size_t i = 0; i < sprite->nb_tiles; ++i) sprite->thumbs[i].data = NULL;
+
+    return ret;
+}
+
+void sprite_free(struct sprite *sprite)
+{
+    if (sprite == NULL) return;
+    g_free(sprite->jpeg);
+    sprite->jpeg = NULL;
+    sprite->jpeg_size = 0;
+}
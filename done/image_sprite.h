@@ -0,0 +1,68 @@
+/**
+ * @file image_sprite.h
+ * @brief Sprite sheets: the thumbnails of a page of images, in one JPEG.
+ *
+ * A page holds SPRITE_PAGE_SIZE images, in the order of the listing. Their
+ * thumbnails are laid out on a grid of cells of the thumbnail resolution of
+ * the imgFS, each centered in its cell, so that a client showing a page of
+ * images fetches and decodes a single image, and finds each thumbnail in it
+ * by its coordinates.
+ */
+
+#pragma once
+
+#include "imgfs.h" // for struct imgfs_file, struct imgfs_read_request
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t
+
+#define SPRITE_PAGE_SIZE 100 // images on a page
+#define SPRITE_MAX_COLS  100 // cells on a row of the grid
+
+/**
+ * @brief Where the thumbnail of an image is in the sprite.
+ */
+struct sprite_tile {
+    char img_id[MAX_IMG_ID + 1];
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;  // 0 (as height) if the thumbnail could not be read: its cell is left black
+    uint32_t height;
+};
+
+struct sprite {
+    uint32_t version;                 // of the imgFS the sprite is made from
+    int more;                         // whether there are images on the next pages
+    size_t nb_tiles;
+    struct sprite_tile tiles[SPRITE_PAGE_SIZE];
+    struct imgfs_read_request thumbs[SPRITE_PAGE_SIZE]; // where the thumbnails are in the imgFS file
+    uint32_t cell_width;              // thumbnail resolution of the imgFS
+    uint32_t cell_height;
+    uint32_t width;                   // of the whole sprite
+    uint32_t height;
+    void *jpeg;                       // the sprite, NULL if the page has no image
+    size_t jpeg_size;
+};
+
+/**
+ * @brief Finds the images of page page (the first page being 0) and their thumbnails, which are
+ * created if needed, as do_read() does (the resized field of their thumbs tells which ones were).
+ * To be called with the lock of the imgFS held.
+ *
+ * @return Some error code. 0 if no error, ERR_INVALID_ARGUMENT if the page is after the last one
+ *         (page 0 always exists, even with no images).
+ */
+int sprite_locate(struct sprite *sprite, size_t page, struct imgfs_file *imgfs_file);
+
+/**
+ * @brief Reads the thumbnails found by sprite_locate() from the imgFS file fd and lays them out
+ * cols per row. Needs no lock, the thumbnails of an imgFS never moving.
+ *
+ * @return Some error code. 0 if no error, ERR_INVALID_ARGUMENT if cols is 0 or above SPRITE_MAX_COLS.
+ */
+int sprite_compose(struct sprite *sprite, size_t cols, int fd);
+
+/**
+ * @brief Frees the JPEG of sprite.
+ */
+void sprite_free(struct sprite *sprite);
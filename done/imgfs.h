@@ -11,6 +11,20 @@
  * should be stored as raw bytes appended at the end of the imgFS
  * file and addressed by offsets in the metadata structure.
  *
+ * An imgFS grown since its creation has its other metadata structures in
+ * extents appended to the file as the contents are (see struct imgfs_extent).
+ *
+ * Details added to the format later (such as the placeholders of the images)
+ * are kept in an extension file next to it (see struct imgfs_ext), leaving
+ * the imgFS file itself as it always was.
+ *
+ * The changes of the header and metadata of an imgFS may go through a journal
+ * before being written in place (see imgfs_journal.h).
+ *
+ * The header and each metadata structure end with a checksum of their other
+ * fields, written with them and verified by do_open(), a torn or corrupted
+ * write being thus detected (0 when written by a former version: not verified).
+ *
  * @author Mia Primorac
  */
 
@@ -29,6 +43,10 @@
 // Constraints
 #define MAX_IMGFS_NAME  31  // max. size of a ImgFS name
 #define MAX_IMG_ID     127  // max. size of an image id
+#define MAX_PLACEHOLDER 31  // max. size of the placeholder of an image (a BlurHash, see blurhash.h)
+#define MAX_RES_NAME    15  // max. size of the name of a resolution
+#define MAX_EXTRA_RES    8  // max. number of resolutions of an imgFS besides THUMB_RES, SMALL_RES and ORIG_RES
+#define INSERT_BATCH_THREADS 8 // threads hashing and measuring the images inserted at once
 
 // For is_valid in imgfs_metadata
 #define EMPTY     0
@@ -56,8 +74,8 @@ struct imgfs_header {
     uint32_t nb_files;
     uint32_t max_files;
     uint16_t resized_res[2 * (NB_RES - 1)]; // thumb_res XY, small_res XY
-    uint32_t unused_32;
-    uint64_t unused_64;
+    uint32_t checksum;    // of the other fields (see imgfs_header_checksum()), 0 if none
+    uint64_t last_extent; // offset of the last metadata extent added (see do_grow()), 0 if none
 };
 
 //---------------------------------------------------------
@@ -74,9 +92,122 @@ struct img_metadata {
     uint64_t offset[NB_RES];
     uint16_t is_valid;
     uint16_t unused_16;
+    uint32_t checksum;    // of the other fields (see imgfs_metadata_checksum()), 0 if none
+};
 
+//-------------------------------------------------------------
+/**
+ * @struct imgfs_extent
+ * @brief The metadata structures of an imgFS beyond those it was created with are in extents
+ * appended to the file (see do_grow()): each one this structure, followed by its nb_entries
+ * metadata structures. They are chained from the last one added (header.last_extent) on,
+ * each one being before the next in the file, and their entries come after the first
+ * ones in the metadata array, in the order they were added.
+ */
+struct imgfs_extent {
+    uint64_t previous;    // offset of the extent added before this one, 0 if none
+    uint32_t nb_entries;
+    uint32_t unused_32;
+};
+
+/**
+ * @struct imgfs_segment
+ * @brief Entries of the metadata array stored one after the other in the imgFS file: those
+ * following the header, or those of an extent.
+ */
+struct imgfs_segment {
+    uint64_t offset;      // of the first one in the imgFS file
+    uint32_t first;       // index of the first one in the metadata array
+    uint32_t nb_entries;
 };
 
+//-------------------------------------------------------------
+#define IMGFS_EXT_SUFFIX  ".ext"     // name of the extension file: the one of the imgFS file, with this suffix
+#define IMGFS_QUARANTINE_SUFFIX ".quarantine" // where the corrupted entries are kept (see imgfs_verify())
+#define IMGFS_EXT_MAGIC   "IMGFSEXT" // first bytes of an extension file (without null byte)
+#define IMGFS_EXT_VERSION 2
+
+/**
+ * @struct imgfs_ext_header
+ * @brief This structure starts the extension file of an imgFS, followed by its nb_resolutions
+ * resolutions (see struct imgfs_resolution), then by nb_entries entries of entry_size bytes,
+ * one per metadata entry.
+ *
+ * Later versions may append fields to the entries: entry_size tells how to skip them, and the
+ * fields a version does not know about are read as zeros (version 1 has no resolutions).
+ */
+struct imgfs_ext_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_size;
+    uint32_t nb_entries;
+    uint32_t nb_resolutions;
+};
+
+/**
+ * @struct imgfs_resolution
+ * @brief A resolution of the images of an imgFS besides thumb, small and orig, in the
+ * extension file: its resolution code (see imgfs_resolution_atoi()) is NB_RES plus its rank.
+ */
+struct imgfs_resolution {
+    char name[MAX_RES_NAME + 1];
+    uint16_t width;
+    uint16_t height;
+    uint32_t unused_32;
+};
+
+/**
+ * @struct img_variant
+ * @brief Where the content of an image in one of the resolutions of the extension file is.
+ */
+struct img_variant {
+    uint64_t offset; // 0 if not resized yet
+    uint32_t size;
+    uint32_t unused_32;
+};
+
+/**
+ * @struct img_metadata_ext
+ * @brief This structure holds the details of an image kept in the extension file (version 2).
+ * They belong to the content whose SHA they carry: an entry whose SHA is not the one of the
+ * image in the same metadata entry is left from an image deleted since, and is ignored.
+ *
+ * Only the variants of the nb_resolutions resolutions of the file are stored in it.
+ */
+struct img_metadata_ext {
+    unsigned char SHA[SHA256_DIGEST_LENGTH];
+    char placeholder[MAX_PLACEHOLDER + 1]; // "" if none
+    struct img_variant variants[MAX_EXTRA_RES];
+};
+
+/**
+ * @struct imgfs_ext
+ * @brief The extension file of an imgFS, in memory. It is only created once some image needs it:
+ * an imgFS without one (or with one this version cannot read) is an imgFS whose images have no
+ * details beyond their metadata.
+ */
+struct imgfs_ext {
+    char *filename;
+    int writable;                     // whether the imgFS file was opened for writing
+    FILE *file;                       // NULL if there is no extension file (yet)
+    struct imgfs_ext_header header;
+    struct imgfs_resolution resolutions[MAX_EXTRA_RES]; // header.nb_resolutions of them
+    struct img_metadata_ext *entries; // header.nb_entries, NULL if there is no extension file
+};
+
+//-------------------------------------------------------------
+/**
+ * @brief When the changes made to an imgFS reach the disk (see imgfs_durability.h)
+ */
+enum imgfs_durability {
+    DURABILITY_STRICT = 0, // synced before the change is reported as made
+    DURABILITY_INTERVAL,   // synced every sync_interval ms, by a background thread
+    DURABILITY_NONE        // left to the system (e.g. for bulk loads)
+};
+
+struct imgfs_journal;
+struct imgfs_flusher;
+
 //-------------------------------------------------------------
 /**
  * @struct imgfs_file
@@ -86,6 +217,75 @@ struct imgfs_file {
     FILE *file;
     struct imgfs_header header;
     struct img_metadata *metadata;
+    struct imgfs_ext *ext;
+    struct imgfs_segment *segments; // where the metadata are in the file, NULL if all after the header
+    uint32_t nb_segments;
+    struct imgfs_journal *journal;  // NULL if the changes are written in place right away
+    enum imgfs_durability durability;
+    uint32_t sync_interval;         // in ms, for DURABILITY_INTERVAL
+    struct imgfs_flusher *flusher;  // syncing the changes, for DURABILITY_INTERVAL only
+    uint32_t nb_quarantined;        // entries found corrupted by do_open() (see imgfs_verify())
+};
+
+//-------------------------------------------------------------
+/**
+ * @struct jpeg_probe
+ * @brief State of the search for the dimensions of a JPEG image received chunk by chunk
+ * (see jpeg_probe_update() in image_content.h).
+ */
+struct jpeg_probe {
+    int state;
+    uint8_t marker;       // marker of the current segment
+    uint8_t frame_len;    // bytes of frame received
+    uint32_t remaining;   // bytes left in the current segment
+    uint8_t frame[5];     // precision, height and width from the start of frame segment
+    uint32_t height;
+    uint32_t width;
+};
+
+//-------------------------------------------------------------
+/**
+ * @struct imgfs_read_request
+ * @brief One of the images read at once with do_read_batch_locate() and do_read_batch().
+ */
+struct imgfs_read_request {
+    const char *img_id;
+    int resolution;
+    int status;       // ERR_NONE once the image is located, some error code if it cannot be read
+    uint64_t offset;  // of its content in the imgFS file
+    uint32_t size;
+    const char *data; // its content, once read
+    int resized;      // whether its content was made by lazily_resize() while located
+};
+
+//-------------------------------------------------------------
+/**
+ * @struct imgfs_insert_request
+ * @brief One of the images inserted at once with do_insert_batch_prepare() and do_insert_batch().
+ */
+struct imgfs_insert_request {
+    const char *img_id;
+    const char *data;     // its content
+    size_t size;
+    int status;           // ERR_NONE once the image is inserted, some error code if it cannot be
+    unsigned char SHA[SHA256_DIGEST_LENGTH];
+    uint32_t orig_res[2]; // width and height, as in img_metadata
+    char placeholder[MAX_PLACEHOLDER + 1]; // "" if it could not be computed
+};
+
+//-------------------------------------------------------------
+/**
+ * @struct imgfs_insert
+ * @brief An image being inserted chunk by chunk, see do_insert_begin().
+ */
+struct imgfs_insert {
+    struct imgfs_file *imgfs_file;
+    char img_id[MAX_IMG_ID + 1];
+    uint64_t offset;      // start of the region reserved at the end of the file for the content
+    size_t size;          // announced image size
+    size_t written;       // bytes received so far
+    SHA256_CTX sha;
+    struct jpeg_probe probe;
 };
 
 //-------------------------------------------------------------
@@ -106,7 +306,22 @@ void print_header(const struct imgfs_header *header);
 void print_metadata(const struct img_metadata *metadata);
 
 /**
- * @brief Open imgFS file, read the header and all the metadata.
+ * @brief Writes the SHA in hexadecimal (2 * SHA256_DIGEST_LENGTH characters and a null byte) to sha_string.
+ */
+void sha_to_string(const unsigned char *SHA, char *sha_string);
+
+/**
+ * @brief Reads a SHA written in hexadecimal in the len characters of sha_string.
+ *
+ * @return ERR_INVALID_ARGUMENT if sha_string is not a SHA256 in hexadecimal, 0 otherwise.
+ */
+int sha_from_string(const char *sha_string, size_t len, unsigned char *SHA);
+
+/**
+ * @brief Open imgFS file, read the header and all the metadata (and the extension file, if any).
+ * The changes left in its journal, if any, are redone (see imgfs_journal_recover()), then the
+ * checksums verified (see imgfs_verify()): ERR_CORRUPTED if the one of the header is wrong.
+ * Its changes are DURABILITY_STRICT (see imgfs_set_durability()).
  *
  * @param imgfs_filename Path to the imgFS file
  * @param open_mode Mode for fopen(), eg.: "rb", "rb+", etc.
@@ -116,6 +331,76 @@ int do_open(const char *imgfs_filename,
             const char *open_mode,
             struct imgfs_file *imgfs_file);
 
+/**
+ * @brief Prepares the extension of the imgFS file imgfs_filename, opened with open_mode
+ * (see struct imgfs_ext): reads its extension file, if there is one. Opening the imgFS file
+ * with "w" makes a new imgFS: the extension file of the former one, if any, is then removed.
+ * Called by do_open() and do_create().
+ *
+ * @return Some error code. 0 if no error.
+ */
+int imgfs_ext_open(const char *imgfs_filename, const char *open_mode, struct imgfs_file *imgfs_file);
+
+/**
+ * @brief Makes the extension file of imgfs_file (if any) follow its header.max_files, after it grew,
+ * leaving it aside if it cannot. Called by do_grow().
+ *
+ * @return Some error code. 0 if no error.
+ */
+int imgfs_ext_grow(struct imgfs_file *imgfs_file);
+
+/**
+ * @brief Gets where the metadata entry index is in the imgFS file.
+ *
+ * @param nb_contiguous Where to write the number of entries from index on stored one after
+ *        the other from there (up to the end of its extent), if not NULL.
+ * @return The offset of the entry, -1 if there is no such entry.
+ */
+long imgfs_metadata_offset(const struct imgfs_file *imgfs_file, size_t index, size_t *nb_contiguous);
+
+/**
+ * @brief Writes the nb metadata entries at indexes, changed in memory, and then the header: to the
+ * journal of imgfs_file if it has one (see imgfs_journal.h), in place otherwise.
+ *
+ * @return Some error code. 0 if no error.
+ */
+int imgfs_write_entries(struct imgfs_file *imgfs_file, const uint32_t *indexes, size_t nb);
+
+/**
+ * @brief Writes the nb metadata entries at indexes and then the header in place, as
+ * imgfs_write_entries() does without journal (it is what checkpoints write).
+ *
+ * @return Some error code. 0 if no error.
+ */
+int imgfs_write_in_place(struct imgfs_file *imgfs_file, const uint32_t *indexes, size_t nb);
+
+/**
+ * @brief CRC32C (see crc32c.h) of the fields of header but its checksum, never 0.
+ */
+uint32_t imgfs_header_checksum(const struct imgfs_header *header);
+
+/**
+ * @brief CRC32C (see crc32c.h) of the fields of metadata but its checksum, never 0.
+ */
+uint32_t imgfs_metadata_checksum(const struct img_metadata *metadata);
+
+/**
+ * @brief Sets the checksums of the nb metadata entries at indexes of imgfs_file and of its header,
+ * before they are written (by imgfs_write_in_place(), imgfs_journal_append() and co.).
+ */
+void imgfs_seal(struct imgfs_file *imgfs_file, const uint32_t *indexes, size_t nb);
+
+/**
+ * @brief Verifies the checksums of the metadata entries of imgfs_file, just opened with open_mode.
+ * A corrupted entry is reported and quarantined: not seen as an image anymore and, with open_mode
+ * for writing, appended to the quarantine file (index then entry, as read) and emptied in place,
+ * once all of them are synced to the quarantine file. Called by do_open(), once the journaled
+ * changes are redone.
+ *
+ * @return Some error code. 0 if no error.
+ */
+int imgfs_verify(const char *imgfs_filename, const char *open_mode, struct imgfs_file *imgfs_file);
+
 /**
  * @brief Do some clean-up for imgFS file handling.
  *
@@ -131,15 +416,33 @@ void do_close(struct imgfs_file *imgfs_file);
 enum do_list_mode {
     STDOUT,
     JSON,
+    JSON_BLOBS, // as JSON, but each image with the URL of its content (see BLOB_URI)
+    CBOR,       // binary (RFC 8949), each image with its SHA and sizes (see do_list_fields())
     NB_DO_LIST_MODES
 };
 
+/**
+ * @brief Where the server serves image contents by SHA (in hexadecimal): URLs that never change.
+ */
+#define BLOB_URI "/imgfs/blob/"
+
+/**
+ * @brief Details of the images a listing may give besides their ID (bits of fields, see do_list_fields()),
+ * all already in memory.
+ */
+#define LIST_ORIG_RES 0x1 // "orig_res": [ width, height ]
+#define LIST_SIZE     0x2 // "size": [ thumb, small, orig ] in bytes, 0 if not resized yet
+#define LIST_SHA      0x4 // "sha": the SHA of the content, in hexadecimal
+#define LIST_VARIANTS 0x8 // "variants": the resolutions the image has, e.g. [ "small", "orig" ]
+#define LIST_PLACEHOLDER 0x10 // "placeholder": its BlurHash, if it has one (from the extension file)
+
 /**
  * @brief Displays (on stdout) imgFS metadata.
  *
  * @param imgfs_file In memory structure with header and metadata.
  * @param output_mode What style to use for displaying infos.
- * @param json A pointer to a string containing the list in JSON format if output_mode is JSON.
+ * @param json A pointer to a string containing the list in JSON format if output_mode is JSON or JSON_BLOBS
+ *      (in CBOR if output_mode is CBOR: see do_list_fields() for its length).
  *      It will be dynamically allocated by the function. Ignored for other output modes.
  * @return some error code.
  */
@@ -147,14 +450,113 @@ int do_list(const struct imgfs_file *imgfs_file,
             enum do_list_mode output_mode, char **json);
 
 /**
- * @brief Creates the imgFS called imgfs_filename. Writes the header and the
- *        preallocated empty metadata array to imgFS file.
+ * @brief As do_list(), each image of a JSON listing being an object with the details in fields
+ * (LIST_* bits) besides its "img_id" if fields is not 0.
+ *
+ * The CBOR listing has the same structure as the JSON one (a map of "Images" to an array of maps,
+ * of indefinite lengths), each image always with its "size" and "sha" (as 32 bytes), and the
+ * details in fields besides.
+ *
+ * @param len Where to write the length of the listing (the JSON one being also null-terminated), if not NULL.
+ */
+int do_list_fields(const struct imgfs_file *imgfs_file, enum do_list_mode output_mode,
+                   unsigned int fields, char **json, size_t *len);
+
+/**
+ * @brief Reads the LIST_* bits named in names, comma-separated (e.g. "orig_res,sha"), into fields.
+ *
+ * @return ERR_INVALID_ARGUMENT if some name is unknown, 0 otherwise.
+ */
+int list_fields_parse(const char *names, unsigned int *fields);
+
+/**
+ * @brief Position of a listing written piece by piece with do_list_chunk().
+ */
+struct imgfs_list_cursor {
+    uint32_t slot;    // next metadata entry to look at
+    size_t remaining; // images still to be listed
+    size_t listed;    // images listed so far
+    unsigned int fields; // LIST_* details listed with each image
+};
+
+/**
+ * @brief Writes the images of a JSON or CBOR listing (see do_list_fields(), the fields being those
+ * of cursor) piece by piece, without building it whole.
+ *
+ * Writes to buffer as many of the elements of the "Images" array as fit in size bytes,
+ * from cursor on in metadata order, and moves cursor past them: cursor->slot is then the next
+ * valid entry, or max_files if there is none. JSON elements are comma-separated (with a leading
+ * comma if some images were listed before), CBOR items simply follow each other.
+ *
+ * @param imgfs_file In memory structure with header and metadata.
+ * @param output_mode JSON, JSON_BLOBS or CBOR.
+ * @param cursor Where to start from, updated.
+ * @param buffer Where to write.
+ * @param size Size of buffer.
+ * @return The number of bytes written, 0 once there is nothing left to list, or some error code
+ *         (ERR_INVALID_ARGUMENT if not even one image fits).
+ */
+int do_list_chunk(const struct imgfs_file *imgfs_file, enum do_list_mode output_mode,
+                  struct imgfs_list_cursor *cursor, char *buffer, size_t size);
+
+/**
+ * @brief Writes what comes before the images of a listing (JSON, JSON_BLOBS or CBOR) to out if it fits
+ * in size bytes.
+ * @return The number of bytes needed.
+ */
+size_t do_list_head(enum do_list_mode output_mode, char *out, size_t size);
+
+/**
+ * @brief Writes what comes after the images of a listing, once they were listed up to cursor, to out if it
+ * fits in size bytes: with cursor->slot as "next" (where the next page starts) if next is not 0.
+ * @return The number of bytes needed.
+ */
+size_t do_list_tail(enum do_list_mode output_mode, const struct imgfs_list_cursor *cursor, int next,
+                    char *out, size_t size);
+
+/**
+ * @brief Converts the len bytes of CBOR data (as written by do_list_fields()) to JSON, laid out
+ * as do_list_fields() does (byte strings becoming strings in hexadecimal), into *json.
+ *
+ * @return Some error code. 0 if no error, ERR_INVALID_ARGUMENT if cbor is not a single well-formed
+ *         CBOR item of the types used in listings.
+ */
+int cbor_to_json(const char *cbor, size_t len, char **json);
+
+/**
+ * @brief Writes str (of at most max_len characters) as a JSON string, with its quotes,
+ * escaped as json-c does, to out if it fits in size bytes.
+ *
+ * @return The number of bytes needed.
+ */
+size_t json_string(const char *str, size_t max_len, char *out, size_t size);
+
+/**
+ * @brief Creates the imgFS called imgfs_filename. Writes the header and
+ *        reserves the empty metadata array in the imgFS file, as a hole of the
+ *        file (only written to when entries are: see do_open()).
  *
  * @param imgfs_filename Path to the imgFS file
  * @param imgfs_file In memory structure with header and metadata.
  */
 int do_create(const char *imgfs_filename, struct imgfs_file *imgfs_file);
 
+/**
+ * @brief Grows the imgFS to max_files metadata entries, in place: the new ones, all empty, are
+ * in an extent appended to the file (see struct imgfs_extent), left as a hole of the file as those
+ * of do_create().
+ *
+ * The header being written last, once the extent is synced, an imgFS grows entirely or not at all;
+ * the growth is then synced as its durability mode says. An extension file that cannot grow with it
+ * is left aside.
+ *
+ * @param max_files The new maximum number of images, more than header.max_files.
+ * @param imgfs_file The main in-memory data structure, opened for writing.
+ * @return Some error code. 0 if no error, ERR_MAX_FILES if max_files is not more than
+ *         header.max_files.
+ */
+int do_grow(struct imgfs_file *imgfs_file, uint32_t max_files);
+
 /**
  * @brief Deletes an image from a imgFS imgFS.
  *
@@ -178,6 +580,104 @@ int do_delete(const char *img_id, struct imgfs_file *imgfs_file);
  */
 int resolution_atoi(const char *resolution);
 
+/**
+ * @brief As resolution_atoi(), also accepting the names of the resolutions of the extension
+ * file of imgfs_file (which may be NULL).
+ *
+ * @return The corresponding value (NB_RES and up for those of the extension file) or -1 if error.
+ */
+int imgfs_resolution_atoi(const char *resolution, const struct imgfs_file *imgfs_file);
+
+/**
+ * @brief Gets the number of resolutions of the images of imgfs_file: NB_RES and those of its extension file.
+ */
+int imgfs_nb_resolutions(const struct imgfs_file *imgfs_file);
+
+/**
+ * @brief Gets the name of a resolution of imgfs_file ("thumb", "small", "orig" or one of its extension file).
+ *
+ * @return The name, NULL if imgfs_file has no such resolution.
+ */
+const char *imgfs_resolution_name(const struct imgfs_file *imgfs_file, int resolution);
+
+/**
+ * @brief Tells whether name can be given to a new resolution of imgfs_file (which may be NULL):
+ * made of letters, digits, '-' and '_', at most MAX_RES_NAME long and not taken yet.
+ *
+ * @return 1 if it can, 0 otherwise.
+ */
+int imgfs_valid_resolution_name(const char *name, const struct imgfs_file *imgfs_file);
+
+/**
+ * @brief Adds a resolution of width x height called name to the images of imgfs_file, rewriting its
+ * extension file (which is created if there is none). name shall be made of letters, digits, '-' and '_'.
+ *
+ * @return Some error code. 0 if no error, ERR_INVALID_ARGUMENT if name is not valid or already used,
+ *         ERR_RESOLUTIONS if the size is empty or if there are already MAX_EXTRA_RES such resolutions.
+ */
+int imgfs_add_resolution(struct imgfs_file *imgfs_file, const char *name, uint16_t width, uint16_t height);
+
+/**
+ * @brief Gets where the content of the image at index is in some resolution: from its metadata
+ * for thumb, small and orig, from the extension file for the others.
+ *
+ * @param offset Where to write the offset of the content, 0 if the image is not resized yet.
+ * @param size Where to write its size.
+ * @return Some error code. 0 if no error, ERR_RESOLUTIONS if imgfs_file has no such resolution.
+ */
+int imgfs_variant(const struct imgfs_file *imgfs_file, size_t index, int resolution,
+                  uint64_t *offset, uint32_t *size);
+
+/**
+ * @brief Sets where the content of the image at index is in some resolution, writing it to the
+ * metadata or to the extension file (see imgfs_variant()).
+ *
+ * @return Some error code. 0 if no error.
+ */
+int imgfs_set_variant(struct imgfs_file *imgfs_file, size_t index, int resolution,
+                      uint64_t offset, uint32_t size);
+
+/**
+ * @brief Finds the metadata entry of a (valid) image.
+ *
+ * @param img_id The ID of the image.
+ * @param imgfs_file The main in-memory data structure
+ * @return The index of the image in the metadata array, ERR_IMAGE_NOT_FOUND if there is none.
+ */
+int find_image_index(const char *img_id, const struct imgfs_file *imgfs_file);
+
+/**
+ * @brief Finds the metadata entry of a (valid) image with the given content.
+ *
+ * @param SHA The SHA256 of the content.
+ * @param imgfs_file The main in-memory data structure
+ * @return The index of one such image in the metadata array, ERR_IMAGE_NOT_FOUND if there is none.
+ */
+int find_image_by_sha(const unsigned char *SHA, const struct imgfs_file *imgfs_file);
+
+/**
+ * @brief Gets the placeholder of the image at index (its BlurHash, see blurhash.h).
+ *
+ * @return The placeholder, NULL if the image has none.
+ */
+const char *imgfs_placeholder(const struct imgfs_file *imgfs_file, size_t index);
+
+/**
+ * @brief Sets the placeholder of the image at index and writes it to the extension file,
+ * which is first created if there is none.
+ *
+ * @return Some error code. 0 if no error.
+ */
+int imgfs_set_placeholder(struct imgfs_file *imgfs_file, size_t index, const char *placeholder);
+
+/**
+ * @brief Gives the image at index the details kept in the extension file (placeholder, resized
+ * variants) of the image at index from, which has the same content.
+ *
+ * @return Some error code. 0 if no error, ERR_IMAGE_NOT_FOUND if the image at from has no such details.
+ */
+int imgfs_ext_copy(struct imgfs_file *imgfs_file, size_t index, size_t from);
+
 /**
  * @brief Reads the content of an image from a imgFS.
  *
@@ -191,6 +691,27 @@ int resolution_atoi(const char *resolution);
 int do_read(const char *img_id, int resolution, char **image_buffer,
             uint32_t *image_size, struct imgfs_file *imgfs_file);
 
+/**
+ * @brief Locates the contents of the nb images of requests, resizing those not in their resolution yet
+ * (the first step of reading many images at once).
+ *
+ * The status of each request tells whether its image was found (and resized), its resized field
+ * whether it had to be; only a failure to access the imgFS is an error for the whole batch. As the contents may then be read without
+ * imgfs_file (contents never move once written), the file is flushed.
+ *
+ * @return Some error code. 0 if no error.
+ */
+int do_read_batch_locate(struct imgfs_read_request *requests, size_t nb, struct imgfs_file *imgfs_file);
+
+/**
+ * @brief Reads the contents of the located requests (see do_read_batch_locate()) from the imgFS file fd,
+ * in the order of their offsets, adjacent contents at once, and each content once only.
+ *
+ * @param contents Where to write the buffer (to be freed) the data of the requests point into.
+ * @return Some error code. 0 if no error.
+ */
+int do_read_batch(struct imgfs_read_request *requests, size_t nb, int fd, char **contents);
+
 /**
  * @brief Insert image in the imgFS file
  *
@@ -202,6 +723,89 @@ int do_read(const char *img_id, int resolution, char **image_buffer,
 int do_insert(const char *image_buffer, size_t image_size,
               const char *img_id, struct imgfs_file *imgfs_file);
 
+/**
+ * @brief Checks whether an image can be inserted, before its content is available.
+ *
+ * If SHA is not NULL and some image with this content is already stored, the new image
+ * is inserted right away, referring to that content, as do_insert() would do.
+ *
+ * @param img_id Image ID
+ * @param SHA SHA256 of the content of the image, if known, NULL otherwise
+ * @param imgfs_file The main in-memory data structure
+ * @return ERR_IMGFS_FULL or ERR_DUPLICATE_ID if do_insert() would fail with it, another error code
+ *         on failure, 1 if the image was inserted, 0 if its content is needed.
+ */
+int do_insert_preflight(const char *img_id, const unsigned char *SHA, struct imgfs_file *imgfs_file);
+
+/**
+ * @brief Starts the insertion of an image whose content is not available at once.
+ *
+ * Reserves image_size bytes at the end of the imgFS file, where the content is then
+ * written as it arrives by do_insert_write(). The image only becomes part of the
+ * imgFS with do_insert_commit(); do_insert_abort() gives the reserved region back.
+ *
+ * @param insert The insertion state, initialized by this function
+ * @param img_id Image ID
+ * @param image_size Image size
+ * @param imgfs_file The main in-memory data structure
+ * @return Some error code. 0 if no error.
+ */
+int do_insert_begin(struct imgfs_insert *insert, const char *img_id, size_t image_size,
+                    struct imgfs_file *imgfs_file);
+
+/**
+ * @brief Writes the next chunk of the content of an image started with do_insert_begin().
+ *
+ * @param insert The insertion state
+ * @param chunk Raw image content following the previous chunks
+ * @param chunk_size Size of the chunk
+ * @return Some error code. 0 if no error.
+ */
+int do_insert_write(struct imgfs_insert *insert, const char *chunk, size_t chunk_size);
+
+/**
+ * @brief Adds to the imgFS the image whose whole content was written with do_insert_write().
+ *
+ * If the content is a duplicate of an image already stored, the reserved region is given back
+ * and the new image refers to the existing content. On error, the insertion is aborted.
+ *
+ * @param insert The insertion state
+ * @return Some error code. 0 if no error.
+ */
+int do_insert_commit(struct imgfs_insert *insert);
+
+/**
+ * @brief Cancels an insertion started with do_insert_begin().
+ *
+ * @param insert The insertion state
+ */
+void do_insert_abort(struct imgfs_insert *insert);
+
+/**
+ * @brief Hashes the contents of the requests whose status is ERR_NONE, reads their resolutions and
+ * computes their placeholders, on up to INSERT_BATCH_THREADS threads. Needs no imgFS: may be called
+ * before its lock is taken.
+ *
+ * A request whose content is not a valid image gets the error in its status.
+ *
+ * @return Some error code. 0 if no error (even if some requests failed).
+ */
+int do_insert_batch_prepare(struct imgfs_insert_request *requests, size_t nb);
+
+/**
+ * @brief Inserts the prepared requests (see do_insert_batch_prepare()) whose status is ERR_NONE.
+ *
+ * All the new contents are appended with one write, then all the metadata entries and the header
+ * with another, each write being synced to disk. Duplicate contents (among the requests too) are
+ * stored once. A request that cannot be inserted gets the error in its status (ERR_DUPLICATE_ID,
+ * ERR_IMGFS_FULL, ...), as do_insert() would return it; the others are inserted in order, each
+ * incrementing the version of the imgFS.
+ *
+ * @return Some error code. 0 if no error (even if some requests failed), ERR_IO if the writes failed,
+ *         in which case none of the requests is inserted.
+ */
+int do_insert_batch(struct imgfs_insert_request *requests, size_t nb, struct imgfs_file *imgfs_file);
+
 /**
  * @brief Removes the deleted images by moving the existing ones
  *
@@ -1,6 +1,8 @@
 #include "imgfs.h"
+#include "imgfs_journal.h" // for imgfs_journal_recover()
 #include <string.h> // for strncpy
 #include <stdlib.h> // for calloc
+#include <unistd.h> // for ftruncate
 
 /**
  * @brief Helper function to safely free pointers.
@@ -33,8 +35,16 @@ int do_create(const char *imgfs_filename, struct imgfs_file *imgfs_file)
     imgfs_file->header.name[sizeof(imgfs_file->header.name) - 1] = '\0';
     imgfs_file->header.version = 0;
     imgfs_file->header.nb_files = 0; // no files yet
-    imgfs_file->header.unused_32 = 0;
-    imgfs_file->header.unused_64 = 0;
+    imgfs_file->header.last_extent = 0;
+    imgfs_file->header.checksum = imgfs_header_checksum(&imgfs_file->header);
+    imgfs_file->ext = NULL;
+    imgfs_file->segments = NULL;
+    imgfs_file->nb_segments = 0;
+    imgfs_file->journal = NULL;
+    imgfs_file->durability = DURABILITY_STRICT;
+    imgfs_file->sync_interval = 0;
+    imgfs_file->flusher = NULL;
+    imgfs_file->nb_quarantined = 0;
 
     // Initializing all bytes of metadata to 0
     imgfs_file->metadata = calloc(imgfs_file->header.max_files, sizeof(struct img_metadata));
@@ -43,17 +53,32 @@ int do_create(const char *imgfs_filename, struct imgfs_file *imgfs_file)
         return ERR_OUT_OF_MEMORY;
     }
 
+    // No extension file until some image needs it (nor the one of a former imgFS of the same name)
+    const int ret_ext = imgfs_ext_open(imgfs_filename, "wb", imgfs_file);
+    if (ret_ext != ERR_NONE) {
+        do_close(imgfs_file);
+        return ret_ext;
+    }
+
+    // Nor the journal of a former one, whose changes must not be made to this one
+    const int ret_journal = imgfs_journal_recover(imgfs_filename, "wb", imgfs_file);
+    if (ret_journal != ERR_NONE) {
+        do_close(imgfs_file);
+        return ret_journal;
+    }
+
     // Handling writing errors in the header
     if (fwrite(&(imgfs_file->header), sizeof(struct imgfs_header), 1, imgfs_file->file) != 1) {
         safe_free(imgfs_file->metadata);
         do_close(imgfs_file);
         return ERR_IO;
     }
-    // Handling write errors in the metadata
-    if (fwrite(imgfs_file->metadata,
-               sizeof(struct img_metadata),
-               imgfs_file->header.max_files,
-               imgfs_file->file) != imgfs_file->header.max_files) {
+    // The metadata, all empty, are left as a hole of the file (see do_open()): creating an imgFS
+    // takes the same time whatever its max_files
+    const off_t end = (off_t) sizeof(struct imgfs_header) +
+                      (off_t) imgfs_file->header.max_files * (off_t) sizeof(struct img_metadata);
+    if (fflush(imgfs_file->file) != 0 || ftruncate(fileno(imgfs_file->file), end) != 0 ||
+        fseek(imgfs_file->file, (long) end, SEEK_SET) != 0) {
 
         safe_free(imgfs_file->metadata);
         do_close(imgfs_file);
@@ -1,4 +1,5 @@
 #include "imgfs.h"
+#include "imgfs_durability.h" // for imgfs_sync()
 #include <string.h> // for strncmp
 
 
@@ -33,25 +34,19 @@ int do_delete(const char *img_id, struct imgfs_file *imgfs_file)
         return ERR_IMAGE_NOT_FOUND;
     }
 
-    //Writing updated metadata to disk
-    fseek(imgfs_file->file, (long)(sizeof(struct imgfs_header) + sizeof(struct img_metadata) * idx), SEEK_SET);
-    if (fwrite(&imgfs_file->metadata[idx], sizeof(struct img_metadata), 1, imgfs_file->file) != 1) {
-        return ERR_IO;
-    }
-
     //Updating header information
     imgfs_file->header.nb_files--;
     imgfs_file->header.version++;
 
-    //Writing updated header to disk
-    fseek(imgfs_file->file, 0, SEEK_SET);
-    if (fwrite(&imgfs_file->header, sizeof(struct imgfs_header), 1, imgfs_file->file) != 1) {
+    //Writing updated metadata and header to disk (or to the journal), or else keeping the image
+    if (imgfs_write_entries(imgfs_file, &idx, 1) != ERR_NONE) {
+        imgfs_file->metadata[idx].is_valid = NON_EMPTY;
+        imgfs_file->header.nb_files++;
+        imgfs_file->header.version--;
         return ERR_IO;
     }
 
-    //Recommended to insure metadata to disk without delay
-    fflush(imgfs_file->file);
-
-    return ERR_NONE;
+    //Making the deletion durable, as the durability mode of the imgFS says
+    return imgfs_sync(imgfs_file);
 
 }
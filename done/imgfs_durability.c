@@ -0,0 +1,211 @@
+#include "imgfs_durability.h"
+#include "imgfs_journal.h" // for imgfs_journal_sync()
+#include "error.h"
+
+#include <errno.h>  // for ETIMEDOUT
+#include <stdlib.h> // for strtoul, malloc
+#include <string.h> // for strcmp, strncmp
+#include <time.h>   // for clock_gettime
+#include <unistd.h> // for fdatasync
+
+#define INTERVAL_PREFIX "interval:"
+
+int imgfs_durability_parse(const char *option, enum imgfs_durability *durability, uint32_t *sync_interval)
+{
+    M_REQUIRE_NON_NULL(option);
+    M_REQUIRE_NON_NULL(durability);
+    M_REQUIRE_NON_NULL(sync_interval);
+
+    if (strcmp(option, "strict") == 0) {
+        *durability = DURABILITY_STRICT;
+        *sync_interval = 0;
+        return ERR_NONE;
+    }
+    if (strcmp(option, "none") == 0) {
+        *durability = DURABILITY_NONE;
+        *sync_interval = 0;
+        return ERR_NONE;
+    }
+    if (strncmp(option, INTERVAL_PREFIX, strlen(INTERVAL_PREFIX)) != 0) {
+        return ERR_INVALID_ARGUMENT;
+    }
+
+    const char *const ms = option + strlen(INTERVAL_PREFIX);
+    char *end = NULL;
+    errno = 0;
+    const unsigned long interval = strtoul(ms, &end, 10);
+    if (ms[0] < '0' || ms[0] > '9' || *end != '\0' || errno != 0 || interval == 0 || interval > UINT32_MAX) {
+        return ERR_INVALID_ARGUMENT;
+    }
+    *durability = DURABILITY_INTERVAL;
+    *sync_interval = (uint32_t) interval;
+    return ERR_NONE;
+}
+
+/**
+ * @brief Syncs the changes made so far: the records of the journal (with the contents they refer
+ * to), or else the whole imgFS file.
+ *
+ * @return 1 if synced, 0 otherwise
+ */
+static int flusher_sync(struct imgfs_flusher *flusher)
+{
+    if (flusher->journal != NULL) {
+        return imgfs_journal_sync(flusher->journal, imgfs_journal_sequence(flusher->journal)) == ERR_NONE;
+    }
+    return fdatasync(flusher->fd) == 0;
+}
+
+static void *flusher_run(void *arg)
+{
+    struct imgfs_flusher *const flusher = arg;
+
+    pthread_mutex_lock(&flusher->mutex);
+    for (;;) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += flusher->interval / 1000;
+        deadline.tv_nsec += (long) (flusher->interval % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (!flusher->stop &&
+               pthread_cond_timedwait(&flusher->cond, &flusher->mutex, &deadline) != ETIMEDOUT);
+
+        // The changes made meanwhile are synced without blocking those made while syncing
+        if (flusher->dirty) {
+            flusher->dirty = 0;
+            pthread_mutex_unlock(&flusher->mutex);
+            const int synced = flusher_sync(flusher);
+            pthread_mutex_lock(&flusher->mutex);
+            if (!synced) {
+                flusher->dirty = 1;
+                flusher->error = 1;
+            }
+        }
+        if (flusher->stop) break;
+    }
+    pthread_mutex_unlock(&flusher->mutex);
+    return NULL;
+}
+
+int imgfs_set_durability(struct imgfs_file *imgfs_file, enum imgfs_durability durability,
+                         uint32_t sync_interval)
+{
+    M_REQUIRE_NON_NULL(imgfs_file);
+    M_REQUIRE_NON_NULL(imgfs_file->file);
+    if (durability == DURABILITY_INTERVAL && sync_interval == 0) {
+        return ERR_INVALID_ARGUMENT;
+    }
+
+    // The changes made so far are synced by the former flusher, if any
+    imgfs_durability_stop(imgfs_file);
+    imgfs_file->durability = durability;
+    imgfs_file->sync_interval = durability == DURABILITY_INTERVAL ? sync_interval : 0;
+    if (durability != DURABILITY_INTERVAL) return ERR_NONE;
+
+    struct imgfs_flusher *const flusher = calloc(1, sizeof(*flusher));
+    if (flusher == NULL) {
+        imgfs_file->durability = DURABILITY_STRICT;
+        imgfs_file->sync_interval = 0;
+        return ERR_OUT_OF_MEMORY;
+    }
+    flusher->fd = fileno(imgfs_file->file);
+    flusher->journal = imgfs_file->journal;
+    flusher->interval = sync_interval;
+
+    if (pthread_mutex_init(&flusher->mutex, NULL) != 0) {
+        free(flusher);
+        imgfs_file->durability = DURABILITY_STRICT;
+        imgfs_file->sync_interval = 0;
+        return ERR_THREADING;
+    }
+    if (pthread_cond_init(&flusher->cond, NULL) != 0) {
+        pthread_mutex_destroy(&flusher->mutex);
+        free(flusher);
+        imgfs_file->durability = DURABILITY_STRICT;
+        imgfs_file->sync_interval = 0;
+        return ERR_THREADING;
+    }
+    if (pthread_create(&flusher->thread, NULL, flusher_run, flusher) != 0) {
+        pthread_cond_destroy(&flusher->cond);
+        pthread_mutex_destroy(&flusher->mutex);
+        free(flusher);
+        imgfs_file->durability = DURABILITY_STRICT;
+        imgfs_file->sync_interval = 0;
+        return ERR_THREADING;
+    }
+
+    imgfs_file->flusher = flusher;
+    return ERR_NONE;
+}
+
+int imgfs_sync_contents(struct imgfs_file *imgfs_file)
+{
+    M_REQUIRE_NON_NULL(imgfs_file);
+
+    if (fflush(imgfs_file->file) != 0) return ERR_IO;
+    // Journaled, the contents are synced before the records referring to them (see imgfs_journal_sync())
+    if (imgfs_file->durability == DURABILITY_STRICT && imgfs_file->journal == NULL &&
+        fdatasync(fileno(imgfs_file->file)) != 0) {
+        return ERR_IO;
+    }
+    return ERR_NONE;
+}
+
+int imgfs_sync(struct imgfs_file *imgfs_file)
+{
+    M_REQUIRE_NON_NULL(imgfs_file);
+
+    if (fflush(imgfs_file->file) != 0) return ERR_IO;
+
+    switch (imgfs_file->durability) {
+    case DURABILITY_STRICT:
+        // Journaled, the change is synced with the others made meanwhile (see imgfs_wait_durable())
+        if (imgfs_file->journal == NULL && fdatasync(fileno(imgfs_file->file)) != 0) {
+            return ERR_IO;
+        }
+        return ERR_NONE;
+
+    case DURABILITY_INTERVAL:
+        if (imgfs_file->flusher != NULL) {
+            pthread_mutex_lock(&imgfs_file->flusher->mutex);
+            imgfs_file->flusher->dirty = 1;
+            pthread_mutex_unlock(&imgfs_file->flusher->mutex);
+        }
+        return ERR_NONE;
+
+    default:
+        return ERR_NONE;
+    }
+}
+
+int imgfs_wait_durable(struct imgfs_file *imgfs_file, uint64_t sequence)
+{
+    M_REQUIRE_NON_NULL(imgfs_file);
+
+    if (imgfs_file->durability != DURABILITY_STRICT) return ERR_NONE;
+    return imgfs_journal_sync(imgfs_file->journal, sequence);
+}
+
+void imgfs_durability_stop(struct imgfs_file *imgfs_file)
+{
+    if (imgfs_file == NULL || imgfs_file->flusher == NULL) return;
+
+    struct imgfs_flusher *const flusher = imgfs_file->flusher;
+    pthread_mutex_lock(&flusher->mutex);
+    flusher->stop = 1;
+    pthread_cond_signal(&flusher->cond);
+    pthread_mutex_unlock(&flusher->mutex);
+    pthread_join(flusher->thread, NULL);
+
+    if (flusher->error) {
+        fprintf(stderr, "imgfs_durability_stop(): some changes could not be synced\n");
+    }
+    imgfs_file->flusher = NULL;
+
+    pthread_cond_destroy(&flusher->cond);
+    pthread_mutex_destroy(&flusher->mutex);
+    free(flusher);
+}
@@ -0,0 +1,83 @@
+/**
+ * @file imgfs_durability.h
+ * @brief When the changes made to an imgFS are synced to disk: its durability mode.
+ *
+ * DURABILITY_STRICT (the default) syncs each change before it is reported as made: the new contents
+ * first, then the entries referring to them. When the imgFS is journaled, the change is rather
+ * synced with the records of the journal (see imgfs_wait_durable()), once for all the changes made
+ * meanwhile. DURABILITY_INTERVAL leaves the changes to a background thread syncing them every
+ * sync_interval ms: a crash loses those of the last interval at most. DURABILITY_NONE leaves them
+ * to the system (and to do_close()), for bulk loads that can be redone.
+ *
+ * Only the imgFS file (and its journal) are synced: the extension file holds previews and variants
+ * that can be computed again.
+ */
+
+#pragma once
+
+#include "imgfs.h"
+
+#include <pthread.h> // for pthread_t
+#include <stdint.h>  // for uint32_t, uint64_t
+
+#define DURABILITY_OPTION "--durability=" // of imgfscmd and of the server
+
+struct imgfs_flusher {
+    pthread_t thread;
+    pthread_mutex_t mutex;        // for the fields below
+    pthread_cond_t cond;          // signaled to stop
+    int fd;                       // of the imgFS file
+    struct imgfs_journal *journal; // whose records are synced instead, if any
+    uint32_t interval;            // in ms
+    int dirty;                    // whether changes were made since the last sync
+    int stop;
+    int error;                    // whether a sync failed
+};
+
+/**
+ * @brief Reads the durability mode of option: "strict", "none" or "interval:<ms>" (ms > 0).
+ *
+ * @param sync_interval Where to write the ms of "interval:<ms>", 0 for the other modes
+ * @return Some error code. 0 if no error.
+ */
+int imgfs_durability_parse(const char *option, enum imgfs_durability *durability, uint32_t *sync_interval);
+
+/**
+ * @brief Sets the durability mode of imgfs_file, opened for writing, starting the thread syncing its
+ * changes for DURABILITY_INTERVAL. The journal of imgfs_file, if any, must be started before.
+ *
+ * @return Some error code. 0 if no error.
+ */
+int imgfs_set_durability(struct imgfs_file *imgfs_file, enum imgfs_durability durability,
+                         uint32_t sync_interval);
+
+/**
+ * @brief Makes the contents just written to imgfs_file durable before the entries referring to them
+ * are written: synced in DURABILITY_STRICT (unless journaled), only flushed otherwise.
+ *
+ * @return Some error code. 0 if no error.
+ */
+int imgfs_sync_contents(struct imgfs_file *imgfs_file);
+
+/**
+ * @brief Makes the change just made to imgfs_file durable as its durability mode says. Called by
+ * do_insert(), do_delete(), lazily_resize() and co. once they have written the change.
+ *
+ * @return Some error code. 0 if no error.
+ */
+int imgfs_sync(struct imgfs_file *imgfs_file);
+
+/**
+ * @brief Waits for the changes of the journaled imgfs_file up to sequence (see imgfs_journal_sequence())
+ * to be synced, in DURABILITY_STRICT; the other modes do not wait. Like imgfs_journal_sync(), does not
+ * need the imgFS to be locked.
+ *
+ * @return Some error code. 0 if no error.
+ */
+int imgfs_wait_durable(struct imgfs_file *imgfs_file, uint64_t sequence);
+
+/**
+ * @brief Stops the thread syncing the changes of imgfs_file, if any, syncing those it had not.
+ * Called by do_close().
+ */
+void imgfs_durability_stop(struct imgfs_file *imgfs_file);
@@ -0,0 +1,104 @@
+#include "imgfs.h"
+#include "imgfs_durability.h" // for imgfs_sync()
+#include "imgfs_journal.h" // for imgfs_journal_checkpoint()
+#include <string.h> // for memset
+#include <stdlib.h> // for realloc
+#include <unistd.h> // for ftruncate, pwrite, fdatasync
+
+int do_grow(struct imgfs_file *imgfs_file, uint32_t max_files)
+{
+    //Arguments validity check
+    M_REQUIRE_NON_NULL(imgfs_file);
+    M_REQUIRE_NON_NULL(imgfs_file->metadata);
+
+    //File validity check
+    if (imgfs_file->file == NULL) {
+        return ERR_IO;
+    }
+    if (max_files <= imgfs_file->header.max_files) {
+        return ERR_MAX_FILES;
+    }
+    const uint32_t nb_entries = max_files - imgfs_file->header.max_files;
+
+    // The journaled changes are those of entries of the imgFS as it is
+    const int ret = imgfs_journal_checkpoint(imgfs_file);
+    if (ret != ERR_NONE) {
+        return ret;
+    }
+
+    // Room for the new entries (empty) and for their segment, the first one included if it is not yet
+    struct img_metadata *const metadata = realloc(imgfs_file->metadata, max_files * sizeof(struct img_metadata));
+    if (metadata == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    imgfs_file->metadata = metadata;
+    memset(&metadata[imgfs_file->header.max_files], 0, nb_entries * sizeof(struct img_metadata));
+
+    const uint32_t nb_segments = imgfs_file->segments != NULL ? imgfs_file->nb_segments : 1;
+    struct imgfs_segment *const segments = realloc(imgfs_file->segments,
+                                                   (nb_segments + 1) * sizeof(struct imgfs_segment));
+    if (segments == NULL) {
+        return ERR_OUT_OF_MEMORY;
+    }
+    if (imgfs_file->segments == NULL) {
+        segments[0] = (struct imgfs_segment) {
+            sizeof(struct imgfs_header), 0, imgfs_file->header.max_files
+        };
+    }
+    imgfs_file->segments = segments;
+    imgfs_file->nb_segments = nb_segments;
+
+    // The extent goes at the end of the file, its entries being a hole of the file as those of do_create()
+    if (fflush(imgfs_file->file) != 0 || fseek(imgfs_file->file, 0, SEEK_END) != 0) {
+        return ERR_IO;
+    }
+    const long end_offset = ftell(imgfs_file->file);
+    if (end_offset < 0) {
+        return ERR_IO;
+    }
+    const struct imgfs_extent extent = { imgfs_file->header.last_extent, nb_entries, 0 };
+    const int fd = fileno(imgfs_file->file);
+    const off_t extent_end = (off_t) end_offset + (off_t) sizeof(extent) +
+                             (off_t) nb_entries * (off_t) sizeof(struct img_metadata);
+    if (pwrite(fd, &extent, sizeof(extent), (off_t) end_offset) != (ssize_t) sizeof(extent) ||
+        ftruncate(fd, extent_end) != 0) {
+        return ERR_IO;
+    }
+    // The extent is on disk before the header referring to it, which would make the imgFS unreadable otherwise
+    // (unless the durability mode leaves the order of the writes to the system)
+    if (imgfs_file->durability != DURABILITY_NONE && fdatasync(fd) != 0) {
+        return ERR_IO;
+    }
+
+    // Writing the header makes the imgFS grow: until then, the extent is not referred to
+    const struct imgfs_header header = imgfs_file->header;
+    imgfs_file->header.max_files = max_files;
+    imgfs_file->header.last_extent = (uint64_t) end_offset;
+    imgfs_seal(imgfs_file, NULL, 0);
+    if (fseek(imgfs_file->file, 0, SEEK_SET) != 0 ||
+        fwrite(&imgfs_file->header, sizeof(struct imgfs_header), 1, imgfs_file->file) != 1 ||
+        fflush(imgfs_file->file) != 0) {
+        imgfs_file->header = header;
+        return ERR_IO;
+    }
+    segments[imgfs_file->nb_segments++] = (struct imgfs_segment) {
+        (uint64_t) end_offset + sizeof(extent), header.max_files, nb_entries
+    };
+
+    // Synced as the durability mode says. Written in place, the header is not among the records of the
+    // journal, if any, that imgfs_sync() leaves to imgfs_wait_durable() and to the flusher: it is synced here
+    if (imgfs_file->journal != NULL && imgfs_file->durability != DURABILITY_NONE && fdatasync(fd) != 0) {
+        return ERR_IO;
+    }
+    const int synced = imgfs_sync(imgfs_file);
+    if (synced != ERR_NONE) {
+        return synced;
+    }
+
+    // The extension file follows. The imgFS grew whether it does or not: one that does not is left
+    // aside, its previews and variants being computed again
+    if (imgfs_ext_grow(imgfs_file) != ERR_NONE) {
+        fprintf(stderr, "do_grow(): the extension file is left aside\n");
+    }
+    return ERR_NONE;
+}
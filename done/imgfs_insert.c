@@ -1,9 +1,73 @@
 #include "imgfs.h"
+#include <pthread.h>
+#include <stdlib.h> // for calloc
 #include <string.h> // for strncpy
+#include <sys/uio.h> // for pwritev
+#include <unistd.h> // for ftruncate
 #include "image_dedup.h" // for do_name_and_content_dedup()
-#include "image_content.h" // for get_resolution()
+#include "imgfs_journal.h" // for imgfs_journal_append()
+#include "imgfs_durability.h" // for imgfs_sync()
+#include "image_content.h" // for get_resolution(), image_placeholder()
+#include "util.h" // for MIN()
 
 
+/**
+ * @brief Returns the index of the first empty entry of the metadata table, -1 if there is none
+ */
+static int find_free_index(const struct imgfs_file *imgfs_file)
+{
+    //Image full check
+    if(imgfs_file->header.nb_files >= imgfs_file->header.max_files) {
+        return -1;
+    }
+
+    for (int i = 0; i < imgfs_file->header.max_files; i++) {
+        if (imgfs_file->metadata[i].is_valid == EMPTY) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Validates the entry at free_idx, whose metadata is filled, and writes it to disk with the header
+ */
+static int write_new_entry(struct imgfs_file *imgfs_file, int free_idx)
+{
+    //Updating the validity of the new image
+    imgfs_file->metadata[free_idx].is_valid = NON_EMPTY;
+
+    //Updating all the necessary image database header fields.
+    imgfs_file->header.nb_files++;
+    imgfs_file->header.version++;
+
+
+    //Writing corresponding metadata (but not all of it) and header to disk, or to the journal
+    const uint32_t index = (uint32_t) free_idx;
+    return imgfs_write_entries(imgfs_file, &index, 1);
+}
+
+/**
+ * @brief Gives the image at index the details kept in the extension file (placeholder, variants
+ * in its resolutions) of another image with the same content, if one has them.
+ * Those being only previews and copies, failing to store them is not an error.
+ *
+ * @return 1 if the image now has a placeholder, 0 otherwise
+ */
+static int copy_extension(struct imgfs_file *imgfs_file, uint32_t index)
+{
+    const unsigned char *const SHA = imgfs_file->metadata[index].SHA;
+    for (uint32_t i = 0; i < imgfs_file->header.max_files; ++i) {
+        if (i == index || imgfs_file->metadata[i].is_valid == EMPTY ||
+            memcmp(imgfs_file->metadata[i].SHA, SHA, SHA256_DIGEST_LENGTH) != 0) continue;
+
+        if (imgfs_ext_copy(imgfs_file, index, i) == ERR_NONE) {
+            return imgfs_placeholder(imgfs_file, index) != NULL;
+        }
+    }
+    return 0;
+}
+
 int do_insert(const char *image_buffer, size_t image_size,
               const char *img_id, struct imgfs_file *imgfs_file)
 {
@@ -18,19 +82,8 @@ int do_insert(const char *image_buffer, size_t image_size,
         return ERR_INVALID_ARGUMENT;
     }
 
-    //Image full check
-    if(imgfs_file->header.nb_files >= imgfs_file->header.max_files) {
-        return ERR_IMGFS_FULL;
-    }
-
     //Find empty entry index in metadata table
-    int free_idx = -1;
-    for (int i = 0; i < imgfs_file->header.max_files; i++) {
-        if (imgfs_file->metadata[i].is_valid == EMPTY) {
-            free_idx = i;
-            break;
-        }
-    }
+    int free_idx = find_free_index(imgfs_file);
 
     if(free_idx == -1) return ERR_IMGFS_FULL;
 
@@ -79,33 +132,468 @@ int do_insert(const char *image_buffer, size_t image_size,
             imgfs_file->metadata[free_idx].size[resolution] = 0;
             imgfs_file->metadata[free_idx].offset[resolution] = 0;
         }
+
+        //The content must be on disk before the entry referring to it
+        if (imgfs_sync_contents(imgfs_file) != ERR_NONE) {
+            return ERR_IO;
+        }
     }
 
-    //Updating the validity of the new image
-    imgfs_file->metadata[free_idx].is_valid = NON_EMPTY;
+    int ret = write_new_entry(imgfs_file, free_idx);
 
-    //Updating all the necessary image database header fields.
-    imgfs_file->header.nb_files++;
-    imgfs_file->header.version++;
+    //Computing the placeholder only if the content is new
+    char placeholder[MAX_PLACEHOLDER + 1];
+    if (ret == ERR_NONE && !copy_extension(imgfs_file, (uint32_t) free_idx) &&
+        image_placeholder(image_buffer, image_size, placeholder) == ERR_NONE) {
+        (void) imgfs_set_placeholder(imgfs_file, (size_t) free_idx, placeholder);
+    }
+    return ret == ERR_NONE ? imgfs_sync(imgfs_file) : ret;
+}
 
+//======================================================================================================================
 
-    //Writing header to disk, and then corresponding metadata (but not all of it)
-    if (fseek(imgfs_file->file, 0, SEEK_SET) != 0) {
+/**
+ * @brief Looks for the images of the imgFS with the ID img_id or the content SHA (if not NULL).
+ *
+ * @param same_content Where to write the first image with that content, NULL if there is none
+ * @return ERR_DUPLICATE_ID if an image already has that ID, ERR_NONE otherwise
+ */
+static int find_duplicates(const char *img_id, const unsigned char *SHA, const struct imgfs_file *imgfs_file,
+                           const struct img_metadata **same_content)
+{
+    *same_content = NULL;
+    for (uint32_t i = 0; i < imgfs_file->header.max_files; ++i) {
+        const struct img_metadata *curr = &imgfs_file->metadata[i];
+        if (curr->is_valid == EMPTY) continue;
+
+        if (strncmp(curr->img_id, img_id, MAX_IMG_ID) == 0) {
+            return ERR_DUPLICATE_ID;
+        }
+        if (SHA != NULL && *same_content == NULL && memcmp(curr->SHA, SHA, SHA256_DIGEST_LENGTH) == 0) {
+            *same_content = curr;
+        }
+    }
+    return ERR_NONE;
+}
+
+int do_insert_preflight(const char *img_id, const unsigned char *SHA, struct imgfs_file *imgfs_file)
+{
+    //Arguments validity check
+    M_REQUIRE_NON_NULL(img_id);
+    M_REQUIRE_NON_NULL(imgfs_file);
+
+    int free_idx = find_free_index(imgfs_file);
+    if (free_idx == -1) return ERR_IMGFS_FULL;
+
+    const struct img_metadata *same_content = NULL;
+    const int ret_duplicate = find_duplicates(img_id, SHA, imgfs_file, &same_content);
+    if (ret_duplicate != ERR_NONE) {
+        return ret_duplicate;
+    }
+
+    if (same_content == NULL) {
+        return 0; // the content is needed
+    }
+
+    // Referring to the content already stored, as do_name_and_content_dedup() does
+    struct img_metadata *const metadata = &imgfs_file->metadata[free_idx];
+    *metadata = *same_content;
+    memset(metadata->img_id, 0, sizeof(metadata->img_id));
+    strncpy(metadata->img_id, img_id, MAX_IMG_ID);
+
+    int ret = write_new_entry(imgfs_file, free_idx);
+    if (ret == ERR_NONE) (void) copy_extension(imgfs_file, (uint32_t) free_idx);
+    if (ret == ERR_NONE) ret = imgfs_sync(imgfs_file);
+    return ret == ERR_NONE ? 1 : ret;
+}
+
+// SHA256_Init() and co. are deprecated by OpenSSL 3 but are what is needed to hash a content in pieces
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+int do_insert_begin(struct imgfs_insert *insert, const char *img_id, size_t image_size,
+                    struct imgfs_file *imgfs_file)
+{
+    //Arguments validity check
+    M_REQUIRE_NON_NULL(insert);
+    M_REQUIRE_NON_NULL(img_id);
+    M_REQUIRE_NON_NULL(imgfs_file);
+
+    //Image size and ID validity check
+    if (image_size == 0 || strlen(img_id) > MAX_IMG_ID) {
+        return ERR_INVALID_ARGUMENT;
+    }
+
+    //Refusing right away an image that could not be added anyway
+    if (find_free_index(imgfs_file) == -1) {
+        return ERR_IMGFS_FULL;
+    }
+
+    //Reserving the region at the end of the file, so that nothing else is appended there in the meantime
+    if (fflush(imgfs_file->file) != 0 || fseek(imgfs_file->file, 0, SEEK_END) != 0) {
         return ERR_IO;
     }
-    if(fwrite(&imgfs_file->header, sizeof(struct imgfs_header), 1, imgfs_file->file) != 1) {
+    const long end_offset = ftell(imgfs_file->file);
+    if (end_offset < 0 || ftruncate(fileno(imgfs_file->file), (off_t) ((size_t) end_offset + image_size)) != 0) {
         return ERR_IO;
     }
 
-    long metadata_offset = (long)(sizeof(struct imgfs_header) + free_idx * sizeof(struct img_metadata));
+    memset(insert, 0, sizeof(*insert));
+    insert->imgfs_file = imgfs_file;
+    strncpy(insert->img_id, img_id, MAX_IMG_ID);
+    insert->offset = (uint64_t) end_offset;
+    insert->size = image_size;
+    SHA256_Init(&insert->sha);
+    jpeg_probe_init(&insert->probe);
 
-    if (fseek(imgfs_file->file, metadata_offset, SEEK_SET) != 0) {
-        return ERR_IO;
+    return ERR_NONE;
+}
+
+int do_insert_write(struct imgfs_insert *insert, const char *chunk, size_t chunk_size)
+{
+    //Arguments validity check
+    M_REQUIRE_NON_NULL(insert);
+    M_REQUIRE_NON_NULL(insert->imgfs_file);
+    M_REQUIRE_NON_NULL(chunk);
+
+    if (chunk_size > insert->size - insert->written) {
+        return ERR_INVALID_ARGUMENT; // more content than announced
     }
 
-    if (fwrite(&imgfs_file->metadata[free_idx], sizeof(struct img_metadata), 1, imgfs_file->file) !=1) {
+    FILE *const file = insert->imgfs_file->file;
+    if (fseek(file, (long) (insert->offset + insert->written), SEEK_SET) != 0) {
         return ERR_IO;
     }
+    if (fwrite(chunk, 1, chunk_size, file) != chunk_size) {
+        return ERR_IO;
+    }
+
+    SHA256_Update(&insert->sha, chunk, chunk_size);
+    jpeg_probe_update(&insert->probe, chunk, chunk_size);
+    insert->written += chunk_size;
+
+    return ERR_NONE;
+}
+
+int do_insert_commit(struct imgfs_insert *insert)
+{
+    //Arguments validity check
+    M_REQUIRE_NON_NULL(insert);
+    M_REQUIRE_NON_NULL(insert->imgfs_file);
+
+    struct imgfs_file *const imgfs_file = insert->imgfs_file;
+
+    if (insert->written != insert->size) {
+        do_insert_abort(insert);
+        return ERR_INVALID_ARGUMENT; // content incomplete
+    }
+
+    //Find empty entry index in metadata table (the imgFS may have been filled in the meantime)
+    int free_idx = find_free_index(imgfs_file);
+    if (free_idx == -1) {
+        do_insert_abort(insert);
+        return ERR_IMGFS_FULL;
+    }
+
+    struct img_metadata *const metadata = &imgfs_file->metadata[free_idx];
+    memset(metadata, 0, sizeof(*metadata));
+    SHA256_Final(metadata->SHA, &insert->sha);
+    strncpy(metadata->img_id, insert->img_id, MAX_IMG_ID);
+    metadata->size[ORIG_RES] = (uint32_t) insert->size;
+
+    //Height and width as found in the content while it was received
+    int ret = jpeg_probe_resolution(&insert->probe, &metadata->orig_res[1], &metadata->orig_res[0]);
+
+    // Removing duplicates
+    if (ret == ERR_NONE) {
+        ret = do_name_and_content_dedup(imgfs_file, (uint32_t) free_idx);
+    }
+    if (ret != ERR_NONE) {
+        memset(metadata, 0, sizeof(*metadata));
+        do_insert_abort(insert);
+        return ret;
+    }
+
+    if (metadata->offset[ORIG_RES] == 0) {
+        //No duplicate: the content stays where it was written, to be on disk before the entry
+        metadata->offset[ORIG_RES] = insert->offset;
+        if (imgfs_sync_contents(imgfs_file) != ERR_NONE) {
+            memset(metadata, 0, sizeof(*metadata));
+            do_insert_abort(insert);
+            return ERR_IO;
+        }
+    } else {
+        //Duplicate content: the new image refers to the existing one, the reserved region is not needed
+        do_insert_abort(insert);
+    }
+
+    //A new content gets its placeholder with its thumbnail (see lazily_resize())
+    ret = write_new_entry(imgfs_file, free_idx);
+    if (ret == ERR_NONE) (void) copy_extension(imgfs_file, (uint32_t) free_idx);
+    insert->imgfs_file = NULL;
+    return ret == ERR_NONE ? imgfs_sync(imgfs_file) : ret;
+}
+
+#pragma GCC diagnostic pop
+
+void do_insert_abort(struct imgfs_insert *insert)
+{
+    if (insert == NULL || insert->imgfs_file == NULL) return;
 
+    FILE *const file = insert->imgfs_file->file;
+    insert->imgfs_file = NULL;
+
+    //The region can only be given back if nothing was appended after it (it is garbage otherwise, as deleted images)
+    if (fflush(file) != 0 || fseek(file, 0, SEEK_END) != 0) return;
+    const long end_offset = ftell(file);
+    if (end_offset >= 0 && (uint64_t) end_offset == insert->offset + insert->size) {
+        if (ftruncate(fileno(file), (off_t) insert->offset) != 0) {
+            perror("do_insert_abort(): ftruncate() failed");
+        }
+    }
+}
+
+//======================================================================================================================
+
+/**
+ * @brief The requests prepared by one thread: first, first + step, first + 2 * step, ...
+ */
+struct prepare_job {
+    struct imgfs_insert_request *requests;
+    size_t nb;
+    size_t first;
+    size_t step;
+};
+
+static void *prepare_requests(void *arg)
+{
+    const struct prepare_job *job = arg;
+    for (size_t i = job->first; i < job->nb; i += job->step) {
+        struct imgfs_insert_request *request = &job->requests[i];
+        if (request->status != ERR_NONE) continue;
+        if (request->data == NULL || request->size == 0) {
+            request->status = ERR_INVALID_ARGUMENT;
+            continue;
+        }
+        SHA256((const unsigned char *) request->data, request->size, request->SHA);
+        request->status = get_resolution(&request->orig_res[1], &request->orig_res[0],
+                                         request->data, request->size);
+        if (request->status != ERR_NONE ||
+            image_placeholder(request->data, request->size, request->placeholder) != ERR_NONE) {
+            request->placeholder[0] = '\0';
+        }
+    }
+    return NULL;
+}
+
+int do_insert_batch_prepare(struct imgfs_insert_request *requests, size_t nb)
+{
+    //Arguments validity check
+    M_REQUIRE_NON_NULL(requests);
+
+    const long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const size_t nb_threads = MIN(nb, MIN((size_t) INSERT_BATCH_THREADS, nb_cpus > 0 ? (size_t) nb_cpus : 1));
+    if (nb_threads == 0) return ERR_NONE;
+
+    pthread_t threads[INSERT_BATCH_THREADS];
+    int started[INSERT_BATCH_THREADS] = {0};
+    struct prepare_job jobs[INSERT_BATCH_THREADS];
+    for (size_t t = 0; t < nb_threads; ++t) {
+        jobs[t] = (struct prepare_job) { requests, nb, t, nb_threads };
+    }
+
+    //This thread prepares the first share itself, and any share no thread could be started for
+    for (size_t t = 1; t < nb_threads; ++t) {
+        started[t] = pthread_create(&threads[t], NULL, prepare_requests, &jobs[t]) == 0;
+    }
+    prepare_requests(&jobs[0]);
+    for (size_t t = 1; t < nb_threads; ++t) {
+        if (started[t]) {
+            pthread_join(threads[t], NULL);
+        } else {
+            prepare_requests(&jobs[t]);
+        }
+    }
     return ERR_NONE;
 }
+
+/**
+ * @brief Writes the count buffers of iov to fd from offset on, however many calls it takes.
+ */
+static int pwritev_all(int fd, struct iovec *iov, int count, off_t offset)
+{
+    while (count > 0) {
+        ssize_t written = pwritev(fd, iov, count, offset);
+        if (written < 0) return ERR_IO;
+        offset += written;
+
+        //Skipping what was written, which may end in the middle of a buffer
+        while (count > 0 && (size_t) written >= iov->iov_len) {
+            written -= (ssize_t) iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= (size_t) written;
+        }
+    }
+    return ERR_NONE;
+}
+
+/**
+ * @brief Writes the new contents at end_offset, then the metadata entries first to last and the header,
+ * the contents being made durable before the entries referring to them (see imgfs_sync_contents()).
+ */
+static int write_batch(struct imgfs_file *imgfs_file, struct iovec *contents, int nb_contents, long end_offset,
+                       uint32_t first, uint32_t last)
+{
+    const int fd = fileno(imgfs_file->file);
+    if (nb_contents > 0 &&
+        (pwritev_all(fd, contents, nb_contents, (off_t) end_offset) != ERR_NONE ||
+         imgfs_sync_contents(imgfs_file) != ERR_NONE)) {
+        return ERR_IO;
+    }
+
+    //All the entries first to last are written: checksummed with the header
+    for (uint32_t index = first; index <= last; ++index) {
+        imgfs_seal(imgfs_file, &index, 1);
+    }
+
+    //The entries run by run (those of an imgFS grown since its creation being in several extents), then
+    //the header: the header and the metadata table being contiguous on disk, at once if first is 0
+    struct iovec table[2] = { { &imgfs_file->header, sizeof(struct imgfs_header) }, { NULL, 0 } };
+    int ret = ERR_NONE;
+    for (uint32_t index = first; index <= last && ret == ERR_NONE; ) {
+        size_t nb_contiguous = 0;
+        const long offset = imgfs_metadata_offset(imgfs_file, index, &nb_contiguous);
+        const uint32_t nb_entries = (uint32_t) MIN((size_t) (last - index + 1), nb_contiguous);
+        struct iovec run = { &imgfs_file->metadata[index], nb_entries * sizeof(struct img_metadata) };
+        if (offset < 0) {
+            ret = ERR_IO;
+        } else if (index == 0) {
+            table[1] = run;
+        } else {
+            ret = pwritev_all(fd, &run, 1, (off_t) offset);
+        }
+        index += nb_entries;
+    }
+    if (ret == ERR_NONE) ret = pwritev_all(fd, table, table[1].iov_base != NULL ? 2 : 1, 0);
+    return ret;
+}
+
+int do_insert_batch(struct imgfs_insert_request *requests, size_t nb, struct imgfs_file *imgfs_file)
+{
+    //Arguments validity check
+    M_REQUIRE_NON_NULL(requests);
+    M_REQUIRE_NON_NULL(imgfs_file);
+
+    uint32_t *indexes = calloc(nb + 1, sizeof(*indexes));
+    struct iovec *contents = calloc(nb + 1, sizeof(*contents));
+    if (indexes == NULL || contents == NULL) {
+        free(indexes);
+        free(contents);
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    //The new contents go at the end of the file
+    long end_offset = -1;
+    if (fflush(imgfs_file->file) == 0 && fseek(imgfs_file->file, 0, SEEK_END) == 0) {
+        end_offset = ftell(imgfs_file->file);
+    }
+    const struct imgfs_header header = imgfs_file->header;
+
+    //Filling the entries in memory, each one seen by the next ones as any image of the imgFS
+    uint64_t offset = (uint64_t) end_offset;
+    size_t nb_inserted = 0;
+    int nb_contents = 0;
+    uint32_t first = UINT32_MAX, last = 0;
+    for (size_t i = 0; i < nb && end_offset >= 0; ++i) {
+        struct imgfs_insert_request *const request = &requests[i];
+        if (request->status != ERR_NONE) continue;
+        if (request->img_id == NULL || request->img_id[0] == '\0' || strlen(request->img_id) > MAX_IMG_ID) {
+            request->status = ERR_INVALID_IMGID;
+            continue;
+        }
+
+        const int free_idx = find_free_index(imgfs_file);
+        if (free_idx == -1) {
+            request->status = ERR_IMGFS_FULL;
+            continue;
+        }
+
+        const struct img_metadata *same_content = NULL;
+        request->status = find_duplicates(request->img_id, request->SHA, imgfs_file, &same_content);
+        if (request->status != ERR_NONE) continue;
+
+        struct img_metadata *const metadata = &imgfs_file->metadata[free_idx];
+        if (same_content != NULL) {
+            *metadata = *same_content;
+        } else {
+            memset(metadata, 0, sizeof(*metadata));
+            memcpy(metadata->SHA, request->SHA, SHA256_DIGEST_LENGTH);
+            metadata->orig_res[0] = request->orig_res[0];
+            metadata->orig_res[1] = request->orig_res[1];
+            metadata->size[ORIG_RES] = (uint32_t) request->size;
+            metadata->offset[ORIG_RES] = offset;
+            offset += request->size;
+            contents[nb_contents++] = (struct iovec) { (void *) (uintptr_t) request->data, request->size };
+        }
+        memset(metadata->img_id, 0, sizeof(metadata->img_id));
+        strncpy(metadata->img_id, request->img_id, MAX_IMG_ID);
+        metadata->is_valid = NON_EMPTY;
+
+        imgfs_file->header.nb_files++;
+        imgfs_file->header.version++;
+        indexes[nb_inserted++] = (uint32_t) free_idx;
+        first = MIN(first, (uint32_t) free_idx);
+        last = MAX(last, (uint32_t) free_idx);
+    }
+
+    int ret = end_offset < 0 ? ERR_IO : ERR_NONE;
+    if (ret == ERR_NONE && nb_inserted > 0 && imgfs_file->journal != NULL) {
+        //The contents are synced with the records of the entries (see imgfs_journal_sync())
+        if (nb_contents > 0) {
+            ret = pwritev_all(fileno(imgfs_file->file), contents, nb_contents, (off_t) end_offset);
+        }
+        if (ret == ERR_NONE) ret = imgfs_journal_append(imgfs_file, indexes, nb_inserted);
+    } else if (ret == ERR_NONE && nb_inserted > 0) {
+        ret = write_batch(imgfs_file, contents, nb_contents, end_offset, first, last);
+    }
+    if (ret == ERR_NONE && nb_inserted > 0) ret = imgfs_sync(imgfs_file);
+
+    if (ret != ERR_NONE) {
+        //None of the requests is inserted: back to the imgFS as it was
+        imgfs_file->header = header;
+        for (size_t i = 0; i < nb_inserted; ++i) {
+            memset(&imgfs_file->metadata[indexes[i]], 0, sizeof(struct img_metadata));
+        }
+        for (size_t i = 0; i < nb; ++i) {
+            if (requests[i].status == ERR_NONE) requests[i].status = ERR_IO;
+        }
+        //Entries and header may be written already: so are they as they were, before the contents
+        //they refer to are cut off
+        if (end_offset >= 0 && nb_inserted > 0 && imgfs_file->journal == NULL &&
+            (imgfs_write_in_place(imgfs_file, indexes, nb_inserted) != ERR_NONE ||
+             imgfs_sync_contents(imgfs_file) != ERR_NONE)) {
+            fprintf(stderr, "do_insert_batch(): the entries could not be written back\n");
+        }
+        if (end_offset >= 0 && ftruncate(fileno(imgfs_file->file), (off_t) end_offset) != 0) {
+            perror("do_insert_batch(): ftruncate() failed");
+        }
+    } else {
+        //The inserted requests are those still ERR_NONE, in the order of indexes
+        size_t k = 0;
+        for (size_t i = 0; i < nb && k < nb_inserted; ++i) {
+            if (requests[i].status != ERR_NONE) continue;
+            const uint32_t index = indexes[k++];
+            if (!copy_extension(imgfs_file, index) && requests[i].placeholder[0] != '\0') {
+                (void) imgfs_set_placeholder(imgfs_file, index, requests[i].placeholder);
+            }
+        }
+    }
+
+    free(indexes);
+    free(contents);
+    return ret;
+}
@@ -0,0 +1,331 @@
+#include "imgfs_journal.h"
+#include "crc32c.h"
+#include "error.h"
+
+#include <fcntl.h>  // for open
+#include <stddef.h> // for offsetof
+#include <stdlib.h> // for malloc, qsort
+#include <string.h> // for strcpy
+#include <unistd.h> // for fdatasync, ftruncate
+
+static char *journal_filename(const char *imgfs_filename)
+{
+    char *const filename = malloc(strlen(imgfs_filename) + sizeof(IMGFS_JOURNAL_SUFFIX));
+    if (filename != NULL) {
+        strcpy(filename, imgfs_filename);
+        strcat(filename, IMGFS_JOURNAL_SUFFIX);
+    }
+    return filename;
+}
+
+/**
+ * @brief Checksum (CRC32C, see crc32c.h) of the bytes of record but its checksum field.
+ */
+static uint32_t record_checksum(const struct imgfs_journal_record *record)
+{
+    const size_t before = offsetof(struct imgfs_journal_record, checksum);
+    const size_t after = before + sizeof(record->checksum);
+    return crc32c(crc32c(0, record, before), (const char *) record + after, sizeof(*record) - after);
+}
+
+/**
+ * @brief Whether record is a whole record of a change of the imgFS with header.
+ */
+static int record_valid(const struct imgfs_journal_record *record, const struct imgfs_header *header)
+{
+    return record->magic == IMGFS_JOURNAL_MAGIC && record->checksum == record_checksum(record) &&
+           record->header.max_files == header->max_files && record->index < header->max_files;
+}
+
+/**
+ * @brief Adds the nb indexes to the dirty ones of journal.
+ */
+static int add_dirty(struct imgfs_journal *journal, const uint32_t *indexes, size_t nb)
+{
+    if (journal->nb_dirty + nb > journal->max_dirty) {
+        const size_t max_dirty = journal->nb_dirty + nb > 2 * journal->max_dirty ?
+                                 journal->nb_dirty + nb : 2 * journal->max_dirty;
+        uint32_t *const dirty = realloc(journal->dirty, max_dirty * sizeof(*dirty));
+        if (dirty == NULL) return ERR_OUT_OF_MEMORY;
+        journal->dirty = dirty;
+        journal->max_dirty = max_dirty;
+    }
+    memcpy(&journal->dirty[journal->nb_dirty], indexes, nb * sizeof(*indexes));
+    journal->nb_dirty += nb;
+    return ERR_NONE;
+}
+
+static int compare_indexes(const void *a, const void *b)
+{
+    const uint32_t x = *(const uint32_t *) a;
+    const uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Writes the dirty entries of journal in place (in the order of the file, each one once)
+ * and syncs them to disk.
+ */
+static int write_dirty(struct imgfs_file *imgfs_file, struct imgfs_journal *journal)
+{
+    qsort(journal->dirty, journal->nb_dirty, sizeof(*journal->dirty), compare_indexes);
+    size_t nb = 0;
+    for (size_t i = 0; i < journal->nb_dirty; ++i) {
+        if (nb == 0 || journal->dirty[nb - 1] != journal->dirty[i]) journal->dirty[nb++] = journal->dirty[i];
+    }
+    journal->nb_dirty = nb;
+
+    const int ret = imgfs_write_in_place(imgfs_file, journal->dirty, nb);
+    if (ret != ERR_NONE) return ret;
+    return fflush(imgfs_file->file) == 0 && fdatasync(fileno(imgfs_file->file)) == 0 ? ERR_NONE : ERR_IO;
+}
+
+int imgfs_journal_recover(const char *imgfs_filename, const char *open_mode, struct imgfs_file *imgfs_file)
+{
+    M_REQUIRE_NON_NULL(imgfs_filename);
+    M_REQUIRE_NON_NULL(open_mode);
+    M_REQUIRE_NON_NULL(imgfs_file);
+
+    char *const filename = journal_filename(imgfs_filename);
+    if (filename == NULL) return ERR_OUT_OF_MEMORY;
+    if (open_mode[0] == 'w') {
+        remove(filename); // there may be none
+        free(filename);
+        return ERR_NONE;
+    }
+    FILE *const file = fopen(filename, "rb");
+    if (file == NULL) {
+        free(filename);
+        return ERR_NONE; // nothing to redo
+    }
+
+    // The records of a change are made once its last one is read: those of a change
+    // whose last record is missing (or torn) are not
+    struct imgfs_journal journal;
+    memset(&journal, 0, sizeof(journal));
+    struct imgfs_journal_record *pending = NULL;
+    size_t nb_pending = 0, max_pending = 0;
+    struct imgfs_journal_record record;
+    int ret = ERR_NONE;
+    while (ret == ERR_NONE && fread(&record, sizeof(record), 1, file) == 1 &&
+           record_valid(&record, &imgfs_file->header)) {
+        if (nb_pending == max_pending) {
+            max_pending = max_pending == 0 ? 16 : 2 * max_pending;
+            struct imgfs_journal_record *const more = realloc(pending, max_pending * sizeof(*pending));
+            if (more == NULL) {
+                ret = ERR_OUT_OF_MEMORY;
+                break;
+            }
+            pending = more;
+        }
+        pending[nb_pending++] = record;
+        if (!(record.flags & JOURNAL_COMMIT)) continue;
+
+        for (size_t i = 0; i < nb_pending && ret == ERR_NONE; ++i) {
+            imgfs_file->metadata[pending[i].index] = pending[i].metadata;
+            ret = add_dirty(&journal, &pending[i].index, 1);
+        }
+        imgfs_file->header = record.header;
+        nb_pending = 0;
+    }
+    fclose(file);
+    free(pending);
+
+    // Opened for writing, the changes are written in place, the journal being useless then
+    if (ret == ERR_NONE && strchr(open_mode, '+') != NULL) {
+        ret = write_dirty(imgfs_file, &journal);
+        if (ret == ERR_NONE) remove(filename);
+    }
+    free(journal.dirty);
+    free(filename);
+    return ret;
+}
+
+int imgfs_journal_start(const char *imgfs_filename, struct imgfs_file *imgfs_file)
+{
+    M_REQUIRE_NON_NULL(imgfs_filename);
+    M_REQUIRE_NON_NULL(imgfs_file);
+    if (imgfs_file->file == NULL) return ERR_IO;
+    if (imgfs_file->journal != NULL) return ERR_NONE;
+
+    struct imgfs_journal *const journal = calloc(1, sizeof(struct imgfs_journal));
+    char *const filename = journal_filename(imgfs_filename);
+    if (journal == NULL || filename == NULL) {
+        free(journal);
+        free(filename);
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    // do_open() made the changes of a former journal
+    journal->filename = filename;
+    journal->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (journal->fd < 0) {
+        free(filename);
+        free(journal);
+        return ERR_IO;
+    }
+    if (pthread_mutex_init(&journal->mutex, NULL) != 0) {
+        close(journal->fd);
+        free(filename);
+        free(journal);
+        return ERR_THREADING;
+    }
+    if (pthread_cond_init(&journal->synced_cond, NULL) != 0) {
+        pthread_mutex_destroy(&journal->mutex);
+        close(journal->fd);
+        free(filename);
+        free(journal);
+        return ERR_THREADING;
+    }
+    journal->imgfs_fd = fileno(imgfs_file->file);
+
+    imgfs_file->journal = journal;
+    return ERR_NONE;
+}
+
+int imgfs_journal_append(struct imgfs_file *imgfs_file, const uint32_t *indexes, size_t nb)
+{
+    M_REQUIRE_NON_NULL(imgfs_file);
+    M_REQUIRE_NON_NULL(imgfs_file->journal);
+    M_REQUIRE_NON_NULL(indexes);
+    if (nb == 0) return ERR_INVALID_ARGUMENT;
+
+    struct imgfs_journal *const journal = imgfs_file->journal;
+    if (journal->nb_dirty + nb > IMGFS_JOURNAL_CHECKPOINT) {
+        const int ret = imgfs_journal_checkpoint(imgfs_file);
+        if (ret != ERR_NONE) return ret;
+    }
+
+    // The entries and header are checksummed as if written in place
+    imgfs_seal(imgfs_file, indexes, nb);
+
+    // The contents the entries refer to must be in the file when the records are synced
+    struct imgfs_journal_record *const records = calloc(nb, sizeof(struct imgfs_journal_record));
+    if (records == NULL) return ERR_OUT_OF_MEMORY;
+    for (size_t i = 0; i < nb; ++i) {
+        records[i].magic = IMGFS_JOURNAL_MAGIC;
+        records[i].index = indexes[i];
+        records[i].flags = i + 1 == nb ? JOURNAL_COMMIT : 0;
+        records[i].header = imgfs_file->header;
+        records[i].metadata = imgfs_file->metadata[indexes[i]];
+        records[i].checksum = record_checksum(&records[i]);
+    }
+    const off_t end = lseek(journal->fd, 0, SEEK_END);
+    int ret = end < 0 || fflush(imgfs_file->file) != 0 ? ERR_IO : ERR_NONE;
+    const char *buffer = (const char *) records;
+    size_t left = nb * sizeof(struct imgfs_journal_record);
+    while (ret == ERR_NONE && left > 0) {
+        const ssize_t written = write(journal->fd, buffer, left);
+        if (written <= 0) {
+            ret = ERR_IO;
+        } else {
+            buffer += written;
+            left -= (size_t) written;
+        }
+    }
+    free(records);
+
+    if (ret == ERR_NONE) ret = add_dirty(journal, indexes, nb);
+    if (ret != ERR_NONE) {
+        // What may have been written of the change would hide the next ones from recovery
+        if (end >= 0 && ftruncate(journal->fd, end) != 0) {
+            perror("imgfs_journal_append(): ftruncate() failed");
+        }
+        return ret;
+    }
+
+    pthread_mutex_lock(&journal->mutex);
+    journal->appended += nb;
+    pthread_mutex_unlock(&journal->mutex);
+    return ERR_NONE;
+}
+
+uint64_t imgfs_journal_sequence(struct imgfs_journal *journal)
+{
+    if (journal == NULL) return 0;
+
+    pthread_mutex_lock(&journal->mutex);
+    const uint64_t sequence = journal->appended;
+    pthread_mutex_unlock(&journal->mutex);
+    return sequence;
+}
+
+int imgfs_journal_sync(struct imgfs_journal *journal, uint64_t sequence)
+{
+    if (journal == NULL) return ERR_NONE;
+
+    int ret = ERR_NONE;
+    pthread_mutex_lock(&journal->mutex);
+    while (journal->synced < sequence) {
+        if (journal->syncing) {
+            // The records may be synced by the thread syncing, or else by this one next
+            pthread_cond_wait(&journal->synced_cond, &journal->mutex);
+            continue;
+        }
+
+        // Syncing all the records appended so far, for the threads waiting for them too:
+        // the contents first, then the records referring to them
+        journal->syncing = 1;
+        const uint64_t appended = journal->appended;
+        pthread_mutex_unlock(&journal->mutex);
+        const int synced = fdatasync(journal->imgfs_fd) == 0 && fdatasync(journal->fd) == 0;
+        pthread_mutex_lock(&journal->mutex);
+
+        journal->syncing = 0;
+        if (synced && appended > journal->synced) journal->synced = appended;
+        pthread_cond_broadcast(&journal->synced_cond);
+        if (!synced) {
+            ret = ERR_IO;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&journal->mutex);
+    return ret;
+}
+
+int imgfs_journal_checkpoint(struct imgfs_file *imgfs_file)
+{
+    M_REQUIRE_NON_NULL(imgfs_file);
+    struct imgfs_journal *const journal = imgfs_file->journal;
+    if (journal == NULL) return ERR_NONE;
+
+    // The records first: until the journal is emptied, they can redo the entries written in place
+    int ret = imgfs_journal_sync(journal, imgfs_journal_sequence(journal));
+    if (ret != ERR_NONE || journal->nb_dirty == 0) return ret;
+
+    ret = write_dirty(imgfs_file, journal);
+    if (ret != ERR_NONE) return ret;
+
+    // No change is appended meanwhile (the imgFS is locked), but records may still be synced
+    pthread_mutex_lock(&journal->mutex);
+    while (journal->syncing) {
+        pthread_cond_wait(&journal->synced_cond, &journal->mutex);
+    }
+    if (ftruncate(journal->fd, 0) != 0) {
+        ret = ERR_IO;
+    } else {
+        journal->nb_dirty = 0;
+    }
+    pthread_mutex_unlock(&journal->mutex);
+    return ret;
+}
+
+void imgfs_journal_close(struct imgfs_file *imgfs_file)
+{
+    if (imgfs_file == NULL || imgfs_file->journal == NULL) return;
+
+    struct imgfs_journal *const journal = imgfs_file->journal;
+    if (imgfs_journal_checkpoint(imgfs_file) == ERR_NONE) {
+        remove(journal->filename);
+    } else {
+        fprintf(stderr, "imgfs_journal_close(): the changes are left in %s\n", journal->filename);
+    }
+    imgfs_file->journal = NULL;
+
+    close(journal->fd);
+    pthread_cond_destroy(&journal->synced_cond);
+    pthread_mutex_destroy(&journal->mutex);
+    free(journal->dirty);
+    free(journal->filename);
+    free(journal);
+}
@@ -0,0 +1,106 @@
+/**
+ * @file imgfs_journal.h
+ * @brief Write-ahead journal of the changes of the header and metadata of an imgFS, in a sidecar file.
+ *
+ * An insertion or a deletion changes some metadata entries and the header, which are in different
+ * places of the imgFS file: written in place, a crash in between leaves them inconsistent. Once an
+ * imgFS is journaled, its changes are rather appended to the journal, each entry changed as a record
+ * that also holds the header, the last record of a change being marked. A change is durable once
+ * its records are synced to disk: the records of all the changes waiting for it are synced at once
+ * (group commit), along with the contents they refer to.
+ *
+ * The changes are written in place at checkpoints, after which the journal is emptied. do_open()
+ * redoes those of a journal that was not (see imgfs_journal_recover()): the changes found entirely
+ * in the journal are made, the others are not.
+ */
+
+#pragma once
+
+#include "imgfs.h"
+
+#include <pthread.h> // for pthread_mutex_t
+#include <stdint.h>  // for uint32_t, uint64_t
+
+#define IMGFS_JOURNAL_SUFFIX ".wal"     // appended to the name of the imgFS file
+#define IMGFS_JOURNAL_MAGIC  0x4c415749 // "IWAL", in little endian
+#define IMGFS_JOURNAL_CHECKPOINT 4096   // records after which the journaled changes are written in place
+
+#define JOURNAL_COMMIT 1 // flag of the last record of a change
+
+/**
+ * @brief An entry changed (and the header once changed), as stored in the journal
+ */
+struct imgfs_journal_record {
+    uint32_t magic;               // IMGFS_JOURNAL_MAGIC
+    uint32_t index;               // of the entry in the metadata array
+    uint32_t flags;               // JOURNAL_COMMIT or 0
+    uint32_t checksum;            // CRC32C of the other bytes of the record
+    struct imgfs_header header;
+    struct img_metadata metadata;
+};
+
+struct imgfs_journal {
+    char *filename;
+    int fd;
+    int imgfs_fd;                 // of the imgFS file, whose contents are synced with the records
+    pthread_mutex_t mutex;        // for the fields below
+    pthread_cond_t synced_cond;
+    uint64_t appended;            // number of records appended since the journal was started
+    uint64_t synced;              // number of them synced to disk
+    int syncing;                  // whether a thread is syncing records (for the others waiting too)
+    uint32_t *dirty;              // indexes of the records appended since the last checkpoint
+    size_t nb_dirty;
+    size_t max_dirty;
+};
+
+/**
+ * @brief Redoes the changes of the journal of the imgFS imgfs_filename, if it has one, in the
+ * in-memory imgfs_file just read. With open_mode for writing, they are written in place too, and
+ * the journal removed; "w" makes a new imgFS, the journal of the former one is just removed.
+ * Called by do_open() and do_create().
+ *
+ * @return Some error code. 0 if no error.
+ */
+int imgfs_journal_recover(const char *imgfs_filename, const char *open_mode, struct imgfs_file *imgfs_file);
+
+/**
+ * @brief Journals the changes of imgfs_file, opened for writing, from now on (see imgfs_write_entries()).
+ *
+ * @return Some error code. 0 if no error.
+ */
+int imgfs_journal_start(const char *imgfs_filename, struct imgfs_file *imgfs_file);
+
+/**
+ * @brief Appends the nb entries at indexes of imgfs_file with its header to its journal, as one change.
+ * The journal is checkpointed first if it is long enough.
+ *
+ * @return Some error code. 0 if no error.
+ */
+int imgfs_journal_append(struct imgfs_file *imgfs_file, const uint32_t *indexes, size_t nb);
+
+/**
+ * @brief Number of records appended to the journal (0 if there is none): the changes made so far are
+ * durable once imgfs_journal_sync() of it returns.
+ */
+uint64_t imgfs_journal_sequence(struct imgfs_journal *journal);
+
+/**
+ * @brief Waits for the records up to sequence (see imgfs_journal_sequence()) to be synced to disk,
+ * syncing them (and those appended meanwhile) if no other thread is. Does not need the imgFS to be
+ * locked: changes may be appended meanwhile, to be synced with the next ones.
+ *
+ * @return Some error code. 0 if no error (or if there is no journal).
+ */
+int imgfs_journal_sync(struct imgfs_journal *journal, uint64_t sequence);
+
+/**
+ * @brief Writes the journaled changes of imgfs_file in place, and empties its journal.
+ *
+ * @return Some error code. 0 if no error (or if there is no journal).
+ */
+int imgfs_journal_checkpoint(struct imgfs_file *imgfs_file);
+
+/**
+ * @brief Checkpoints the journal of imgfs_file and stops journaling its changes. Called by do_close().
+ */
+void imgfs_journal_close(struct imgfs_file *imgfs_file);
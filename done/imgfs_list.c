@@ -2,11 +2,18 @@
 #include "util.h"   // for TO_BE_IMPLEMENTED()
 #include "error.h"  // for ERR_NONE
 #include "stdio.h"  // for print
-#include <json-c/json.h> // for JSON functions
+#include <stdlib.h> // for malloc
 #include <string.h>
+#include <inttypes.h> // for PRIu64
 
 
 int do_list(const struct imgfs_file *imgfs_file,enum do_list_mode output_mode, char **json)
+{
+    return do_list_fields(imgfs_file, output_mode, 0, json, NULL);
+}
+
+int do_list_fields(const struct imgfs_file *imgfs_file, enum do_list_mode output_mode,
+                   unsigned int fields, char **json, size_t *out_len)
 {
     //Argument validity check
     M_REQUIRE_NON_NULL(imgfs_file);
@@ -30,59 +37,581 @@ int do_list(const struct imgfs_file *imgfs_file,enum do_list_mode output_mode, c
 
         return ERR_NONE;
 
-    } else if (output_mode == JSON) {
+    } else if (output_mode == JSON || output_mode == JSON_BLOBS || output_mode == CBOR) {
 
         //=========================================WEEK 13==============================================================
+        M_REQUIRE_NON_NULL(json);
 
-        //create JSON object to hold array of image IDs
-        struct json_object *json_obj = json_object_new_object();
-        if (!json_obj) return ERR_RUNTIME;
+        // Same output as json-c gives for { "Images": [ ... ] }, written directly into a growing buffer
+        size_t capacity = 64 + (size_t) imgfs_file->header.nb_files * 16;
+        char *buffer = malloc(capacity);
+        if (buffer == NULL) return ERR_OUT_OF_MEMORY;
+        size_t len = do_list_head(output_mode, buffer, capacity);
 
-        struct json_object *json_arr = json_object_new_array();
+        struct imgfs_list_cursor cursor = { 0, SIZE_MAX, 0, fields };
+        static const size_t END_LEN = 5; // " ] }" and the null byte
+        int written;
+        while ((written = do_list_chunk(imgfs_file, output_mode, &cursor,
+                                        buffer + len, capacity - len - END_LEN)) != 0) {
+            if (written > 0) {
+                len += (size_t) written;
+                continue;
+            }
+            if (written != ERR_INVALID_ARGUMENT) {
+                free(buffer);
+                return written;
+            }
 
-        if (!json_arr) {
-            json_object_put(json_obj);
-            return ERR_RUNTIME;
+            // the next image does not fit
+            char *const bigger = realloc(buffer, 2 * capacity);
+            if (bigger == NULL) {
+                free(buffer);
+                return ERR_OUT_OF_MEMORY;
+            }
+            buffer = bigger;
+            capacity *= 2;
         }
 
-        //Iterating over metadata array and add each valid image ID to the JSON array
-        for (uint32_t i = 0; i < imgfs_file->header.max_files; i++) {
-            if (imgfs_file->metadata[i].is_valid == NON_EMPTY) {
-                struct json_object *json_str = json_object_new_string(imgfs_file->metadata[i].img_id);
-                if (!json_str) {
-                    json_object_put(json_arr);
-                    json_object_put(json_obj);
-                    return ERR_RUNTIME;
-                }
-                json_object_array_add(json_arr, json_str);
+        len += do_list_tail(output_mode, &cursor, 0, buffer + len, capacity - len);
+        buffer[len] = '\0';
+        *json = buffer;
+        if (out_len != NULL) *out_len = len;
+        return ERR_NONE;
+
+        // ============================================================================================================
+
+    } else {
+        //case where output mode is undefined
+        debug_printf("Unknown output mode: %d\n", output_mode);
+        return ERR_INVALID_ARGUMENT;
+    }
+}
+
+//======================================================================================================================
+
+// Characters json-c escapes in strings
+#define JSON_ESCAPED(c) ((c) < 0x20 || (c) == '"' || (c) == '\\' || (c) == '/')
+
+size_t json_string(const char *str, size_t max_len, char *out, size_t size)
+{
+    // Fast path: most IDs have nothing to escape
+    size_t plain = 0;
+    while (plain < max_len && str[plain] != '\0' && !JSON_ESCAPED((unsigned char) str[plain])) ++plain;
+    if (plain == max_len || str[plain] == '\0') {
+        if (plain + 2 <= size) {
+            out[0] = '"';
+            memcpy(out + 1, str, plain);
+            out[plain + 1] = '"';
+        }
+        return plain + 2;
+    }
+
+    char escaped[8];
+    size_t len = 0;
+
+#define JSON_PUT(c) do { if (len < size) out[len] = (c); ++len; } while (0)
+    JSON_PUT('"');
+    for (size_t i = 0; i < max_len && str[i] != '\0'; ++i) {
+        const unsigned char c = (unsigned char) str[i];
+        size_t escaped_len = 0;
+        switch (c) {
+        case '"': case '\\': case '/':
+            escaped[escaped_len++] = '\\';
+            escaped[escaped_len++] = (char) c;
+            break;
+        case '\b': escaped_len = 2; memcpy(escaped, "\\b", 2); break;
+        case '\f': escaped_len = 2; memcpy(escaped, "\\f", 2); break;
+        case '\n': escaped_len = 2; memcpy(escaped, "\\n", 2); break;
+        case '\r': escaped_len = 2; memcpy(escaped, "\\r", 2); break;
+        case '\t': escaped_len = 2; memcpy(escaped, "\\t", 2); break;
+        default:
+            if (c < 0x20) {
+                escaped_len = (size_t) snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            } else {
+                escaped[escaped_len++] = (char) c;
             }
         }
+        for (size_t j = 0; j < escaped_len; ++j) JSON_PUT(escaped[j]);
+    }
+    JSON_PUT('"');
+#undef JSON_PUT
+
+    return len;
+}
+
+static const struct {
+    const char *name;
+    unsigned int bit;
+} list_field_names[] = {
+    { "orig_res", LIST_ORIG_RES },
+    { "size",     LIST_SIZE },
+    { "sha",      LIST_SHA },
+    { "variants", LIST_VARIANTS },
+    { "placeholder", LIST_PLACEHOLDER }
+};
+#define NB_LIST_FIELDS (sizeof(list_field_names) / sizeof(list_field_names[0]))
 
-        // Add array to the JSON object
-        json_object_object_add(json_obj, "Images", json_arr);
+int list_fields_parse(const char *names, unsigned int *fields)
+{
+    M_REQUIRE_NON_NULL(names);
+    M_REQUIRE_NON_NULL(fields);
 
-        //convert JSON object to string
-        const char *json_str = json_object_to_json_string(json_obj);
-        if (!json_str) {
-            json_object_put(json_obj);
-            return ERR_RUNTIME;
+    *fields = 0;
+    while (*names != '\0') {
+        const size_t len = strcspn(names, ",");
+        size_t i = 0;
+        while (i < NB_LIST_FIELDS &&
+               (strlen(list_field_names[i].name) != len || strncmp(names, list_field_names[i].name, len) != 0)) {
+            ++i;
         }
+        if (i == NB_LIST_FIELDS) return ERR_INVALID_ARGUMENT;
+
+        *fields |= list_field_names[i].bit;
+        names += len + (names[len] == ',');
+    }
+    return ERR_NONE;
+}
+
+/**
+ * @brief Tells whether the image at index has a content in some resolution (it has one once resized).
+ */
+static int has_variant(const struct imgfs_file *imgfs_file, uint32_t index, int resolution)
+{
+    uint64_t offset = 0;
+    uint32_t size = 0;
+    return imgfs_variant(imgfs_file, index, resolution, &offset, &size) == ERR_NONE && offset != 0;
+}
 
-        // Allocate memory for JSON string and copy it
-        *json = strdup(json_str); // strdup cleaner than strcpy -> no need for another malloc
-        if (!*json) {
-            json_object_put(json_obj);
-            return ERR_RUNTIME;
+/**
+ * @brief Writes the element of the "Images" array for the image at index to out if it fits in size bytes:
+ * its ID alone, or an object with the URL of its content (JSON_BLOBS) and the details in fields
+ * (its placeholder and the variants of the resolutions of the extension file being kept apart
+ * from the metadata).
+ * @return The number of bytes needed.
+ */
+static size_t json_image(const struct imgfs_file *imgfs_file, uint32_t index, enum do_list_mode output_mode,
+                         unsigned int fields, char *out, size_t size)
+{
+    const struct img_metadata *const metadata = &imgfs_file->metadata[index];
+    if (output_mode != JSON_BLOBS && fields == 0) {
+        return json_string(metadata->img_id, MAX_IMG_ID, out, size);
+    }
+
+    const char *const placeholder = imgfs_placeholder(imgfs_file, index);
+    char text[sizeof(BLOB_URI) + 2 * SHA256_DIGEST_LENGTH + 64];
+    size_t len = 0;
+#define JSON_PUT_RAW(s) do { if (len + strlen(s) <= size) memcpy(out + len, s, strlen(s)); len += strlen(s); } while (0)
+#define JSON_PUT_STRING(s, max_len) \
+    len += json_string(s, max_len, out + (len < size ? len : size), len < size ? size - len : 0)
+
+    JSON_PUT_RAW("{ \"img_id\": ");
+    JSON_PUT_STRING(metadata->img_id, MAX_IMG_ID);
+
+    if (output_mode == JSON_BLOBS) {
+        strcpy(text, BLOB_URI);
+        sha_to_string(metadata->SHA, text + strlen(BLOB_URI));
+        JSON_PUT_RAW(", \"url\": ");
+        JSON_PUT_STRING(text, sizeof(text));
+    }
+    if (fields & LIST_ORIG_RES) {
+        snprintf(text, sizeof(text), ", \"orig_res\": [ %u, %u ]", metadata->orig_res[0], metadata->orig_res[1]);
+        JSON_PUT_RAW(text);
+    }
+    if (fields & LIST_SIZE) {
+        snprintf(text, sizeof(text), ", \"size\": [ %u, %u, %u ]",
+                 metadata->size[THUMB_RES], metadata->size[SMALL_RES], metadata->size[ORIG_RES]);
+        JSON_PUT_RAW(text);
+    }
+    if (fields & LIST_SHA) {
+        strcpy(text, ", \"sha\": \"");
+        sha_to_string(metadata->SHA, text + strlen(text));
+        strcat(text, "\"");
+        JSON_PUT_RAW(text);
+    }
+    if (fields & LIST_VARIANTS) {
+        // a resolution exists once it has a content
+        JSON_PUT_RAW(", \"variants\": [ ");
+        int first = 1;
+        for (int res = 0; res < imgfs_nb_resolutions(imgfs_file); ++res) {
+            if (!has_variant(imgfs_file, index, res)) continue;
+            snprintf(text, sizeof(text), "%s\"%s\"", first ? "" : ", ", imgfs_resolution_name(imgfs_file, res));
+            JSON_PUT_RAW(text);
+            first = 0;
         }
-        json_object_put(json_obj); // free
+        JSON_PUT_RAW(first ? "]" : " ]");
+    }
+    if ((fields & LIST_PLACEHOLDER) && placeholder != NULL) {
+        JSON_PUT_RAW(", \"placeholder\": ");
+        JSON_PUT_STRING(placeholder, MAX_PLACEHOLDER);
+    }
 
-        return ERR_NONE;
+    JSON_PUT_RAW(" }");
+#undef JSON_PUT_STRING
+#undef JSON_PUT_RAW
 
-        // ============================================================================================================
+    return len;
+}
 
+//======================================================================================================================
+
+// Major types of CBOR data items (RFC 8949)
+#define CBOR_UINT   0
+#define CBOR_NEGINT 1
+#define CBOR_BYTES  2
+#define CBOR_TEXT   3
+#define CBOR_ARRAY  4
+#define CBOR_MAP    5
+#define CBOR_SIMPLE 7
+
+#define CBOR_INDEFINITE 31 // additional information of the head of an item of indefinite length
+#define CBOR_BREAK      ((char) 0xff) // end of an item of indefinite length
+
+/**
+ * @brief Writes the head of a CBOR item of major type and argument value (its length, or the value of an
+ * integer) to out if it fits in size bytes.
+ * @return The number of bytes needed.
+ */
+static size_t cbor_head(unsigned int major, uint64_t value, char *out, size_t size)
+{
+    unsigned char head[9];
+    size_t len = 1;
+    if (value < 24) {
+        head[0] = (unsigned char) (major << 5 | value);
     } else {
-        //case where output mode is undefined
-        debug_printf("Unknown output mode: %d\n", output_mode);
+        const unsigned int nb_bytes = value <= UINT8_MAX ? 1 : value <= UINT16_MAX ? 2 : value <= UINT32_MAX ? 4 : 8;
+        head[0] = (unsigned char) (major << 5 | (nb_bytes == 1 ? 24 : nb_bytes == 2 ? 25 : nb_bytes == 4 ? 26 : 27));
+        // big-endian
+        for (unsigned int i = 0; i < nb_bytes; ++i) {
+            head[1 + i] = (unsigned char) (value >> (8 * (nb_bytes - 1 - i)));
+        }
+        len += nb_bytes;
+    }
+
+    if (len <= size) memcpy(out, head, len);
+    return len;
+}
+
+/**
+ * @brief Writes the element of the "Images" array of a CBOR listing for the image at index to out if it fits
+ * in size bytes: a map with the same keys, in the same order, as the JSON one with fields, LIST_SIZE
+ * and LIST_SHA.
+ * @return The number of bytes needed.
+ */
+static size_t cbor_image(const struct imgfs_file *imgfs_file, uint32_t index, unsigned int fields,
+                         char *out, size_t size)
+{
+    const struct img_metadata *const metadata = &imgfs_file->metadata[index];
+    const char *const placeholder = imgfs_placeholder(imgfs_file, index);
+    size_t len = 0;
+#define CBOR_PUT_HEAD(major, value) len += cbor_head(major, value, out + (len < size ? len : size), len < size ? size - len : 0)
+#define CBOR_PUT_RAW(data, data_len) do { if (len + (data_len) <= size) memcpy(out + len, data, data_len); len += (data_len); } while (0)
+#define CBOR_PUT_TEXT(str) do { CBOR_PUT_HEAD(CBOR_TEXT, strlen(str)); CBOR_PUT_RAW(str, strlen(str)); } while (0)
+
+    fields |= LIST_SIZE | LIST_SHA;
+    if (placeholder == NULL) fields &= ~(unsigned int) LIST_PLACEHOLDER;
+    unsigned int nb_keys = 1;
+    for (unsigned int bit = LIST_ORIG_RES; bit <= LIST_PLACEHOLDER; bit <<= 1) nb_keys += (fields & bit) != 0;
+    CBOR_PUT_HEAD(CBOR_MAP, nb_keys);
+
+    CBOR_PUT_TEXT("img_id");
+    const size_t id_len = strnlen(metadata->img_id, MAX_IMG_ID);
+    CBOR_PUT_HEAD(CBOR_TEXT, id_len);
+    CBOR_PUT_RAW(metadata->img_id, id_len);
+
+    if (fields & LIST_ORIG_RES) {
+        CBOR_PUT_TEXT("orig_res");
+        CBOR_PUT_HEAD(CBOR_ARRAY, 2);
+        CBOR_PUT_HEAD(CBOR_UINT, metadata->orig_res[0]);
+        CBOR_PUT_HEAD(CBOR_UINT, metadata->orig_res[1]);
+    }
+
+    CBOR_PUT_TEXT("size");
+    CBOR_PUT_HEAD(CBOR_ARRAY, NB_RES);
+    for (int res = 0; res < NB_RES; ++res) CBOR_PUT_HEAD(CBOR_UINT, metadata->size[res]);
+
+    CBOR_PUT_TEXT("sha");
+    CBOR_PUT_HEAD(CBOR_BYTES, SHA256_DIGEST_LENGTH);
+    CBOR_PUT_RAW(metadata->SHA, SHA256_DIGEST_LENGTH);
+
+    if (fields & LIST_VARIANTS) {
+        CBOR_PUT_TEXT("variants");
+        unsigned int nb_variants = 0;
+        for (int res = 0; res < imgfs_nb_resolutions(imgfs_file); ++res) {
+            nb_variants += (unsigned int) has_variant(imgfs_file, index, res);
+        }
+        CBOR_PUT_HEAD(CBOR_ARRAY, nb_variants);
+        for (int res = 0; res < imgfs_nb_resolutions(imgfs_file); ++res) {
+            if (has_variant(imgfs_file, index, res)) CBOR_PUT_TEXT(imgfs_resolution_name(imgfs_file, res));
+        }
+    }
+
+    if (fields & LIST_PLACEHOLDER) {
+        CBOR_PUT_TEXT("placeholder");
+        const size_t placeholder_len = strnlen(placeholder, MAX_PLACEHOLDER);
+        CBOR_PUT_HEAD(CBOR_TEXT, placeholder_len);
+        CBOR_PUT_RAW(placeholder, placeholder_len);
+    }
+#undef CBOR_PUT_TEXT
+#undef CBOR_PUT_RAW
+#undef CBOR_PUT_HEAD
+
+    return len;
+}
+
+// { "Images": [ ... in CBOR, both of indefinite length
+#define CBOR_LIST_HEAD "\xbf\x66" "Images" "\x9f"
+
+size_t do_list_head(enum do_list_mode output_mode, char *out, size_t size)
+{
+    const char *const head = output_mode == CBOR ? CBOR_LIST_HEAD : "{ \"Images\": [ ";
+    const size_t len = strlen(head);
+    if (len <= size) memcpy(out, head, len);
+    return len;
+}
+
+size_t do_list_tail(enum do_list_mode output_mode, const struct imgfs_list_cursor *cursor, int next,
+                    char *out, size_t size)
+{
+    char tail[64];
+    size_t len = 0;
+    if (output_mode == CBOR) {
+        // ] ("next": slot) }
+        tail[len++] = CBOR_BREAK;
+        if (next) {
+            len += cbor_head(CBOR_TEXT, strlen("next"), tail + len, sizeof(tail) - len);
+            memcpy(tail + len, "next", strlen("next"));
+            len += strlen("next");
+            len += cbor_head(CBOR_UINT, cursor->slot, tail + len, sizeof(tail) - len);
+        }
+        tail[len++] = CBOR_BREAK;
+    } else {
+        len = (size_t) (next ? snprintf(tail, sizeof(tail), "%s], \"next\": %u }", cursor->listed > 0 ? " " : "", cursor->slot)
+                        : snprintf(tail, sizeof(tail), "%s] }", cursor->listed > 0 ? " " : ""));
+    }
+
+    if (len <= size) memcpy(out, tail, len);
+    return len;
+}
+
+int do_list_chunk(const struct imgfs_file *imgfs_file, enum do_list_mode output_mode,
+                  struct imgfs_list_cursor *cursor, char *buffer, size_t size)
+{
+    //Arguments validity check
+    M_REQUIRE_NON_NULL(imgfs_file);
+    M_REQUIRE_NON_NULL(cursor);
+    M_REQUIRE_NON_NULL(buffer);
+    if (output_mode != JSON && output_mode != JSON_BLOBS && output_mode != CBOR) return ERR_INVALID_ARGUMENT;
+
+    const uint32_t max_files = imgfs_file->header.max_files;
+    size_t written = 0;
+    while (1) {
+        while (cursor->slot < max_files && imgfs_file->metadata[cursor->slot].is_valid != NON_EMPTY) {
+            ++cursor->slot;
+        }
+        if (cursor->slot >= max_files || cursor->remaining == 0) break;
+
+        // CBOR items follow each other
+        const size_t separator = cursor->listed > 0 && output_mode != CBOR ? 2 : 0;
+        if (written + separator > size) break;
+        const size_t len = output_mode == CBOR ?
+                           cbor_image(imgfs_file, cursor->slot, cursor->fields,
+                                      buffer + written + separator, size - written - separator) :
+                           json_image(imgfs_file, cursor->slot, output_mode, cursor->fields,
+                                      buffer + written + separator, size - written - separator);
+        if (written + separator + len > size) break;
+
+        if (separator > 0) memcpy(buffer + written, ", ", separator);
+        written += separator + len;
+        ++cursor->slot;
+        ++cursor->listed;
+        --cursor->remaining;
+    }
+
+    if (written == 0 && cursor->slot < max_files && cursor->remaining > 0) {
+        return ERR_INVALID_ARGUMENT; // buffer too small for the next image
+    }
+    return (int) written;
+}
+
+//======================================================================================================================
+
+#define CBOR_MAX_DEPTH 16
+
+struct cbor_reader {
+    const unsigned char *data;
+    size_t len;
+    size_t pos;
+};
+
+struct text_buffer {
+    char *data;
+    size_t len;
+    size_t capacity;
+};
+
+/**
+ * @brief Makes room for len more bytes (and a null byte) in buffer.
+ * @return Some error code. 0 if no error.
+ */
+static int text_reserve(struct text_buffer *buffer, size_t len)
+{
+    if (buffer->len + len + 1 <= buffer->capacity) return ERR_NONE;
+
+    size_t capacity = buffer->capacity > 0 ? buffer->capacity : 256;
+    while (buffer->len + len + 1 > capacity) capacity *= 2;
+    char *const bigger = realloc(buffer->data, capacity);
+    if (bigger == NULL) return ERR_OUT_OF_MEMORY;
+    buffer->data = bigger;
+    buffer->capacity = capacity;
+    return ERR_NONE;
+}
+
+static int text_put(struct text_buffer *buffer, const char *str, size_t len)
+{
+    const int ret = text_reserve(buffer, len);
+    if (ret != ERR_NONE) return ret;
+    memcpy(buffer->data + buffer->len, str, len);
+    buffer->len += len;
+    return ERR_NONE;
+}
+
+/**
+ * @brief Reads the head of the next CBOR item: its major type, and its argument in value (unless it is
+ * of indefinite length, or a break).
+ * @return Some error code. 0 if no error.
+ */
+static int cbor_read_head(struct cbor_reader *reader, unsigned int *major, uint64_t *value, int *indefinite)
+{
+    if (reader->pos >= reader->len) return ERR_INVALID_ARGUMENT;
+
+    const unsigned char initial = reader->data[reader->pos++];
+    *major = initial >> 5;
+    const unsigned int info = initial & 0x1f;
+    *indefinite = info == CBOR_INDEFINITE;
+    *value = info;
+    if (info < 24 || info == CBOR_INDEFINITE) return ERR_NONE;
+    if (info > 27) return ERR_INVALID_ARGUMENT;
+
+    const size_t nb_bytes = (size_t) 1 << (info - 24);
+    if (reader->len - reader->pos < nb_bytes) return ERR_INVALID_ARGUMENT;
+    *value = 0;
+    for (size_t i = 0; i < nb_bytes; ++i) *value = *value << 8 | reader->data[reader->pos++];
+    return ERR_NONE;
+}
+
+/**
+ * @brief Whether the next item is the break ending an item of indefinite length (which is then skipped).
+ */
+static int cbor_break(struct cbor_reader *reader)
+{
+    if (reader->pos < reader->len && reader->data[reader->pos] == (unsigned char) CBOR_BREAK) {
+        ++reader->pos;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Converts the next CBOR item (and those it contains) to JSON, appended to out.
+ * @return Some error code. 0 if no error.
+ */
+static int cbor_item_to_json(struct cbor_reader *reader, struct text_buffer *out, int depth)
+{
+    unsigned int major;
+    uint64_t value;
+    int indefinite;
+    int ret = cbor_read_head(reader, &major, &value, &indefinite);
+    if (ret != ERR_NONE) return ret;
+
+    char text[32];
+    switch (major) {
+    case CBOR_UINT:
+    case CBOR_NEGINT:
+        if (indefinite) return ERR_INVALID_ARGUMENT;
+        if (major == CBOR_UINT) {
+            snprintf(text, sizeof(text), "%" PRIu64, value);
+        } else if (value < UINT64_MAX) {
+            snprintf(text, sizeof(text), "-%" PRIu64, value + 1); // the value is -1 - n
+        } else {
+            snprintf(text, sizeof(text), "-18446744073709551616"); // -2^64, beyond uint64_t
+        }
+        return text_put(out, text, strlen(text));
+
+    case CBOR_BYTES:
+    case CBOR_TEXT: {
+        if (indefinite || value > reader->len - reader->pos) return ERR_INVALID_ARGUMENT;
+        const char *const str = (const char *) reader->data + reader->pos;
+        const size_t len = (size_t) value;
+        reader->pos += len;
+
+        if (major == CBOR_TEXT) {
+            const size_t needed = json_string(str, len, NULL, 0);
+            ret = text_reserve(out, needed);
+            if (ret == ERR_NONE) out->len += json_string(str, len, out->data + out->len, needed);
+            return ret;
+        }
+        // bytes, in hexadecimal
+        ret = text_reserve(out, 2 * len + 2);
+        if (ret != ERR_NONE) return ret;
+        out->data[out->len++] = '"';
+        for (size_t i = 0; i < len; ++i) {
+            snprintf(out->data + out->len, 3, "%02x", (unsigned char) str[i]);
+            out->len += 2;
+        }
+        out->data[out->len++] = '"';
+        return ERR_NONE;
+    }
+
+    case CBOR_ARRAY:
+    case CBOR_MAP: {
+        if (depth >= CBOR_MAX_DEPTH) return ERR_INVALID_ARGUMENT;
+        ret = text_put(out, major == CBOR_ARRAY ? "[ " : "{ ", 2);
+        uint64_t nb = 0;
+        while (ret == ERR_NONE && (indefinite ? !cbor_break(reader) : nb < value)) {
+            if (nb > 0) ret = text_put(out, ", ", 2);
+            // keys of JSON objects are strings
+            if (ret == ERR_NONE && major == CBOR_MAP) {
+                if (reader->pos >= reader->len || reader->data[reader->pos] >> 5 != CBOR_TEXT) return ERR_INVALID_ARGUMENT;
+                ret = cbor_item_to_json(reader, out, depth + 1);
+                if (ret == ERR_NONE) ret = text_put(out, ": ", 2);
+            }
+            if (ret == ERR_NONE) ret = cbor_item_to_json(reader, out, depth + 1);
+            ++nb;
+        }
+        if (ret != ERR_NONE) return ret;
+        // an empty one is "[ ]", as json-c writes it
+        return text_put(out, major == CBOR_ARRAY ? (nb > 0 ? " ]" : "]") : (nb > 0 ? " }" : "}"), nb > 0 ? 2 : 1);
+    }
+
+    case CBOR_SIMPLE:
+        if (value == 20 || value == 21 || value == 22) {
+            const char *const simple = value == 20 ? "false" : value == 21 ? "true" : "null";
+            return text_put(out, simple, strlen(simple));
+        }
+        return ERR_INVALID_ARGUMENT;
+
+    default: // tags
         return ERR_INVALID_ARGUMENT;
     }
 }
+
+int cbor_to_json(const char *cbor, size_t len, char **json)
+{
+    M_REQUIRE_NON_NULL(cbor);
+    M_REQUIRE_NON_NULL(json);
+
+    struct cbor_reader reader = { (const unsigned char *) cbor, len, 0 };
+    struct text_buffer out = { NULL, 0, 0 };
+
+    int ret = cbor_item_to_json(&reader, &out, 0);
+    if (ret == ERR_NONE && reader.pos != len) ret = ERR_INVALID_ARGUMENT; // trailing bytes
+    if (ret == ERR_NONE) ret = text_reserve(&out, 0);
+    if (ret != ERR_NONE) {
+        free(out.data);
+        return ret;
+    }
+
+    out.data[out.len] = '\0';
+    *json = out.data;
+    return ERR_NONE;
+}
@@ -2,6 +2,37 @@
 #include <string.h>
 #include "image_content.h"
 #include <stdlib.h>
+#include <unistd.h> // for pread
+
+int find_image_index(const char *img_id, const struct imgfs_file *imgfs_file)
+{
+    //Arguments validity check
+    M_REQUIRE_NON_NULL(img_id);
+    M_REQUIRE_NON_NULL(imgfs_file);
+
+    for (uint32_t i = 0; i < imgfs_file->header.max_files; ++i) {
+        if (imgfs_file->metadata[i].is_valid != EMPTY &&
+            strncmp(imgfs_file->metadata[i].img_id, img_id, MAX_IMG_ID) == 0) {
+            return (int) i;
+        }
+    }
+    return ERR_IMAGE_NOT_FOUND;
+}
+
+int find_image_by_sha(const unsigned char *SHA, const struct imgfs_file *imgfs_file)
+{
+    //Arguments validity check
+    M_REQUIRE_NON_NULL(SHA);
+    M_REQUIRE_NON_NULL(imgfs_file);
+
+    for (uint32_t i = 0; i < imgfs_file->header.max_files; ++i) {
+        if (imgfs_file->metadata[i].is_valid != EMPTY &&
+            memcmp(imgfs_file->metadata[i].SHA, SHA, SHA256_DIGEST_LENGTH) == 0) {
+            return (int) i;
+        }
+    }
+    return ERR_IMAGE_NOT_FOUND;
+}
 
 int do_read(const char *img_id, int resolution, char **image_buffer,
             uint32_t *image_size, struct imgfs_file *imgfs_file)
@@ -14,20 +45,23 @@ int do_read(const char *img_id, int resolution, char **image_buffer,
     M_REQUIRE_NON_NULL(imgfs_file);
 
     //Searching for the entry in metadata corresponding to supplied imgID
-    size_t imgID_idx ;
-    for (imgID_idx = 0; imgID_idx < imgfs_file->header.max_files; ++imgID_idx) {
-        if (strncmp(imgfs_file->metadata[imgID_idx].img_id, img_id, MAX_IMG_ID) == 0) {
-            break;
-        }
-    }
+    const int found_idx = find_image_index(img_id, imgfs_file);
 
     //Case where no corresponding imgID was found in metadata table
-    if(imgID_idx == imgfs_file->header.max_files) {
-        return ERR_IMAGE_NOT_FOUND;
+    if(found_idx < 0) {
+        return found_idx;
+    }
+    const size_t imgID_idx = (size_t) found_idx;
+
+    //Where the content is in the requested resolution (thumb, small, orig or one of the extension file)
+    uint64_t offset = 0;
+    int ret = imgfs_variant(imgfs_file, imgID_idx, resolution, &offset, image_size);
+    if (ret != ERR_NONE) {
+        return ret;
     }
 
     //if image does not already exist in requested resolution, we call lazily_resize (if not original resolution)
-    if (imgfs_file->metadata[imgID_idx].offset[resolution] == 0 ||imgfs_file->metadata[imgID_idx].size[resolution]== 0) {
+    if (offset == 0 || *image_size == 0) {
 
         if(resolution != ORIG_RES) {
             //Resizing img if not in original resolution
@@ -35,18 +69,21 @@ int do_read(const char *img_id, int resolution, char **image_buffer,
             if (ret_resize != ERR_NONE) {
                 return ret_resize;
             }
+            ret = imgfs_variant(imgfs_file, imgID_idx, resolution, &offset, image_size);
+            if (ret != ERR_NONE) {
+                return ret;
+            }
         }
     }
 
     //Reading the content of the image into buffer, now that we have index and size
-    *image_size = imgfs_file->metadata[imgID_idx].size[resolution];
     *image_buffer = calloc(1,*image_size);
 
     if(*image_buffer == NULL) {
         return ERR_OUT_OF_MEMORY;
     }
 
-    fseek(imgfs_file->file, imgfs_file->metadata[imgID_idx].offset[resolution], SEEK_SET);
+    fseek(imgfs_file->file, (long) offset, SEEK_SET);
 
     if(fread(*image_buffer, *image_size, 1, imgfs_file->file) != 1) {
         free(*image_buffer);
@@ -55,4 +92,115 @@ int do_read(const char *img_id, int resolution, char **image_buffer,
     }
 
     return ERR_NONE;
-}
\ No newline at end of file
+}
+int do_read_batch_locate(struct imgfs_read_request *requests, size_t nb, struct imgfs_file *imgfs_file)
+{
+    //Arguments validity check
+    M_REQUIRE_NON_NULL(requests);
+    M_REQUIRE_NON_NULL(imgfs_file);
+
+    for (size_t i = 0; i < nb; ++i) {
+        struct imgfs_read_request *const request = &requests[i];
+        request->data = NULL;
+        request->resized = 0;
+        if (request->img_id == NULL || request->resolution < 0 ||
+            request->resolution >= imgfs_nb_resolutions(imgfs_file)) {
+            request->status = ERR_INVALID_ARGUMENT;
+            continue;
+        }
+
+        const int index = find_image_index(request->img_id, imgfs_file);
+        request->status = index < 0 ? index : ERR_NONE;
+        if (index < 0) continue;
+
+        request->status = imgfs_variant(imgfs_file, (size_t) index, request->resolution,
+                                        &request->offset, &request->size);
+        if (request->status == ERR_NONE && request->resolution != ORIG_RES &&
+            (request->offset == 0 || request->size == 0)) {
+            request->status = lazily_resize(request->resolution, imgfs_file, (size_t) index);
+            if (request->status == ERR_NONE) {
+                request->resized = 1;
+                request->status = imgfs_variant(imgfs_file, (size_t) index, request->resolution,
+                                                &request->offset, &request->size);
+            }
+        }
+    }
+
+    return fflush(imgfs_file->file) == 0 ? ERR_NONE : ERR_IO;
+}
+
+/**
+ * @brief Orders requests by the offset of their content.
+ */
+static int compare_offsets(const void *a, const void *b)
+{
+    const struct imgfs_read_request *const first = *(const struct imgfs_read_request * const *) a;
+    const struct imgfs_read_request *const second = *(const struct imgfs_read_request * const *) b;
+    return (first->offset > second->offset) - (first->offset < second->offset);
+}
+
+int do_read_batch(struct imgfs_read_request *requests, size_t nb, int fd, char **contents)
+{
+    //Arguments validity check
+    M_REQUIRE_NON_NULL(requests);
+    M_REQUIRE_NON_NULL(contents);
+
+    // The located contents, by offset
+    struct imgfs_read_request **order = calloc(nb > 0 ? nb : 1, sizeof(*order));
+    if (order == NULL) return ERR_OUT_OF_MEMORY;
+    size_t nb_located = 0;
+    for (size_t i = 0; i < nb; ++i) {
+        if (requests[i].status == ERR_NONE) order[nb_located++] = &requests[i];
+    }
+    qsort(order, nb_located, sizeof(*order), compare_offsets);
+
+    // Room for each content once (the same one may be asked for twice, or be shared by duplicates)
+    size_t total = 0;
+    for (size_t i = 0; i < nb_located; ++i) {
+        if (i == 0 || order[i]->offset != order[i - 1]->offset) total += order[i]->size;
+    }
+    char *const buffer = malloc(total > 0 ? total : 1);
+    if (buffer == NULL) {
+        free(order);
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    int ret = ERR_NONE;
+    size_t pos = 0;
+    size_t i = 0;
+    while (i < nb_located && ret == ERR_NONE) {
+        // the contents that follow each other in the file are read at once
+        const uint64_t start = order[i]->offset;
+        const size_t start_pos = pos;
+        uint64_t end = start;
+        for (; i < nb_located && order[i]->offset <= end; ++i) {
+            if (order[i]->offset == end) {
+                order[i]->data = buffer + pos;
+                pos += order[i]->size;
+                end += order[i]->size;
+            } else {
+                order[i]->data = buffer + start_pos + (order[i]->offset - start); // same content as a previous one
+            }
+        }
+
+        size_t done = 0;
+        while (done < pos - start_pos) {
+            const ssize_t nb_read = pread(fd, buffer + start_pos + done, pos - start_pos - done, (off_t) (start + done));
+            if (nb_read <= 0) {
+                ret = ERR_IO;
+                break;
+            }
+            done += (size_t) nb_read;
+        }
+    }
+    free(order);
+
+    if (ret != ERR_NONE) {
+        free(buffer);
+        for (size_t j = 0; j < nb; ++j) requests[j].data = NULL;
+        return ret;
+    }
+
+    *contents = buffer;
+    return ERR_NONE;
+}
@@ -8,16 +8,48 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h> // for atouint32() errors
+#include <stdint.h> // for SIZE_MAX
 #include <vips/vips.h>
 
 #include "error.h"
 #include "util.h" // atouint16
 #include "imgfs.h"
+#include "imgfs_journal.h"
+#include "imgfs_durability.h"
 #include "http_net.h"
 #include "imgfs_server_service.h"
+#include "image_cache.h"
+#include "change_log.h"
+#include "event_hub.h"
+#include "image_sprite.h"
 
 // Main in-memory structure for imgFS
 static struct imgfs_file fs_file;
+// Contents recently read from it
+static struct image_cache cache;
+// Insertions and deletions, for clients to catch up with
+static struct change_log changes;
+// Connections the changes are pushed to, as they are made
+static struct event_hub events;
+// Small listings last built, valid as long as the imgFS has the same version
+static struct list_cache {
+    char *json;
+    size_t len;
+    uint32_t version;
+    unsigned int fields;
+} list_cache[NB_DO_LIST_MODES];
+// Sprites last made, with their maps, by version of the imgFS, page and columns
+static struct sprite_cache {
+    uint32_t version;
+    size_t page;
+    size_t cols;
+    void *jpeg;     // NULL if the slot is free, or the page has no image
+    size_t jpeg_size;
+    char *json;
+    size_t json_len;
+} sprite_cache[SPRITE_CACHE_SLOTS];
+static size_t sprite_cache_next; // slot to be replaced next
 static uint16_t server_port;
 pthread_mutex_t thread;
 
@@ -27,7 +59,7 @@ pthread_mutex_t thread;
 /**********************************************************************
  * Sends error message.
  ********************************************************************** */
-static int reply_error_msg(int connection, int error)
+static int reply_error_status(int connection, const char *status, const char *headers, int error)
 {
 #define ERR_MSG_SIZE 256
     char err_msg[ERR_MSG_SIZE]; // enough for any reasonable err_msg
@@ -35,24 +67,34 @@ static int reply_error_msg(int connection, int error)
         fprintf(stderr, "reply_error_msg(): sprintf() failed...\n");
         return ERR_RUNTIME;
     }
-    return http_reply(connection, "500 Internal Server Error", "",
+    return http_reply(connection, status, headers,
                       err_msg, strlen(err_msg));
 }
 
+static int reply_error_msg(int connection, int error)
+{
+    return reply_error_status(connection, "500 Internal Server Error", "", error);
+}
+
 
 /**********************************************************************
  * Sends 302 OK message.
  ********************************************************************** */
-static int reply_302_msg(int connection)
+static int reply_302_headers(int connection, const char *headers)
 {
     char location[ERR_MSG_SIZE];
-    if (snprintf(location, ERR_MSG_SIZE, "Location: http://localhost:%d/" BASE_FILE HTTP_LINE_DELIM,
-                 server_port) < 0) {
+    if (snprintf(location, ERR_MSG_SIZE, "Location: http://localhost:%d/" BASE_FILE HTTP_LINE_DELIM "%s",
+                 server_port, headers) < 0) {
         fprintf(stderr, "reply_302_msg(): sprintf() failed...\n");
         return ERR_RUNTIME;
     }
     return http_reply(connection, "302 Found", location, "", 0);
 }
+
+static int reply_302_msg(int connection)
+{
+    return reply_302_headers(connection, "");
+}
 /**
  * Locks the mutex thread
  * @return ERR_RUNTIME if error and ERR_NONE if not
@@ -79,43 +121,378 @@ int thread_unlock()
     return ERR_NONE;
 }
 
-int handle_list_call(int connection)
+/**
+ * Writes the event telling subscribers to /imgfs/events that the change op of img_id
+ * brought the imgFS to version (its ID, as for Last-Event-ID) into out, of at least
+ * CHANGE_EVENT_SIZE bytes. Returns its length.
+ */
+#define CHANGE_EVENT_SIZE (128 + 6 * MAX_IMG_ID)
+static size_t change_event(char *out, uint32_t version, uint32_t op, const char *img_id)
+{
+    static const char *const op_names[] = { "", "insert", "delete" };
+    size_t len = (size_t) snprintf(out, CHANGE_EVENT_SIZE, "id: %u\nevent: %s\ndata: { \"version\": %u, \"img_id\": ",
+                                   version, op_names[op <= CHANGE_DELETE ? op : 0], version);
+    len += json_string(img_id, MAX_IMG_ID, out + len, CHANGE_EVENT_SIZE - len);
+    len += (size_t) snprintf(out + len, CHANGE_EVENT_SIZE - len, " }\n\n");
+    return len;
+}
+
+/**
+ * Records a change that brought fs_file to version (with the mutex locked),
+ * and pushes it to the subscribers to /imgfs/events.
+ * The change is made anyway: if it cannot be recorded, the next one starts the log again.
+ */
+static void log_change_to(uint32_t version, enum change_op op, const char *img_id)
 {
+    if (change_log_append(&changes, version, op, img_id) != ERR_NONE) {
+        fprintf(stderr, "Failed to record the change of %s in the change log\n", img_id);
+    }
+
+    char event[CHANGE_EVENT_SIZE];
+    event_hub_publish(&events, event, change_event(event, version, op, img_id));
+}
+
+/**
+ * Records a change that brought fs_file to its current version, see log_change_to().
+ */
+static void log_change(enum change_op op, const char *img_id)
+{
+    log_change_to(fs_file.header.version, op, img_id);
+}
+
+/**********************************************************************
+ * Headers of a listing: its type, which depends on the "Accept" header.
+ ********************************************************************** */
+static const char *list_headers(enum do_list_mode mode)
+{
+    return mode == CBOR ? "Content-Type: application/cbor" HTTP_LINE_DELIM "Vary: Accept" HTTP_LINE_DELIM :
+           "Content-Type: application/json" HTTP_LINE_DELIM "Vary: Accept" HTTP_LINE_DELIM;
+}
+
+/**********************************************************************
+ * Sends the listing from cursor on, in chunks ("Transfer-Encoding: chunked"),
+ * the lock being held only while each chunk is written. A page (paginated)
+ * ends with the cursor of the next one, if any.
+ ********************************************************************** */
+static int reply_list_stream(int connection, enum do_list_mode mode, struct imgfs_list_cursor cursor, int paginated)
+{
+    char *buffer = malloc(LIST_CHUNK_SIZE);
+    if (buffer == NULL) return reply_error_msg(connection, ERR_OUT_OF_MEMORY);
+
+    int ret = http_reply_chunked(connection, HTTP_OK, list_headers(mode));
+    if (ret == ERR_NONE) {
+        ret = http_send_chunk(connection, buffer, do_list_head(mode, buffer, LIST_CHUNK_SIZE));
+    }
+
+    int more = 0;
+    while (ret == ERR_NONE) {
+        if (thread_lock() != ERR_NONE) {
+            ret = ERR_RUNTIME;
+            break;
+        }
+        const int len = do_list_chunk(&fs_file, mode, &cursor, buffer, LIST_CHUNK_SIZE);
+        more = cursor.slot < fs_file.header.max_files;
+        if (thread_unlock() != ERR_NONE) {
+            ret = ERR_RUNTIME;
+            break;
+        }
+
+        if (len <= 0) {
+            ret = len;
+            break;
+        }
+        ret = http_send_chunk(connection, buffer, (size_t) len);
+    }
+    free(buffer);
+
+    // The status is sent already: on error, the body is left unfinished and the connection closed
+    if (ret != ERR_NONE) return ret < 0 ? ret : ERR_IO;
+
+    char end[64];
+    ret = http_send_chunk(connection, end, do_list_tail(mode, &cursor, paginated && more, end, sizeof(end)));
+    return ret == ERR_NONE ? http_send_chunk(connection, NULL, 0) : ret;
+}
+
+int handle_list_call(int connection, const struct http_message* msg)
+{
+
+    M_REQUIRE_NON_NULL(msg);
 
     char *json_op = NULL;
 
+    // "urls=blob" gives the stable URL of the content of each image;
+    // machine clients may rather ask for the binary listing (which gives the SHA, thus the URL, anyway)
+    char urls[8] = {0};
+    const enum do_list_mode mode = http_accepts(msg, "application/cbor") ? CBOR :
+                                   http_get_var(&msg->uri, "urls", urls, sizeof(urls)) > 0 &&
+                                   strcmp(urls, "blob") == 0 ? JSON_BLOBS : JSON;
+
+    // Pagination: "limit" images at most, from the metadata entry "cursor" on
+    char cursor_str[16] = {0}, limit_str[16] = {0};
+    const int has_cursor = http_get_var(&msg->uri, "cursor", cursor_str, sizeof(cursor_str)) > 0;
+    const int has_limit = http_get_var(&msg->uri, "limit", limit_str, sizeof(limit_str)) > 0;
+    struct imgfs_list_cursor cursor = { 0, SIZE_MAX, 0, 0 };
+
+    // "fields=orig_res,size,sha,variants,placeholder" gives these details of each image
+    char fields_str[64] = {0};
+    if (http_get_var(&msg->uri, "fields", fields_str, sizeof(fields_str)) > 0 &&
+        list_fields_parse(fields_str, &cursor.fields) != ERR_NONE) {
+        return reply_error_msg(connection, ERR_INVALID_ARGUMENT);
+    }
+
+    if (has_cursor) {
+        cursor.slot = atouint32(cursor_str);
+        if (errno == ERANGE) return reply_error_msg(connection, ERR_INVALID_ARGUMENT);
+    }
+    if (has_limit) {
+        cursor.remaining = atouint32(limit_str);
+        if (errno == ERANGE || cursor.remaining == 0) return reply_error_msg(connection, ERR_INVALID_ARGUMENT);
+    }
+    if (has_cursor || has_limit) {
+        return reply_list_stream(connection, mode, cursor, 1);
+    }
+
     // Locking the mutex before calling do_do_list
     if (thread_lock() != ERR_NONE) return reply_error_msg(connection, ERR_RUNTIME);
 
-    int list_ret = do_list(&fs_file, JSON, &json_op);
+    // Big listings are not built at once (nor with the lock held all along)
+    if (fs_file.header.nb_files > LIST_STREAM_THRESHOLD) {
+        if (thread_unlock() != ERR_NONE) return reply_error_msg(connection, ERR_RUNTIME);
+        return reply_list_stream(connection, mode, cursor, 0);
+    }
+
+    // Every insertion and deletion changes the version: the listing is only built again then
+    struct list_cache *const cached = &list_cache[mode];
+    int list_ret = ERR_NONE;
+    if (cached->json == NULL || cached->version != fs_file.header.version || cached->fields != cursor.fields) {
+        free(cached->json);
+        cached->json = NULL;
+        list_ret = do_list_fields(&fs_file, mode, cursor.fields, &cached->json, &cached->len);
+        if (list_ret == ERR_NONE) {
+            cached->version = fs_file.header.version;
+            cached->fields = cursor.fields;
+        }
+    }
+    if (list_ret == ERR_NONE) {
+        json_op = malloc(cached->len);
+        if (json_op != NULL) {
+            memcpy(json_op, cached->json, cached->len);
+        } else {
+            list_ret = ERR_OUT_OF_MEMORY;
+        }
+    }
+    const size_t json_len = cached->len;
 
     // Unlocking the mutex after calling do_do_list
-    if(thread_unlock() != ERR_NONE) return reply_error_msg(connection, ERR_RUNTIME);
+    if(thread_unlock() != ERR_NONE) {
+        free(json_op);
+        return reply_error_msg(connection, ERR_RUNTIME);
+    }
 
 
     if (list_ret != ERR_NONE) {
-        if (json_op) free(json_op);
         return reply_error_msg(connection, list_ret);
     }
 
-    if (json_op) {
-        int ret = http_reply(connection, HTTP_OK, "Content-Type: application/json\r\n",
-                             json_op, strlen(json_op));
+    int ret = http_reply(connection, HTTP_OK, list_headers(mode), json_op, json_len);
 
-        free(json_op);
-        return ret;
-    }
+    free(json_op);
+    return ret;
+}
 
-    return reply_error_msg(connection, ERR_RUNTIME);
+
+/**********************************************************************
+ * Sends 416 for a range that is not in the content (of size bytes).
+ ********************************************************************** */
+static int reply_bad_range(int connection, size_t size)
+{
+    char content_range[ERR_MSG_SIZE];
+    snprintf(content_range, sizeof(content_range), "Content-Range: bytes */%zu" HTTP_LINE_DELIM, size);
+    return http_reply(connection, HTTP_BAD_RANGE, content_range, NULL, 0);
+}
+
+/**********************************************************************
+ * Finds the image to be sent, by name (img_id) or by content (SHA).
+ * Must be called with the mutex locked.
+ ********************************************************************** */
+static int locate_image(const char *img_id, const unsigned char *SHA)
+{
+    return img_id != NULL ? find_image_index(img_id, &fs_file) : find_image_by_sha(SHA, &fs_file);
 }
 
+/**********************************************************************
+ * Lets know of the variant of img_id in resolution res just made by
+ * lazily_resize(). Must be called with the mutex locked.
+ ********************************************************************** */
+static void variant_made(const char *img_id, int res)
+{
+    // The new variant does not change the version: the event has no ID
+    const char *const res_name = imgfs_resolution_name(&fs_file, res);
+    char event[CHANGE_EVENT_SIZE];
+    size_t len = (size_t) snprintf(event, sizeof(event), "event: variant\ndata: { \"img_id\": ");
+    len += json_string(img_id, MAX_IMG_ID, event + len, sizeof(event) - len);
+    len += (size_t) snprintf(event + len, sizeof(event) - len, ", \"resolution\": \"%s\" }\n\n",
+                             res_name != NULL ? res_name : "");
+    event_hub_publish(&events, event, len);
+
+    // nor do the listings with sizes, variants or placeholders (which come with thumbnails)
+    // get another version: they are out of date
+    for (size_t i = 0; i < NB_DO_LIST_MODES; ++i) {
+        if (list_cache[i].fields & (LIST_SIZE | LIST_VARIANTS | LIST_PLACEHOLDER)) {
+            free(list_cache[i].json);
+            list_cache[i].json = NULL;
+        }
+    }
+}
+
+/**********************************************************************
+ * Sends an image found by name or by content (see locate_image()),
+ * from the cache when possible. cache_control tells how long clients
+ * (and caches on the way) may keep it.
+ ********************************************************************** */
+static int reply_image(int connection, const struct http_message *msg, const char *img_id,
+                       const unsigned char *SHA, int res, const char *cache_control)
+{
+    const struct http_string *range = http_get_header(msg, "Range");
+
+    // Locating the image: the cache is keyed by where its content is
+    if (thread_lock() != ERR_NONE) return reply_error_msg(connection, ERR_RUNTIME);
+
+    int index = locate_image(img_id, SHA);
+    struct image_cache_key key = { 0, res, 0 };
+    size_t content_size = 0;
+    char sha[2 * SHA256_DIGEST_LENGTH + 1] = {0};
+    uint32_t variant_size = 0;
+    if (index >= 0 && imgfs_variant(&fs_file, (size_t) index, res, &key.offset, &variant_size) != ERR_NONE) {
+        index = ERR_RESOLUTIONS;
+    }
+    if (index >= 0) {
+        key.index = (uint32_t) index;
+        content_size = variant_size;
+        sha_to_string(fs_file.metadata[index].SHA, sha);
+    }
+    // a range may be sent from the file itself: it must hold what was written to it
+    const int flushed = range == NULL || fflush(fs_file.file) == 0;
+
+    if(thread_unlock() != ERR_NONE) return reply_error_msg(connection, ERR_RUNTIME);
+
+    if (index < 0) {
+        return reply_error_msg(connection, index);
+    }
+
+    // Strong validator: the content (thus its SHA) and the resolution determine the bytes sent
+    // (the resolutions do not change while the imgFS is served)
+    const char *const res_name = imgfs_resolution_name(&fs_file, res);
+    char etag[2 * SHA256_DIGEST_LENGTH + MAX_RES_NAME + 8];
+    snprintf(etag, sizeof(etag), "\"%s-%s\"", sha, res_name);
+    char validators[sizeof(etag) + 128];
+    snprintf(validators, sizeof(validators), "ETag: %s" HTTP_LINE_DELIM "Cache-Control: %s" HTTP_LINE_DELIM,
+             etag, cache_control);
+
+    if (http_etag_matches(http_get_header(msg, "If-None-Match"), etag)) {
+        return http_reply(connection, HTTP_NOT_MODIFIED, validators, NULL, 0);
+    }
+
+    // A part is only sent if it is of the content the client has the rest of
+    const struct http_string *if_range = http_get_header(msg, "If-Range");
+    if (if_range != NULL && (if_range->len != strlen(etag) || strncmp(if_range->val, etag, if_range->len) != 0)) {
+        range = NULL;
+    }
+    size_t first = 0, last = 0;
+    int ranged = key.offset != 0 ? http_parse_range(range, content_size, &first, &last) : 0;
+    if (ranged < 0) {
+        return reply_bad_range(connection, content_size);
+    }
+
+    // Not yet resized images are never in the cache
+    const struct image_cache_entry *entry = key.offset != 0 ? image_cache_get(&cache, &key) : NULL;
+
+    if (entry == NULL && ranged > 0 && flushed) {
+        // Sending the part straight from the imgFS file: contents never move once written
+        char headers[sizeof(validators) + 128];
+        snprintf(headers, sizeof(headers), "Content-Type: image/jpeg" HTTP_LINE_DELIM "%s"
+                 "Content-Range: bytes %zu-%zu/%zu" HTTP_LINE_DELIM, validators, first, last, content_size);
+        return http_reply_file(connection, HTTP_PARTIAL, headers, fileno(fs_file.file),
+                               (off_t) (key.offset + first), last - first + 1);
+    }
+
+    if (entry == NULL) {
+        char *image_buffer;
+        uint32_t image_size;
+
+        // Locking the mutex before calling do_read
+        if (thread_lock() != ERR_NONE) return reply_error_msg(connection, ERR_RUNTIME);
+
+        // the image may have been resized, or even deleted and inserted again in the meantime
+        index = locate_image(img_id, SHA);
+        int ret_read = index;
+        char found_id[MAX_IMG_ID + 1] = {0};
+        if (index >= 0) {
+            uint64_t offset = 0;
+            const int resized = imgfs_variant(&fs_file, (size_t) index, res, &offset, &variant_size) == ERR_NONE &&
+                                offset == 0;
+            strncpy(found_id, fs_file.metadata[index].img_id, MAX_IMG_ID);
+            ret_read = do_read(found_id, res, &image_buffer, &image_size, &fs_file);
+
+            if (ret_read == ERR_NONE && resized) variant_made(found_id, res);
+        }
+        if (ret_read == ERR_NONE) {
+            key.index = (uint32_t) index;
+            ret_read = imgfs_variant(&fs_file, (size_t) index, res, &key.offset, &variant_size);
+            if (ret_read != ERR_NONE) free(image_buffer);
+        }
+
+        // Unlocking the mutex after calling do_read
+        if(thread_unlock() != ERR_NONE) {
+            if (ret_read == ERR_NONE) free(image_buffer);
+            return reply_error_msg(connection, ERR_RUNTIME);
+        }
+
+        if (ret_read != ERR_NONE) {
+            return reply_error_msg(connection, ret_read);
+        }
+
+        entry = image_cache_put(&cache, &key, image_buffer, image_size);
+        if (entry == NULL) {
+            free(image_buffer);
+            return reply_error_msg(connection, ERR_OUT_OF_MEMORY);
+        }
+    }
+
+    // Not resized before: the range could not be checked against the size yet
+    if (range != NULL && ranged == 0) {
+        ranged = http_parse_range(range, entry->size, &first, &last);
+        if (ranged < 0) {
+            const uint32_t size = entry->size;
+            image_cache_release(&cache, entry);
+            return reply_bad_range(connection, size);
+        }
+    }
+
+    //Sending HTTP response with the image (or the part asked for)
+    char headers[sizeof(validators) + 128];
+    int http_ret;
+    if (ranged > 0) {
+        snprintf(headers, sizeof(headers), "Content-Type: image/jpeg" HTTP_LINE_DELIM "%s"
+                 "Content-Range: bytes %zu-%zu/%u" HTTP_LINE_DELIM, validators, first, last, entry->size);
+        http_ret = http_reply(connection, HTTP_PARTIAL, headers, entry->data + first, last - first + 1);
+    } else {
+        snprintf(headers, sizeof(headers), "Content-Type: image/jpeg" HTTP_LINE_DELIM "%s"
+                 "Accept-Ranges: bytes" HTTP_LINE_DELIM, validators);
+        http_ret = http_reply(connection, "200 OK", headers, entry->data, entry->size);
+    }
+
+    image_cache_release(&cache, entry);
+
+    return http_ret;
+}
 
 int handle_read_call(int connection, const struct http_message* msg)
 {
 
     M_REQUIRE_NON_NULL(msg);
 
-    char res_str[15] = {0};
+    char res_str[MAX_RES_NAME + 1] = {0};
     char img_id[MAX_IMG_ID] = {0};
 
     // GetING res and imgID from the image's URI
@@ -125,38 +502,363 @@ int handle_read_call(int connection, const struct http_message* msg)
     }
 
     // Converting resolution string to int value
-    int res = resolution_atoi(res_str);
+    int res = imgfs_resolution_atoi(res_str, &fs_file);
     if (res == -1) {
         return reply_error_msg(connection, ERR_RESOLUTIONS);
     }
 
-    char *image_buffer;
-    uint32_t image_size;
+    // A name may later get another content, hence caches must revalidate each time
+    return reply_image(connection, msg, img_id, NULL, res, "no-cache");
+}
 
-    // Locking the mutex before calling do_read
-    if (thread_lock() != ERR_NONE) return reply_error_msg(connection, ERR_RUNTIME);
+int handle_blob_call(int connection, const struct http_message* msg)
+{
 
-    int ret_read = do_read(img_id, res, &image_buffer, &image_size, &fs_file);
+    M_REQUIRE_NON_NULL(msg);
 
-    // Unlocking the mutex after calling do_read
-    if(thread_unlock() != ERR_NONE) return reply_error_msg(connection, ERR_RUNTIME);
+    // The SHA is the rest of the path, up to the parameters
+    const char *sha_str = msg->uri.val + strlen(BLOB_URI);
+    size_t sha_len = 0;
+    while (strlen(BLOB_URI) + sha_len < msg->uri.len && sha_str[sha_len] != '?') ++sha_len;
 
-    if (ret_read != ERR_NONE) {
-        return reply_error_msg(connection, ret_read);
+    unsigned char SHA[SHA256_DIGEST_LENGTH];
+    if (sha_from_string(sha_str, sha_len, SHA) != ERR_NONE) {
+        return reply_error_msg(connection, ERR_INVALID_ARGUMENT);
     }
 
-    char headers[MAX_HEADER_SIZE];
-    snprintf(headers, sizeof(headers), "Content-Type: image/jpeg\r\n");
+    // Original resolution by default
+    char res_str[MAX_RES_NAME + 1] = {0};
+    int res = ORIG_RES;
+    if (http_get_var(&msg->uri, "res", res_str, sizeof(res_str)) > 0) {
+        res = imgfs_resolution_atoi(res_str, &fs_file);
+        if (res == -1) {
+            return reply_error_msg(connection, ERR_RESOLUTIONS);
+        }
+    }
 
-    //Sending HTTP response with the image
-    int http_ret = http_reply(connection, "200 OK", headers, image_buffer, image_size);
+    // Such a URL always designates the same content
+    return reply_image(connection, msg, NULL, SHA, res, "public, max-age=31536000, immutable");
+}
 
-    free(image_buffer);
-    image_buffer = NULL;
 
-    return http_ret;
+/**********************************************************************
+ * Whether the len bytes of str have some control character.
+ ********************************************************************** */
+static int has_control(const char *str, size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        if ((unsigned char) str[i] < 0x20 || str[i] == 0x7f) return 1;
+    }
+    return 0;
 }
 
+/**********************************************************************
+ * Writes str to out (of size bytes, at least 3 per character of str
+ * and 1) as a component of a URL: all but the unreserved characters
+ * percent-encoded. Returns the length written.
+ ********************************************************************** */
+static size_t url_encode(const char *str, char *out, size_t size)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    size_t len = 0;
+    for (; *str != '\0' && len + 4 <= size; ++str) {
+        const unsigned char c = (unsigned char) *str;
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+            c == '-' || c == '.' || c == '_' || c == '~') {
+            out[len++] = (char) c;
+        } else {
+            out[len++] = '%';
+            out[len++] = hex[c >> 4];
+            out[len++] = hex[c & 0xf];
+        }
+    }
+    out[len] = '\0';
+    return len;
+}
+
+/**********************************************************************
+ * Sends many images in one response ("multipart/mixed", each part with
+ * its length), as asked for in the body, one "<resolution> <img_id>" per
+ * line. They are all located (and resized) with the mutex locked once,
+ * then read in the order of their offsets; the parts are in the order
+ * of the lines, those of the images that cannot be read with an error
+ * message instead.
+ ********************************************************************** */
+int handle_batch_read_call(int connection, const struct http_message* msg)
+{
+
+    M_REQUIRE_NON_NULL(msg);
+
+    struct imgfs_read_request *requests = calloc(BATCH_READ_MAX, sizeof(*requests));
+    char (*img_ids)[MAX_IMG_ID + 1] = calloc(BATCH_READ_MAX, sizeof(*img_ids));
+    if (requests == NULL || img_ids == NULL) {
+        free(requests);
+        free(img_ids);
+        return reply_error_msg(connection, ERR_OUT_OF_MEMORY);
+    }
+
+    size_t nb = 0;
+    int ret = ERR_NONE;
+    const char *line = msg->body.val;
+    const char *const body_end = msg->body.val + msg->body.len;
+    while (line < body_end && ret == ERR_NONE) {
+        const char *line_end = memchr(line, '\n', (size_t) (body_end - line));
+        if (line_end == NULL) line_end = body_end;
+        const char *id_start = memchr(line, ' ', (size_t) (line_end - line));
+        const char *id_end = line_end > line && line_end[-1] == '\r' ? line_end - 1 : line_end;
+
+        if (line == id_end) {
+            // empty line
+        } else if (nb == BATCH_READ_MAX) {
+            ret = ERR_INVALID_ARGUMENT;
+        } else if (id_start == NULL || id_start - line > MAX_RES_NAME || id_end - id_start - 1 > MAX_IMG_ID) {
+            ret = ERR_INVALID_ARGUMENT;
+        } else if (has_control(line, (size_t) (id_end - line))) {
+            // they would break the headers of the parts
+            ret = ERR_INVALID_ARGUMENT;
+        } else {
+            char res_str[MAX_RES_NAME + 1] = {0};
+            memcpy(res_str, line, (size_t) (id_start - line));
+            memcpy(img_ids[nb], id_start + 1, (size_t) (id_end - id_start - 1));
+            requests[nb].img_id = img_ids[nb];
+            requests[nb].resolution = imgfs_resolution_atoi(res_str, &fs_file);
+            ++nb;
+        }
+        line = line_end + 1;
+    }
+    if (ret == ERR_NONE && nb == 0) ret = ERR_NOT_ENOUGH_ARGUMENTS;
+    if (ret != ERR_NONE) {
+        free(requests);
+        free(img_ids);
+        return reply_error_msg(connection, ret);
+    }
+
+    // One pass over the metadata with the mutex locked, one over the contents without
+    if (thread_lock() != ERR_NONE) {
+        free(requests);
+        free(img_ids);
+        return reply_error_msg(connection, ERR_RUNTIME);
+    }
+    ret = do_read_batch_locate(requests, nb, &fs_file);
+    for (size_t i = 0; i < nb; ++i) {
+        if (requests[i].resized) variant_made(requests[i].img_id, requests[i].resolution);
+    }
+    const int fd = fileno(fs_file.file);
+    if (thread_unlock() != ERR_NONE && ret == ERR_NONE) ret = ERR_RUNTIME;
+
+    char *contents = NULL;
+    if (ret == ERR_NONE) ret = do_read_batch(requests, nb, fd, &contents);
+    if (ret != ERR_NONE) {
+        free(requests);
+        free(img_ids);
+        return reply_error_msg(connection, ret);
+    }
+
+    // Each part has its length: clients need not look for the boundary in the images
+#define BATCH_BOUNDARY "imgfs-batch-read-boundary"
+    ret = http_reply_chunked(connection, HTTP_OK,
+                             "Content-Type: multipart/mixed; boundary=" BATCH_BOUNDARY HTTP_LINE_DELIM);
+    for (size_t i = 0; i < nb && ret == ERR_NONE; ++i) {
+        const struct imgfs_read_request *const request = &requests[i];
+        char error[ERR_MSG_SIZE];
+        const char *data = request->data;
+        size_t size = request->size;
+        if (request->status != ERR_NONE) {
+            snprintf(error, sizeof(error), "Error: %s\n", ERR_MSG(request->status));
+            data = error;
+            size = strlen(error);
+        }
+
+        const char *const res_name = imgfs_resolution_name(&fs_file, request->resolution);
+        char img_id[3 * MAX_IMG_ID + 1];
+        url_encode(request->img_id, img_id, sizeof(img_id));
+        char part[sizeof(img_id) + 256];
+        const int part_len = snprintf(part, sizeof(part), "%s--" BATCH_BOUNDARY HTTP_LINE_DELIM "Content-Type: %s" HTTP_LINE_DELIM
+                                      "Content-Location: /imgfs/read?res=%s&img_id=%s" HTTP_LINE_DELIM
+                                      "Content-Length: %zu" HTTP_HDR_END_DELIM,
+                                      i > 0 ? HTTP_LINE_DELIM : "",
+                                      request->status == ERR_NONE ? "image/jpeg" : "text/plain",
+                                      res_name != NULL ? res_name : "",
+                                      img_id, size);
+        ret = http_send_chunk(connection, part, (size_t) part_len);
+        if (ret == ERR_NONE && size > 0) ret = http_send_chunk(connection, data, size);
+    }
+    free(contents);
+    free(requests);
+    free(img_ids);
+
+    // The status is sent already: on error, the body is left unfinished and the connection closed
+    if (ret != ERR_NONE) return ret;
+
+    static const char end[] = HTTP_LINE_DELIM "--" BATCH_BOUNDARY "--" HTTP_LINE_DELIM;
+    ret = http_send_chunk(connection, end, strlen(end));
+    return ret == ERR_NONE ? http_send_chunk(connection, NULL, 0) : ret;
+#undef BATCH_BOUNDARY
+}
+
+/**********************************************************************
+ * Writes to json the map of sprite, made for page and cols: where the
+ * thumbnail of each image is in it, and the URL of the sprite itself.
+ ********************************************************************** */
+static int sprite_map(const struct sprite *sprite, size_t page, size_t cols, char **json, size_t *len)
+{
+    const size_t size = 512 + sprite->nb_tiles * (128 + 6 * MAX_IMG_ID);
+    *json = malloc(size);
+    if (*json == NULL) return ERR_OUT_OF_MEMORY;
+
+    size_t pos = (size_t) snprintf(*json, size, "{ \"version\": %u, \"page\": %zu, \"more\": %s, "
+                                   "\"width\": %u, \"height\": %u, \"image\": ",
+                                   sprite->version, page, sprite->more ? "true" : "false",
+                                   sprite->width, sprite->height);
+    if (sprite->nb_tiles > 0) {
+        pos += (size_t) snprintf(*json + pos, size - pos, "\"" URI_ROOT "/sprite?page=%zu&cols=%zu&version=%u&format=jpeg\"",
+                                 page, cols, sprite->version);
+    } else {
+        pos += (size_t) snprintf(*json + pos, size - pos, "null");
+    }
+
+    pos += (size_t) snprintf(*json + pos, size - pos, ", \"tiles\": { ");
+    for (size_t i = 0; i < sprite->nb_tiles; ++i) {
+        const struct sprite_tile *const tile = &sprite->tiles[i];
+        if (i > 0) pos += (size_t) snprintf(*json + pos, size - pos, ", ");
+        pos += json_string(tile->img_id, MAX_IMG_ID, *json + pos, size - pos);
+        pos += (size_t) snprintf(*json + pos, size - pos, ": { \"x\": %u, \"y\": %u, \"width\": %u, \"height\": %u }",
+                                 tile->x, tile->y, tile->width, tile->height);
+    }
+    pos += (size_t) snprintf(*json + pos, size - pos, "%s} }", sprite->nb_tiles > 0 ? " " : "");
+
+    *len = pos;
+    return ERR_NONE;
+}
+
+/**********************************************************************
+ * Looks for the sprite of version, page and cols in the cache (with the
+ * mutex locked), and copies its JPEG (if jpeg) or its map to out.
+ * Returns 1 if it is there, 0 if not, or some error code.
+ ********************************************************************** */
+static int sprite_cache_get(uint32_t version, size_t page, size_t cols, int jpeg, char **out, size_t *len)
+{
+    for (size_t i = 0; i < SPRITE_CACHE_SLOTS; ++i) {
+        const struct sprite_cache *const cached = &sprite_cache[i];
+        if (cached->json == NULL || cached->version != version || cached->page != page || cached->cols != cols) {
+            continue;
+        }
+        if (jpeg && cached->jpeg == NULL) return ERR_IMAGE_NOT_FOUND; // the page has no image
+
+        const void *const data = jpeg ? cached->jpeg : cached->json;
+        *len = jpeg ? cached->jpeg_size : cached->json_len;
+        *out = malloc(*len > 0 ? *len : 1);
+        if (*out == NULL) return ERR_OUT_OF_MEMORY;
+        memcpy(*out, data, *len);
+        return 1;
+    }
+    return 0;
+}
+
+/**********************************************************************
+ * Sends the thumbnails of a page of images in one JPEG ("format=jpeg"),
+ * or the map of where each one is in it. Sprites are cached by version
+ * of the imgFS, page and columns: the JPEG of an older version is sent
+ * as long as it is cached, the map giving the URL of the JPEG of its
+ * version, which thus never changes.
+ ********************************************************************** */
+int handle_sprite_call(int connection, const struct http_message* msg)
+{
+
+    M_REQUIRE_NON_NULL(msg);
+
+    char page_str[16] = {0}, cols_str[16] = {0}, version_str[16] = {0}, format[8] = {0};
+    size_t page = 0, cols = SPRITE_DEFAULT_COLS;
+    if (http_get_var(&msg->uri, "page", page_str, sizeof(page_str)) > 0) {
+        page = atouint32(page_str);
+        if (errno == ERANGE) return reply_error_msg(connection, ERR_INVALID_ARGUMENT);
+    }
+    if (http_get_var(&msg->uri, "cols", cols_str, sizeof(cols_str)) > 0) {
+        cols = atouint32(cols_str);
+        if (errno == ERANGE || cols == 0 || cols > SPRITE_MAX_COLS) {
+            return reply_error_msg(connection, ERR_INVALID_ARGUMENT);
+        }
+    }
+    const int has_version = http_get_var(&msg->uri, "version", version_str, sizeof(version_str)) > 0;
+    const uint32_t version = has_version ? atouint32(version_str) : 0;
+    if (has_version && errno == ERANGE) return reply_error_msg(connection, ERR_INVALID_ARGUMENT);
+    const int jpeg = http_get_var(&msg->uri, "format", format, sizeof(format)) > 0 && strcmp(format, "jpeg") == 0;
+
+    // JPEGs of a given version are the same forever
+    const char *const headers = !jpeg ? "Content-Type: application/json" HTTP_LINE_DELIM :
+                                has_version ? "Content-Type: image/jpeg" HTTP_LINE_DELIM
+                                "Cache-Control: public, max-age=31536000, immutable" HTTP_LINE_DELIM :
+                                "Content-Type: image/jpeg" HTTP_LINE_DELIM;
+
+    struct sprite *sprite = calloc(1, sizeof(*sprite));
+    if (sprite == NULL) return reply_error_msg(connection, ERR_OUT_OF_MEMORY);
+
+    if (thread_lock() != ERR_NONE) {
+        free(sprite);
+        return reply_error_msg(connection, ERR_RUNTIME);
+    }
+
+    char *out = NULL;
+    size_t len = 0;
+    const uint32_t current = fs_file.header.version;
+    int ret = sprite_cache_get(has_version ? version : current, page, cols, jpeg, &out, &len);
+    if (ret == 0) {
+        // Sprites of older versions cannot be made anymore
+        if (has_version && version != current) {
+            ret = ERR_IMAGE_NOT_FOUND;
+        } else {
+            ret = sprite_locate(sprite, page, &fs_file);
+            for (size_t i = 0; i < sprite->nb_tiles; ++i) {
+                if (sprite->thumbs[i].resized) variant_made(sprite->tiles[i].img_id, THUMB_RES);
+            }
+        }
+    }
+    const int fd = fileno(fs_file.file);
+
+    if (thread_unlock() != ERR_NONE && ret == ERR_NONE) ret = ERR_RUNTIME;
+
+    if (ret == 1) {
+        // cached
+        free(sprite);
+        ret = http_reply(connection, HTTP_OK, headers, out, len);
+        free(out);
+        return ret;
+    }
+
+    // Made without the lock held: the thumbnails located never move
+    char *json = NULL;
+    size_t json_len = 0;
+    if (ret == ERR_NONE) ret = sprite_compose(sprite, cols, fd);
+    if (ret == ERR_NONE) ret = sprite_map(sprite, page, cols, &json, &json_len);
+    if (ret == ERR_NONE && jpeg && sprite->jpeg == NULL) ret = ERR_IMAGE_NOT_FOUND;
+    if (ret != ERR_NONE) {
+        sprite_free(sprite);
+        free(sprite);
+        free(json);
+        return reply_error_msg(connection, ret);
+    }
+
+    ret = jpeg ? http_reply(connection, HTTP_OK, headers, sprite->jpeg, sprite->jpeg_size) :
+          http_reply(connection, HTTP_OK, headers, json, json_len);
+
+    // The cache takes the sprite and its map (replacing the oldest ones)
+    if (thread_lock() == ERR_NONE) {
+        struct sprite_cache *const slot = &sprite_cache[sprite_cache_next];
+        sprite_cache_next = (sprite_cache_next + 1) % SPRITE_CACHE_SLOTS;
+        g_free(slot->jpeg);
+        free(slot->json);
+        *slot = (struct sprite_cache) {
+            sprite->version, page, cols, sprite->jpeg, sprite->jpeg_size, json, json_len
+        };
+        sprite->jpeg = NULL;
+        json = NULL;
+        thread_unlock();
+    }
+    sprite_free(sprite);
+    free(sprite);
+    free(json);
+    return ret;
+}
 
 int handle_delete_call(int connection, const struct http_message* msg)
 {
@@ -173,11 +875,20 @@ int handle_delete_call(int connection, const struct http_message* msg)
     // Locking the mutex before calling do_delete
     if (thread_lock() != ERR_NONE) return reply_error_msg(connection, ERR_RUNTIME);
 
+    const int index = find_image_index(img_id, &fs_file);
     int ret_delete = do_delete(img_id, &fs_file);
+    if (ret_delete == ERR_NONE) {
+        if (index >= 0) image_cache_invalidate(&cache, (uint32_t) index);
+        log_change(CHANGE_DELETE, img_id);
+    }
+    const uint64_t sequence = imgfs_journal_sequence(fs_file.journal);
 
     // Unlocking the mutex after calling do_delete
     if(thread_unlock() != ERR_NONE) return reply_error_msg(connection, ERR_RUNTIME);
 
+    // The deletion is durable once journaled, with the other changes made meanwhile (if strict)
+    if (ret_delete == ERR_NONE) ret_delete = imgfs_wait_durable(&fs_file, sequence);
+
     if (ret_delete != ERR_NONE) {
         return reply_error_msg(connection, ret_delete);
     }
@@ -205,10 +916,15 @@ int handle_insert_call(int connection, const struct http_message* msg)
     if (thread_lock() != ERR_NONE) return reply_error_msg(connection, ERR_RUNTIME);
 
     int ret = do_insert(image_buffer, image_size, name, &fs_file);
+    if (ret == ERR_NONE) log_change(CHANGE_INSERT, name);
+    const uint64_t sequence = imgfs_journal_sequence(fs_file.journal);
 
     // Unlock the mutex after calling do_insert
     if(thread_unlock() != ERR_NONE) return reply_error_msg(connection, ERR_RUNTIME);
 
+    // The insertion is durable once journaled, with the other changes made meanwhile (if strict)
+    if (ret == ERR_NONE) ret = imgfs_wait_durable(&fs_file, sequence);
+
     if (ret != ERR_NONE) {
         return reply_error_msg(connection, ret);
     }
@@ -217,6 +933,454 @@ int handle_insert_call(int connection, const struct http_message* msg)
     return reply_302_msg(connection);
 }
 
+/**********************************************************************
+ * Inserts all the images of a "multipart/form-data" body, each named by
+ * its filename (or its name). They are hashed and measured before the
+ * mutex is locked, then inserted together: their contents appended with
+ * one write, the metadata and header with another. Replies with the
+ * status of each image, in order.
+ ********************************************************************** */
+int handle_batch_insert_call(int connection, const struct http_message* msg)
+{
+
+    M_REQUIRE_NON_NULL(msg);
+
+    struct http_string boundary;
+    if (!http_multipart_boundary(msg, &boundary)) {
+        return reply_error_msg(connection, ERR_INVALID_ARGUMENT);
+    }
+
+    struct imgfs_insert_request *requests = calloc(BATCH_INSERT_MAX, sizeof(*requests));
+    char (*img_ids)[MAX_IMG_ID + 1] = calloc(BATCH_INSERT_MAX, sizeof(*img_ids));
+    if (requests == NULL || img_ids == NULL) {
+        free(requests);
+        free(img_ids);
+        return reply_error_msg(connection, ERR_OUT_OF_MEMORY);
+    }
+
+    size_t nb = 0;
+    int ret = 1;
+    struct http_string body = msg->body;
+    struct http_string name, content;
+    while (ret == 1 && (ret = http_multipart_next(&boundary, &body, &name, &content)) == 1) {
+        if (nb == BATCH_INSERT_MAX) {
+            ret = ERR_INVALID_ARGUMENT;
+            break;
+        }
+        memcpy(img_ids[nb], name.val, MIN(name.len, (size_t) MAX_IMG_ID));
+        requests[nb].img_id = img_ids[nb];
+        requests[nb].data = content.val;
+        requests[nb].size = content.len;
+        if (name.len > MAX_IMG_ID) requests[nb].status = ERR_INVALID_IMGID;
+        ++nb;
+    }
+    if (ret == ERR_NONE && nb == 0) ret = ERR_NOT_ENOUGH_ARGUMENTS;
+    if (ret == ERR_NONE) ret = do_insert_batch_prepare(requests, nb);
+    if (ret != ERR_NONE) {
+        free(requests);
+        free(img_ids);
+        return reply_error_msg(connection, ret);
+    }
+
+    if (thread_lock() != ERR_NONE) {
+        free(requests);
+        free(img_ids);
+        return reply_error_msg(connection, ERR_RUNTIME);
+    }
+
+    ret = do_insert_batch(requests, nb, &fs_file);
+    const uint32_t version = fs_file.header.version;
+    if (ret == ERR_NONE) {
+        // Each image inserted incremented the version
+        size_t nb_inserted = 0;
+        for (size_t i = 0; i < nb; ++i) nb_inserted += requests[i].status == ERR_NONE;
+        uint32_t inserted_version = version - (uint32_t) nb_inserted;
+        for (size_t i = 0; i < nb; ++i) {
+            if (requests[i].status == ERR_NONE) log_change_to(++inserted_version, CHANGE_INSERT, requests[i].img_id);
+        }
+    }
+    const uint64_t sequence = imgfs_journal_sequence(fs_file.journal);
+
+    if (thread_unlock() != ERR_NONE) {
+        free(requests);
+        free(img_ids);
+        return reply_error_msg(connection, ERR_RUNTIME);
+    }
+
+    if (ret == ERR_NONE) ret = imgfs_wait_durable(&fs_file, sequence);
+
+    if (ret != ERR_NONE) {
+        free(requests);
+        free(img_ids);
+        return reply_error_msg(connection, ret);
+    }
+
+    const size_t size = 64 + nb * (64 + 6 * MAX_IMG_ID + ERR_MSG_SIZE);
+    char *json = malloc(size);
+    if (json == NULL) {
+        free(requests);
+        free(img_ids);
+        return reply_error_msg(connection, ERR_OUT_OF_MEMORY);
+    }
+
+    size_t len = (size_t) snprintf(json, size, "{ \"version\": %u, \"images\": [ ", version);
+    for (size_t i = 0; i < nb; ++i) {
+        len += (size_t) snprintf(json + len, size - len, "%s{ \"img_id\": ", i > 0 ? ", " : "");
+        len += json_string(requests[i].img_id, MAX_IMG_ID, json + len, size - len);
+        if (requests[i].status == ERR_NONE) {
+            len += (size_t) snprintf(json + len, size - len, ", \"inserted\": true }");
+        } else {
+            len += (size_t) snprintf(json + len, size - len, ", \"inserted\": false, \"error\": ");
+            len += json_string(ERR_MSG(requests[i].status), ERR_MSG_SIZE, json + len, size - len);
+            len += (size_t) snprintf(json + len, size - len, " }");
+        }
+    }
+    len += (size_t) snprintf(json + len, size - len, " ] }");
+    free(requests);
+    free(img_ids);
+
+    const int http_ret = http_reply(connection, HTTP_OK, "Content-Type: application/json\r\n", json, len);
+    free(json);
+    return http_ret;
+}
+
+
+int handle_changes_call(int connection, const struct http_message* msg)
+{
+
+    M_REQUIRE_NON_NULL(msg);
+
+    char since_str[16] = {0};
+    if (http_get_var(&msg->uri, "since", since_str, sizeof(since_str)) <= 0) {
+        return reply_error_msg(connection, ERR_NOT_ENOUGH_ARGUMENTS);
+    }
+    const uint32_t since = atouint32(since_str);
+    if (errno == ERANGE) return reply_error_msg(connection, ERR_INVALID_ARGUMENT);
+
+    struct change_record *records = calloc(CHANGES_PER_REPLY, sizeof(*records));
+    if (records == NULL) return reply_error_msg(connection, ERR_OUT_OF_MEMORY);
+
+    if (thread_lock() != ERR_NONE) {
+        free(records);
+        return reply_error_msg(connection, ERR_RUNTIME);
+    }
+
+    size_t nb = 0;
+    const int ret = change_log_read(&changes, since, records, CHANGES_PER_REPLY, &nb);
+    const uint32_t version = fs_file.header.version;
+
+    if (thread_unlock() != ERR_NONE) {
+        free(records);
+        return reply_error_msg(connection, ERR_RUNTIME);
+    }
+
+    if (ret != ERR_NONE && ret != ERR_INVALID_ARGUMENT) {
+        free(records);
+        return reply_error_msg(connection, ret);
+    }
+
+    // The version the client is at once it applied these changes; "reset" if it has to list everything again
+    static const char *const op_names[] = { "", "insert", "delete" };
+    const size_t size = 64 + nb * (64 + 6 * MAX_IMG_ID + 2);
+    char *json = malloc(size);
+    if (json == NULL) {
+        free(records);
+        return reply_error_msg(connection, ERR_OUT_OF_MEMORY);
+    }
+
+    size_t len;
+    if (ret == ERR_INVALID_ARGUMENT) {
+        len = (size_t) snprintf(json, size, "{ \"version\": %u, \"reset\": true }", version);
+    } else {
+        const uint32_t reached = nb > 0 ? records[nb - 1].version : since;
+        len = (size_t) snprintf(json, size, "{ \"version\": %u, \"more\": %s, \"changes\": [ ",
+                                reached, reached < version ? "true" : "false");
+        for (size_t i = 0; i < nb; ++i) {
+            const uint32_t op = records[i].op <= CHANGE_DELETE ? records[i].op : 0;
+            len += (size_t) snprintf(json + len, size - len, "%s{ \"version\": %u, \"op\": \"%s\", \"img_id\": ",
+                                     i > 0 ? ", " : "", records[i].version, op_names[op]);
+            len += json_string(records[i].img_id, MAX_IMG_ID, json + len, size - len);
+            len += (size_t) snprintf(json + len, size - len, " }");
+        }
+        len += (size_t) snprintf(json + len, size - len, "%s] }", nb > 0 ? " " : "");
+    }
+    free(records);
+
+    const int http_ret = http_reply(connection, HTTP_OK, "Content-Type: application/json\r\n", json, len);
+    free(json);
+    return http_ret;
+}
+
+
+/**********************************************************************
+ * Subscribes the connection to the changes of the imgFS ("Server-Sent Events").
+ * A client that was already subscribed gives the ID of the last event it got
+ * (with the Last-Event-ID header, or the since parameter): the changes it
+ * missed are sent first, if they are known; otherwise, it is sent a "reset"
+ * event, after which it has to list the whole imgFS again.
+ ********************************************************************** */
+int handle_events_call(int connection, const struct http_message* msg)
+{
+
+    M_REQUIRE_NON_NULL(msg);
+
+    char since_str[16] = {0};
+    const struct http_string *last_id = http_get_header(msg, "Last-Event-ID");
+    if (last_id != NULL && last_id->len > 0 && last_id->len < sizeof(since_str)) {
+        memcpy(since_str, last_id->val, last_id->len);
+    } else {
+        http_get_var(&msg->uri, "since", since_str, sizeof(since_str));
+    }
+    const int resuming = since_str[0] != '\0';
+    const uint32_t since = resuming ? atouint32(since_str) : 0;
+    if (resuming && errno == ERANGE) return reply_error_msg(connection, ERR_INVALID_ARGUMENT);
+
+    struct change_record *records = resuming ? calloc(CHANGES_PER_REPLY, sizeof(*records)) : NULL;
+    if (resuming && records == NULL) return reply_error_msg(connection, ERR_OUT_OF_MEMORY);
+    const size_t size = 512 + (resuming ? CHANGES_PER_REPLY * CHANGE_EVENT_SIZE : 0);
+    char *initial = malloc(size);
+    if (initial == NULL) {
+        free(records);
+        return reply_error_msg(connection, ERR_OUT_OF_MEMORY);
+    }
+
+    // Subscribing with the mutex locked: no change is made between those sent first and the next ones
+    if (thread_lock() != ERR_NONE) {
+        free(records);
+        free(initial);
+        return reply_error_msg(connection, ERR_RUNTIME);
+    }
+
+    const uint32_t version = fs_file.header.version;
+    size_t nb = 0;
+    int ret = resuming ? change_log_read(&changes, since, records, CHANGES_PER_REPLY, &nb) : ERR_NONE;
+    const int reset = ret == ERR_INVALID_ARGUMENT || (nb > 0 && records[nb - 1].version < version);
+
+    size_t len = (size_t) snprintf(initial, size, HTTP_PROTOCOL_ID HTTP_OK HTTP_LINE_DELIM
+                                   "Content-Type: text/event-stream" HTTP_LINE_DELIM
+                                   "Cache-Control: no-cache" HTTP_LINE_DELIM
+                                   "Connection: close" HTTP_HDR_END_DELIM
+                                   "retry: %d\n", EVENTS_RETRY_MS);
+    if (reset) {
+        len += (size_t) snprintf(initial + len, size - len,
+                                 "id: %u\nevent: reset\ndata: { \"version\": %u }\n\n", version, version);
+    } else if (!resuming) {
+        // The version the events start from, for the client to resume from later
+        len += (size_t) snprintf(initial + len, size - len, "id: %u\n\n", version);
+    } else {
+        for (size_t i = 0; i < nb; ++i) {
+            len += change_event(initial + len, records[i].version, records[i].op, records[i].img_id);
+        }
+    }
+    if (ret == ERR_NONE || ret == ERR_INVALID_ARGUMENT) {
+        ret = event_hub_subscribe(&events, connection, initial, len);
+    }
+
+    if (thread_unlock() != ERR_NONE && ret == ERR_NONE) {
+        // the connection belongs to the hub anyway
+        fprintf(stderr, "handle_events_call(): pthread_mutex_unlock failed\n");
+    }
+    free(records);
+    free(initial);
+
+    if (ret != ERR_NONE) {
+        return reply_error_msg(connection, ret);
+    }
+    return HTTP_CONNECTION_TAKEN;
+}
+
+
+int handle_stats_call(int connection)
+{
+    struct image_cache_stats stats;
+    image_cache_stats(&cache, &stats);
+
+    const size_t lookups = stats.hits + stats.misses;
+    char json[ERR_MSG_SIZE];
+    const int len = snprintf(json, sizeof(json),
+                             "{ \"cache\": { \"hits\": %zu, \"misses\": %zu, \"hit_ratio\": %.3f, "
+                             "\"evictions\": %zu, \"entries\": %zu, \"bytes\": %zu } }",
+                             stats.hits, stats.misses, lookups > 0 ? (double) stats.hits / (double) lookups : 0.0,
+                             stats.evictions, stats.entries, stats.bytes);
+    if (len < 0 || (size_t) len >= sizeof(json)) {
+        return reply_error_msg(connection, ERR_RUNTIME);
+    }
+
+    return http_reply(connection, HTTP_OK, "Content-Type: application/json\r\n", json, (size_t) len);
+}
+
+
+/**********************************************************************
+ * Makes room for more images: the imgFS grows to max_files entries.
+ ********************************************************************** */
+int handle_grow_call(int connection, const struct http_message* msg)
+{
+
+    M_REQUIRE_NON_NULL(msg);
+
+    char max_files_str[11] = {0};
+    if (http_get_var(&msg->uri, "max_files", max_files_str, sizeof(max_files_str)) <= 0) {
+        return reply_error_msg(connection, ERR_NOT_ENOUGH_ARGUMENTS);
+    }
+    const uint32_t max_files = atouint32(max_files_str);
+    if (errno == ERANGE || max_files == 0) {
+        return reply_error_msg(connection, ERR_INVALID_ARGUMENT);
+    }
+
+    // The metadata array moves: nothing else may look at it meanwhile
+    if (thread_lock() != ERR_NONE) return reply_error_msg(connection, ERR_RUNTIME);
+
+    int ret = do_grow(&fs_file, max_files);
+    const uint64_t sequence = imgfs_journal_sequence(fs_file.journal);
+
+    if (thread_unlock() != ERR_NONE) return reply_error_msg(connection, ERR_RUNTIME);
+
+    // The growth is durable with the changes made before it (if strict)
+    if (ret == ERR_NONE) ret = imgfs_wait_durable(&fs_file, sequence);
+
+    if (ret != ERR_NONE) {
+        return reply_error_msg(connection, ret);
+    }
+
+    return reply_302_msg(connection);
+}
+
+
+/**********************************************************************
+ * Streamed insertion: the body is written to the imgFS file as it arrives.
+ ********************************************************************** */
+static int insert_stream_write(void *ctx, const char *chunk, size_t chunk_len)
+{
+    if (thread_lock() != ERR_NONE) return ERR_RUNTIME;
+
+    int ret = do_insert_write(ctx, chunk, chunk_len);
+
+    if (thread_unlock() != ERR_NONE) return ERR_RUNTIME;
+    return ret;
+}
+
+static int insert_stream_end(void *ctx, int connection, int err)
+{
+    struct imgfs_insert *insert = ctx;
+
+    if (thread_lock() != ERR_NONE) {
+        free(insert);
+        return reply_error_msg(connection, ERR_RUNTIME);
+    }
+
+    if (err == ERR_NONE) {
+        err = do_insert_commit(insert);
+        if (err == ERR_NONE) log_change(CHANGE_INSERT, insert->img_id);
+    } else {
+        do_insert_abort(insert);
+    }
+    const uint64_t sequence = imgfs_journal_sequence(fs_file.journal);
+
+    if (thread_unlock() != ERR_NONE) err = ERR_RUNTIME;
+    free(insert);
+
+    if (err == ERR_NONE) err = imgfs_wait_durable(&fs_file, sequence);
+
+    if (err != ERR_NONE) {
+        return reply_error_msg(connection, err);
+    }
+    // Send redirect response to client
+    return reply_302_msg(connection);
+}
+
+/**********************************************************************
+ * Answers an insertion whose client waits for "100 Continue" before sending
+ * the image, when it is not needed: the name is taken (409), the imgFS is full,
+ * or the content given by its "X-Content-SHA256" is already stored.
+ * Returns HTTP_BODY_ANSWERED if it did, HTTP_BODY_BUFFERED otherwise.
+ ********************************************************************** */
+static int handle_insert_preflight(int connection, const struct http_message *msg, const char *name)
+{
+    unsigned char sha[SHA256_DIGEST_LENGTH];
+    const unsigned char *known_sha = NULL;
+    const struct http_string *sha_header = http_get_header(msg, "X-Content-SHA256");
+    if (sha_header != NULL && sha_from_string(sha_header->val, sha_header->len, sha) == ERR_NONE) {
+        known_sha = sha;
+    }
+
+    if (thread_lock() != ERR_NONE) return HTTP_BODY_BUFFERED;
+
+    int ret = do_insert_preflight(name, known_sha, &fs_file);
+    if (ret > 0) log_change(CHANGE_INSERT, name);
+    const uint64_t sequence = imgfs_journal_sequence(fs_file.journal);
+
+    if (thread_unlock() != ERR_NONE) {
+        reply_error_status(connection, "500 Internal Server Error", "Connection: close" HTTP_LINE_DELIM, ERR_RUNTIME);
+        return HTTP_BODY_ANSWERED;
+    }
+
+    if (ret > 0 && imgfs_wait_durable(&fs_file, sequence) != ERR_NONE) ret = ERR_IO;
+
+    if (ret == 0) return HTTP_BODY_BUFFERED;
+
+    if (ret > 0) {
+        reply_302_headers(connection, "Connection: close" HTTP_LINE_DELIM);
+    } else if (ret == ERR_DUPLICATE_ID) {
+        reply_error_status(connection, "409 Conflict", "Connection: close" HTTP_LINE_DELIM, ret);
+    } else if (ret == ERR_IMGFS_FULL) {
+        reply_error_status(connection, "507 Insufficient Storage", "Connection: close" HTTP_LINE_DELIM, ret);
+    } else {
+        reply_error_status(connection, "500 Internal Server Error", "Connection: close" HTTP_LINE_DELIM, ret);
+    }
+    return HTTP_BODY_ANSWERED;
+}
+
+/**********************************************************************
+ * Chooses the requests whose body is streamed: insertions that can start.
+ * Others (even failing insertions) are handled by handle_http_message().
+ ********************************************************************** */
+static int handle_http_stream(const struct http_message *msg, size_t content_len, int connection,
+                              struct http_body_stream *stream)
+{
+    M_REQUIRE_NON_NULL(msg);
+    M_REQUIRE_NON_NULL(stream);
+
+    if (!http_match_verb(&msg->method, "POST") || !http_match_uri(msg, URI_ROOT "/insert")) {
+        return HTTP_BODY_BUFFERED;
+    }
+
+    char name[MAX_IMG_ID + 1] = {0};
+    if (http_get_var(&msg->uri, "name", name, sizeof(name)) <= 0) {
+        return HTTP_BODY_BUFFERED;
+    }
+
+    // The image may not be needed at all
+    if (http_expects_continue(msg) &&
+        handle_insert_preflight(connection, msg, name) == HTTP_BODY_ANSWERED) {
+        return HTTP_BODY_ANSWERED;
+    }
+
+    struct imgfs_insert *insert = malloc(sizeof(*insert));
+    if (insert == NULL) return HTTP_BODY_BUFFERED;
+
+    if (thread_lock() != ERR_NONE) {
+        free(insert);
+        return HTTP_BODY_BUFFERED;
+    }
+
+    int ret = do_insert_begin(insert, name, content_len, &fs_file);
+
+    if (thread_unlock() != ERR_NONE && ret == ERR_NONE) {
+        do_insert_abort(insert);
+        ret = ERR_RUNTIME;
+    }
+
+    if (ret != ERR_NONE) {
+        free(insert);
+        return HTTP_BODY_BUFFERED;
+    }
+
+    stream->ctx = insert;
+    stream->write = insert_stream_write;
+    stream->end = insert_stream_end;
+    return HTTP_BODY_STREAMED;
+}
+
 
 /**********************************************************************
  * Simple handling of http message. TO BE UPDATED WEEK 13
@@ -235,20 +1399,47 @@ int handle_http_message(struct http_message* msg, int connection)
 
     if (http_match_verb(&msg->method, "GET")) {
         if (http_match_uri(msg, URI_ROOT "/list")) {
-            return handle_list_call(connection);
+            return handle_list_call(connection, msg);
         }
         if (http_match_uri(msg, URI_ROOT "/read")) {
             return handle_read_call(connection, msg);
         }
+        if (http_match_uri(msg, BLOB_URI)) {
+            return handle_blob_call(connection, msg);
+        }
         if (http_match_uri(msg, URI_ROOT "/delete")) {
             return handle_delete_call(connection, msg);
         }
+        if (http_match_uri(msg, URI_ROOT "/changes")) {
+            return handle_changes_call(connection, msg);
+        }
+        if (http_match_uri(msg, URI_ROOT "/events")) {
+            return handle_events_call(connection, msg);
+        }
+        if (http_match_uri(msg, URI_ROOT "/sprite")) {
+            return handle_sprite_call(connection, msg);
+        }
+        if (http_match_uri(msg, URI_ROOT "/stats")) {
+            return handle_stats_call(connection);
+        }
     }
 
     if (http_match_verb(&msg->method, "POST") &&
         http_match_uri(msg, URI_ROOT "/insert")) {
         return handle_insert_call(connection, msg);
     }
+    if (http_match_verb(&msg->method, "POST") &&
+        http_match_uri(msg, URI_ROOT "/batch_read")) {
+        return handle_batch_read_call(connection, msg);
+    }
+    if (http_match_verb(&msg->method, "POST") &&
+        http_match_uri(msg, URI_ROOT "/batch_insert")) {
+        return handle_batch_insert_call(connection, msg);
+    }
+    if (http_match_verb(&msg->method, "POST") &&
+        http_match_uri(msg, URI_ROOT "/grow")) {
+        return handle_grow_call(connection, msg);
+    }
 
     return reply_error_msg(connection, ERR_INVALID_COMMAND);
 }
@@ -256,7 +1447,8 @@ int handle_http_message(struct http_message* msg, int connection)
 
 /********************************************************************//**
  * Startup function. Create imgFS file and load in-memory structure.
- * Pass the imgFS file name as argv[1] and optionally port number as argv[2]
+ * Pass the imgFS file name as argv[1] and optionally port number as argv[2],
+ * and --durability=none|interval:<ms>|strict anywhere after argv[1] (strict by default)
  ********************************************************************** */
 int server_startup (int argc, char **argv)
 {
@@ -265,6 +1457,20 @@ int server_startup (int argc, char **argv)
     M_REQUIRE_NON_NULL(argv);
     if (argc < 2) return ERR_NOT_ENOUGH_ARGUMENTS;
 
+    // The port number is the first argument after the imgFS file that is not an option
+    enum imgfs_durability durability = DURABILITY_STRICT;
+    uint32_t sync_interval = 0;
+    const char *port = NULL;
+    for (int i = 2; i < argc; ++i) {
+        if (strncmp(argv[i], DURABILITY_OPTION, strlen(DURABILITY_OPTION)) == 0) {
+            const int ret_durability = imgfs_durability_parse(argv[i] + strlen(DURABILITY_OPTION),
+                                       &durability, &sync_interval);
+            if (ret_durability != ERR_NONE) return ret_durability;
+        } else if (port == NULL) {
+            port = argv[i];
+        }
+    }
+
     //Vips initialization
     if (VIPS_INIT(argv[0])) {
         vips_error_exit(NULL);
@@ -274,10 +1480,18 @@ int server_startup (int argc, char **argv)
 
     if (ret_open < 0) return ret_open;
 
+    // Changes are journaled, the requests made at the same time being synced to disk at once
+    const int ret_journal = imgfs_journal_start(argv[1], &fs_file);
+    if (ret_journal != ERR_NONE) return ret_journal;
+
+    // and synced to disk as the durability mode says
+    const int ret_durability = imgfs_set_durability(&fs_file, durability, sync_interval);
+    if (ret_durability != ERR_NONE) return ret_durability;
+
     print_header(&fs_file.header);
 
-    // Using 2nd argument as the port number if present
-    server_port = (argc > 2) ? atouint16(argv[2]) : DEFAULT_LISTENING_PORT;
+    // Using the port number if present
+    server_port = port != NULL ? atouint16(port) : DEFAULT_LISTENING_PORT;
 
     // Initialize the global mutex
     if (pthread_mutex_init(&thread, NULL) != 0) {
@@ -285,7 +1499,17 @@ int server_startup (int argc, char **argv)
         return ERR_RUNTIME;
     }
 
+    const int ret_cache = image_cache_init(&cache, IMAGE_CACHE_BUDGET);
+    if (ret_cache != ERR_NONE) return ret_cache;
+
+    const int ret_changes = change_log_open(&changes, argv[1], fs_file.header.version);
+    if (ret_changes != ERR_NONE) return ret_changes;
+
+    const int ret_events = event_hub_start(&events);
+    if (ret_events != ERR_NONE) return ret_events;
+
     http_init(server_port, handle_http_message);
+    http_set_stream_callback(handle_http_stream);
 
     printf("ImgFS server started on http://localhost:%u\n", server_port);
 
@@ -300,7 +1524,20 @@ void server_shutdown (void)
 
     fprintf(stderr, "Shutting down...\n");
     http_close();
+    event_hub_stop(&events);
     do_close(&fs_file);
+    image_cache_free(&cache);
+    change_log_close(&changes);
+    for (size_t i = 0; i < NB_DO_LIST_MODES; ++i) {
+        free(list_cache[i].json);
+        list_cache[i].json = NULL;
+    }
+    for (size_t i = 0; i < SPRITE_CACHE_SLOTS; ++i) {
+        g_free(sprite_cache[i].jpeg);
+        free(sprite_cache[i].json);
+        sprite_cache[i].jpeg = NULL;
+        sprite_cache[i].json = NULL;
+    }
     vips_shutdown();
 
     // Destroying the global mutex
@@ -11,6 +11,15 @@
 
 #define BASE_FILE "index.html"
 #define DEFAULT_LISTENING_PORT 8000
+#define IMAGE_CACHE_BUDGET (64 * 1024 * 1024) // bytes of image contents kept in memory
+#define LIST_STREAM_THRESHOLD 1024 // images from which a whole listing is streamed rather than built at once
+#define LIST_CHUNK_SIZE      16384 // bytes of a streamed listing written at once (with the lock held)
+#define CHANGES_PER_REPLY     1000 // changes sent at most for one request to /imgfs/changes, or /imgfs/events
+#define EVENTS_RETRY_MS       2000 // milliseconds a client of /imgfs/events waits before connecting again
+#define BATCH_READ_MAX         256 // images read at most for one request to /imgfs/batch_read
+#define BATCH_INSERT_MAX       256 // images inserted at most for one request to /imgfs/batch_insert
+#define SPRITE_CACHE_SLOTS       8 // sprites kept, with their maps, for requests to /imgfs/sprite
+#define SPRITE_DEFAULT_COLS     10 // thumbnails per row of a sprite, if not asked for
 
 int server_startup (int argc, char **argv);
 
@@ -5,21 +5,30 @@
  * @author Mia Primorac
  */
 
+#define _GNU_SOURCE        // for SEEK_DATA and SEEK_HOLE
+
 #include "imgfs.h"
+#include "crc32c.h"
+#include "imgfs_durability.h"
+#include "imgfs_journal.h"
 #include "util.h"
 
+#include <errno.h>         // for errno, ENXIO
 #include <inttypes.h>      // for PRIxN macros
 #include <openssl/sha.h>   // for SHA256_DIGEST_LENGTH
+#include <stddef.h>        // for offsetof
 #include <stdint.h>        // for uint8_t
 #include <stdio.h>         // for sprintf
 #include <stdlib.h>        // for calloc
 #include <string.h>        // for strcmp
+#include <sys/stat.h>      // for fstat
+#include <unistd.h>        // for lseek, pread, fsync
 
 /*******************************************************************
  * Human-readable SHA
  */
-static void sha_to_string(const unsigned char *SHA,
-                          char *sha_string)
+void sha_to_string(const unsigned char *SHA,
+                   char *sha_string)
 {
     if (SHA == NULL) return;
 
@@ -30,6 +39,33 @@ static void sha_to_string(const unsigned char *SHA,
     sha_string[2 * SHA256_DIGEST_LENGTH] = '\0';
 }
 
+/*******************************************************************
+ * SHA from its human-readable form
+ */
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+int sha_from_string(const char *sha_string, size_t len, unsigned char *SHA)
+{
+    M_REQUIRE_NON_NULL(sha_string);
+    M_REQUIRE_NON_NULL(SHA);
+
+    if (len != 2 * SHA256_DIGEST_LENGTH) return ERR_INVALID_ARGUMENT;
+
+    for (size_t i = 0; i < SHA256_DIGEST_LENGTH; ++i) {
+        const int high = hex_digit(sha_string[2 * i]);
+        const int low = hex_digit(sha_string[2 * i + 1]);
+        if (high < 0 || low < 0) return ERR_INVALID_ARGUMENT;
+        SHA[i] = (unsigned char) (high << 4 | low);
+    }
+    return ERR_NONE;
+}
+
 /*******************************************************************
  * imgFS header display.
  */
@@ -121,6 +157,637 @@ int resolution_atoi (const char* str)
 
 
 
+/*******************************************************************
+ * Extension file
+ */
+static void ext_forget(struct imgfs_ext *ext)
+{
+    if (ext->file != NULL) fclose(ext->file);
+    ext->file = NULL;
+    free(ext->entries);
+    ext->entries = NULL;
+    memset(&ext->header, 0, sizeof(ext->header));
+    memset(ext->resolutions, 0, sizeof(ext->resolutions));
+}
+
+/**
+ * @brief Size of the fields of an entry this version knows about, for nb_resolutions resolutions.
+ */
+static size_t ext_known_size(uint32_t nb_resolutions)
+{
+    return offsetof(struct img_metadata_ext, variants) + nb_resolutions * sizeof(struct img_variant);
+}
+
+static long ext_entry_offset(const struct imgfs_ext *ext, size_t index)
+{
+    return (long) (sizeof(struct imgfs_ext_header) + ext->header.nb_resolutions * sizeof(struct imgfs_resolution) +
+                   index * ext->header.entry_size);
+}
+
+static int ext_read(struct imgfs_ext *ext, uint32_t max_files)
+{
+    if (fread(&ext->header, sizeof(ext->header), 1, ext->file) != 1) return ERR_IO;
+    if (memcmp(ext->header.magic, IMGFS_EXT_MAGIC, sizeof(ext->header.magic)) != 0 ||
+        ext->header.entry_size == 0 || ext->header.nb_entries != max_files ||
+        ext->header.nb_resolutions > MAX_EXTRA_RES) {
+        return ERR_IO;
+    }
+    if (ext->header.nb_resolutions > 0 &&
+        fread(ext->resolutions, sizeof(struct imgfs_resolution), ext->header.nb_resolutions, ext->file) !=
+        ext->header.nb_resolutions) {
+        return ERR_IO;
+    }
+
+    ext->entries = calloc(ext->header.nb_entries, sizeof(struct img_metadata_ext));
+    if (ext->entries == NULL) return ERR_OUT_OF_MEMORY;
+
+    // Only the fields this version knows about are read, the others are skipped
+    const uint32_t entry_size = ext->header.entry_size;
+    const size_t known_size = ext_known_size(ext->header.nb_resolutions);
+    const size_t known = entry_size < known_size ? entry_size : known_size;
+    for (uint32_t i = 0; i < ext->header.nb_entries; ++i) {
+        if (fread(&ext->entries[i], known, 1, ext->file) != 1 ||
+            (known < entry_size && fseek(ext->file, (long) (entry_size - known), SEEK_CUR) != 0)) {
+            return ERR_IO;
+        }
+    }
+    return ERR_NONE;
+}
+
+int imgfs_ext_open(const char *imgfs_filename, const char *open_mode, struct imgfs_file *imgfs_file)
+{
+    M_REQUIRE_NON_NULL(imgfs_filename);
+    M_REQUIRE_NON_NULL(open_mode);
+    M_REQUIRE_NON_NULL(imgfs_file);
+
+    struct imgfs_ext *const ext = calloc(1, sizeof(struct imgfs_ext));
+    char *const filename = malloc(strlen(imgfs_filename) + strlen(IMGFS_EXT_SUFFIX) + 1);
+    if (ext == NULL || filename == NULL) {
+        free(ext);
+        free(filename);
+        return ERR_OUT_OF_MEMORY;
+    }
+    strcpy(filename, imgfs_filename);
+    strcat(filename, IMGFS_EXT_SUFFIX);
+    ext->filename = filename;
+    ext->writable = open_mode[0] != 'r' || strchr(open_mode, '+') != NULL;
+
+    if (open_mode[0] == 'w') {
+        remove(filename); // there may be none
+    } else {
+        ext->file = fopen(filename, ext->writable ? "rb+" : "rb");
+        if (ext->file != NULL) {
+            // One that cannot be read is left aside, the images being readable without it
+            const int ret = ext_read(ext, imgfs_file->header.max_files);
+            if (ret != ERR_NONE) ext_forget(ext);
+            if (ret == ERR_OUT_OF_MEMORY) {
+                free(filename);
+                free(ext);
+                return ret;
+            }
+        }
+    }
+
+    imgfs_file->ext = ext;
+    return ERR_NONE;
+}
+
+/**
+ * @brief (Re)writes the whole extension file, in the version of this code, from ext.
+ */
+static int ext_write(struct imgfs_ext *ext)
+{
+    if (ext->file != NULL) fclose(ext->file);
+    memcpy(ext->header.magic, IMGFS_EXT_MAGIC, sizeof(ext->header.magic));
+    ext->header.version = IMGFS_EXT_VERSION;
+    ext->header.entry_size = (uint32_t) ext_known_size(ext->header.nb_resolutions);
+
+    ext->file = fopen(ext->filename, "wb+");
+    if (ext->file == NULL ||
+        fwrite(&ext->header, sizeof(ext->header), 1, ext->file) != 1 ||
+        fwrite(ext->resolutions, sizeof(struct imgfs_resolution), ext->header.nb_resolutions, ext->file) !=
+        ext->header.nb_resolutions) {
+        return ERR_IO;
+    }
+    for (uint32_t i = 0; i < ext->header.nb_entries; ++i) {
+        if (fwrite(&ext->entries[i], ext->header.entry_size, 1, ext->file) != 1) return ERR_IO;
+    }
+    return fflush(ext->file) == 0 ? ERR_NONE : ERR_IO;
+}
+
+/**
+ * @brief Creates the extension file (of the version of this code), with no details for any image.
+ */
+static int ext_create(struct imgfs_ext *ext, uint32_t max_files)
+{
+    ext_forget(ext);
+    ext->header.nb_entries = max_files;
+    ext->entries = calloc(max_files, sizeof(struct img_metadata_ext));
+    if (ext->entries == NULL) {
+        ext_forget(ext);
+        return ERR_OUT_OF_MEMORY;
+    }
+
+    const int ret = ext_write(ext);
+    if (ret != ERR_NONE) ext_forget(ext);
+    return ret;
+}
+
+int imgfs_ext_grow(struct imgfs_file *imgfs_file)
+{
+    M_REQUIRE_NON_NULL(imgfs_file);
+    struct imgfs_ext *const ext = imgfs_file->ext;
+    if (ext == NULL || ext->entries == NULL || ext->header.nb_entries >= imgfs_file->header.max_files) {
+        return ERR_NONE;
+    }
+    if (!ext->writable) {
+        ext_forget(ext);
+        return ERR_IO;
+    }
+
+    struct img_metadata_ext *const entries = realloc(ext->entries,
+                                                     imgfs_file->header.max_files * sizeof(struct img_metadata_ext));
+    if (entries == NULL) {
+        ext_forget(ext);
+        return ERR_OUT_OF_MEMORY;
+    }
+    memset(&entries[ext->header.nb_entries], 0,
+           (imgfs_file->header.max_files - ext->header.nb_entries) * sizeof(struct img_metadata_ext));
+    ext->entries = entries;
+    ext->header.nb_entries = imgfs_file->header.max_files;
+
+    const int ret = ext_write(ext);
+    if (ret != ERR_NONE) ext_forget(ext);
+    return ret;
+}
+
+/**
+ * @brief Gets the extension entry of the image at index, NULL if there is none for its content.
+ */
+static const struct img_metadata_ext *ext_entry(const struct imgfs_file *imgfs_file, size_t index)
+{
+    if (imgfs_file == NULL || imgfs_file->ext == NULL || imgfs_file->ext->entries == NULL ||
+        index >= imgfs_file->ext->header.nb_entries) {
+        return NULL;
+    }
+
+    const struct img_metadata_ext *const entry = &imgfs_file->ext->entries[index];
+    return memcmp(entry->SHA, imgfs_file->metadata[index].SHA, SHA256_DIGEST_LENGTH) == 0 ? entry : NULL;
+}
+
+/**
+ * @brief Gets the extension entry of the image at index to change it, creating the extension
+ * file if there is none, and starting the entry anew if it is left from another content.
+ *
+ * @return Some error code. 0 if no error.
+ */
+static int ext_entry_for_write(struct imgfs_file *imgfs_file, size_t index, struct img_metadata_ext **entry)
+{
+    M_REQUIRE_NON_NULL(imgfs_file);
+    M_REQUIRE_NON_NULL(imgfs_file->ext);
+    if (index >= imgfs_file->header.max_files) return ERR_INVALID_ARGUMENT;
+
+    struct imgfs_ext *const ext = imgfs_file->ext;
+    if (!ext->writable) return ERR_IO;
+    if (ext->entries == NULL) {
+        const int ret = ext_create(ext, imgfs_file->header.max_files);
+        if (ret != ERR_NONE) return ret;
+    }
+
+    *entry = &ext->entries[index];
+    if (memcmp((*entry)->SHA, imgfs_file->metadata[index].SHA, SHA256_DIGEST_LENGTH) != 0) {
+        memset(*entry, 0, sizeof(**entry));
+        memcpy((*entry)->SHA, imgfs_file->metadata[index].SHA, SHA256_DIGEST_LENGTH);
+    }
+    return ERR_NONE;
+}
+
+/**
+ * @brief Writes the extension entry of the image at index to the extension file.
+ */
+static int ext_write_entry(struct imgfs_ext *ext, size_t index)
+{
+    // Only the fields of this version are written: those appended by later ones are kept
+    const uint32_t entry_size = ext->header.entry_size;
+    const size_t known_size = ext_known_size(ext->header.nb_resolutions);
+    const size_t known = entry_size < known_size ? entry_size : known_size;
+    if (fseek(ext->file, ext_entry_offset(ext, index), SEEK_SET) != 0 ||
+        fwrite(&ext->entries[index], known, 1, ext->file) != 1 || fflush(ext->file) != 0) {
+        return ERR_IO;
+    }
+    return ERR_NONE;
+}
+
+const char *imgfs_placeholder(const struct imgfs_file *imgfs_file, size_t index)
+{
+    const struct img_metadata_ext *const entry = ext_entry(imgfs_file, index);
+    return entry == NULL || entry->placeholder[0] == '\0' ? NULL : entry->placeholder;
+}
+
+int imgfs_set_placeholder(struct imgfs_file *imgfs_file, size_t index, const char *placeholder)
+{
+    M_REQUIRE_NON_NULL(placeholder);
+
+    struct img_metadata_ext *entry = NULL;
+    const int ret = ext_entry_for_write(imgfs_file, index, &entry);
+    if (ret != ERR_NONE) return ret;
+
+    memset(entry->placeholder, 0, sizeof(entry->placeholder));
+    strncpy(entry->placeholder, placeholder, MAX_PLACEHOLDER);
+    return ext_write_entry(imgfs_file->ext, index);
+}
+
+int imgfs_ext_copy(struct imgfs_file *imgfs_file, size_t index, size_t from)
+{
+    const struct img_metadata_ext *const source = ext_entry(imgfs_file, from);
+    if (source == NULL) return ERR_IMAGE_NOT_FOUND;
+
+    struct img_metadata_ext *entry = NULL;
+    const int ret = ext_entry_for_write(imgfs_file, index, &entry);
+    if (ret != ERR_NONE) return ret;
+
+    *entry = *source;
+    return ext_write_entry(imgfs_file->ext, index);
+}
+
+/*******************************************************************
+ * Resolutions
+ */
+int imgfs_nb_resolutions(const struct imgfs_file *imgfs_file)
+{
+    if (imgfs_file == NULL || imgfs_file->ext == NULL) return NB_RES;
+    return NB_RES + (int) imgfs_file->ext->header.nb_resolutions;
+}
+
+const char *imgfs_resolution_name(const struct imgfs_file *imgfs_file, int resolution)
+{
+    static const char *const res_names[NB_RES] = { "thumb", "small", "orig" };
+    if (resolution < 0 || resolution >= imgfs_nb_resolutions(imgfs_file)) return NULL;
+    return resolution < NB_RES ? res_names[resolution] : imgfs_file->ext->resolutions[resolution - NB_RES].name;
+}
+
+int imgfs_resolution_atoi(const char *resolution, const struct imgfs_file *imgfs_file)
+{
+    const int res = resolution_atoi(resolution);
+    if (res != -1 || resolution == NULL) return res;
+
+    for (int i = NB_RES; i < imgfs_nb_resolutions(imgfs_file); ++i) {
+        if (strcmp(resolution, imgfs_resolution_name(imgfs_file, i)) == 0) return i;
+    }
+    return -1;
+}
+
+int imgfs_valid_resolution_name(const char *name, const struct imgfs_file *imgfs_file)
+{
+    if (name == NULL) return 0;
+
+    // A name that can be used as is in URLs and file names, and that is not taken
+    const size_t len = strlen(name);
+    return len > 0 && len <= MAX_RES_NAME &&
+           strspn(name, "abcdefghijklmnopqrstuvwxyz"
+                  "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_") == len &&
+           imgfs_resolution_atoi(name, imgfs_file) == -1;
+}
+
+int imgfs_add_resolution(struct imgfs_file *imgfs_file, const char *name, uint16_t width, uint16_t height)
+{
+    M_REQUIRE_NON_NULL(imgfs_file);
+    M_REQUIRE_NON_NULL(imgfs_file->ext);
+    M_REQUIRE_NON_NULL(name);
+
+    if (!imgfs_valid_resolution_name(name, imgfs_file)) return ERR_INVALID_ARGUMENT;
+
+    struct imgfs_ext *const ext = imgfs_file->ext;
+    if (width == 0 || height == 0 || ext->header.nb_resolutions >= MAX_EXTRA_RES) return ERR_RESOLUTIONS;
+    if (!ext->writable) return ERR_IO;
+    if (ext->entries == NULL) {
+        const int ret = ext_create(ext, imgfs_file->header.max_files);
+        if (ret != ERR_NONE) return ret;
+    }
+
+    // The entries grow with a variant: the whole file is rewritten
+    struct imgfs_resolution *const added = &ext->resolutions[ext->header.nb_resolutions];
+    memset(added, 0, sizeof(*added));
+    strcpy(added->name, name);
+    added->width = width;
+    added->height = height;
+    ++ext->header.nb_resolutions;
+    return ext_write(ext);
+}
+
+int imgfs_variant(const struct imgfs_file *imgfs_file, size_t index, int resolution,
+                  uint64_t *offset, uint32_t *size)
+{
+    M_REQUIRE_NON_NULL(imgfs_file);
+    M_REQUIRE_NON_NULL(offset);
+    M_REQUIRE_NON_NULL(size);
+    if (index >= imgfs_file->header.max_files) return ERR_INVALID_ARGUMENT;
+    if (resolution < 0 || resolution >= imgfs_nb_resolutions(imgfs_file)) return ERR_RESOLUTIONS;
+
+    if (resolution < NB_RES) {
+        *offset = imgfs_file->metadata[index].offset[resolution];
+        *size = imgfs_file->metadata[index].size[resolution];
+        return ERR_NONE;
+    }
+
+    const struct img_metadata_ext *const entry = ext_entry(imgfs_file, index);
+    *offset = entry == NULL ? 0 : entry->variants[resolution - NB_RES].offset;
+    *size = entry == NULL ? 0 : entry->variants[resolution - NB_RES].size;
+    return ERR_NONE;
+}
+
+int imgfs_set_variant(struct imgfs_file *imgfs_file, size_t index, int resolution,
+                      uint64_t offset, uint32_t size)
+{
+    M_REQUIRE_NON_NULL(imgfs_file);
+    if (index >= imgfs_file->header.max_files) return ERR_INVALID_ARGUMENT;
+    if (resolution < 0 || resolution >= imgfs_nb_resolutions(imgfs_file)) return ERR_RESOLUTIONS;
+
+    if (resolution < NB_RES) {
+        struct img_metadata *const metadata = &imgfs_file->metadata[index];
+        metadata->offset[resolution] = offset;
+        metadata->size[resolution] = size;
+        const uint32_t entry = (uint32_t) index;
+        return imgfs_write_entries(imgfs_file, &entry, 1);
+    }
+
+    struct img_metadata_ext *entry = NULL;
+    const int ret = ext_entry_for_write(imgfs_file, index, &entry);
+    if (ret != ERR_NONE) return ret;
+
+    entry->variants[resolution - NB_RES].offset = offset;
+    entry->variants[resolution - NB_RES].size = size;
+    return ext_write_entry(imgfs_file->ext, index);
+}
+
+/**
+ * @brief Reads size bytes at offset of fd into buffer.
+ */
+static int read_at(int fd, char *buffer, size_t size, off_t offset)
+{
+    while (size > 0) {
+        const ssize_t nb_read = pread(fd, buffer, size, offset);
+        if (nb_read <= 0) return ERR_IO;
+        buffer += nb_read;
+        size -= (size_t) nb_read;
+        offset += nb_read;
+    }
+    return ERR_NONE;
+}
+
+/**
+ * @brief Reads the nb_entries metadata entries of the imgFS file (of size file_size) at offset
+ * into the (zeroed) entries.
+ *
+ * The metadata of an imgFS are a hole of the file until written to (see do_create()): only the
+ * regions of the file with data are read, the others being empty entries, left as they are.
+ * Where holes cannot be found, all of it is read.
+ */
+static int read_entries(int fd, off_t file_size, struct img_metadata *entries, uint32_t nb_entries, off_t offset)
+{
+    const off_t end = offset + (off_t) nb_entries * (off_t) sizeof(struct img_metadata);
+    if (file_size < end) return ERR_IO;
+
+    off_t data = offset;
+    while (data < end) {
+        off_t hole = end;
+#ifdef SEEK_DATA
+        const off_t next_data = lseek(fd, data, SEEK_DATA);
+        if (next_data < 0 && errno == ENXIO) break; // only holes up to the end
+        if (next_data >= 0) {
+            data = next_data;
+            hole = lseek(fd, data, SEEK_HOLE);
+            if (hole < 0 || hole > end) hole = end;
+        }
+#endif
+        if (data >= end) break;
+        if (read_at(fd, (char *) entries + (data - offset), (size_t) (hole - data), data) != ERR_NONE) return ERR_IO;
+        data = hole;
+    }
+    return ERR_NONE;
+}
+
+/**
+ * @brief Finds the segments of the metadata of imgfs_file, following its extents (if any).
+ */
+static int read_segments(struct imgfs_file *imgfs_file, int fd, off_t file_size)
+{
+    // From the last extent added to the first one, each one before the next in the file
+    uint32_t nb_extents = 0;
+    uint64_t nb_extra = 0;
+    uint64_t offset = imgfs_file->header.last_extent;
+    uint64_t limit = (uint64_t) file_size;
+    while (offset != 0) {
+        struct imgfs_extent extent;
+        if (offset < sizeof(struct imgfs_header) || offset + sizeof(extent) > limit ||
+            read_at(fd, (char *) &extent, sizeof(extent), (off_t) offset) != ERR_NONE) {
+            return ERR_IO;
+        }
+        nb_extra += extent.nb_entries;
+        if (nb_extra >= imgfs_file->header.max_files) return ERR_IO;
+
+        struct imgfs_segment *const segments = realloc(imgfs_file->segments,
+                                                       (nb_extents + 2) * sizeof(struct imgfs_segment));
+        if (segments == NULL) return ERR_OUT_OF_MEMORY;
+        imgfs_file->segments = segments;
+        segments[1 + nb_extents++] = (struct imgfs_segment) {
+            offset + sizeof(extent), 0, extent.nb_entries
+        };
+        limit = offset;
+        offset = extent.previous;
+    }
+    if (nb_extents == 0) return ERR_NONE;
+
+    // Those created with the imgFS first, then the extents in the order they were added
+    struct imgfs_segment *const segments = imgfs_file->segments;
+    segments[0] = (struct imgfs_segment) {
+        sizeof(struct imgfs_header), 0, imgfs_file->header.max_files - (uint32_t) nb_extra
+    };
+    for (uint32_t i = 1, j = nb_extents; i < j; ++i, --j) {
+        const struct imgfs_segment tmp = segments[i];
+        segments[i] = segments[j];
+        segments[j] = tmp;
+    }
+    for (uint32_t i = 1; i <= nb_extents; ++i) {
+        segments[i].first = segments[i - 1].first + segments[i - 1].nb_entries;
+    }
+    imgfs_file->nb_segments = nb_extents + 1;
+    return ERR_NONE;
+}
+
+/**
+ * @brief Reads the metadata array of imgfs_file (allocated, zeroed), segment by segment.
+ */
+static int read_metadata(struct imgfs_file *imgfs_file)
+{
+    const int fd = fileno(imgfs_file->file);
+    struct stat st;
+    if (fstat(fd, &st) != 0) return ERR_IO;
+
+    int ret = read_segments(imgfs_file, fd, st.st_size);
+    if (ret != ERR_NONE) return ret;
+
+    const struct imgfs_segment first = { sizeof(struct imgfs_header), 0, imgfs_file->header.max_files };
+    const struct imgfs_segment *const segments = imgfs_file->segments != NULL ? imgfs_file->segments : &first;
+    const uint32_t nb_segments = imgfs_file->segments != NULL ? imgfs_file->nb_segments : 1;
+    for (uint32_t i = 0; i < nb_segments && ret == ERR_NONE; ++i) {
+        ret = read_entries(fd, st.st_size, &imgfs_file->metadata[segments[i].first], segments[i].nb_entries,
+                           (off_t) segments[i].offset);
+    }
+
+    // where the entries were read from (those created with the imgFS)
+    const long end = (long) (sizeof(struct imgfs_header) + segments[0].nb_entries * sizeof(struct img_metadata));
+    if (ret == ERR_NONE && fseek(imgfs_file->file, end, SEEK_SET) != 0) ret = ERR_IO;
+    return ret;
+}
+
+long imgfs_metadata_offset(const struct imgfs_file *imgfs_file, size_t index, size_t *nb_contiguous)
+{
+    if (imgfs_file == NULL || index >= imgfs_file->header.max_files) return -1;
+
+    const struct imgfs_segment first = { sizeof(struct imgfs_header), 0, imgfs_file->header.max_files };
+    const struct imgfs_segment *segment = &first;
+    for (uint32_t i = 0; imgfs_file->segments != NULL && i < imgfs_file->nb_segments; ++i) {
+        segment = &imgfs_file->segments[i];
+        if (index < (size_t) segment->first + segment->nb_entries) break;
+    }
+
+    if (nb_contiguous != NULL) *nb_contiguous = (size_t) segment->first + segment->nb_entries - index;
+    return (long) (segment->offset + (index - segment->first) * sizeof(struct img_metadata));
+}
+
+int imgfs_write_in_place(struct imgfs_file *imgfs_file, const uint32_t *indexes, size_t nb)
+{
+    M_REQUIRE_NON_NULL(imgfs_file);
+    M_REQUIRE_NON_NULL(imgfs_file->file);
+    if (nb > 0) M_REQUIRE_NON_NULL(indexes);
+
+    imgfs_seal(imgfs_file, indexes, nb);
+    for (size_t i = 0; i < nb; ++i) {
+        const long offset = imgfs_metadata_offset(imgfs_file, indexes[i], NULL);
+        if (offset < 0 || fseek(imgfs_file->file, offset, SEEK_SET) != 0 ||
+            fwrite(&imgfs_file->metadata[indexes[i]], sizeof(struct img_metadata), 1, imgfs_file->file) != 1) {
+            return ERR_IO;
+        }
+    }
+    if (fseek(imgfs_file->file, 0, SEEK_SET) != 0 ||
+        fwrite(&imgfs_file->header, sizeof(struct imgfs_header), 1, imgfs_file->file) != 1) {
+        return ERR_IO;
+    }
+    return ERR_NONE;
+}
+
+uint32_t imgfs_header_checksum(const struct imgfs_header *header)
+{
+    // Field by field, not the padding after name, which a copy of the structure may not keep
+    const size_t counts = offsetof(struct imgfs_header, resized_res) + sizeof(header->resized_res) -
+                          offsetof(struct imgfs_header, version);
+    uint32_t crc = crc32c(0, header->name, sizeof(header->name));
+    crc = crc32c(crc, &header->version, counts);
+    crc = crc32c(crc, &header->last_extent, sizeof(header->last_extent));
+    return crc != 0 ? crc : 1; // 0 stands for no checksum
+}
+
+uint32_t imgfs_metadata_checksum(const struct img_metadata *metadata)
+{
+    // Not the padding after size, which a copy of the structure may not keep
+    const size_t first = offsetof(struct img_metadata, size) + sizeof(metadata->size);
+    const size_t second = offsetof(struct img_metadata, checksum) - offsetof(struct img_metadata, offset);
+    const uint32_t crc = crc32c(crc32c(0, metadata, first), metadata->offset, second);
+    return crc != 0 ? crc : 1;
+}
+
+void imgfs_seal(struct imgfs_file *imgfs_file, const uint32_t *indexes, size_t nb)
+{
+    if (imgfs_file == NULL) return;
+
+    for (size_t i = 0; indexes != NULL && i < nb; ++i) {
+        struct img_metadata *const metadata = &imgfs_file->metadata[indexes[i]];
+        metadata->checksum = imgfs_metadata_checksum(metadata);
+    }
+    imgfs_file->header.checksum = imgfs_header_checksum(&imgfs_file->header);
+}
+
+/**
+ * @brief Appends the corrupted entry at index, as read, to the quarantine file of the imgFS
+ * (opened on the first one).
+ */
+static int quarantine(const char *imgfs_filename, FILE **file, uint32_t index, const struct img_metadata *metadata)
+{
+    if (*file == NULL) {
+        char *const filename = malloc(strlen(imgfs_filename) + sizeof(IMGFS_QUARANTINE_SUFFIX));
+        if (filename == NULL) return ERR_OUT_OF_MEMORY;
+        strcpy(filename, imgfs_filename);
+        strcat(filename, IMGFS_QUARANTINE_SUFFIX);
+        *file = fopen(filename, "ab");
+        free(filename);
+        if (*file == NULL) return ERR_IO;
+    }
+    if (fwrite(&index, sizeof(index), 1, *file) != 1 || fwrite(metadata, sizeof(*metadata), 1, *file) != 1) {
+        return ERR_IO;
+    }
+    return ERR_NONE;
+}
+
+int imgfs_verify(const char *imgfs_filename, const char *open_mode, struct imgfs_file *imgfs_file)
+{
+    M_REQUIRE_NON_NULL(imgfs_filename);
+    M_REQUIRE_NON_NULL(open_mode);
+    M_REQUIRE_NON_NULL(imgfs_file);
+
+    const int writable = strchr(open_mode, '+') != NULL;
+    FILE *quarantined = NULL;
+    int ret = ERR_NONE;
+    imgfs_file->nb_quarantined = 0;
+
+    // The corrupted entries are kept in the quarantine file first...
+    for (uint32_t i = 0; i < imgfs_file->header.max_files && ret == ERR_NONE; ++i) {
+        const struct img_metadata *const metadata = &imgfs_file->metadata[i];
+        if (metadata->checksum == 0 || metadata->checksum == imgfs_metadata_checksum(metadata)) continue;
+
+        fprintf(stderr, "do_open(): metadata entry %" PRIu32 " of %s is corrupted, quarantined\n",
+                i, imgfs_filename);
+        if (writable) ret = quarantine(imgfs_filename, &quarantined, i, metadata);
+        ++imgfs_file->nb_quarantined;
+    }
+    // ...on disk before any of them is cleared from the imgFS
+    if (quarantined != NULL) {
+        if (ret == ERR_NONE && (fflush(quarantined) != 0 || fsync(fileno(quarantined)) != 0)) ret = ERR_IO;
+        if (fclose(quarantined) != 0 && ret == ERR_NONE) ret = ERR_IO;
+    }
+    if (ret != ERR_NONE || imgfs_file->nb_quarantined == 0) return ret;
+
+    for (uint32_t i = 0; i < imgfs_file->header.max_files && ret == ERR_NONE; ++i) {
+        struct img_metadata *const metadata = &imgfs_file->metadata[i];
+        if (metadata->checksum == 0 || metadata->checksum == imgfs_metadata_checksum(metadata)) continue;
+
+        memset(metadata, 0, sizeof(*metadata));
+        if (writable) ret = imgfs_write_in_place(imgfs_file, &i, 1);
+    }
+    if (ret != ERR_NONE) return ret;
+
+    // The images left: the header counted those quarantined, if they were
+    uint32_t nb_files = 0;
+    for (uint32_t i = 0; i < imgfs_file->header.max_files; ++i) {
+        nb_files += imgfs_file->metadata[i].is_valid != EMPTY;
+    }
+    imgfs_file->header.nb_files = nb_files;
+    if (!writable) return ERR_NONE;
+
+    ret = imgfs_write_in_place(imgfs_file, NULL, 0);
+    return ret == ERR_NONE && fflush(imgfs_file->file) != 0 ? ERR_IO : ret;
+}
+
+int imgfs_write_entries(struct imgfs_file *imgfs_file, const uint32_t *indexes, size_t nb)
+{
+    M_REQUIRE_NON_NULL(imgfs_file);
+
+    if (imgfs_file->journal != NULL) {
+        return imgfs_journal_append(imgfs_file, indexes, nb);
+    }
+    return imgfs_write_in_place(imgfs_file, indexes, nb);
+}
+
 int do_open(const char* imgfs_filename,const char* open_mode,struct imgfs_file* imgfs_file)
 {
 
@@ -131,6 +798,15 @@ int do_open(const char* imgfs_filename,const char* open_mode,struct imgfs_file*
     M_REQUIRE_NON_NULL(imgfs_file);
 
 
+    imgfs_file->ext = NULL;
+    imgfs_file->segments = NULL;
+    imgfs_file->nb_segments = 0;
+    imgfs_file->journal = NULL;
+    imgfs_file->durability = DURABILITY_STRICT;
+    imgfs_file->sync_interval = 0;
+    imgfs_file->flusher = NULL;
+    imgfs_file->nb_quarantined = 0;
+
     //Open the file
     imgfs_file->file = fopen(imgfs_filename, open_mode);
     if (!imgfs_file->file) {
@@ -143,6 +819,14 @@ int do_open(const char* imgfs_filename,const char* open_mode,struct imgfs_file*
         return ERR_IO; // Error reading the header
     }
 
+    //Verifying the header before relying on it to read the metadata
+    if (imgfs_file->header.checksum != 0 &&
+        imgfs_file->header.checksum != imgfs_header_checksum(&imgfs_file->header)) {
+        fprintf(stderr, "do_open(): the header of %s is corrupted\n", imgfs_filename);
+        fclose(imgfs_file->file);
+        return ERR_CORRUPTED;
+    }
+
     //Allocating the memory for the metadata array
     uint32_t nb_files = imgfs_file->header.max_files;
     imgfs_file->metadata = calloc(nb_files, sizeof(struct img_metadata));
@@ -151,15 +835,28 @@ int do_open(const char* imgfs_filename,const char* open_mode,struct imgfs_file*
         return ERR_OUT_OF_MEMORY;
     }
 
-    // Read the contents of the metadata
-    for (uint32_t i = 0; i < imgfs_file->header.max_files; i++) {
-        if (fread(&imgfs_file->metadata[i], sizeof(struct img_metadata), 1, imgfs_file->file)!= 1) {
-            fclose(imgfs_file->file);
-            free(imgfs_file->metadata);
-            return ERR_IO;
-
-        }
+    // Read the contents of the metadata, as changed since by the journal (if any), and verify them
+    int ret = read_metadata(imgfs_file);
+    if (ret == ERR_NONE) ret = imgfs_journal_recover(imgfs_filename, open_mode, imgfs_file);
+    if (ret == ERR_NONE) ret = imgfs_verify(imgfs_filename, open_mode, imgfs_file);
+    if (ret != ERR_NONE) {
+        fclose(imgfs_file->file);
+        free(imgfs_file->metadata);
+        free(imgfs_file->segments);
+        imgfs_file->segments = NULL;
+        imgfs_file->nb_segments = 0;
+        return ret;
+    }
 
+    // The details of the images beyond their metadata
+    ret = imgfs_ext_open(imgfs_filename, open_mode, imgfs_file);
+    if (ret != ERR_NONE) {
+        fclose(imgfs_file->file);
+        free(imgfs_file->metadata);
+        free(imgfs_file->segments);
+        imgfs_file->segments = NULL;
+        imgfs_file->nb_segments = 0;
+        return ret;
     }
 
     // Everything went well
@@ -169,6 +866,10 @@ int do_open(const char* imgfs_filename,const char* open_mode,struct imgfs_file*
 void do_close(struct imgfs_file *imgfs_file)
 {
     if (imgfs_file != NULL) {
+        // Syncing the changes left to the background thread, then writing the journaled ones in place
+        imgfs_durability_stop(imgfs_file);
+        imgfs_journal_close(imgfs_file);
+
         // Closing the file
         if (imgfs_file->file != NULL) {
             fclose(imgfs_file->file);
@@ -180,6 +881,17 @@ void do_close(struct imgfs_file *imgfs_file)
             free(imgfs_file->metadata);
             imgfs_file->metadata = NULL; // Set pointer to null after freeing
         }
+        // and where they are
+        free(imgfs_file->segments);
+        imgfs_file->segments = NULL;
+        imgfs_file->nb_segments = 0;
+        // and the extension
+        if (imgfs_file->ext != NULL) {
+            ext_forget(imgfs_file->ext);
+            free(imgfs_file->ext->filename);
+            free(imgfs_file->ext);
+            imgfs_file->ext = NULL;
+        }
     } else return; // Nothing to close or free
 }
 
@@ -9,6 +9,7 @@
 
 #include "imgfs.h"
 #include "imgfscmd_functions.h"
+#include "imgfs_durability.h" // for DURABILITY_OPTION
 #include "util.h"   // for _unused //todo : use the method ?
 
 
@@ -37,6 +38,8 @@ command_mapping commands[] = {
     {"delete", do_delete_cmd},
     {"insert", do_insert_cmd},
     {"read", do_read_cmd},
+    {"grow", do_grow_cmd},
+    {"decode", do_decode_cmd},
 
 };
 
@@ -58,6 +61,19 @@ int main(int argc, char *argv[])
     argc--;
     argv++; // skips command call name
 
+    // The global option, before the command
+    if (strncmp(argv[0], DURABILITY_OPTION, strlen(DURABILITY_OPTION)) == 0) {
+        ret = set_durability_cmd(argv[0] + strlen(DURABILITY_OPTION));
+        if (ret != ERR_NONE || argc < 2) {
+            fprintf(stderr, "ERROR: %s\n", ERR_MSG(ret != ERR_NONE ? ret : ERR_NOT_ENOUGH_ARGUMENTS));
+            help(argc, argv);
+            vips_shutdown();
+            return ret != ERR_NONE ? ret : ERR_NOT_ENOUGH_ARGUMENTS;
+        }
+        argc--;
+        argv++;
+    }
+
     // Loop through all defined commands
     for (int i = 0; i < (int)NB_COMMANDS; ++i) {
         ret = ERR_INVALID_COMMAND;
@@ -7,6 +7,7 @@
 
 #include "imgfs.h"
 #include "imgfscmd_functions.h"
+#include "imgfs_durability.h"
 #include "util.h"   // for _unused
 
 #include <stdlib.h>
@@ -22,13 +23,17 @@ static const uint16_t default_small_res = 256;
 static const uint16_t MAX_THUMB_RES = 128;
 static const uint16_t MAX_SMALL_RES = 512;
 
+// durability mode of the imgFS changed by the command (see set_durability_cmd())
+static enum imgfs_durability durability = DURABILITY_STRICT;
+static uint32_t sync_interval = 0;
+
 /**
  * @description Creates new file's name based on img id and resolution.
  * @param img_id A pointer to the unique id of the image.
- * @param resolution The resolution of the image for which the name is to be created.
+ * @param resolution The name of the resolution of the image for which the name is to be created.
  * @param new_name Address of a character pointer where the new name of the image would be stored
  */
-static void create_name(const char* img_id, int resolution, char** new_name);
+static void create_name(const char* img_id, const char *resolution, char** new_name);
 /**
  * @description Write a disk image's buffer to a specified file.
  * @param filename A pointer the name of the file to which the image buffer is to be written.
@@ -47,6 +52,19 @@ static int write_disk_image(const char *filename, const char *image_buffer, uint
  */
 static int read_disk_image(const char *path, char **image_buffer, uint32_t *image_size);
 
+/**
+ * @brief Opens the imgFS imgfs_filename for writing, with the durability mode of the command.
+ */
+static int open_for_writing(const char *imgfs_filename, struct imgfs_file *imgfs_file)
+{
+    const int ret = do_open(imgfs_filename, "rb+", imgfs_file);
+    if (ret != ERR_NONE) return ret;
+
+    const int ret_durability = imgfs_set_durability(imgfs_file, durability, sync_interval);
+    if (ret_durability != ERR_NONE) do_close(imgfs_file);
+    return ret_durability;
+}
+
 /**
  * @brief Helper function to safely free pointers.
  *
@@ -60,12 +78,24 @@ void safe_Free(void* ptr)
     }
 }
 
+/**********************************************************************
+ * Sets the durability mode of the imgFS changed by the command.
+ ********************************************************************** */
+int set_durability_cmd(const char *mode)
+{
+    M_REQUIRE_NON_NULL(mode);
+    return imgfs_durability_parse(mode, &durability, &sync_interval);
+}
+
 /**********************************************************************
  * Displays some explanations -> Updated in week 10
  ********************************************************************** */
 int help(int useless _unused, char **useless_too _unused)
 {
-    printf("imgfscmd [COMMAND] [ARGUMENTS]\n"
+    printf("imgfscmd [--durability=MODE] [COMMAND] [ARGUMENTS]\n"
+           "  --durability=MODE: when the changes made to the imgFS are synced to disk.\n"
+           "      MODE is strict (each change, the default), interval:<MS> (every MS milliseconds)\n"
+           "      or none (left to the system).\n"
            "  help: displays this help.\n"
            "  list <imgFS_filename>: list imgFS content.\n"
            "  create <imgFS_filename> [options]: create a new imgFS.\n"
@@ -79,16 +109,21 @@ int help(int useless _unused, char **useless_too _unused)
            "          -small_res <X_RES> <Y_RES>: resolution for small images.\n"
            "                                  default value is %ux%u\n"
            "                                  maximum value is %ux%u\n"
-           "  read   <imgFS_filename> <imgID> [original|orig|thumbnail|thumb|small]:\n"
+           "          -res <NAME> <X_RES> <Y_RES>: another resolution, called NAME, for the images.\n"
+           "                                  up to %u of them\n"
+           "  read   <imgFS_filename> <imgID> [original|orig|thumbnail|thumb|small|<NAME>]:\n"
            "      read an image from the imgFS and save it to a file.\n"
            "      default resolution is \"original\".\n"
            "  insert <imgFS_filename> <imgID> <filename>: insert a new image in the imgFS.\n"
-           "  delete <imgFS_filename> <imgID>: delete image imgID from imgFS.\n",
+           "  delete <imgFS_filename> <imgID>: delete image imgID from imgFS.\n"
+           "  grow   <imgFS_filename> <MAX_FILES>: make room for up to MAX_FILES images in the imgFS.\n"
+           "  decode <filename>: print a binary (CBOR) listing, as sent by the server, in JSON.\n",
            default_max_files,
            default_thumb_res, default_thumb_res,
            MAX_THUMB_RES, MAX_THUMB_RES,
            default_small_res, default_small_res,
-           MAX_SMALL_RES, MAX_SMALL_RES
+           MAX_SMALL_RES, MAX_SMALL_RES,
+           MAX_EXTRA_RES
           );
 
     return ERR_NONE;
@@ -133,7 +168,8 @@ int do_list_cmd(int argc, char **argv)
  *
  * This function creates a new imgFS file with the given file name and initializes its header and metadata.
  * The function processes the optional arguments for max_files, thumb_res, and small_res and sets the corresponding
- * values in the header. The function then calls the do_create function to initialize the rest of the imgFS file.
+ * values in the header. The function then calls the do_create function to initialize the rest of the imgFS file,
+ * and adds the other resolutions (-res) to it.
  *
  * @param argc The number of command-line arguments.
  * @param argv An array of command-line argument strings.
@@ -167,6 +203,8 @@ int do_create_cmd(int argc, char **argv)
     uint16_t thumb_y_res = default_thumb_res;
     uint16_t small_x_res = default_small_res;
     uint16_t small_y_res = default_small_res;
+    struct imgfs_resolution extra_res[MAX_EXTRA_RES];
+    unsigned int nb_extra_res = 0;
 
     //==================================================================================================================
 
@@ -200,6 +238,27 @@ int do_create_cmd(int argc, char **argv)
             if (small_x_res == 0 || small_y_res == 0 || small_x_res > MAX_SMALL_RES || small_y_res > MAX_SMALL_RES) {
                 return ERR_RESOLUTIONS;
             }
+        } else if (strcmp(curr, "-res") == 0 ) {//checks that we have at least three parameters
+            if (i + 3 >= argc) {
+                return ERR_NOT_ENOUGH_ARGUMENTS;
+            }
+            if (nb_extra_res == MAX_EXTRA_RES) {
+                return ERR_RESOLUTIONS;
+            }
+            // Checked before anything is written: the built-in names and those given before are taken
+            if (!imgfs_valid_resolution_name(argv[i + 1], NULL)) {
+                return ERR_INVALID_ARGUMENT;
+            }
+            for (unsigned int j = 0; j < nb_extra_res; ++j) {
+                if (strcmp(extra_res[j].name, argv[i + 1]) == 0) return ERR_INVALID_ARGUMENT;
+            }
+            struct imgfs_resolution *const res = &extra_res[nb_extra_res++];
+            strcpy(res->name, argv[++i]);
+            res->width = atouint16(argv[++i]);
+            res->height = atouint16(argv[++i]);
+            if (res->width == 0 || res->height == 0) {
+                return ERR_RESOLUTIONS;
+            }
         } else {
             return ERR_INVALID_ARGUMENT;  // Argument is not recognized or missing necessary parameters
         }
@@ -222,6 +281,12 @@ int do_create_cmd(int argc, char **argv)
 
     do_create(imgfs_filename, &imgfsFile);
 
+    // The other resolutions go to the extension file
+    int ret = ERR_NONE;
+    for (unsigned int i = 0; i < nb_extra_res && ret == ERR_NONE && imgfsFile.ext != NULL; ++i) {
+        ret = imgfs_add_resolution(&imgfsFile, extra_res[i].name, extra_res[i].width, extra_res[i].height);
+    }
+
     // After the imgFS file is created, for cleanup, the file is closed and the metadata is freed
     if (imgfsFile.file != NULL) {
         do_close(&imgfsFile);
@@ -230,7 +295,7 @@ int do_create_cmd(int argc, char **argv)
 
 
     //Everything went well
-    return ERR_NONE;
+    return ret;
 }
 
 /**********************************************************************
@@ -261,7 +326,7 @@ int do_delete_cmd(int argc, char **argv)
     memset(&imgfsFile, 0, sizeof(imgfsFile));
 
     //Opening the file in rb+ mode
-    int open_ret = do_open(imgfs_filename, "rb+", &imgfsFile);
+    int open_ret = open_for_writing(imgfs_filename, &imgfsFile);
     //In case of error
     if (open_ret != ERR_NONE) return open_ret;
 
@@ -282,6 +347,27 @@ int do_delete_cmd(int argc, char **argv)
 }
 
 
+/**********************************************************************
+ * Grows the imgFS to a new maximum number of images.
+ */
+int do_grow_cmd(int argc, char **argv)
+{
+    M_REQUIRE_NON_NULL(argv);
+    if (argc != 2) return ERR_NOT_ENOUGH_ARGUMENTS;
+
+    const uint32_t max_files = atouint32(argv[1]);
+    if (max_files == 0) return ERR_MAX_FILES;
+
+    struct imgfs_file imgfsFile;
+    zero_init_var(imgfsFile);
+    int error = open_for_writing(argv[0], &imgfsFile);
+    if (error != ERR_NONE) return error;
+
+    error = do_grow(&imgfsFile, max_files);
+    do_close(&imgfsFile);
+    return error;
+}
+
 /**********************************************************************
  * Reads an image from the imgFS and writes it to a separate image file.
  */
@@ -292,28 +378,36 @@ int do_read_cmd(int argc, char **argv)
 
     const char * const img_id = argv[1];
 
-    const int resolution = (argc == 3) ? resolution_atoi(argv[2]) : ORIG_RES;
-    if (resolution == -1) return ERR_RESOLUTIONS;
-
     struct imgfs_file myfile;
     zero_init_var(myfile);
-    int error = do_open(argv[0], "rb+", &myfile);
+    int error = open_for_writing(argv[0], &myfile);
 
     if (error != ERR_NONE) return error;
 
+    // Besides those of any imgFS, the resolution may be one of this one
+    const int resolution = (argc == 3) ? imgfs_resolution_atoi(argv[2], &myfile) : ORIG_RES;
+    if (resolution == -1) {
+        do_close(&myfile);
+        return ERR_RESOLUTIONS;
+    }
+
     char *image_buffer = NULL;
     uint32_t image_size = 0;
     error = do_read(img_id, resolution, &image_buffer, &image_size, &myfile);
 
+    // Extracting to a separate image file.
+    char* tmp_name = NULL;
+    if (error == ERR_NONE) {
+        create_name(img_id, imgfs_resolution_name(&myfile, resolution), &tmp_name);
+    }
     do_close(&myfile);
     if (error != ERR_NONE) {
         return error;
     }
-
-    // Extracting to a separate image file.
-    char* tmp_name = NULL;
-    create_name(img_id, resolution, &tmp_name);
-    if (tmp_name == NULL) return ERR_OUT_OF_MEMORY;
+    if (tmp_name == NULL) {
+        safe_Free(image_buffer);
+        return ERR_OUT_OF_MEMORY;
+    }
     error = write_disk_image(tmp_name, image_buffer, image_size);
     safe_Free(tmp_name);
     safe_Free(image_buffer);
@@ -332,7 +426,7 @@ int do_insert_cmd(int argc, char **argv)
 
     struct imgfs_file imgfsFile;
     zero_init_var(imgfsFile);
-    int error = do_open(argv[0], "rb+", &imgfsFile);
+    int error = open_for_writing(argv[0], &imgfsFile);
     if (error != ERR_NONE) return error;
 
     char *image_buffer = NULL;
@@ -354,33 +448,19 @@ int do_insert_cmd(int argc, char **argv)
 /**********************************************************************
  * Create a new name for the image file.
  */
-static void create_name(const char* img_id, int resolution, char** new_name)
+static void create_name(const char* img_id, const char *resolution, char** new_name)
 {
 
-    const char* resolution_str = NULL;
-
-    switch (resolution) {
-    case ORIG_RES:
-        resolution_str = "_orig";
-        break;
-    case THUMB_RES:
-        resolution_str = "_thumb";
-        break;
-    case SMALL_RES:
-        resolution_str = "_small";
-        break;
-    default:
-        resolution_str = "_unknownResolution";
-    }
+    const char* resolution_str = resolution != NULL ? resolution : "unknownResolution";
 
-    //Allocating memory for : image_id + resolution_suffix + '.jpg' + '\0'
-    *new_name = calloc(strlen(img_id) + strlen(resolution_str) + strlen(".jpg") + 1, sizeof(char));
+    //Allocating memory for : image_id + '_' + resolution + '.jpg' + '\0'
+    *new_name = calloc(strlen(img_id) + 1 + strlen(resolution_str) + strlen(".jpg") + 1, sizeof(char));
     if (*new_name == NULL) {
         return ; // out of memory
     }
 
     //Using sprintf to update filename
-    sprintf(*new_name, "%s%s.jpg", img_id, resolution_str);
+    sprintf(*new_name, "%s_%s.jpg", img_id, resolution_str);
 }
 
 /**********************************************************************
@@ -455,3 +535,26 @@ static int read_disk_image(const char *path, char **image_buffer, uint32_t *imag
 
 
 
+
+/**********************************************************************
+ * Prints a binary (CBOR) listing, as received from the server, in JSON.
+ ********************************************************************** */
+int do_decode_cmd(int argc, char **argv)
+{
+    M_REQUIRE_NON_NULL(argv);
+    if (argc != 1) return ERR_NOT_ENOUGH_ARGUMENTS;
+
+    char *cbor = NULL;
+    uint32_t cbor_size = 0;
+    int ret = read_disk_image(argv[0], &cbor, &cbor_size);
+    if (ret != ERR_NONE) return ret;
+
+    char *json = NULL;
+    ret = cbor_to_json(cbor, cbor_size, &json);
+    free(cbor);
+    if (ret != ERR_NONE) return ret;
+
+    printf("%s\n", json);
+    free(json);
+    return ERR_NONE;
+}
@@ -12,6 +12,12 @@
  ********************************************************************** */
 int help (int, char*[]);
 
+/**********************************************************************
+ * Sets the durability mode (see imgfs_durability.h) of the imgFS changed
+ * by the command, from the value of its --durability= option.
+ ********************************************************************** */
+int set_durability_cmd(const char *mode);
+
 /********************************************************************
  * Opens imgFS file and calls do_list().
  *******************************************************************/
@@ -36,3 +42,13 @@ int do_insert_cmd(int argc, char* argv[]);
  * Reads an image from the imgFS.
  *******************************************************************/
 int do_read_cmd(int argc, char* argv[]);
+
+/********************************************************************
+ * Grows the imgFS to a new maximum number of images.
+ *******************************************************************/
+int do_grow_cmd(int argc, char* argv[]);
+
+/********************************************************************
+ * Prints a binary (CBOR) listing in JSON.
+ *******************************************************************/
+int do_decode_cmd(int argc, char* argv[]);
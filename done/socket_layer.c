@@ -1,6 +1,9 @@
 #include "socket_layer.h"
 #include "error.h"
 #include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/sendfile.h>
+#include <errno.h>
 #include <unistd.h>
 #include <netinet/in.h>
 #include <string.h>
@@ -68,8 +71,31 @@ ssize_t tcp_read(int active_socket, char* buf, size_t buflen)
     return recv(active_socket,buf,buflen,0);
 }
 
+int tcp_set_timeout(int active_socket, unsigned int seconds)
+{
+    const struct timeval timeout = { .tv_sec = seconds, .tv_usec = 0 };
+    if (setsockopt(active_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0) {
+        perror("Error setting socket timeout");
+        return ERR_IO;
+    }
+    return ERR_NONE;
+}
+
 ssize_t tcp_send(int active_socket, const char* response, size_t response_len)
 {
     M_REQUIRE_NON_NULL(response);
     return send(active_socket,response,response_len,0);
-}
\ No newline at end of file
+}
+
+ssize_t tcp_send_file(int active_socket, int fd, off_t offset, size_t len)
+{
+    size_t sent = 0;
+    while (sent < len) {
+        // sendfile() may send less than asked for, and advances offset itself
+        const ssize_t n = sendfile(active_socket, fd, &offset, len - sent);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        sent += (size_t) n;
+    }
+    return (ssize_t) sent;
+}
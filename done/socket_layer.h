@@ -23,4 +23,16 @@ int tcp_accept(int passive_socket);
  */
 ssize_t tcp_read(int active_socket, char* buf, size_t buflen);
 
+/**
+ * @brief Makes tcp_read() on the active socket fail (with errno EAGAIN) after seconds without data
+ */
+int tcp_set_timeout(int active_socket, unsigned int seconds);
+
 ssize_t tcp_send(int active_socket, const char* response, size_t response_len);
+
+/**
+ * @brief Sends len bytes of the file fd, from offset on, without copying them through user space.
+ *
+ * Returns the number of bytes sent (less than len only on error).
+ */
+ssize_t tcp_send_file(int active_socket, int fd, off_t offset, size_t len);
@@ -0,0 +1,144 @@
+/**
+ * @file bench-http-parse.c
+ * @brief Throughput of HTTP message parsing over the captured messages of tests/data/
+ *
+ * Each capture is fed to the parser in chunks, as handle_connection() receives it:
+ *  - "rescan": http_parse_message() on the whole buffer after every chunk,
+ *    and the buffer cleared after every message (former handle_connection() loop);
+ *  - "incremental": http_parse_incremental() resumes where the previous chunk stopped.
+ *
+ * Usage: bench-http-parse <file.bin>...
+ */
+
+#include "http_prot.h"
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NB_ROUNDS 200
+
+static const size_t chunk_sizes[] = { 64, 1448, 16384 };
+#define NB_CHUNK_SIZES (sizeof(chunk_sizes) / sizeof(chunk_sizes[0]))
+
+/**********************************************************************
+ * Returns elapsed seconds since start.
+ */
+static double elapsed(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**********************************************************************
+ * Reads a whole file into a newly allocated buffer.
+ */
+static char *read_capture(const char *filename, size_t *size)
+{
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) return NULL;
+
+    fseek(file, 0, SEEK_END);
+    const long pos = ftell(file);
+    rewind(file);
+    if (pos <= 0) {
+        fclose(file);
+        return NULL;
+    }
+    *size = (size_t) pos;
+
+    char *buffer = malloc(*size);
+    if (buffer != NULL && fread(buffer, 1, *size, file) != *size) {
+        free(buffer);
+        buffer = NULL;
+    }
+    fclose(file);
+    return buffer;
+}
+
+/**********************************************************************
+ * Feeds the capture chunk by chunk, parsing the whole buffer each time.
+ */
+static int run_rescan(const char *capture, size_t size, size_t chunk, char *rcvbuf)
+{
+    struct http_message msg;
+    int content_len = 0;
+    size_t received = 0;
+    int ret = 0;
+
+    while (ret == 0 && received < size) {
+        const size_t n = size - received < chunk ? size - received : chunk;
+        memcpy(rcvbuf + received, capture + received, n);
+        received += n;
+        ret = http_parse_message(rcvbuf, received, &msg, &content_len);
+    }
+    memset(rcvbuf, 0, size + 1);
+    return ret;
+}
+
+/**********************************************************************
+ * Feeds the capture chunk by chunk to the incremental parser.
+ */
+static int run_incremental(const char *capture, size_t size, size_t chunk, char *rcvbuf)
+{
+    struct http_message msg;
+    struct http_parser parser;
+    size_t received = 0;
+    int ret = 0;
+
+    http_parser_init(&parser);
+    while (ret == 0 && received < size) {
+        const size_t n = size - received < chunk ? size - received : chunk;
+        memcpy(rcvbuf + received, capture + received, n);
+        received += n;
+        ret = http_parse_incremental(&parser, rcvbuf, received, &msg);
+    }
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <file.bin>...\n", argv[0]);
+        return ERR_NOT_ENOUGH_ARGUMENTS;
+    }
+
+    printf("%-40s %8s %8s %14s %14s\n", "capture", "bytes", "chunk", "rescan MB/s", "increm. MB/s");
+
+    for (int i = 1; i < argc; ++i) {
+        size_t size = 0;
+        char *capture = read_capture(argv[i], &size);
+        char *rcvbuf = capture ? calloc(1, size + 1) : NULL;
+        if (rcvbuf == NULL) {
+            fprintf(stderr, "Cannot load %s\n", argv[i]);
+            free(capture);
+            continue;
+        }
+
+        for (size_t c = 0; c < NB_CHUNK_SIZES; ++c) {
+            struct timespec start;
+            int ok = 1;
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (int r = 0; r < NB_ROUNDS; ++r) ok &= run_rescan(capture, size, chunk_sizes[c], rcvbuf) == 1;
+            const double t_rescan = elapsed(&start);
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (int r = 0; r < NB_ROUNDS; ++r) ok &= run_incremental(capture, size, chunk_sizes[c], rcvbuf) == 1;
+            const double t_incremental = elapsed(&start);
+
+            const double mbytes = (double) size * NB_ROUNDS / 1e6;
+            const char *name = strrchr(argv[i], '/');
+            printf("%-40s %8zu %8zu %14.1f %14.1f%s\n", name ? name + 1 : argv[i], size, chunk_sizes[c],
+                   mbytes / t_rescan, mbytes / t_incremental, ok ? "" : "  (incomplete message!)");
+        }
+
+        free(rcvbuf);
+        free(capture);
+    }
+
+    return ERR_NONE;
+}
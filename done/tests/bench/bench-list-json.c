@@ -0,0 +1,140 @@
+/**
+ * @file bench-list-json.c
+ * @brief Cost of the JSON listing of an imgFS, for synthetic metadata tables of growing size
+ *
+ * Each table is listed NB_ROUNDS times with:
+ *  - "json-c": a json-c object tree serialized and copied (former do_list(JSON));
+ *  - "writer": do_list(JSON), which writes the document directly;
+ *  - "cached": a copy of the document, as the server sends a listing again while the version is the same;
+ *  - "cbor": do_list_fields(CBOR), the binary listing (which also has the SHA and sizes of each image).
+ * One image in ESCAPED_EVERY has a '/' in its ID, to go through the escaping path.
+ *
+ * Usage: bench-list-json [nb_images]...
+ */
+
+#include "imgfs.h"
+#include "error.h"
+
+#include <json-c/json.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NB_ROUNDS 20
+#define ESCAPED_EVERY 16
+
+static volatile char sink;
+
+static const uint32_t default_sizes[] = { 100, 10000, 1000000 };
+#define NB_DEFAULT_SIZES (sizeof(default_sizes) / sizeof(default_sizes[0]))
+
+/**********************************************************************
+ * Returns elapsed seconds since start.
+ */
+static double elapsed(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**********************************************************************
+ * The listing as do_list() built it with json-c.
+ */
+static char *list_json_c(const struct imgfs_file *imgfs_file)
+{
+    struct json_object *json_obj = json_object_new_object();
+    struct json_object *json_arr = json_object_new_array();
+    if (json_obj == NULL || json_arr == NULL) return NULL;
+
+    for (uint32_t i = 0; i < imgfs_file->header.max_files; i++) {
+        if (imgfs_file->metadata[i].is_valid == NON_EMPTY) {
+            json_object_array_add(json_arr, json_object_new_string(imgfs_file->metadata[i].img_id));
+        }
+    }
+    json_object_object_add(json_obj, "Images", json_arr);
+
+    char *json = strdup(json_object_to_json_string(json_obj));
+    json_object_put(json_obj);
+    return json;
+}
+
+int main(int argc, char *argv[])
+{
+    printf("%10s %12s %12s %12s %12s %12s %12s %s\n", "images", "bytes", "json-c ms", "writer ms", "cached ms",
+           "cbor bytes", "cbor ms", "");
+
+    const int nb_sizes = argc > 1 ? argc - 1 : (int) NB_DEFAULT_SIZES;
+    for (int s = 0; s < nb_sizes; ++s) {
+        const uint32_t nb_images = argc > 1 ? (uint32_t) strtoul(argv[s + 1], NULL, 10) : default_sizes[s];
+
+        struct imgfs_file file;
+        memset(&file, 0, sizeof(file));
+        file.header.max_files = nb_images;
+        file.header.nb_files = nb_images;
+        file.metadata = calloc(nb_images, sizeof(struct img_metadata));
+        if (file.metadata == NULL) {
+            fprintf(stderr, "Cannot allocate %u entries\n", nb_images);
+            return ERR_OUT_OF_MEMORY;
+        }
+        for (uint32_t i = 0; i < nb_images; ++i) {
+            file.metadata[i].is_valid = NON_EMPTY;
+            snprintf(file.metadata[i].img_id, sizeof(file.metadata[i].img_id),
+                     i % ESCAPED_EVERY == 0 ? "album/%08u.jpg" : "image-%08u", i);
+        }
+
+        struct timespec start;
+        size_t bytes = 0;
+        int same = 1;
+
+        char *reference = list_json_c(&file);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < NB_ROUNDS; ++r) free(list_json_c(&file));
+        const double t_json_c = elapsed(&start);
+
+        char *json = NULL;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < NB_ROUNDS; ++r) {
+            free(json);
+            json = NULL;
+            if (do_list(&file, JSON, &json) != ERR_NONE) same = 0;
+        }
+        const double t_writer = elapsed(&start);
+        if (json != NULL) bytes = strlen(json);
+        same &= reference != NULL && json != NULL && strcmp(reference, json) == 0;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < NB_ROUNDS; ++r) {
+            char *copy = malloc(bytes);
+            if (copy != NULL) {
+                memcpy(copy, json, bytes);
+                sink ^= copy[bytes / 2]; // not to be optimized away
+            }
+            free(copy);
+        }
+        const double t_cached = elapsed(&start);
+
+        char *cbor = NULL;
+        size_t cbor_bytes = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < NB_ROUNDS; ++r) {
+            free(cbor);
+            cbor = NULL;
+            if (do_list_fields(&file, CBOR, 0, &cbor, &cbor_bytes) != ERR_NONE) same = 0;
+        }
+        const double t_cbor = elapsed(&start);
+        free(cbor);
+
+        printf("%10u %12zu %12.3f %12.3f %12.3f %12zu %12.3f %s\n", nb_images, bytes,
+               1e3 * t_json_c / NB_ROUNDS, 1e3 * t_writer / NB_ROUNDS, 1e3 * t_cached / NB_ROUNDS,
+               cbor_bytes, 1e3 * t_cbor / NB_ROUNDS, same ? "" : " (outputs differ!)");
+
+        free(json);
+        free(reference);
+        free(file.metadata);
+    }
+
+    return ERR_NONE;
+}
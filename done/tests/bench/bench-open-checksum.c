@@ -0,0 +1,121 @@
+/**
+ * @file bench-open-checksum.c
+ * @brief Cost of the checksums of the metadata of an imgFS, for metadata tables of growing size
+ *
+ * For each size:
+ *  - "crc MB/s": crc32c() over the metadata table (with the CRC instruction, if the processor has one);
+ *  - "table MB/s": crc32c_portable(), the lookup table it falls back to;
+ *  - "open ms": do_open() of an imgFS whose entries are all checksummed, verifying them;
+ *  - "verify ms": imgfs_verify() alone, the part of do_open() due to the checksums.
+ * The imgFS is written to BENCH_FILE, removed afterwards.
+ *
+ * Usage: bench-open-checksum [nb_images]...
+ */
+
+#include "imgfs.h"
+#include "crc32c.h"
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NB_ROUNDS 5
+#define BENCH_FILE "bench-open-checksum.imgfs"
+
+static volatile uint32_t sink;
+
+static const uint32_t default_sizes[] = { 10000, 100000, 1000000 };
+#define NB_DEFAULT_SIZES (sizeof(default_sizes) / sizeof(default_sizes[0]))
+
+/**********************************************************************
+ * Returns elapsed seconds since start.
+ */
+static double elapsed(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**********************************************************************
+ * Writes an imgFS of nb_images images, all its entries checksummed.
+ */
+static int write_imgfs(struct img_metadata *metadata, uint32_t nb_images)
+{
+    struct imgfs_header header;
+    memset(&header, 0, sizeof(header));
+    strncpy(header.name, CAT_TXT, MAX_IMGFS_NAME);
+    header.max_files = nb_images;
+    header.nb_files = nb_images;
+    header.checksum = imgfs_header_checksum(&header);
+    for (uint32_t i = 0; i < nb_images; ++i) {
+        metadata[i].is_valid = NON_EMPTY;
+        snprintf(metadata[i].img_id, sizeof(metadata[i].img_id), "image-%08u", i);
+        metadata[i].size[ORIG_RES] = 1000 + i;
+        metadata[i].offset[ORIG_RES] = (uint64_t) i * 4096;
+        metadata[i].checksum = imgfs_metadata_checksum(&metadata[i]);
+    }
+
+    FILE *file = fopen(BENCH_FILE, "wb");
+    if (file == NULL) return ERR_IO;
+    const int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(metadata, sizeof(*metadata), nb_images, file) == nb_images;
+    return fclose(file) == 0 && ok ? ERR_NONE : ERR_IO;
+}
+
+int main(int argc, char *argv[])
+{
+    printf("%10s %12s %12s %12s %12s %s\n", "images", "crc MB/s", "table MB/s", "open ms", "verify ms", "");
+
+    const int nb_sizes = argc > 1 ? argc - 1 : (int) NB_DEFAULT_SIZES;
+    for (int s = 0; s < nb_sizes; ++s) {
+        const uint32_t nb_images = argc > 1 ? (uint32_t) strtoul(argv[s + 1], NULL, 10) : default_sizes[s];
+        const size_t bytes = (size_t) nb_images * sizeof(struct img_metadata);
+
+        struct img_metadata *metadata = calloc(nb_images, sizeof(struct img_metadata));
+        if (metadata == NULL || write_imgfs(metadata, nb_images) != ERR_NONE) {
+            fprintf(stderr, "Cannot write an imgFS of %u images\n", nb_images);
+            free(metadata);
+            return ERR_IO;
+        }
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < NB_ROUNDS; ++r) sink ^= crc32c(0, metadata, bytes);
+        const double t_crc = elapsed(&start);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int r = 0; r < NB_ROUNDS; ++r) sink ^= crc32c_portable(0, metadata, bytes);
+        const double t_table = elapsed(&start);
+
+        double t_open = 0, t_verify = 0;
+        int verified = 1;
+        for (int r = 0; r < NB_ROUNDS; ++r) {
+            struct imgfs_file file;
+            memset(&file, 0, sizeof(file));
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            if (do_open(BENCH_FILE, "rb", &file) != ERR_NONE) {
+                verified = 0;
+                break;
+            }
+            t_open += elapsed(&start);
+            verified &= file.nb_quarantined == 0 && file.header.nb_files == nb_images;
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            verified &= imgfs_verify(BENCH_FILE, "rb", &file) == ERR_NONE;
+            t_verify += elapsed(&start);
+            do_close(&file);
+        }
+
+        printf("%10u %12.0f %12.0f %12.3f %12.3f %s\n", nb_images,
+               (double) bytes * NB_ROUNDS / t_crc / 1e6, (double) bytes * NB_ROUNDS / t_table / 1e6,
+               1e3 * t_open / NB_ROUNDS, 1e3 * t_verify / NB_ROUNDS, verified ? "" : " (not verified!)");
+
+        free(metadata);
+        remove(BENCH_FILE);
+    }
+
+    return ERR_NONE;
+}
@@ -0,0 +1,103 @@
+#include "blurhash.h"
+#include "test.h"
+#include <check.h>
+#include <string.h>
+
+#define WIDTH  8
+#define HEIGHT 6
+
+// ======================================================================
+START_TEST(blurhash_null_params)
+{
+    start_test_print;
+
+    unsigned char pixels[3] = {0};
+    char hash[BLURHASH_LENGTH + 1];
+    ck_assert_invalid_arg(blurhash_encode(NULL, 1, 1, 3, hash));
+    ck_assert_invalid_arg(blurhash_encode(pixels, 1, 1, 3, NULL));
+    ck_assert_invalid_arg(blurhash_encode(pixels, 0, 1, 3, hash));
+    ck_assert_invalid_arg(blurhash_encode(pixels, 1, 0, 3, hash));
+    ck_assert_invalid_arg(blurhash_encode(pixels, 1, 1, 0, hash));
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(blurhash_plain_images)
+{
+    start_test_print;
+
+    unsigned char pixels[WIDTH * HEIGHT * 3];
+    char hash[BLURHASH_LENGTH + 1];
+
+    // 4 x 3 components ("L"), no AC component: all of them in the middle of the scale ("fQ")
+    memset(pixels, 0, sizeof(pixels));
+    ck_assert_err_none(blurhash_encode(pixels, WIDTH, HEIGHT, 3, hash));
+    ck_assert_str_eq(hash, "L00000fQfQfQfQfQfQfQfQfQfQfQ");
+
+    // the DC component is the average colour (the AC ones are not all flat: the cosines of the
+    // components do not sum to 0 over the pixels)
+    memset(pixels, 0xff, sizeof(pixels));
+    ck_assert_err_none(blurhash_encode(pixels, WIDTH, HEIGHT, 3, hash));
+    ck_assert_mem_eq(hash + 2, "TSUA", 4);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(blurhash_grey_images)
+{
+    start_test_print;
+
+    // A horizontal gradient, in grey with alpha and in RGB
+    unsigned char grey[WIDTH * HEIGHT * 2];
+    unsigned char rgb[WIDTH * HEIGHT * 3];
+    for (size_t i = 0; i < WIDTH * HEIGHT; ++i) {
+        const unsigned char value = (unsigned char) (i % WIDTH * 255 / (WIDTH - 1));
+        grey[2 * i] = value;
+        grey[2 * i + 1] = 0x80;
+        memset(&rgb[3 * i], value, 3);
+    }
+
+    char grey_hash[BLURHASH_LENGTH + 1];
+    char rgb_hash[BLURHASH_LENGTH + 1];
+    ck_assert_err_none(blurhash_encode(grey, WIDTH, HEIGHT, 2, grey_hash));
+    ck_assert_err_none(blurhash_encode(rgb, WIDTH, HEIGHT, 3, rgb_hash));
+    ck_assert_uint_eq(strlen(rgb_hash), BLURHASH_LENGTH);
+    ck_assert_str_eq(grey_hash, rgb_hash);
+
+    // The image changes from left to right only: upside down, it is the same
+    unsigned char flipped[WIDTH * HEIGHT * 3];
+    for (size_t y = 0; y < HEIGHT; ++y) {
+        memcpy(&flipped[3 * WIDTH * y], &rgb[3 * WIDTH * (HEIGHT - 1 - y)], 3 * WIDTH);
+    }
+    char flipped_hash[BLURHASH_LENGTH + 1];
+    ck_assert_err_none(blurhash_encode(flipped, WIDTH, HEIGHT, 3, flipped_hash));
+    ck_assert_str_eq(flipped_hash, rgb_hash);
+
+    // but not mirrored
+    for (size_t i = 0; i < WIDTH * HEIGHT; ++i) {
+        memcpy(&flipped[3 * i], &rgb[3 * (i / WIDTH * WIDTH + WIDTH - 1 - i % WIDTH)], 3);
+    }
+    ck_assert_err_none(blurhash_encode(flipped, WIDTH, HEIGHT, 3, flipped_hash));
+    ck_assert_str_ne(flipped_hash, rgb_hash);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+Suite *blurhash_test_suite()
+{
+    Suite *s = suite_create("Tests blurhash implementation");
+
+    Add_Test(s, blurhash_null_params);
+    Add_Test(s, blurhash_plain_images);
+    Add_Test(s, blurhash_grey_images);
+
+    return s;
+}
+
+TEST_SUITE(blurhash_test_suite)
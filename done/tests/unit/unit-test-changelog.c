@@ -0,0 +1,119 @@
+#include "change_log.h"
+#include "test.h"
+#include <check.h>
+#include <string.h>
+
+#define LOG_IMGFS DATA_DIR "/dump-changelog.imgfs"
+
+// ======================================================================
+START_TEST(change_log_null_params)
+{
+    start_test_print;
+
+    struct change_log log;
+    struct change_record record;
+    size_t nb;
+    memset(&log, 0, sizeof(log));
+
+    ck_assert_invalid_arg(change_log_open(NULL, LOG_IMGFS, 0));
+    ck_assert_invalid_arg(change_log_open(&log, NULL, 0));
+    ck_assert_invalid_arg(change_log_append(&log, 1, CHANGE_INSERT, "pic"));
+    ck_assert_invalid_arg(change_log_read(&log, 0, &record, 1, &nb));
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(change_log_append_and_read)
+{
+    start_test_print;
+
+    struct change_log log;
+    struct change_record records[4];
+    size_t nb = 0;
+
+    remove(LOG_IMGFS CHANGE_LOG_SUFFIX);
+    ck_assert_err_none(change_log_open(&log, LOG_IMGFS, 2));
+    ck_assert_uint_eq(change_log_version(&log), 2);
+
+    ck_assert_err_none(change_log_append(&log, 3, CHANGE_INSERT, "pic3"));
+    ck_assert_err_none(change_log_append(&log, 4, CHANGE_DELETE, "pic1"));
+    ck_assert_err_none(change_log_append(&log, 5, CHANGE_INSERT, "pic4"));
+    ck_assert_uint_eq(change_log_version(&log), 5);
+
+    ck_assert_err_none(change_log_read(&log, 2, records, 4, &nb));
+    ck_assert_uint_eq(nb, 3);
+    ck_assert_uint_eq(records[0].version, 3);
+    ck_assert_str_eq(records[0].img_id, "pic3");
+    ck_assert_uint_eq(records[1].op, CHANGE_DELETE);
+    ck_assert_str_eq(records[1].img_id, "pic1");
+
+    ck_assert_err_none(change_log_read(&log, 3, records, 1, &nb));
+    ck_assert_uint_eq(nb, 1);
+    ck_assert_uint_eq(records[0].version, 4);
+
+    ck_assert_err_none(change_log_read(&log, 5, records, 4, &nb));
+    ck_assert_uint_eq(nb, 0);
+
+    // unknown: before the log, or after its end
+    ck_assert_invalid_arg(change_log_read(&log, 1, records, 4, &nb));
+    ck_assert_invalid_arg(change_log_read(&log, 6, records, 4, &nb));
+
+    change_log_close(&log);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(change_log_reopen)
+{
+    start_test_print;
+
+    struct change_log log;
+    struct change_record records[4];
+    size_t nb = 0;
+
+    remove(LOG_IMGFS CHANGE_LOG_SUFFIX);
+    ck_assert_err_none(change_log_open(&log, LOG_IMGFS, 0));
+    ck_assert_err_none(change_log_append(&log, 1, CHANGE_INSERT, "pic1"));
+    ck_assert_err_none(change_log_append(&log, 2, CHANGE_INSERT, "pic2"));
+    change_log_close(&log);
+
+    // same version: the records are kept
+    ck_assert_err_none(change_log_open(&log, LOG_IMGFS, 2));
+    ck_assert_err_none(change_log_read(&log, 0, records, 4, &nb));
+    ck_assert_uint_eq(nb, 2);
+    ck_assert_str_eq(records[1].img_id, "pic2");
+
+    // a change that was not recorded: the log starts again
+    ck_assert_err_none(change_log_append(&log, 4, CHANGE_DELETE, "pic2"));
+    ck_assert_invalid_arg(change_log_read(&log, 2, records, 4, &nb));
+    ck_assert_err_none(change_log_read(&log, 3, records, 4, &nb));
+    ck_assert_uint_eq(nb, 1);
+    change_log_close(&log);
+
+    // the imgFS was changed without the log
+    ck_assert_err_none(change_log_open(&log, LOG_IMGFS, 7));
+    ck_assert_uint_eq(change_log_version(&log), 7);
+    ck_assert_invalid_arg(change_log_read(&log, 4, records, 4, &nb));
+    change_log_close(&log);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+Suite *change_log_test_suite()
+{
+    Suite *s = suite_create("Tests change_log implementation");
+
+    Add_Test(s, change_log_null_params);
+    Add_Test(s, change_log_append_and_read);
+    Add_Test(s, change_log_reopen);
+
+    return s;
+}
+
+TEST_SUITE(change_log_test_suite)
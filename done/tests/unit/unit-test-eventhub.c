@@ -0,0 +1,141 @@
+#include "event_hub.h"
+#include "error.h"
+#include "test.h"
+#include <check.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define EVENT "event: insert\ndata: { \"img_id\": \"pic1\" }\n\n"
+
+/**
+ * Reads from fd until len bytes are in buf, or nothing comes for a second.
+ * Returns the number of bytes read, -1 once the peer closed the connection.
+ */
+static ssize_t read_within(int fd, char *buf, size_t len)
+{
+    size_t got = 0;
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    while (got < len && poll(&pfd, 1, 1000) > 0) {
+        const ssize_t r = read(fd, buf + got, len - got);
+        if (r <= 0) return -1;
+        got += (size_t) r;
+    }
+    return (ssize_t) got;
+}
+
+// ======================================================================
+START_TEST(event_queue_wraps)
+{
+    start_test_print;
+
+    struct event_queue queue;
+    const char *data = NULL;
+    ck_assert_err_none(event_queue_init(&queue, 8));
+
+    ck_assert_err_none(event_queue_push(&queue, "abcdef", 6));
+    ck_assert_uint_eq(event_queue_peek(&queue, &data), 6);
+    ck_assert_int_eq(strncmp(data, "abcdef", 6), 0);
+    event_queue_pop(&queue, 4);
+
+    // no room left for more than 6 bytes, the 4 last going to the start of the buffer
+    ck_assert_err(event_queue_push(&queue, "ghijklm", 7), ERR_OUT_OF_MEMORY);
+    ck_assert_uint_eq(queue.len, 2);
+    ck_assert_err_none(event_queue_push(&queue, "ghijkl", 6));
+    ck_assert_uint_eq(queue.len, 8);
+
+    ck_assert_uint_eq(event_queue_peek(&queue, &data), 4);
+    ck_assert_int_eq(strncmp(data, "efgh", 4), 0);
+    event_queue_pop(&queue, 4);
+    ck_assert_uint_eq(event_queue_peek(&queue, &data), 4);
+    ck_assert_int_eq(strncmp(data, "ijkl", 4), 0);
+    event_queue_pop(&queue, 4);
+    ck_assert_uint_eq(queue.len, 0);
+
+    event_queue_free(&queue);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(event_hub_publish_to_subscribers)
+{
+    start_test_print;
+
+    struct event_hub hub;
+    int first[2], second[2];
+    char buf[256] = {0};
+
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, first), 0);
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, second), 0);
+    ck_assert_err_none(event_hub_start(&hub));
+
+    ck_assert_err_none(event_hub_subscribe(&hub, first[0], "hello\n", 6));
+    ck_assert_int_eq(read_within(first[1], buf, 6), 6);
+    ck_assert_int_eq(strncmp(buf, "hello\n", 6), 0);
+
+    ck_assert_err_none(event_hub_subscribe(&hub, second[0], "", 0));
+    event_hub_publish(&hub, EVENT, strlen(EVENT));
+    ck_assert_int_eq(read_within(first[1], buf, strlen(EVENT)), strlen(EVENT));
+    ck_assert_int_eq(strncmp(buf, EVENT, strlen(EVENT)), 0);
+    ck_assert_int_eq(read_within(second[1], buf, strlen(EVENT)), strlen(EVENT));
+
+    // a subscriber that leaves does not stop the others from getting events
+    close(first[1]);
+    event_hub_publish(&hub, EVENT, strlen(EVENT));
+    ck_assert_int_eq(read_within(second[1], buf, strlen(EVENT)), strlen(EVENT));
+
+    event_hub_stop(&hub);
+    ck_assert_int_eq(read_within(second[1], buf, 1), -1);
+    close(second[1]);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(event_hub_drops_slow_subscriber)
+{
+    start_test_print;
+
+    struct event_hub hub;
+    int slow[2];
+    char buf[EVENT_QUEUE_SIZE / 16];
+
+    ck_assert_int_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, slow), 0);
+    ck_assert_err_none(event_hub_start(&hub));
+    ck_assert_err_none(event_hub_subscribe(&hub, slow[0], "", 0));
+
+    // never read: once the socket is full, the events pile up in the queue, until it overflows
+    memset(buf, 'x', sizeof(buf));
+    for (int i = 0; i < 1024; ++i) {
+        event_hub_publish(&hub, buf, sizeof(buf));
+    }
+
+    // what was sent is there, then the connection is closed
+    ssize_t r;
+    while ((r = read_within(slow[1], buf, sizeof(buf))) > 0);
+    ck_assert_int_eq(r, -1);
+
+    event_hub_stop(&hub);
+    close(slow[1]);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+Suite *event_hub_test_suite()
+{
+    Suite *s = suite_create("Tests event_hub implementation");
+
+    Add_Test(s, event_queue_wraps);
+    Add_Test(s, event_hub_publish_to_subscribers);
+    Add_Test(s, event_hub_drops_slow_subscriber);
+
+    return s;
+}
+
+TEST_SUITE(event_hub_test_suite)
@@ -1,4 +1,5 @@
 #include "http_prot.h"
+#include "http_scan.h"
 #include "test.h"
 #include <check.h>
 
@@ -158,6 +159,75 @@ START_TEST(http_get_var_valid)
 }
 END_TEST
 
+// ======================================================================
+START_TEST(http_get_var_bounded)
+{
+    start_test_print;
+
+    char buf[10];
+
+    const char *str = "/imgfs/read?res=orig&img_id=pic1 HTTP/1.1" HTTP_LINE_DELIM "X-Ids: ?thumbres=1&max_files=3";
+    struct http_string http_str = {.val = str, .len = strlen("/imgfs/read?res=orig&img_id=pic1")};
+
+    ck_assert_int_eq(http_get_var(&http_str, "img_id", buf, 10), 4);
+    ck_assert_str_eq(buf, "pic1");
+    ck_assert_int_eq(http_get_var(&http_str, "res", buf, 10), 4);
+    ck_assert_str_eq(buf, "orig");
+
+    // only the URL is looked at, and only whole parameter names match
+    ck_assert_int_eq(http_get_var(&http_str, "max_files", buf, 10), 0);
+    ck_assert_int_eq(http_get_var(&http_str, "id", buf, 10), 0);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(http_scan_delims_all_isas)
+{
+    start_test_print;
+
+    // long enough to span several SIMD blocks, with delimiters split across block boundaries
+    const char *str = "GET /imgfs/read?res=orig&img_id=mure.jpg HTTP/1.1" HTTP_LINE_DELIM
+                      "Host: localhost:8000" HTTP_LINE_DELIM "Referer: http://x/?a=b&c=d" HTTP_LINE_DELIM
+                      "X-Padding-To-Split-The-Next-Delimiter-Across-Blocks-1234:" HTTP_LINE_DELIM
+                      "Accept: */*" HTTP_HDR_END_DELIM "=&?";
+    const size_t len = strlen(str);
+    const unsigned all = (1u << NB_HTTP_DELIMS) - 1;
+
+    struct http_delim expected[256];
+    struct http_delim got[256];
+
+    ck_assert_err_none(http_scan_select(HTTP_SCAN_SCALAR));
+    const size_t nb = http_scan_delims(str, len, all, expected, 256);
+    ck_assert_int_gt(nb, 20);
+
+    const enum http_scan_isa isas[] = { HTTP_SCAN_SSE2, HTTP_SCAN_AVX2, HTTP_SCAN_AUTO };
+    for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); ++i) {
+        if (http_scan_select(isas[i]) != ERR_NONE) continue; // not supported by this CPU
+
+        for (size_t start = 0; start < 40; ++start) {
+            const size_t n = http_scan_delims(str + start, len - start, all, got, 256);
+            size_t first = 0;
+            while (first < nb && expected[first].pos < start) ++first;
+            ck_assert_int_eq(n, nb - first);
+            for (size_t j = 0; j < n; ++j) {
+                ck_assert_int_eq(got[j].pos + start, expected[first + j].pos);
+                ck_assert_int_eq(got[j].kind, expected[first + j].kind);
+            }
+        }
+
+        // stops after max_delims
+        ck_assert_int_eq(http_scan_delims(str, len, all, got, 3), 3);
+        ck_assert_int_eq(http_scan_next(str, len, HTTP_SCAN(HTTP_DELIM_CRLF), NULL),
+                         strlen("GET /imgfs/read?res=orig&img_id=mure.jpg HTTP/1.1"));
+    }
+    ck_assert_err_none(http_scan_select(HTTP_SCAN_AUTO));
+
+    end_test_print;
+}
+END_TEST
+
 // ======================================================================
 START_TEST(http_parse_message_null_params)
 {
@@ -279,6 +349,378 @@ START_TEST(http_parse_message_full_headers_full_content)
 }
 END_TEST
 
+// ======================================================================
+START_TEST(http_parse_incremental_null_params)
+{
+    start_test_print;
+
+    const char *str = "";
+    struct http_message msg;
+    struct http_parser parser;
+    http_parser_init(&parser);
+
+    ck_assert_invalid_arg(http_parse_incremental(NULL, str, 0, &msg));
+    ck_assert_invalid_arg(http_parse_incremental(&parser, NULL, 0, &msg));
+    ck_assert_invalid_arg(http_parse_incremental(&parser, str, 0, NULL));
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(http_parse_incremental_byte_per_byte)
+{
+    start_test_print;
+
+    const char *str = "POST /imgfs/insert?&name=papillon.jpg HTTP/1.1" HTTP_LINE_DELIM "Host: localhost:8000" HTTP_LINE_DELIM
+                      "Content-Length: 12" HTTP_LINE_DELIM "Accept: */*" HTTP_HDR_END_DELIM "Hello world!";
+    const size_t len = strlen(str);
+    const size_t header_len = len - strlen("Hello world!");
+    struct http_message msg;
+    struct http_parser parser;
+    http_parser_init(&parser);
+
+    for (size_t i = 1; i < len; ++i) {
+        ck_assert_int_eq(http_parse_incremental(&parser, str, i, &msg), 0);
+        ck_assert_int_eq(http_parser_message_len(&parser), i < header_len ? 0 : len);
+        if (i < header_len) {
+            // at most the first byte of a split delimiter is scanned again
+            ck_assert(parser.scanned <= i && parser.scanned + 1 >= i);
+        } else {
+            ck_assert_int_eq(parser.scanned, header_len);
+        }
+    }
+    ck_assert_int_eq(http_parse_incremental(&parser, str, len, &msg), 1);
+
+    ck_assert_http_str_eq(msg.method, "POST");
+    ck_assert_http_str_eq(msg.uri, "/imgfs/insert?&name=papillon.jpg");
+    ck_assert_int_eq(msg.num_headers, 3);
+    ck_assert_has_header(&msg, "Content-Length", "12");
+    ck_assert_has_header(&msg, "Accept", "*/*");
+    ck_assert_http_str_eq(msg.body, "Hello world!");
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(http_parse_incremental_moved_buffer)
+{
+    start_test_print;
+
+    const char *str = "POST /imgfs/insert?&name=a HTTP/1.1" HTTP_LINE_DELIM "Content-Length: 5" HTTP_HDR_END_DELIM "abcde";
+    const size_t len = strlen(str);
+    struct http_message msg;
+    struct http_parser parser;
+    http_parser_init(&parser);
+
+    // headers parsed from a first buffer, without the trailing null byte
+    char *first = malloc(len - 2);
+    ck_assert_ptr_nonnull(first);
+    memcpy(first, str, len - 2);
+    ck_assert_int_eq(http_parse_incremental(&parser, first, len - 2, &msg), 0);
+    ck_assert_int_eq(http_parser_message_len(&parser), len);
+    free(first);
+
+    // then completed in another one
+    char *second = strdup(str);
+    ck_assert_ptr_nonnull(second);
+    ck_assert_int_eq(http_parse_incremental(&parser, second, len, &msg), 1);
+    ck_assert_ptr_eq(msg.method.val, second);
+    ck_assert_http_str_eq(msg.uri, "/imgfs/insert?&name=a");
+    ck_assert_http_str_eq(msg.body, "abcde");
+    free(second);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(http_parse_message_content_length_overflow)
+{
+    start_test_print;
+
+    struct http_message msg;
+    int content_len = 0;
+
+    // 2^64 + 1 would wrap around to 1
+    const char *overflow = "POST /imgfs/insert?&name=a HTTP/1.1" HTTP_LINE_DELIM
+                           "Content-Length: 18446744073709551617" HTTP_HDR_END_DELIM "a";
+    ck_assert_int_lt(http_parse_message(overflow, strlen(overflow), &msg, &content_len), 0);
+
+    // leading zeros are not significant
+    const char *padded = "POST /imgfs/insert?&name=a HTTP/1.1" HTTP_LINE_DELIM
+                         "Content-Length: 000000000000000000000000000000000001" HTTP_HDR_END_DELIM "a";
+    ck_assert_int_eq(http_parse_message(padded, strlen(padded), &msg, &content_len), 1);
+    ck_assert_int_eq(content_len, 1);
+
+    const char *too_long = "POST /imgfs/insert?&name=a HTTP/1.1" HTTP_LINE_DELIM
+                           "Content-Length: 000100000000000000000000" HTTP_HDR_END_DELIM "a";
+    ck_assert_int_lt(http_parse_message(too_long, strlen(too_long), &msg, &content_len), 0);
+
+    // a length with no room left for the header
+    const char *no_room = "POST /imgfs/insert?&name=a HTTP/1.1" HTTP_LINE_DELIM
+                          "Content-Length: 18446744073709551609" HTTP_HDR_END_DELIM "a";
+    ck_assert_int_lt(http_parse_message(no_room, strlen(no_room), &msg, &content_len), 0);
+
+    // a length the parser accepts (the message is only incomplete), but not an int
+    const char *huge = "POST /imgfs/insert?&name=a HTTP/1.1" HTTP_LINE_DELIM
+                       "Content-Length: 1844674407370955160" HTTP_HDR_END_DELIM "a";
+    struct http_parser parser;
+    http_parser_init(&parser);
+    ck_assert_int_eq(http_parse_incremental(&parser, huge, strlen(huge), &msg), 0);
+    ck_assert_invalid_arg(http_parse_message(huge, strlen(huge), &msg, &content_len));
+    ck_assert_int_eq(content_len, 0);
+
+    const char *above_int = "POST /imgfs/insert?&name=a HTTP/1.1" HTTP_LINE_DELIM
+                            "Content-Length: 2147483648" HTTP_HDR_END_DELIM "a";
+    ck_assert_invalid_arg(http_parse_message(above_int, strlen(above_int), &msg, &content_len));
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(http_parse_incremental_pipelined)
+{
+    start_test_print;
+
+    const char *first = "GET /imgfs/list HTTP/1.1" HTTP_LINE_DELIM "Host: localhost" HTTP_HDR_END_DELIM;
+    const char *second = "POST /imgfs/insert?name=a HTTP/1.1" HTTP_LINE_DELIM "Connection: Close" HTTP_LINE_DELIM
+                         "Content-Length: 3" HTTP_HDR_END_DELIM "xyz";
+    char buf[256];
+    const size_t len = (size_t) snprintf(buf, sizeof(buf), "%s%s", first, second);
+    struct http_message msg;
+    struct http_parser parser;
+
+    // the first message ends where the second one starts
+    http_parser_init(&parser);
+    ck_assert_int_eq(http_parse_incremental(&parser, buf, len, &msg), 1);
+    ck_assert_int_eq(http_parser_message_len(&parser), strlen(first));
+    ck_assert_http_str_eq(msg.uri, "/imgfs/list");
+    ck_assert_ptr_null(msg.body.val);
+    ck_assert_int_eq(http_wants_close(&msg), 0);
+
+    const char *next = buf + http_parser_message_len(&parser);
+    http_parser_init(&parser);
+    ck_assert_int_eq(http_parse_incremental(&parser, next, len - strlen(first), &msg), 1);
+    ck_assert_http_str_eq(msg.method, "POST");
+    ck_assert_http_str_eq(msg.body, "xyz");
+    ck_assert_int_eq(http_wants_close(&msg), 1);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(http_get_header_valid)
+{
+    start_test_print;
+
+    struct http_message msg;
+    ck_assert_int_eq(http_parse_message("GET / HTTP/1.1" HTTP_LINE_DELIM "content-length: 0" HTTP_LINE_DELIM
+                                        "Connection: keep-alive" HTTP_HDR_END_DELIM,
+                                        strlen("GET / HTTP/1.1" HTTP_LINE_DELIM "content-length: 0" HTTP_LINE_DELIM
+                                               "Connection: keep-alive" HTTP_HDR_END_DELIM),
+                                        &msg, &(int) {0}), 1);
+
+    ck_assert_ptr_null(http_get_header(NULL, "Host"));
+    ck_assert_ptr_null(http_get_header(&msg, NULL));
+    ck_assert_ptr_null(http_get_header(&msg, "Host"));
+    ck_assert_ptr_null(http_get_header(&msg, "Content"));
+
+    const struct http_string *value = http_get_header(&msg, "Content-Length");
+    ck_assert_ptr_nonnull(value);
+    const struct http_string content_length = *value;
+    ck_assert_http_str_eq(content_length, "0");
+    ck_assert_int_eq(http_wants_close(&msg), 0);
+    ck_assert_int_eq(http_expects_continue(&msg), 0);
+
+    ck_assert_int_eq(http_parse_message("POST / HTTP/1.1" HTTP_LINE_DELIM "expect: 100-Continue" HTTP_HDR_END_DELIM,
+                                        strlen("POST / HTTP/1.1" HTTP_LINE_DELIM "expect: 100-Continue" HTTP_HDR_END_DELIM),
+                                        &msg, &(int) {0}), 1);
+    ck_assert_int_eq(http_expects_continue(&msg), 1);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(http_etag_matches_valid)
+{
+    start_test_print;
+
+#define ETAG_CONDITION(str) (&(struct http_string) { str, sizeof(str) - 1 })
+    ck_assert_int_eq(http_etag_matches(NULL, "\"abc\""), 0);
+    ck_assert_int_eq(http_etag_matches(ETAG_CONDITION("\"abc\""), NULL), 0);
+
+    ck_assert_int_eq(http_etag_matches(ETAG_CONDITION("\"abc\""), "\"abc\""), 1);
+    ck_assert_int_eq(http_etag_matches(ETAG_CONDITION("\"abcd\""), "\"abc\""), 0);
+    ck_assert_int_eq(http_etag_matches(ETAG_CONDITION("\"ab\""), "\"abc\""), 0);
+    ck_assert_int_eq(http_etag_matches(ETAG_CONDITION("abc"), "\"abc\""), 0);
+    ck_assert_int_eq(http_etag_matches(ETAG_CONDITION(""), "\"abc\""), 0);
+    ck_assert_int_eq(http_etag_matches(ETAG_CONDITION("*"), "\"abc\""), 1);
+    ck_assert_int_eq(http_etag_matches(ETAG_CONDITION("W/\"abc\""), "\"abc\""), 1);
+    ck_assert_int_eq(http_etag_matches(ETAG_CONDITION("\"x\", W/\"y\" ,\"abc\"  "), "\"abc\""), 1);
+    ck_assert_int_eq(http_etag_matches(ETAG_CONDITION("\"x\", \"y\""), "\"abc\""), 0);
+#undef ETAG_CONDITION
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(http_wants_close_valid)
+{
+    start_test_print;
+
+    struct http_message msg;
+    // -1 if the request cannot be parsed
+#define WANTS_CLOSE(request) (http_parse_message(request HTTP_HDR_END_DELIM, strlen(request HTTP_HDR_END_DELIM), \
+                                                 &msg, &(int) {0}) == 1 ? http_wants_close(&msg) : -1)
+    ck_assert_int_eq(WANTS_CLOSE("GET / HTTP/1.1" HTTP_LINE_DELIM "Host: a"), 0);
+    ck_assert(msg.version.len == strlen("HTTP/1.1") && strncmp(msg.version.val, "HTTP/1.1", msg.version.len) == 0);
+    ck_assert_int_eq(WANTS_CLOSE("GET / HTTP/1.1" HTTP_LINE_DELIM "Connection: close"), 1);
+    ck_assert_int_eq(WANTS_CLOSE("GET / HTTP/1.1" HTTP_LINE_DELIM "Connection: keep-alive, Close"), 1);
+    ck_assert_int_eq(WANTS_CLOSE("GET / HTTP/1.1" HTTP_LINE_DELIM "Connection: upgrade,close "), 1);
+    ck_assert_int_eq(WANTS_CLOSE("GET / HTTP/1.1" HTTP_LINE_DELIM "Connection: closed"), 0);
+
+    // HTTP/1.0 connections are closed unless kept alive
+    ck_assert_int_eq(WANTS_CLOSE("GET / HTTP/1.0" HTTP_LINE_DELIM "Host: a"), 1);
+    ck_assert_int_eq(WANTS_CLOSE("GET / HTTP/1.0" HTTP_LINE_DELIM "Connection: Keep-Alive"), 0);
+    ck_assert_int_eq(WANTS_CLOSE("GET / HTTP/1.0" HTTP_LINE_DELIM "Connection: keep-alive, close"), 1);
+    ck_assert_int_eq(WANTS_CLOSE("GET /" HTTP_LINE_DELIM "Host: a"), 1);
+#undef WANTS_CLOSE
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(http_accepts_valid)
+{
+    start_test_print;
+
+    struct http_message msg;
+    memset(&msg, 0, sizeof(msg));
+    ck_assert_int_eq(http_accepts(&msg, "application/cbor"), 0);
+
+    msg.num_headers = 1;
+    msg.headers[0].key = (struct http_string) { "accept", strlen("accept") };
+#define ACCEPTS(str) (msg.headers[0].value = (struct http_string) { str, strlen(str) }, \
+                      http_accepts(&msg, "application/cbor"))
+    ck_assert_int_eq(ACCEPTS("application/cbor"), 1);
+    ck_assert_int_eq(ACCEPTS("Application/CBOR"), 1);
+    ck_assert_int_eq(ACCEPTS("application/json, application/cbor;q=0.9"), 1);
+    ck_assert_int_eq(ACCEPTS("application/cbor ; q=1, */*"), 1);
+    ck_assert_int_eq(ACCEPTS("application/json"), 0);
+    ck_assert_int_eq(ACCEPTS("*/*"), 0);
+    ck_assert_int_eq(ACCEPTS("application/cbor-seq"), 0);
+    ck_assert_int_eq(ACCEPTS("application/cbor;q=0"), 0);
+    ck_assert_int_eq(ACCEPTS("application/cbor; q=0.000, text/html"), 0);
+#undef ACCEPTS
+    ck_assert_int_eq(http_accepts(&msg, NULL), 0);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(http_multipart_valid)
+{
+    start_test_print;
+
+    struct http_message msg;
+    memset(&msg, 0, sizeof(msg));
+    struct http_string boundary, name, content;
+    ck_assert_int_eq(http_multipart_boundary(&msg, &boundary), 0);
+
+    msg.num_headers = 1;
+    msg.headers[0].key = (struct http_string) { "Content-Type", strlen("Content-Type") };
+    msg.headers[0].value = (struct http_string) { "application/json", strlen("application/json") };
+    ck_assert_int_eq(http_multipart_boundary(&msg, &boundary), 0);
+
+    const char *type = "multipart/form-data; boundary=\"xyz\"";
+    msg.headers[0].value = (struct http_string) { type, strlen(type) };
+    ck_assert_int_eq(http_multipart_boundary(&msg, &boundary), 1);
+    ck_assert_int_eq(boundary.len, 3);
+    ck_assert_int_eq(strncmp(boundary.val, "xyz", 3), 0);
+
+    // the second content has a line break, and looks like a delimiter, but without its "--"
+    static const char data[] = "preamble\r\n--xyz\r\n"
+                               "Content-Disposition: form-data; name=\"image\"; filename=\"pic1\"\r\n"
+                               "Content-Type: image/jpeg\r\n\r\n"
+                               "abc\r\n--xyz\r\n"
+                               "content-disposition: form-data; name=pic2\r\n\r\n"
+                               "d\0e\r\nxyz\r\n--xyz--\r\n";
+    struct http_string body = { data, sizeof(data) - 1 };
+
+    ck_assert_int_eq(http_multipart_next(&boundary, &body, &name, &content), 1);
+    ck_assert_int_eq(name.len, 4);
+    ck_assert_int_eq(strncmp(name.val, "pic1", 4), 0);
+    ck_assert_int_eq(content.len, 3);
+    ck_assert_int_eq(strncmp(content.val, "abc", 3), 0);
+
+    ck_assert_int_eq(http_multipart_next(&boundary, &body, &name, &content), 1);
+    ck_assert_int_eq(name.len, 4);
+    ck_assert_int_eq(strncmp(name.val, "pic2", 4), 0);
+    ck_assert_int_eq(content.len, 8);
+    ck_assert_mem_eq(content.val, "d\0e\r\nxyz", 8);
+
+    ck_assert_int_eq(http_multipart_next(&boundary, &body, &name, &content), 0);
+    ck_assert_int_eq(body.len, 0);
+
+    // the last part is not closed
+    body = (struct http_string) { data, sizeof(data) - 1 - strlen("--xyz--\r\n") };
+    ck_assert_int_eq(http_multipart_next(&boundary, &body, &name, &content), 1);
+    ck_assert_invalid_arg(http_multipart_next(&boundary, &body, &name, &content));
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(http_parse_range_valid)
+{
+    start_test_print;
+
+#define RANGE(str) (&(struct http_string) { str, sizeof(str) - 1 })
+    size_t first = 0, last = 0;
+    ck_assert_invalid_arg(http_parse_range(RANGE("bytes=0-1"), 10, NULL, &last));
+    ck_assert_invalid_arg(http_parse_range(RANGE("bytes=0-1"), 10, &first, NULL));
+    ck_assert_int_eq(http_parse_range(NULL, 10, &first, &last), 0);
+
+    ck_assert_int_eq(http_parse_range(RANGE("bytes=2-5"), 10, &first, &last), 1);
+    ck_assert_uint_eq(first, 2);
+    ck_assert_uint_eq(last, 5);
+    ck_assert_int_eq(http_parse_range(RANGE("bytes=2-"), 10, &first, &last), 1);
+    ck_assert_uint_eq(first, 2);
+    ck_assert_uint_eq(last, 9);
+    ck_assert_int_eq(http_parse_range(RANGE("bytes=8-100"), 10, &first, &last), 1);
+    ck_assert_uint_eq(first, 8);
+    ck_assert_uint_eq(last, 9);
+    ck_assert_int_eq(http_parse_range(RANGE("bytes=-3"), 10, &first, &last), 1);
+    ck_assert_uint_eq(first, 7);
+    ck_assert_uint_eq(last, 9);
+    ck_assert_int_eq(http_parse_range(RANGE("bytes=-30"), 10, &first, &last), 1);
+    ck_assert_uint_eq(first, 0);
+    ck_assert_uint_eq(last, 9);
+
+    ck_assert_invalid_arg(http_parse_range(RANGE("bytes=10-"), 10, &first, &last));
+    ck_assert_invalid_arg(http_parse_range(RANGE("bytes=-0"), 10, &first, &last));
+
+    // ignored
+    ck_assert_int_eq(http_parse_range(RANGE("bytes=5-2"), 10, &first, &last), 0);
+    ck_assert_int_eq(http_parse_range(RANGE("bytes=0-1,4-5"), 10, &first, &last), 0);
+    ck_assert_int_eq(http_parse_range(RANGE("bytes=-"), 10, &first, &last), 0);
+    ck_assert_int_eq(http_parse_range(RANGE("items=0-1"), 10, &first, &last), 0);
+    ck_assert_int_eq(http_parse_range(RANGE("bytes=99999999999999999999999-"), 10, &first, &last), 0);
+#undef RANGE
+
+    end_test_print;
+}
+END_TEST
+
 // ======================================================================
 Suite *http_test_suite()
 {
@@ -294,12 +736,28 @@ Suite *http_test_suite()
     Add_Test(s, http_get_var_not_found);
     Add_Test(s, http_get_var_too_big);
     Add_Test(s, http_get_var_valid);
+    Add_Test(s, http_get_var_bounded);
+
+    Add_Test(s, http_scan_delims_all_isas);
 
     Add_Test(s, http_parse_message_null_params);
     Add_Test(s, http_parse_message_partial_headers);
     Add_Test(s, http_parse_message_full_headers_no_content);
     Add_Test(s, http_parse_message_full_headers_partial_content);
     Add_Test(s, http_parse_message_full_headers_full_content);
+    Add_Test(s, http_parse_message_content_length_overflow);
+
+    Add_Test(s, http_parse_incremental_null_params);
+    Add_Test(s, http_parse_incremental_byte_per_byte);
+    Add_Test(s, http_parse_incremental_moved_buffer);
+    Add_Test(s, http_parse_incremental_pipelined);
+
+    Add_Test(s, http_get_header_valid);
+    Add_Test(s, http_etag_matches_valid);
+    Add_Test(s, http_parse_range_valid);
+    Add_Test(s, http_wants_close_valid);
+    Add_Test(s, http_accepts_valid);
+    Add_Test(s, http_multipart_valid);
 
     return s;
 }
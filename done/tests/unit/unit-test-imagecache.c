@@ -0,0 +1,146 @@
+#include "image_cache.h"
+#include "test.h"
+#include <check.h>
+#include <string.h>
+
+static char *content(size_t size, char c)
+{
+    char *data = malloc(size);
+    ck_assert_ptr_nonnull(data);
+    memset(data, c, size);
+    return data;
+}
+
+// ======================================================================
+START_TEST(image_cache_hit_and_miss)
+{
+    start_test_print;
+
+    struct image_cache cache;
+    ck_assert_invalid_arg(image_cache_init(NULL, 0));
+    ck_assert_err_none(image_cache_init(&cache, 16 * 1000));
+
+    const struct image_cache_key key = { 3, 0, 21664 };
+    ck_assert_ptr_null(image_cache_get(&cache, &key));
+
+    const struct image_cache_entry *entry = image_cache_put(&cache, &key, content(100, 'a'), 100);
+    ck_assert_ptr_nonnull(entry);
+    ck_assert_int_eq(entry->size, 100);
+    image_cache_release(&cache, entry);
+
+    entry = image_cache_get(&cache, &key);
+    ck_assert_ptr_nonnull(entry);
+    ck_assert_int_eq(entry->data[99], 'a');
+    image_cache_release(&cache, entry);
+
+    // another resolution, or another content of the same entry
+    const struct image_cache_key other_res = { 3, 1, 21664 };
+    const struct image_cache_key other_offset = { 3, 0, 42 };
+    ck_assert_ptr_null(image_cache_get(&cache, &other_res));
+    ck_assert_ptr_null(image_cache_get(&cache, &other_offset));
+
+    struct image_cache_stats stats;
+    image_cache_stats(&cache, &stats);
+    ck_assert_int_eq(stats.hits, 1);
+    ck_assert_int_eq(stats.misses, 3);
+    ck_assert_int_eq(stats.entries, 1);
+    ck_assert_int_eq(stats.bytes, 100);
+
+    image_cache_free(&cache);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(image_cache_evicts_least_recently_used)
+{
+    start_test_print;
+
+    struct image_cache cache;
+    // 1000 bytes per shard
+    ck_assert_err_none(image_cache_init(&cache, IMAGE_CACHE_SHARDS * 1000));
+
+    // entries 0, 16 and 32 are in the same shard
+    const struct image_cache_key a = { 0, 0, 1 }, b = { IMAGE_CACHE_SHARDS, 0, 2 }, c = { 2 * IMAGE_CACHE_SHARDS, 0, 3 };
+    image_cache_release(&cache, image_cache_put(&cache, &a, content(400, 'a'), 400));
+    image_cache_release(&cache, image_cache_put(&cache, &b, content(400, 'b'), 400));
+
+    // a is now more recently used than b
+    image_cache_release(&cache, image_cache_get(&cache, &a));
+
+    // b is used while c is added: it cannot be evicted, a is
+    const struct image_cache_entry *used = image_cache_get(&cache, &b);
+    ck_assert_ptr_nonnull(used);
+    image_cache_release(&cache, image_cache_put(&cache, &c, content(400, 'c'), 400));
+    ck_assert_ptr_null(image_cache_get(&cache, &a));
+    image_cache_release(&cache, used);
+
+    const struct image_cache_entry *entry = image_cache_get(&cache, &c);
+    ck_assert_ptr_nonnull(entry);
+    image_cache_release(&cache, entry);
+
+    // too big to be kept
+    const struct image_cache_key big = { 5, 0, 1 };
+    entry = image_cache_put(&cache, &big, content(2000, 'z'), 2000);
+    ck_assert_ptr_nonnull(entry);
+    ck_assert_int_eq(entry->data[1999], 'z');
+    image_cache_release(&cache, entry);
+    ck_assert_ptr_null(image_cache_get(&cache, &big));
+
+    struct image_cache_stats stats;
+    image_cache_stats(&cache, &stats);
+    ck_assert_int_eq(stats.evictions, 1);
+    ck_assert_int_eq(stats.entries, 2);
+    ck_assert_int_eq(stats.bytes, 800);
+
+    image_cache_free(&cache);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(image_cache_invalidate_entry)
+{
+    start_test_print;
+
+    struct image_cache cache;
+    ck_assert_err_none(image_cache_init(&cache, 16 * 1000));
+
+    const struct image_cache_key thumb = { 7, 0, 10 }, orig = { 7, 2, 20 }, other = { 7 + IMAGE_CACHE_SHARDS, 0, 30 };
+    image_cache_release(&cache, image_cache_put(&cache, &thumb, content(10, 't'), 10));
+    image_cache_release(&cache, image_cache_put(&cache, &other, content(10, 'o'), 10));
+
+    // still in use while invalidated
+    const struct image_cache_entry *used = image_cache_put(&cache, &orig, content(10, 'x'), 10);
+
+    image_cache_invalidate(&cache, 7);
+    ck_assert_ptr_null(image_cache_get(&cache, &thumb));
+    ck_assert_ptr_null(image_cache_get(&cache, &orig));
+    ck_assert_int_eq(used->data[0], 'x');
+    image_cache_release(&cache, used);
+
+    const struct image_cache_entry *entry = image_cache_get(&cache, &other);
+    ck_assert_ptr_nonnull(entry);
+    image_cache_release(&cache, entry);
+
+    image_cache_free(&cache);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+Suite *image_cache_test_suite()
+{
+    Suite *s = suite_create("Tests image_cache implementation");
+
+    Add_Test(s, image_cache_hit_and_miss);
+    Add_Test(s, image_cache_evicts_least_recently_used);
+    Add_Test(s, image_cache_invalidate_entry);
+
+    return s;
+}
+
+TEST_SUITE(image_cache_test_suite)
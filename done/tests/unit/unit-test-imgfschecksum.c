@@ -0,0 +1,273 @@
+#include "imgfs.h"
+#include "crc32c.h"
+#include "test.h"
+#include <check.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <vips/vips.h>
+
+// ======================================================================
+static long size_of(const char *filename)
+{
+    struct stat st;
+    return stat(filename, &st) == 0 ? (long) st.st_size : -1;
+}
+
+static void quarantine_name(char *quarantine, const char *imgfs_filename)
+{
+    strcpy(quarantine, imgfs_filename);
+    strcat(quarantine, IMGFS_QUARANTINE_SUFFIX);
+}
+
+/**
+ * Overwrites the byte at offset of the file with value, as a torn write would.
+ */
+static void corrupt(const char *filename, long offset, char value)
+{
+    FILE *file = fopen(filename, "rb+");
+    ck_assert_ptr_nonnull(file);
+    ck_assert_int_eq(fseek(file, offset, SEEK_SET), 0);
+    ck_assert_int_eq(fputc(value, file), value);
+    fclose(file);
+}
+
+static size_t find_image(const struct imgfs_file *file, const char *img_id)
+{
+    for (size_t i = 0; i < file->header.max_files; ++i) {
+        if (file->metadata[i].is_valid && strcmp(file->metadata[i].img_id, img_id) == 0) {
+            return i;
+        }
+    }
+    return file->header.max_files;
+}
+
+// ======================================================================
+START_TEST(crc32c_values)
+{
+    start_test_print;
+
+    // The check value of CRC32C, and an iSCSI test vector (RFC 3720, B.4)
+    ck_assert_uint_eq(crc32c(0, "123456789", 9), 0xe3069283);
+    unsigned char zeros[32] = {0};
+    ck_assert_uint_eq(crc32c(0, zeros, sizeof(zeros)), 0x8a9136aa);
+    ck_assert_uint_eq(crc32c(0, NULL, 0), 0);
+
+    // in pieces, at any alignment, with or without the CRC instruction
+    char data[300];
+    for (size_t i = 0; i < sizeof(data); ++i) data[i] = (char) (i * 7 + 3);
+    for (size_t start = 0; start < 9; ++start) {
+        for (size_t size = 0; size + start <= sizeof(data); size += 37) {
+            const uint32_t whole = crc32c(0, data + start, size);
+            ck_assert_uint_eq(crc32c_portable(0, data + start, size), whole);
+            ck_assert_uint_eq(crc32c(crc32c(0, data + start, size / 3), data + start + size / 3, size - size / 3),
+                              whole);
+        }
+    }
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(imgfs_checksum_written)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    char image[72876];
+    struct imgfs_file file;
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    read_file(image, DATA_DIR "/papillon.jpg", sizeof(image));
+
+    // An imgFS written before the checksums were is not verified
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_int_eq(file.header.checksum, 0);
+    ck_assert_int_eq(file.metadata[0].checksum, 0);
+    ck_assert_int_eq(file.nb_quarantined, 0);
+
+    // but the entries and header written since are
+    ck_assert_err_none(do_insert(image, sizeof(image), "pic3", &file));
+    ck_assert_err_none(do_delete("pic2", &file));
+    do_close(&file);
+
+    ck_assert_err_none(do_open(dump, "rb", &file));
+    ck_assert_int_eq(file.nb_quarantined, 0);
+    ck_assert_int_ne(file.header.checksum, 0);
+    ck_assert_int_eq(file.header.checksum, imgfs_header_checksum(&file.header));
+    const size_t index = find_image(&file, "pic3");
+    ck_assert_int_lt(index, file.header.max_files);
+    ck_assert_int_ne(file.metadata[index].checksum, 0);
+    ck_assert_int_eq(file.metadata[index].checksum, imgfs_metadata_checksum(&file.metadata[index]));
+    ck_assert_int_eq(file.metadata[1].is_valid, EMPTY);
+    ck_assert_int_eq(file.metadata[1].checksum, imgfs_metadata_checksum(&file.metadata[1]));
+
+    // The padding after size is not checksummed, the other fields are
+    struct img_metadata metadata = file.metadata[index];
+    memset((char *) &metadata + offsetof(struct img_metadata, size) + sizeof(metadata.size), 0xff,
+           offsetof(struct img_metadata, offset) - offsetof(struct img_metadata, size) - sizeof(metadata.size));
+    ck_assert_int_eq(imgfs_metadata_checksum(&metadata), metadata.checksum);
+    metadata.offset[ORIG_RES] ^= 1;
+    ck_assert_int_ne(imgfs_metadata_checksum(&metadata), metadata.checksum);
+
+    // nor the padding after the name of the header
+    struct imgfs_header header = file.header;
+    memset((char *) &header + sizeof(header.name), 0xff, offsetof(struct imgfs_header, version) - sizeof(header.name));
+    ck_assert_int_eq(imgfs_header_checksum(&header), header.checksum);
+    header.last_extent ^= 1;
+    ck_assert_int_ne(imgfs_header_checksum(&header), header.checksum);
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(imgfs_checksum_quarantine)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    char quarantine[4200];
+    char image[72876];
+    char other[82234];
+    struct imgfs_file file;
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    quarantine_name(quarantine, dump);
+    remove(quarantine); // left by a former run
+    read_file(image, DATA_DIR "/papillon.jpg", sizeof(image));
+    read_file(other, DATA_DIR "/brouillard.jpg", sizeof(other));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_err_none(do_insert(image, sizeof(image), "pic3", &file));
+    ck_assert_err_none(do_insert(other, sizeof(other), "pic4", &file));
+    const size_t index = find_image(&file, "pic3");
+    const long offset = imgfs_metadata_offset(&file, index, NULL);
+    const size_t other_index = find_image(&file, "pic4");
+    const long other_offset = imgfs_metadata_offset(&file, other_index, NULL);
+    do_close(&file);
+    ck_assert_int_lt(index, other_index);
+
+    // The offset of the content torn, and the identifier of the other
+    corrupt(dump, offset + (long) offsetof(struct img_metadata, offset) + 1, 0x42);
+    corrupt(dump, other_offset + (long) offsetof(struct img_metadata, img_id), 'q');
+
+    // Read-only, the entries are only hidden
+    ck_assert_err_none(do_open(dump, "rb", &file));
+    ck_assert_int_eq(file.nb_quarantined, 2);
+    ck_assert_int_eq(file.metadata[index].is_valid, EMPTY);
+    ck_assert_int_eq(find_image(&file, "pic3"), file.header.max_files);
+    ck_assert_int_eq(file.metadata[other_index].is_valid, EMPTY);
+    ck_assert_int_eq(file.header.nb_files, 2);
+    ck_assert_int_lt(find_image(&file, "pic1"), file.header.max_files);
+    do_close(&file);
+    ck_assert_int_eq(size_of(quarantine), -1);
+
+    // Opened for writing, they are moved to the quarantine file
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_int_eq(file.nb_quarantined, 2);
+    ck_assert_int_eq(file.header.nb_files, 2);
+    do_close(&file);
+    ck_assert_int_eq(size_of(quarantine), 2 * (sizeof(uint32_t) + sizeof(struct img_metadata)));
+
+    FILE *kept = fopen(quarantine, "rb");
+    ck_assert_ptr_nonnull(kept);
+    uint32_t kept_index = 0;
+    struct img_metadata kept_metadata;
+    ck_assert_int_eq(fread(&kept_index, sizeof(kept_index), 1, kept), 1);
+    ck_assert_int_eq(fread(&kept_metadata, sizeof(kept_metadata), 1, kept), 1);
+    ck_assert_int_eq(kept_index, index);
+    ck_assert_str_eq(kept_metadata.img_id, "pic3");
+    ck_assert_int_eq(fread(&kept_index, sizeof(kept_index), 1, kept), 1);
+    ck_assert_int_eq(fread(&kept_metadata, sizeof(kept_metadata), 1, kept), 1);
+    fclose(kept);
+    ck_assert_int_eq(kept_index, other_index);
+    ck_assert_str_eq(kept_metadata.img_id, "qic4");
+
+    // and the imgFS is consistent again
+    ck_assert_err_none(do_open(dump, "rb", &file));
+    ck_assert_int_eq(file.nb_quarantined, 0);
+    ck_assert_int_eq(file.header.nb_files, 2);
+    ck_assert_int_eq(file.metadata[index].is_valid, EMPTY);
+    ck_assert_int_eq(file.metadata[other_index].is_valid, EMPTY);
+    do_close(&file);
+    remove(quarantine);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(imgfs_checksum_header)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    struct imgfs_file file;
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_err_none(do_delete("pic1", &file));
+    do_close(&file);
+
+    // max_files torn: the metadata cannot be found
+    corrupt(dump, offsetof(struct imgfs_header, max_files) + 2, 0x01);
+    ck_assert_err(do_open(dump, "rb", &file), ERR_CORRUPTED);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(imgfs_checksum_batch_and_grow)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    char brouillard[82234];
+    char papillon[72876];
+    struct imgfs_file file;
+
+    DUPLICATE_FILE(dump, IMGFS("full"));
+    read_file(brouillard, DATA_DIR "/brouillard.jpg", sizeof(brouillard));
+    read_file(papillon, DATA_DIR "/papillon.jpg", sizeof(papillon));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_err_none(do_grow(&file, 5));
+
+    struct imgfs_insert_request requests[] = {
+        { .img_id = "pic4", .data = brouillard, .size = sizeof(brouillard) },
+        { .img_id = "pic5", .data = papillon, .size = sizeof(papillon) }
+    };
+    ck_assert_err_none(do_insert_batch_prepare(requests, 2));
+    ck_assert_err_none(do_insert_batch(requests, 2, &file));
+    do_close(&file);
+
+    ck_assert_err_none(do_open(dump, "rb", &file));
+    ck_assert_int_eq(file.nb_quarantined, 0);
+    ck_assert_int_eq(file.header.nb_files, 5);
+    ck_assert_int_eq(file.header.checksum, imgfs_header_checksum(&file.header));
+    for (uint32_t i = 3; i < 5; ++i) {
+        ck_assert_int_eq(file.metadata[i].checksum, imgfs_metadata_checksum(&file.metadata[i]));
+    }
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+Suite *imgfs_checksum_test_suite()
+{
+    Suite *s = suite_create("Tests crc32c and the checksums of imgFS");
+
+    Add_Test(s, crc32c_values);
+    Add_Test(s, imgfs_checksum_written);
+    Add_Test(s, imgfs_checksum_quarantine);
+    Add_Test(s, imgfs_checksum_header);
+    Add_Test(s, imgfs_checksum_batch_and_grow);
+
+    return s;
+}
+
+TEST_SUITE_VIPS(imgfs_checksum_test_suite)
@@ -131,6 +131,44 @@ START_TEST(lazily_resize_already_exists)
 }
 END_TEST
 
+// ======================================================================
+START_TEST(lazily_resize_extra_resolution)
+{
+    start_test_print;
+    DECLARE_DUMP;
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    char dump_ext[4096 + sizeof(IMGFS_EXT_SUFFIX)] = {0};
+    strcat(strcat(dump_ext, dump), IMGFS_EXT_SUFFIX);
+    remove(dump_ext); // left by a former run
+
+    struct imgfs_file file;
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_err_none(imgfs_add_resolution(&file, "w96", 96, 96));
+    ck_assert_invalid_arg(lazily_resize(NB_RES + 1, &file, 1));
+
+    // The variant is appended as the others, but kept in the extension file
+    const struct img_metadata metadata = file.metadata[1];
+    ck_assert_err_none(lazily_resize(NB_RES, &file, 1));
+    ck_assert_int_eq(memcmp(&metadata, &file.metadata[1], sizeof(metadata)), 0);
+
+    uint64_t offset = 0;
+    uint32_t size = 0;
+    ck_assert_err_none(imgfs_variant(&file, 1, NB_RES, &offset, &size));
+    ck_assert_uint_eq(offset, 192659);
+    ck_assert_int_ne(size, 0);
+    ck_assert_int_eq(fseek(file.file, 0, SEEK_END), 0);
+    ck_assert_uint_eq(ftell(file.file), 192659 + size);
+
+    // once only
+    ck_assert_err_none(lazily_resize(NB_RES, &file, 1));
+    ck_assert_int_eq(fseek(file.file, 0, SEEK_END), 0);
+    ck_assert_uint_eq(ftell(file.file), 192659 + size);
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
 // ======================================================================
 START_TEST(lazily_resize_valid)
 {
@@ -273,6 +311,7 @@ Suite *imgfs_content_test_suite()
     Add_Test(s, lazily_resize_res_orig);
     Add_Test(s, lazily_resize_invalid_mode);
     Add_Test(s, lazily_resize_already_exists);
+    Add_Test(s, lazily_resize_extra_resolution);
     Add_Test(s, lazily_resize_valid);
     Add_Test(s, lazily_resize_valid_fallible);
 
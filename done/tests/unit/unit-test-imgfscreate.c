@@ -2,6 +2,8 @@
 #include "imgfscmd_functions.h"
 #include "test.h"
 #include <check.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // ======================================================================
 START_TEST(do_create_null_params)
@@ -64,6 +66,48 @@ START_TEST(do_create_correct)
 }
 END_TEST
 
+// ======================================================================
+START_TEST(do_create_sparse)
+{
+    start_test_print;
+    DECLARE_DUMP;
+
+    struct imgfs_file file = { .header.max_files = 100000,
+                               .header.resized_res = { 32, 32, 32, 32 } };
+
+    // The metadata are not written, but the file has their size
+    ck_assert_err_none(do_create(dump, &file));
+    do_close(&file);
+
+    struct stat st;
+    ck_assert_int_eq(stat(dump, &st), 0);
+    ck_assert_int_eq(st.st_size, sizeof(struct imgfs_header) + 100000 * sizeof(struct img_metadata));
+    ck_assert_int_lt(st.st_blocks * 512, st.st_size / 2);
+
+    // An entry written amid the hole is read, the others are empty
+    struct img_metadata metadata = { .img_id = "pic", .is_valid = NON_EMPTY };
+    FILE *const f = fopen(dump, "rb+");
+    ck_assert_ptr_nonnull(f);
+    ck_assert_int_eq(fseek(f, (long) (sizeof(struct imgfs_header) + 70000 * sizeof(struct img_metadata)), SEEK_SET), 0);
+    ck_assert_int_eq(fwrite(&metadata, sizeof(metadata), 1, f), 1);
+    fclose(f);
+
+    ck_assert_err_none(do_open(dump, "rb", &file));
+    ck_assert_mem_eq(&file.metadata[70000], &metadata, sizeof(metadata));
+    struct img_metadata empty_metadata = {0};
+    ck_assert_mem_eq(&file.metadata[69999], &empty_metadata, sizeof(empty_metadata));
+    ck_assert_mem_eq(&file.metadata[70001], &empty_metadata, sizeof(empty_metadata));
+    ck_assert_mem_eq(&file.metadata[99999], &empty_metadata, sizeof(empty_metadata));
+    do_close(&file);
+
+    // A file too short for its metadata cannot be opened
+    ck_assert_int_eq(truncate(dump, st.st_size - 1), 0);
+    ck_assert_err(do_open(dump, "rb", &file), ERR_IO);
+
+    end_test_print;
+}
+END_TEST
+
 // ======================================================================
 START_TEST(do_create_cmd_null_params)
 {
@@ -144,6 +188,32 @@ START_TEST(do_create_cmd_res_too_big)
 }
 END_TEST
 
+// ======================================================================
+START_TEST(do_create_cmd_invalid_res_name)
+{
+    start_test_print;
+    DECLARE_DUMP_PREFIXED(1);
+    DECLARE_DUMP_PREFIXED(2);
+    DECLARE_DUMP_PREFIXED(3);
+
+    char *argv1[] = {dump1, "-res", "a/b", "64", "64"};
+    ck_assert_invalid_arg(do_create_cmd(5, argv1));
+
+    char *argv2[] = {dump2, "-res", "medium", "64", "64", "-res", "small", "32", "32"};
+    ck_assert_invalid_arg(do_create_cmd(9, argv2));
+
+    char *argv3[] = {dump3, "-res", "medium", "64", "64", "-res", "medium", "32", "32"};
+    ck_assert_invalid_arg(do_create_cmd(9, argv3));
+
+    // refused before anything is written
+    ck_assert_int_ne(access(dump1, F_OK), 0);
+    ck_assert_int_ne(access(dump2, F_OK), 0);
+    ck_assert_int_ne(access(dump3, F_OK), 0);
+
+    end_test_print;
+}
+END_TEST
+
 // ======================================================================
 START_TEST(do_create_cmd_no_flags)
 {
@@ -283,12 +353,14 @@ Suite *imgfs_do_create_test_suite()
 
     Add_Test(s, do_create_null_params);
     Add_Test(s, do_create_correct);
+    Add_Test(s, do_create_sparse);
 
     Add_Test(s, do_create_cmd_null_params);
     Add_Test(s, do_create_cmd_invalid_flag);
     Add_Test(s, do_create_cmd_not_enough_flag_params);
     Add_Test(s, do_create_cmd_no_filename);
     Add_Test(s, do_create_cmd_res_too_big);
+    Add_Test(s, do_create_cmd_invalid_res_name);
     Add_Test(s, do_create_cmd_no_flags);
     Add_Test(s, do_create_cmd_all_flags);
     Add_Test(s, do_create_cmd_repeating_flags);
@@ -0,0 +1,250 @@
+#include "imgfs.h"
+#include "imgfs_durability.h"
+#include "imgfs_journal.h"
+#include "test.h"
+#include <check.h>
+#include <string.h>
+#include <unistd.h>
+#include <vips/vips.h>
+
+/**
+ * Whether the flusher of file has synced its changes, within a second.
+ */
+static int flushed(struct imgfs_file *file)
+{
+    for (int i = 0; i < 100; ++i) {
+        pthread_mutex_lock(&file->flusher->mutex);
+        const int dirty = file->flusher->dirty;
+        pthread_mutex_unlock(&file->flusher->mutex);
+        if (!dirty) return 1;
+        usleep(10000);
+    }
+    return 0;
+}
+
+/**
+ * Whether the records of the journal of file are all synced, within a second: the flusher
+ * clears its dirty flag before syncing them.
+ */
+static int journal_synced(struct imgfs_file *file)
+{
+    for (int i = 0; i < 100; ++i) {
+        pthread_mutex_lock(&file->journal->mutex);
+        const int synced = file->journal->synced == file->journal->appended;
+        pthread_mutex_unlock(&file->journal->mutex);
+        if (synced) return 1;
+        usleep(10000);
+    }
+    return 0;
+}
+
+// ======================================================================
+START_TEST(imgfs_durability_null_params)
+{
+    start_test_print;
+
+    enum imgfs_durability durability;
+    uint32_t sync_interval;
+    ck_assert_invalid_arg(imgfs_durability_parse(NULL, &durability, &sync_interval));
+    ck_assert_invalid_arg(imgfs_durability_parse("strict", NULL, &sync_interval));
+    ck_assert_invalid_arg(imgfs_durability_parse("strict", &durability, NULL));
+    ck_assert_invalid_arg(imgfs_set_durability(NULL, DURABILITY_NONE, 0));
+    ck_assert_invalid_arg(imgfs_sync_contents(NULL));
+    ck_assert_invalid_arg(imgfs_sync(NULL));
+    ck_assert_invalid_arg(imgfs_wait_durable(NULL, 0));
+    imgfs_durability_stop(NULL);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(imgfs_durability_parse_modes)
+{
+    start_test_print;
+
+    enum imgfs_durability durability;
+    uint32_t sync_interval = 42;
+    ck_assert_err_none(imgfs_durability_parse("strict", &durability, &sync_interval));
+    ck_assert_int_eq(durability, DURABILITY_STRICT);
+    ck_assert_int_eq(sync_interval, 0);
+    ck_assert_err_none(imgfs_durability_parse("none", &durability, &sync_interval));
+    ck_assert_int_eq(durability, DURABILITY_NONE);
+    ck_assert_err_none(imgfs_durability_parse("interval:250", &durability, &sync_interval));
+    ck_assert_int_eq(durability, DURABILITY_INTERVAL);
+    ck_assert_int_eq(sync_interval, 250);
+
+    ck_assert_invalid_arg(imgfs_durability_parse("interval:0", &durability, &sync_interval));
+    ck_assert_invalid_arg(imgfs_durability_parse("interval:", &durability, &sync_interval));
+    ck_assert_invalid_arg(imgfs_durability_parse("interval:-5", &durability, &sync_interval));
+    ck_assert_invalid_arg(imgfs_durability_parse("interval:10ms", &durability, &sync_interval));
+    ck_assert_invalid_arg(imgfs_durability_parse("interval:4294967296", &durability, &sync_interval));
+    ck_assert_invalid_arg(imgfs_durability_parse("batched", &durability, &sync_interval));
+    ck_assert_invalid_arg(imgfs_durability_parse("", &durability, &sync_interval));
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(imgfs_durability_flusher)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    struct imgfs_file file;
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_int_eq(file.durability, DURABILITY_STRICT);
+    ck_assert_ptr_null(file.flusher);
+
+    ck_assert_invalid_arg(imgfs_set_durability(&file, DURABILITY_INTERVAL, 0));
+    ck_assert_err_none(imgfs_set_durability(&file, DURABILITY_INTERVAL, 20));
+    ck_assert_int_eq(file.sync_interval, 20);
+    ck_assert_ptr_nonnull(file.flusher);
+
+    // The deletion is left to the flusher
+    ck_assert_err_none(do_delete("pic1", &file));
+    ck_assert_int_eq(file.flusher->dirty, 1);
+    ck_assert(flushed(&file));
+    ck_assert_int_eq(file.flusher->error, 0);
+
+    ck_assert_err_none(imgfs_set_durability(&file, DURABILITY_NONE, 0));
+    ck_assert_ptr_null(file.flusher);
+    ck_assert_int_eq(file.sync_interval, 0);
+    ck_assert_err_none(do_delete("pic2", &file));
+
+    do_close(&file);
+    ck_assert_ptr_null(file.flusher);
+    ck_assert_err_none(do_open(dump, "rb", &file));
+    ck_assert_int_eq(file.header.nb_files, 0);
+    ck_assert_int_eq(file.header.version, 4);
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(imgfs_durability_journaled)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    char image[72876];
+    struct imgfs_file file;
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    read_file(image, DATA_DIR "/papillon.jpg", sizeof(image));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_err_none(imgfs_journal_start(dump, &file));
+
+    // Strict: the change is synced with the journal, once waited for
+    ck_assert_err_none(do_delete("pic2", &file));
+    ck_assert_err_none(imgfs_wait_durable(&file, imgfs_journal_sequence(file.journal)));
+    ck_assert_int_eq(file.journal->synced, 1);
+
+    // Interval: by the flusher, nobody waiting
+    ck_assert_err_none(imgfs_set_durability(&file, DURABILITY_INTERVAL, 20));
+    ck_assert_err_none(do_insert(image, sizeof(image), "pic3", &file));
+    ck_assert_err_none(imgfs_wait_durable(&file, imgfs_journal_sequence(file.journal)));
+    ck_assert(flushed(&file));
+    ck_assert(journal_synced(&file));
+
+    do_close(&file);
+    ck_assert_err_none(do_open(dump, "rb", &file));
+    ck_assert_int_eq(file.header.nb_files, 2);
+    ck_assert_int_eq(file.header.version, 4);
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(imgfs_durability_none_persists_on_close)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    char brouillard[82234];
+    char papillon[72876];
+    struct imgfs_file file;
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    read_file(brouillard, DATA_DIR "/brouillard.jpg", sizeof(brouillard));
+    read_file(papillon, DATA_DIR "/papillon.jpg", sizeof(papillon));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_err_none(imgfs_set_durability(&file, DURABILITY_NONE, 0));
+    ck_assert_ptr_null(file.flusher);
+
+    struct imgfs_insert_request requests[] = {
+        { .img_id = "pic3", .data = brouillard, .size = sizeof(brouillard) },
+        { .img_id = "pic4", .data = papillon, .size = sizeof(papillon) }
+    };
+    ck_assert_err_none(do_insert_batch_prepare(requests, 2));
+    ck_assert_err_none(do_insert_batch(requests, 2, &file));
+    ck_assert_err_none(requests[0].status);
+    ck_assert_err_none(requests[1].status);
+    ck_assert_err_none(do_delete("pic1", &file));
+
+    do_close(&file);
+    ck_assert_err_none(do_open(dump, "rb", &file));
+    ck_assert_int_eq(file.header.nb_files, 3);
+    ck_assert_int_eq(file.header.version, 5);
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(imgfs_durability_grow)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    struct imgfs_file file;
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    const uint32_t max_files = file.header.max_files;
+    ck_assert_err_none(imgfs_journal_start(dump, &file));
+
+    // Left to the flusher too, the header written in place included
+    ck_assert_err_none(imgfs_set_durability(&file, DURABILITY_INTERVAL, 20));
+    ck_assert_err_none(do_grow(&file, max_files + 5));
+    ck_assert_int_eq(file.flusher->dirty, 1);
+    ck_assert(flushed(&file));
+    ck_assert_int_eq(file.flusher->error, 0);
+
+    ck_assert_err_none(imgfs_set_durability(&file, DURABILITY_NONE, 0));
+    ck_assert_err_none(do_grow(&file, max_files + 10));
+
+    do_close(&file);
+    ck_assert_err_none(do_open(dump, "rb", &file));
+    ck_assert_int_eq(file.header.max_files, max_files + 10);
+    ck_assert_int_eq(file.header.nb_files, 2);
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+Suite *imgfs_durability_test_suite()
+{
+    Suite *s = suite_create("Tests imgfs_durability implementation");
+
+    Add_Test(s, imgfs_durability_null_params);
+    Add_Test(s, imgfs_durability_parse_modes);
+    Add_Test(s, imgfs_durability_flusher);
+    Add_Test(s, imgfs_durability_journaled);
+    Add_Test(s, imgfs_durability_none_persists_on_close);
+    Add_Test(s, imgfs_durability_grow);
+
+    return s;
+}
+
+TEST_SUITE_VIPS(imgfs_durability_test_suite)
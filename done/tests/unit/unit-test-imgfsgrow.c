@@ -0,0 +1,205 @@
+#include "imgfs.h"
+#include "test.h"
+#include <check.h>
+#include <string.h>
+#include <vips/vips.h>
+
+// ======================================================================
+static long file_size(FILE *file)
+{
+    fflush(file);
+    fseek(file, 0, SEEK_END);
+    return ftell(file);
+}
+
+// ======================================================================
+static size_t find_image(const struct imgfs_file *file, const char *img_id)
+{
+    for (size_t i = 0; i < file->header.max_files; ++i) {
+        if (file->metadata[i].is_valid && strcmp(file->metadata[i].img_id, img_id) == 0) {
+            return i;
+        }
+    }
+    return file->header.max_files;
+}
+
+// ======================================================================
+START_TEST(do_grow_null_params)
+{
+    start_test_print;
+
+    ck_assert_invalid_arg(do_grow(NULL, 10));
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(do_grow_not_larger)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    struct imgfs_file file;
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+
+    ck_assert_err(do_grow(&file, 100), ERR_MAX_FILES);
+    ck_assert_err(do_grow(&file, 42), ERR_MAX_FILES);
+    ck_assert_int_eq(file_size(file.file), 192659);
+
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(do_grow_valid)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    struct imgfs_file file;
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_ptr_null(file.segments);
+
+    ck_assert_err_none(do_grow(&file, 150));
+    ck_assert_int_eq(file.header.max_files, 150);
+    ck_assert_int_eq(file.header.last_extent, 192659);
+    // the extent and its (empty) entries are appended, nothing else moves
+    ck_assert_int_eq(file_size(file.file), 192659 + sizeof(struct imgfs_extent) + 50 * sizeof(struct img_metadata));
+
+    do_close(&file);
+    ck_assert_err_none(do_open(dump, "rb", &file));
+    ck_assert_int_eq(file.header.max_files, 150);
+    ck_assert_int_eq(file.header.nb_files, 2);
+    ck_assert_int_eq(file.nb_segments, 2);
+    ck_assert_int_eq(file.segments[1].first, 100);
+    ck_assert_int_eq(file.segments[1].nb_entries, 50);
+
+    size_t nb_contiguous = 0;
+    ck_assert_int_eq(imgfs_metadata_offset(&file, 99, &nb_contiguous),
+                     sizeof(struct imgfs_header) + 99 * sizeof(struct img_metadata));
+    ck_assert_int_eq(nb_contiguous, 1);
+    ck_assert_int_eq(imgfs_metadata_offset(&file, 100, &nb_contiguous), 192659 + sizeof(struct imgfs_extent));
+    ck_assert_int_eq(nb_contiguous, 50);
+
+    ck_assert_int_lt(find_image(&file, "pic1"), 100);
+    ck_assert_int_lt(find_image(&file, "pic2"), 100);
+    for (size_t i = 100; i < 150; ++i) {
+        ck_assert_int_eq(file.metadata[i].is_valid, EMPTY);
+    }
+
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(do_grow_full)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    char image[72876];
+    struct imgfs_file file;
+
+    DUPLICATE_FILE(dump, IMGFS("full"));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    read_file(image, DATA_DIR "/papillon.jpg", 72876);
+
+    ck_assert_err(do_insert(image, 72876, "pic4", &file), ERR_IMGFS_FULL);
+    ck_assert_err_none(do_grow(&file, 4));
+    ck_assert_err_none(do_insert(image, 72876, "pic4", &file));
+    ck_assert_err(do_insert(image, 72876, "pic5", &file), ERR_IMGFS_FULL);
+    ck_assert_err_none(do_grow(&file, 6));
+    ck_assert_err_none(do_insert(image, 72876, "pic5", &file));
+    ck_assert_err_none(do_insert(image, 72876, "pic6", &file));
+
+    do_close(&file);
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_int_eq(file.header.max_files, 6);
+    ck_assert_int_eq(file.header.nb_files, 6);
+    ck_assert_int_eq(file.nb_segments, 3);
+    ck_assert_int_eq(find_image(&file, "pic4"), 3);
+    ck_assert_int_ge(find_image(&file, "pic5"), 4);
+    ck_assert_int_ge(find_image(&file, "pic6"), 4);
+
+    // the entries of the extents are written in place
+    ck_assert_err_none(do_delete("pic5", &file));
+    do_close(&file);
+    ck_assert_err_none(do_open(dump, "rb", &file));
+    ck_assert_int_eq(file.header.nb_files, 5);
+    ck_assert_int_eq(find_image(&file, "pic5"), file.header.max_files);
+    ck_assert_int_ge(find_image(&file, "pic6"), 4);
+
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(do_grow_batch_across_extents)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    char brouillard[82234];
+    char papillon[72876];
+    struct imgfs_file file;
+
+    DUPLICATE_FILE(dump, IMGFS("full"));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    read_file(brouillard, DATA_DIR "/brouillard.jpg", sizeof(brouillard));
+    read_file(papillon, DATA_DIR "/papillon.jpg", sizeof(papillon));
+
+    ck_assert_err_none(do_grow(&file, 4));
+    ck_assert_err_none(do_grow(&file, 6));
+
+    struct imgfs_insert_request requests[] = {
+        { .img_id = "pic4", .data = brouillard, .size = sizeof(brouillard) },
+        { .img_id = "pic5", .data = papillon, .size = sizeof(papillon) },
+        { .img_id = "pic6", .data = papillon, .size = sizeof(papillon) }
+    };
+    const size_t nb = sizeof(requests) / sizeof(requests[0]);
+
+    ck_assert_err_none(do_insert_batch_prepare(requests, nb));
+    ck_assert_err_none(do_insert_batch(requests, nb, &file));
+    for (size_t i = 0; i < nb; ++i) {
+        ck_assert_err_none(requests[i].status);
+    }
+
+    do_close(&file);
+    ck_assert_err_none(do_open(dump, "rb", &file));
+    ck_assert_int_eq(file.header.nb_files, 6);
+    for (size_t i = 0; i < nb; ++i) {
+        ck_assert_int_lt(find_image(&file, requests[i].img_id), 6);
+    }
+
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+Suite *imgfs_grow_test_suite()
+{
+    Suite *s = suite_create("Tests do_grow implementation");
+
+    Add_Test(s, do_grow_null_params);
+    Add_Test(s, do_grow_not_larger);
+    Add_Test(s, do_grow_valid);
+    Add_Test(s, do_grow_full);
+    Add_Test(s, do_grow_batch_across_extents);
+
+    return s;
+}
+
+TEST_SUITE_VIPS(imgfs_grow_test_suite)
@@ -338,6 +338,295 @@ START_TEST(do_insert_write_initializes_metadata)
 }
 END_TEST
 
+// ======================================================================
+static long file_size(FILE *file)
+{
+    fflush(file);
+    fseek(file, 0, SEEK_END);
+    return ftell(file);
+}
+
+// ======================================================================
+START_TEST(do_insert_stream_null_params)
+{
+    start_test_print;
+
+    char chunk;
+    struct imgfs_insert insert;
+    struct imgfs_file file;
+
+    ck_assert_invalid_arg(do_insert_begin(NULL, "pic", 1, &file));
+    ck_assert_invalid_arg(do_insert_begin(&insert, NULL, 1, &file));
+    ck_assert_invalid_arg(do_insert_begin(&insert, "pic", 1, NULL));
+    ck_assert_invalid_arg(do_insert_write(NULL, &chunk, 1));
+    ck_assert_invalid_arg(do_insert_commit(NULL));
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(do_insert_stream_valid)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    char image[82234];
+    struct imgfs_file file;
+    struct imgfs_insert insert;
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    read_file(image, DATA_DIR "/brouillard.jpg", 82234);
+
+    ck_assert_err_none(do_insert_begin(&insert, "pic3", 82234, &file));
+    ck_assert_int_eq(file_size(file.file), 192659 + 82234);
+
+    // content received in uneven chunks
+    for (size_t done = 0; done < 82234; done += 1000) {
+        ck_assert_err_none(do_insert_write(&insert, image + done, 82234 - done < 1000 ? 82234 - done : 1000));
+    }
+    ck_assert_invalid_arg(do_insert_write(&insert, image, 1));
+    ck_assert_err_none(do_insert_commit(&insert));
+
+    do_close(&file);
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+
+    const struct img_metadata *md = NULL;
+    for (uint32_t i = 0; i < file.header.max_files; ++i) {
+        if (strcmp(file.metadata[i].img_id, "pic3") == 0) {
+            md = &file.metadata[i];
+            break;
+        }
+    }
+    ck_assert_msg(md != NULL, "the inserted metadata could not be found by image id");
+
+    unsigned char pic_sha[SHA256_DIGEST_LENGTH] = {0xf8, 0x88, 0xf0, 0xdd, 0xd4, 0xf8, 0x24, 0x75, 0x99, 0xf6, 0xde,
+                                                   0x79, 0x7e, 0x0a, 0x6f, 0x55, 0x76, 0xd3, 0xd1, 0xe7, 0x41, 0x97,
+                                                   0xd3, 0x3d, 0xac, 0x09, 0x08, 0x94, 0xdb, 0x07, 0xbf, 0x1e
+                                                  };
+    ck_assert_mem_eq(md->SHA, pic_sha, SHA256_DIGEST_LENGTH);
+    ck_assert_int_eq(md->orig_res[0], 600);
+    ck_assert_int_eq(md->orig_res[1], 400);
+    ck_assert_int_eq(md->size[ORIG_RES], 82234);
+    ck_assert_int_eq(md->offset[ORIG_RES], 192659);
+    ck_assert_int_eq(md->offset[THUMB_RES], 0);
+    ck_assert_int_eq(md->is_valid, NON_EMPTY);
+
+    ck_assert_int_eq(file.header.version, 3);
+    ck_assert_int_eq(file.header.nb_files, 3);
+
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(do_insert_stream_duplicate_rolls_back)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    char image[72876];
+    struct imgfs_file file;
+    struct imgfs_insert insert;
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    read_file(image, DATA_DIR "/papillon.jpg", 72876);
+    const long size = file_size(file.file);
+
+    // same content as pic1: the image refers to it, nothing is left at the end of the file
+    ck_assert_err_none(do_insert_begin(&insert, "pic3", 72876, &file));
+    ck_assert_err_none(do_insert_write(&insert, image, 72876));
+    ck_assert_err_none(do_insert_commit(&insert));
+    ck_assert_int_eq(file_size(file.file), size);
+    ck_assert_int_eq(file.header.nb_files, 3);
+
+    // duplicate name
+    ck_assert_err_none(do_insert_begin(&insert, "pic1", 72876, &file));
+    ck_assert_err_none(do_insert_write(&insert, image, 72876));
+    ck_assert_err(do_insert_commit(&insert), ERR_DUPLICATE_ID);
+    ck_assert_int_eq(file_size(file.file), size);
+
+    // incomplete content
+    ck_assert_err_none(do_insert_begin(&insert, "pic4", 72876, &file));
+    ck_assert_err_none(do_insert_write(&insert, image, 1000));
+    ck_assert_invalid_arg(do_insert_commit(&insert));
+    ck_assert_int_eq(file_size(file.file), size);
+    ck_assert_int_eq(file.header.nb_files, 3);
+
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(do_insert_stream_invalid_image)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    char image[72876] = {0};
+    struct imgfs_file file;
+    struct imgfs_insert insert;
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    const long size = file_size(file.file);
+
+    ck_assert_err_none(do_insert_begin(&insert, "pic42", 72876, &file));
+    ck_assert_err_none(do_insert_write(&insert, image, 72876));
+    ck_assert_err(do_insert_commit(&insert), ERR_IMGLIB);
+    ck_assert_int_eq(file_size(file.file), size);
+
+    do_close(&file);
+
+    DUPLICATE_FILE(dump, IMGFS("full"));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_err(do_insert_begin(&insert, "pic", 72876, &file), ERR_IMGFS_FULL);
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(do_insert_preflight_valid)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    struct imgfs_file file;
+    unsigned char sha[SHA256_DIGEST_LENGTH];
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    const long size = file_size(file.file);
+
+    // SHA of papillon.jpg (pic1)
+    ck_assert_err_none(sha_from_string("66ac648b32a8268ed0b350b184cfa04c00c6236af3a2aa4411c01518f6061af8", 64, sha));
+    ck_assert_invalid_arg(sha_from_string("66ac648b32a8268ed0b350b184cfa04c00c6236af3a2aa4411c01518f6061af", 63, sha));
+
+    ck_assert_err(do_insert_preflight("pic1", NULL, &file), ERR_DUPLICATE_ID);
+    ck_assert_int_eq(do_insert_preflight("pic3", NULL, &file), 0);
+    ck_assert_int_eq(file.header.nb_files, 2);
+
+    // known content: inserted without it
+    ck_assert_int_eq(do_insert_preflight("pic3", sha, &file), 1);
+    ck_assert_int_eq(file_size(file.file), size);
+
+    do_close(&file);
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_int_eq(file.header.nb_files, 3);
+    ck_assert_int_eq(file.header.version, 3);
+    const struct img_metadata *md = NULL;
+    for (uint32_t i = 0; i < file.header.max_files; ++i) {
+        if (strcmp(file.metadata[i].img_id, "pic3") == 0) {
+            md = &file.metadata[i];
+            break;
+        }
+    }
+    ck_assert_msg(md != NULL, "the inserted metadata could not be found by image id");
+    ck_assert_mem_eq(md->SHA, sha, SHA256_DIGEST_LENGTH);
+    ck_assert_int_eq(md->offset[ORIG_RES], 21664);
+    ck_assert_int_eq(md->size[ORIG_RES], 72876);
+    ck_assert_int_eq(md->orig_res[0], 1200);
+    do_close(&file);
+
+    DUPLICATE_FILE(dump, IMGFS("full"));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_err(do_insert_preflight("pic", sha, &file), ERR_IMGFS_FULL);
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(do_insert_batch_valid)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    char brouillard[82234];
+    char papillon[72876];
+    struct imgfs_file file;
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    read_file(brouillard, DATA_DIR "/brouillard.jpg", sizeof(brouillard));
+    read_file(papillon, DATA_DIR "/papillon.jpg", sizeof(papillon));
+
+    struct imgfs_insert_request requests[] = {
+        { .img_id = "pic3", .data = brouillard, .size = sizeof(brouillard) },
+        { .img_id = "pic4", .data = brouillard, .size = sizeof(brouillard) }, // same content as pic3
+        { .img_id = "pic1", .data = brouillard, .size = sizeof(brouillard) }, // ID taken
+        { .img_id = "pic5", .data = papillon, .size = sizeof(papillon) },     // same content as pic1
+        { .img_id = "pic6", .data = "not an image", .size = 12 },
+        { .img_id = "pic3", .data = papillon, .size = sizeof(papillon) }      // ID taken in the batch
+    };
+    const size_t nb = sizeof(requests) / sizeof(requests[0]);
+
+    ck_assert_err_none(do_insert_batch_prepare(requests, nb));
+    ck_assert_int_eq(requests[0].orig_res[0], 600);
+    ck_assert_int_eq(requests[0].orig_res[1], 400);
+    ck_assert_mem_eq(requests[0].SHA, requests[1].SHA, SHA256_DIGEST_LENGTH);
+    ck_assert_int_ne(requests[4].status, ERR_NONE);
+
+    ck_assert_err_none(do_insert_batch(requests, nb, &file));
+    ck_assert_err_none(requests[0].status);
+    ck_assert_err_none(requests[1].status);
+    ck_assert_err(requests[2].status, ERR_DUPLICATE_ID);
+    ck_assert_err_none(requests[3].status);
+    ck_assert_err(requests[5].status, ERR_DUPLICATE_ID);
+
+    // the content of pic3 only is appended
+    ck_assert_int_eq(file_size(file.file), 192659 + 82234);
+
+    do_close(&file);
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_int_eq(file.header.nb_files, 5);
+    ck_assert_int_eq(file.header.version, 5);
+
+    const struct img_metadata *md[3] = { NULL, NULL, NULL };
+    const char *const ids[3] = { "pic3", "pic4", "pic5" };
+    for (uint32_t i = 0; i < file.header.max_files; ++i) {
+        for (size_t j = 0; j < 3; ++j) {
+            if (file.metadata[i].is_valid && strcmp(file.metadata[i].img_id, ids[j]) == 0) md[j] = &file.metadata[i];
+        }
+    }
+    ck_assert_ptr_nonnull(md[0]);
+    ck_assert_ptr_nonnull(md[1]);
+    ck_assert_ptr_nonnull(md[2]);
+    ck_assert_int_eq(md[0]->offset[ORIG_RES], 192659);
+    ck_assert_int_eq(md[0]->size[ORIG_RES], 82234);
+    ck_assert_int_eq(md[0]->orig_res[0], 600);
+    ck_assert_int_eq(md[1]->offset[ORIG_RES], 192659);
+    ck_assert_int_eq(md[2]->offset[ORIG_RES], 21664);
+    ck_assert_int_eq(md[2]->size[ORIG_RES], 72876);
+    if (file.ext->entries != NULL) {
+        // the same content has the same placeholder (if it could be computed)
+        const char *const placeholder = imgfs_placeholder(&file, (size_t) (md[0] - file.metadata));
+        ck_assert_ptr_nonnull(placeholder);
+        ck_assert_str_eq(imgfs_placeholder(&file, (size_t) (md[1] - file.metadata)), placeholder);
+    }
+
+    char *buffer = NULL;
+    uint32_t size = 0;
+    ck_assert_err_none(do_read("pic4", ORIG_RES, &buffer, &size, &file));
+    ck_assert_int_eq(size, 82234);
+    ck_assert_mem_eq(buffer, brouillard, 64);
+    free(buffer);
+
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
 // ======================================================================
 Suite *imgfs_content_test_suite()
 {
@@ -352,6 +641,12 @@ Suite *imgfs_content_test_suite()
     Add_Test(s, do_insert_valid);
     Add_Test(s, do_insert_write_correct_metadata);
     Add_Test(s, do_insert_write_initializes_metadata);
+    Add_Test(s, do_insert_stream_null_params);
+    Add_Test(s, do_insert_stream_valid);
+    Add_Test(s, do_insert_stream_duplicate_rolls_back);
+    Add_Test(s, do_insert_stream_invalid_image);
+    Add_Test(s, do_insert_preflight_valid);
+    Add_Test(s, do_insert_batch_valid);
 
     return s;
 }
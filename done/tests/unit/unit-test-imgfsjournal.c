@@ -0,0 +1,259 @@
+#include "imgfs.h"
+#include "imgfs_journal.h"
+#include "test.h"
+#include <check.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vips/vips.h>
+
+#define RECORD_SIZE sizeof(struct imgfs_journal_record)
+
+// ======================================================================
+static long size_of(const char *filename)
+{
+    struct stat st;
+    return stat(filename, &st) == 0 ? (long) st.st_size : -1;
+}
+
+static void journal_name(char *journal, const char *imgfs_filename)
+{
+    strcpy(journal, imgfs_filename);
+    strcat(journal, IMGFS_JOURNAL_SUFFIX);
+}
+
+/**
+ * The header of the imgFS file as it is on disk.
+ */
+static struct imgfs_header header_on_disk(const char *imgfs_filename)
+{
+    struct imgfs_header header;
+    memset(&header, 0, sizeof(header));
+    FILE *file = fopen(imgfs_filename, "rb");
+    ck_assert_ptr_nonnull(file);
+    ck_assert_int_eq(fread(&header, sizeof(header), 1, file), 1);
+    fclose(file);
+    return header;
+}
+
+// ======================================================================
+START_TEST(imgfs_journal_null_params)
+{
+    start_test_print;
+
+    struct imgfs_file file;
+    const uint32_t index = 0;
+    ck_assert_invalid_arg(imgfs_journal_recover(NULL, "rb", &file));
+    ck_assert_invalid_arg(imgfs_journal_recover("imgfs", NULL, &file));
+    ck_assert_invalid_arg(imgfs_journal_recover("imgfs", "rb", NULL));
+    ck_assert_invalid_arg(imgfs_journal_start(NULL, &file));
+    ck_assert_invalid_arg(imgfs_journal_start("imgfs", NULL));
+    ck_assert_invalid_arg(imgfs_journal_append(NULL, &index, 1));
+    ck_assert_invalid_arg(imgfs_journal_checkpoint(NULL));
+    ck_assert_err_none(imgfs_journal_sync(NULL, 1));
+    ck_assert_int_eq(imgfs_journal_sequence(NULL), 0);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(imgfs_journal_checkpoint_valid)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    char journal[4200];
+    struct imgfs_file file;
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    journal_name(journal, dump);
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_err_none(imgfs_journal_start(dump, &file));
+
+    // The deletion goes to the journal only
+    ck_assert_err_none(do_delete("pic1", &file));
+    ck_assert_int_eq(imgfs_journal_sequence(file.journal), 1);
+    ck_assert_err_none(imgfs_journal_sync(file.journal, 1));
+    ck_assert_int_eq(size_of(journal), RECORD_SIZE);
+    ck_assert_int_eq(header_on_disk(dump).nb_files, 2);
+
+    // but is seen by whoever opens the imgFS
+    struct imgfs_file reader;
+    ck_assert_err_none(do_open(dump, "rb", &reader));
+    ck_assert_int_eq(reader.header.nb_files, 1);
+    ck_assert_int_eq(reader.header.version, 3);
+    ck_assert_int_eq(reader.metadata[0].is_valid, EMPTY);
+    do_close(&reader);
+    ck_assert_int_eq(size_of(journal), RECORD_SIZE);
+
+    // until it is written in place
+    ck_assert_err_none(imgfs_journal_checkpoint(&file));
+    ck_assert_int_eq(size_of(journal), 0);
+    ck_assert_int_eq(header_on_disk(dump).nb_files, 1);
+
+    do_close(&file);
+    ck_assert_int_eq(size_of(journal), -1);
+    ck_assert_err_none(do_open(dump, "rb", &file));
+    ck_assert_int_eq(file.header.nb_files, 1);
+    ck_assert_int_eq(file.metadata[0].is_valid, EMPTY);
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(imgfs_journal_recover_valid)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    DECLARE_DUMP_PREFIXED(_crash);
+    char journal[4200], journal_crash[4200];
+    char image[72876];
+    struct imgfs_file file;
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    journal_name(journal, dump);
+    journal_name(journal_crash, dump_crash);
+    read_file(image, DATA_DIR "/papillon.jpg", sizeof(image));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_err_none(imgfs_journal_start(dump, &file));
+
+    ck_assert_err_none(do_delete("pic2", &file));
+    ck_assert_err_none(do_insert(image, sizeof(image), "pic3", &file));
+    ck_assert_err_none(imgfs_journal_sync(file.journal, imgfs_journal_sequence(file.journal)));
+
+    // The imgFS as a crash would leave it: its changes in the journal only
+    DUPLICATE_FILE(dump_crash, dump);
+    DUPLICATE_FILE(journal_crash, journal);
+    do_close(&file);
+
+    struct imgfs_file recovered;
+    ck_assert_err_none(do_open(dump_crash, "rb+", &recovered));
+    ck_assert_int_eq(size_of(journal_crash), -1);
+    ck_assert_int_eq(recovered.header.nb_files, 2);
+    ck_assert_int_eq(recovered.header.version, 4);
+    ck_assert_err_none(do_open(dump, "rb", &file));
+    ck_assert_mem_eq(recovered.metadata, file.metadata, file.header.max_files * sizeof(struct img_metadata));
+    do_close(&file);
+    do_close(&recovered);
+
+    // written in place
+    ck_assert_int_eq(header_on_disk(dump_crash).nb_files, 2);
+    ck_assert_int_eq(header_on_disk(dump_crash).version, 4);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(imgfs_journal_recover_torn)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    DECLARE_DUMP_PREFIXED(_crash);
+    char journal[4200], journal_crash[4200];
+    char brouillard[82234];
+    char papillon[72876];
+    struct imgfs_file file;
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    journal_name(journal, dump);
+    journal_name(journal_crash, dump_crash);
+    read_file(brouillard, DATA_DIR "/brouillard.jpg", sizeof(brouillard));
+    read_file(papillon, DATA_DIR "/papillon.jpg", sizeof(papillon));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_err_none(imgfs_journal_start(dump, &file));
+
+    // One change, then another of three entries
+    ck_assert_err_none(do_delete("pic1", &file));
+    struct imgfs_insert_request requests[] = {
+        { .img_id = "pic3", .data = brouillard, .size = sizeof(brouillard) },
+        { .img_id = "pic4", .data = papillon, .size = sizeof(papillon) },
+        { .img_id = "pic5", .data = brouillard, .size = sizeof(brouillard) }
+    };
+    ck_assert_err_none(do_insert_batch_prepare(requests, 3));
+    ck_assert_err_none(do_insert_batch(requests, 3, &file));
+    ck_assert_int_eq(imgfs_journal_sequence(file.journal), 4);
+    ck_assert_err_none(imgfs_journal_sync(file.journal, 4));
+
+    // A crash while its last record was written: the second change is not made
+    DUPLICATE_FILE(dump_crash, dump);
+    DUPLICATE_FILE(journal_crash, journal);
+    ck_assert_int_eq(truncate(journal_crash, 3 * RECORD_SIZE + RECORD_SIZE / 2), 0);
+    do_close(&file);
+
+    ck_assert_err_none(do_open(dump_crash, "rb", &file));
+    ck_assert_int_eq(file.header.nb_files, 1);
+    ck_assert_int_eq(file.header.version, 3);
+    for (uint32_t i = 0; i < file.header.max_files; ++i) {
+        ck_assert_int_eq(file.metadata[i].is_valid == NON_EMPTY, strcmp(file.metadata[i].img_id, "pic2") == 0);
+    }
+    do_close(&file);
+
+    // nor is it with a record corrupted
+    DUPLICATE_FILE(journal_crash, journal);
+    FILE *wal = fopen(journal_crash, "rb+");
+    ck_assert_ptr_nonnull(wal);
+    ck_assert_int_eq(fseek(wal, 2 * RECORD_SIZE + 200, SEEK_SET), 0);
+    ck_assert_int_eq(fputc('X', wal), 'X');
+    fclose(wal);
+
+    ck_assert_err_none(do_open(dump_crash, "rb+", &file));
+    ck_assert_int_eq(file.header.nb_files, 1);
+    ck_assert_int_eq(size_of(journal_crash), -1);
+    do_close(&file);
+    ck_assert_int_eq(header_on_disk(dump_crash).nb_files, 1);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(imgfs_journal_created_anew)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    char journal[4200];
+    struct imgfs_file file;
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    journal_name(journal, dump);
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_err_none(imgfs_journal_start(dump, &file));
+    ck_assert_err_none(do_delete("pic1", &file));
+    DUPLICATE_FILE(DATA_DIR "journal.tmp", journal);
+    do_close(&file);
+    DUPLICATE_FILE(journal, DATA_DIR "journal.tmp");
+    remove(DATA_DIR "journal.tmp");
+
+    // The journal of a former imgFS of the same name does not apply
+    memset(&file, 0, sizeof(file));
+    file.header.max_files = 100;
+    ck_assert_err_none(do_create(dump, &file));
+    ck_assert_int_eq(size_of(journal), -1);
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+Suite *imgfs_journal_test_suite()
+{
+    Suite *s = suite_create("Tests imgfs_journal implementation");
+
+    Add_Test(s, imgfs_journal_null_params);
+    Add_Test(s, imgfs_journal_checkpoint_valid);
+    Add_Test(s, imgfs_journal_recover_valid);
+    Add_Test(s, imgfs_journal_recover_torn);
+    Add_Test(s, imgfs_journal_created_anew);
+
+    return s;
+}
+
+TEST_SUITE_VIPS(imgfs_journal_test_suite)
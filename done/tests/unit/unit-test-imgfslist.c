@@ -3,6 +3,8 @@
 #include "test.h"
 #include "util.h"
 #include <check.h>
+#include <stdlib.h>
+#include <string.h>
 
 // ======================================================================
 START_TEST(do_list_null_params)
@@ -92,6 +94,244 @@ START_TEST(do_list_json_non_emtpy)
 }
 END_TEST
 
+// ======================================================================
+START_TEST(do_list_json_blobs)
+{
+    start_test_print;
+
+    char *out = NULL;
+    struct imgfs_file file;
+
+    ck_assert_err_none(do_open(IMGFS("test02"), "rb", &file));
+    ck_assert_err_none(do_list(&file, JSON_BLOBS, &out));
+
+    ck_assert_str_eq(out, "{ \"Images\": [ "
+                     "{ \"img_id\": \"pic1\", \"url\": "
+                     "\"\\/imgfs\\/blob\\/66ac648b32a8268ed0b350b184cfa04c00c6236af3a2aa4411c01518f6061af8\" }, "
+                     "{ \"img_id\": \"pic2\", \"url\": "
+                     "\"\\/imgfs\\/blob\\/95962b09e0fc9716ee4c2a1cf173f9147758235360d7ac0a73dfa378858b8a10\" } ] }");
+
+    free(out);
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(do_list_json_fields)
+{
+    start_test_print;
+
+    char *out = NULL;
+    struct imgfs_file file;
+    unsigned int fields = 0;
+
+    ck_assert_invalid_arg(list_fields_parse(NULL, &fields));
+    ck_assert_invalid_arg(list_fields_parse("size,colour", &fields));
+    ck_assert_err_none(list_fields_parse("", &fields));
+    ck_assert_uint_eq(fields, 0);
+    ck_assert_err_none(list_fields_parse("variants,sha,orig_res,size", &fields));
+    ck_assert_uint_eq(fields, LIST_ORIG_RES | LIST_SIZE | LIST_SHA | LIST_VARIANTS);
+
+    ck_assert_err_none(do_open(IMGFS("test02"), "rb", &file));
+    file.metadata[1].offset[SMALL_RES] = 200000;
+    file.metadata[1].size[SMALL_RES] = 4242;
+
+    ck_assert_err_none(do_list_fields(&file, JSON, fields, &out, NULL));
+    ck_assert_str_eq(out, "{ \"Images\": [ "
+                     "{ \"img_id\": \"pic1\", \"orig_res\": [ 1200, 800 ], \"size\": [ 0, 0, 72876 ], "
+                     "\"sha\": \"66ac648b32a8268ed0b350b184cfa04c00c6236af3a2aa4411c01518f6061af8\", "
+                     "\"variants\": [ \"orig\" ] }, "
+                     "{ \"img_id\": \"pic2\", \"orig_res\": [ 1200, 800 ], \"size\": [ 0, 4242, 98119 ], "
+                     "\"sha\": \"95962b09e0fc9716ee4c2a1cf173f9147758235360d7ac0a73dfa378858b8a10\", "
+                     "\"variants\": [ \"small\", \"orig\" ] } ] }");
+    free(out);
+
+    // with the URLs of the contents
+    ck_assert_err_none(do_list_fields(&file, JSON_BLOBS, LIST_ORIG_RES, &out, NULL));
+    ck_assert_str_eq(out, "{ \"Images\": [ "
+                     "{ \"img_id\": \"pic1\", \"url\": "
+                     "\"\\/imgfs\\/blob\\/66ac648b32a8268ed0b350b184cfa04c00c6236af3a2aa4411c01518f6061af8\", "
+                     "\"orig_res\": [ 1200, 800 ] }, "
+                     "{ \"img_id\": \"pic2\", \"url\": "
+                     "\"\\/imgfs\\/blob\\/95962b09e0fc9716ee4c2a1cf173f9147758235360d7ac0a73dfa378858b8a10\", "
+                     "\"orig_res\": [ 1200, 800 ] } ] }");
+    free(out);
+
+    // no fields: the IDs only
+    ck_assert_err_none(do_list_fields(&file, JSON, 0, &out, NULL));
+    ck_assert_str_eq(out, "{ \"Images\": [ \"pic1\", \"pic2\" ] }");
+    free(out);
+
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(do_list_cbor)
+{
+    start_test_print;
+
+    char *cbor = NULL, *json = NULL, *decoded = NULL;
+    size_t len = 0;
+    struct imgfs_file file;
+
+    ck_assert_err_none(do_open(IMGFS("test02"), "rb", &file));
+
+    // { "Images": [ { "img_id": "pic1", "size": [ 0, 0, 72876 ], "sha": h'66ac...' }, ...
+    ck_assert_err_none(do_list_fields(&file, CBOR, 0, &cbor, &len));
+    static const char start[] = "\xbf\x66Images\x9f\xa3\x66img_id\x64pic1\x64size\x83\x00\x00\x1a\x00\x01\x1c\xac"
+                                "\x63sha\x58\x20\x66\xac\x64\x8b";
+    ck_assert(len > sizeof(start) - 1);
+    ck_assert_mem_eq(cbor, start, sizeof(start) - 1);
+    ck_assert_mem_eq(cbor + len - 2, "\xff\xff", 2);
+
+    // the same as the JSON listing with the details always in the CBOR one
+    ck_assert_err_none(do_list_fields(&file, JSON, LIST_SIZE | LIST_SHA, &json, NULL));
+    ck_assert_err_none(cbor_to_json(cbor, len, &decoded));
+    ck_assert_str_eq(decoded, json);
+    free(cbor);
+    free(json);
+    free(decoded);
+
+    ck_assert_err_none(do_list_fields(&file, CBOR, LIST_ORIG_RES | LIST_VARIANTS, &cbor, &len));
+    ck_assert_err_none(do_list_fields(&file, JSON, LIST_ORIG_RES | LIST_VARIANTS | LIST_SIZE | LIST_SHA, &json, NULL));
+    ck_assert_err_none(cbor_to_json(cbor, len, &decoded));
+    ck_assert_str_eq(decoded, json);
+    free(decoded);
+
+    // truncated, or followed by something else
+    ck_assert_invalid_arg(cbor_to_json(cbor, len - 1, &decoded));
+    ck_assert_invalid_arg(cbor_to_json(cbor, 20, &decoded));
+    ck_assert_invalid_arg(cbor_to_json("\xa1\x01\x02", 3, &decoded)); // key not a string
+    ck_assert_invalid_arg(cbor_to_json("\x82\x01\x02\x03", 4, &decoded));
+
+    // negative integers, down to -2^64
+    ck_assert_err_none(cbor_to_json("\x83\x20\x38\x63\x3b\xff\xff\xff\xff\xff\xff\xff\xff", 13, &decoded));
+    ck_assert_str_eq(decoded, "[ -1, -100, -18446744073709551616 ]");
+    free(decoded);
+    free(cbor);
+    free(json);
+
+    do_close(&file);
+
+    // empty
+    memset(&file, 0, sizeof(file));
+    ck_assert_err_none(do_list_fields(&file, CBOR, 0, &cbor, &len));
+    ck_assert_uint_eq(len, 11);
+    ck_assert_err_none(cbor_to_json(cbor, len, &decoded));
+    ck_assert_str_eq(decoded, "{ \"Images\": [ ] }");
+    free(cbor);
+    free(decoded);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(do_list_json_escaped)
+{
+    start_test_print;
+
+    char *out = NULL;
+    struct imgfs_file file;
+    memset(&file, 0, sizeof(file));
+    file.header.max_files = 3;
+    file.header.nb_files = 2;
+    file.metadata = calloc(file.header.max_files, sizeof(struct img_metadata));
+    ck_assert_ptr_nonnull(file.metadata);
+
+    file.metadata[0].is_valid = NON_EMPTY;
+    strcpy(file.metadata[0].img_id, "a/b\"c\\d\n\x01");
+    file.metadata[2].is_valid = NON_EMPTY;
+    strcpy(file.metadata[2].img_id, "plain");
+
+    ck_assert_err_none(do_list(&file, JSON, &out));
+    ck_assert_str_eq(out, "{ \"Images\": [ \"a\\/b\\\"c\\\\d\\n\\u0001\", \"plain\" ] }");
+
+    free(out);
+    free(file.metadata);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(do_list_json_large)
+{
+    start_test_print;
+
+    char *out = NULL;
+    struct imgfs_file file;
+    memset(&file, 0, sizeof(file));
+    file.header.max_files = 2000;
+    file.header.nb_files = 10; // the buffer has to grow
+    file.metadata = calloc(file.header.max_files, sizeof(struct img_metadata));
+    ck_assert_ptr_nonnull(file.metadata);
+
+    for (uint32_t i = 0; i < file.header.max_files; ++i) {
+        file.metadata[i].is_valid = NON_EMPTY;
+        memset(file.metadata[i].img_id, 'a' + (char) (i % 26), MAX_IMG_ID);
+    }
+
+    ck_assert_err_none(do_list(&file, JSON, &out));
+    ck_assert_uint_eq(strlen(out), strlen("{ \"Images\": [ ") + 2000 * (MAX_IMG_ID + 2) + 1999 * 2 + strlen(" ] }"));
+    ck_assert_int_eq(out[strlen("{ \"Images\": [ ") + 1], 'a');
+    ck_assert_str_eq(out + strlen(out) - strlen("x\" ] }"), "x\" ] }"); // the 2000th ID is x...x
+
+    free(out);
+    free(file.metadata);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(do_list_chunk_valid)
+{
+    start_test_print;
+
+    struct imgfs_file file;
+    char buffer[16];
+    struct imgfs_list_cursor cursor = { 0, SIZE_MAX, 0, 0 };
+
+    ck_assert_invalid_arg(do_list_chunk(NULL, JSON, &cursor, buffer, sizeof(buffer)));
+
+    ck_assert_err_none(do_open(IMGFS("test02"), "rb", &file));
+
+    ck_assert_invalid_arg(do_list_chunk(&file, JSON, NULL, buffer, sizeof(buffer)));
+    ck_assert_invalid_arg(do_list_chunk(&file, JSON, &cursor, NULL, sizeof(buffer)));
+    ck_assert_invalid_arg(do_list_chunk(&file, STDOUT, &cursor, buffer, sizeof(buffer)));
+    ck_assert_invalid_arg(do_list_chunk(&file, JSON, &cursor, buffer, 5)); // "pic1" does not fit
+
+    // one image per chunk
+    ck_assert_int_eq(do_list_chunk(&file, JSON, &cursor, buffer, 8), 6);
+    ck_assert_mem_eq(buffer, "\"pic1\"", 6);
+    ck_assert_int_eq(do_list_chunk(&file, JSON, &cursor, buffer, 8), 8);
+    ck_assert_mem_eq(buffer, ", \"pic2\"", 8);
+    ck_assert_int_eq(do_list_chunk(&file, JSON, &cursor, buffer, 8), 0);
+    ck_assert_uint_eq(cursor.listed, 2);
+    ck_assert_uint_eq(cursor.slot, file.header.max_files);
+
+    // pages: the cursor stops on the next image
+    cursor = (struct imgfs_list_cursor) { 0, 1, 0, 0 };
+    ck_assert_int_eq(do_list_chunk(&file, JSON, &cursor, buffer, sizeof(buffer)), 6);
+    ck_assert_uint_eq(cursor.slot, 1);
+    cursor.remaining = 1;
+    cursor.listed = 0;
+    ck_assert_int_eq(do_list_chunk(&file, JSON, &cursor, buffer, sizeof(buffer)), 6);
+    ck_assert_mem_eq(buffer, "\"pic2\"", 6);
+    ck_assert_uint_eq(cursor.slot, file.header.max_files);
+
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
 // ======================================================================
 Suite *imgfs_structures_test_suite()
 {
@@ -105,6 +345,12 @@ Suite *imgfs_structures_test_suite()
 
     Add_Test(s, do_list_json_emtpy);
     Add_Test(s, do_list_json_non_emtpy);
+    Add_Test(s, do_list_json_blobs);
+    Add_Test(s, do_list_json_fields);
+    Add_Test(s, do_list_cbor);
+    Add_Test(s, do_list_json_escaped);
+    Add_Test(s, do_list_json_large);
+    Add_Test(s, do_list_chunk_valid);
     return s;
 }
 
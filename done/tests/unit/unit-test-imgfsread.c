@@ -134,6 +134,83 @@ START_TEST(do_read_resize_invalid_mode)
 }
 END_TEST
 
+// ======================================================================
+START_TEST(find_image_by_sha_valid)
+{
+    start_test_print;
+
+    struct imgfs_file file;
+    unsigned char sha[SHA256_DIGEST_LENGTH];
+
+    ck_assert_err_none(sha_from_string("95962b09e0fc9716ee4c2a1cf173f9147758235360d7ac0a73dfa378858b8a10",
+                                       2 * SHA256_DIGEST_LENGTH, sha));
+    ck_assert_invalid_arg(find_image_by_sha(NULL, &file));
+    ck_assert_invalid_arg(find_image_by_sha(sha, NULL));
+
+    ck_assert_err_none(do_open(IMGFS("test02"), "rb", &file));
+
+    ck_assert_int_eq(find_image_by_sha(sha, &file), find_image_index("pic2", &file));
+    sha[0] ^= 1;
+    ck_assert_err(find_image_by_sha(sha, &file), ERR_IMAGE_NOT_FOUND);
+
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(do_read_batch_valid)
+{
+    start_test_print;
+
+    struct imgfs_file file;
+    char *contents = NULL;
+    char *expected[2];
+    uint32_t expected_size[2];
+
+    ck_assert_err_none(do_open(IMGFS("test02"), "rb", &file));
+    ck_assert_err_none(do_read("pic1", ORIG_RES, &expected[0], &expected_size[0], &file));
+    ck_assert_err_none(do_read("pic2", ORIG_RES, &expected[1], &expected_size[1], &file));
+
+    // pic2 comes after pic1 in the file, pic1 is asked for twice
+    struct imgfs_read_request requests[] = {
+        { "pic2", ORIG_RES, 0, 0, 0, NULL },
+        { "pic1", ORIG_RES, 0, 0, 0, NULL },
+        { "pic3", ORIG_RES, 0, 0, 0, NULL },
+        { "pic1", -1, 0, 0, 0, NULL },
+        { "pic1", ORIG_RES, 0, 0, 0, NULL },
+    };
+    ck_assert_invalid_arg(do_read_batch_locate(NULL, 1, &file));
+    ck_assert_invalid_arg(do_read_batch_locate(requests, 1, NULL));
+    ck_assert_err_none(do_read_batch_locate(requests, 5, &file));
+    ck_assert_err_none(requests[0].status);
+    ck_assert_err_none(requests[1].status);
+    ck_assert_err(requests[2].status, ERR_IMAGE_NOT_FOUND);
+    ck_assert_invalid_arg(requests[3].status);
+    ck_assert_uint_eq(requests[1].size, expected_size[0]);
+    ck_assert_int_eq(requests[1].resized, 0);
+
+    ck_assert_invalid_arg(do_read_batch(requests, 5, fileno(file.file), NULL));
+    ck_assert_err_none(do_read_batch(requests, 5, fileno(file.file), &contents));
+    ck_assert_mem_eq(requests[0].data, expected[1], expected_size[1]);
+    ck_assert_mem_eq(requests[1].data, expected[0], expected_size[0]);
+    ck_assert_ptr_null(requests[2].data);
+    ck_assert_ptr_null(requests[3].data);
+    ck_assert_ptr_eq(requests[4].data, requests[1].data);
+    // in the order of the file, each content once
+    ck_assert_ptr_eq(requests[1].data, contents);
+    ck_assert_ptr_eq(requests[0].data, contents + expected_size[0]);
+
+    free(contents);
+    free(expected[0]);
+    free(expected[1]);
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
 // ======================================================================
 Suite *imgfs_read_test_suite()
 {
@@ -144,6 +221,8 @@ Suite *imgfs_read_test_suite()
     Add_Test(s, do_read_valid);
     Add_Test(s, do_read_resize);
     Add_Test(s, do_read_resize_invalid_mode);
+    Add_Test(s, find_image_by_sha_valid);
+    Add_Test(s, do_read_batch_valid);
 
     return s;
 }
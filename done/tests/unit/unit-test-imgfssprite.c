@@ -0,0 +1,104 @@
+#include "image_sprite.h"
+#include "imgfs.h"
+#include "test.h"
+#include <check.h>
+#include <string.h>
+#include <vips/vips.h>
+
+// ======================================================================
+START_TEST(sprite_locate_valid)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    struct imgfs_file file;
+    struct sprite *sprite = calloc(1, sizeof(*sprite));
+    ck_assert_ptr_nonnull(sprite);
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+
+    ck_assert_invalid_arg(sprite_locate(NULL, 0, &file));
+    ck_assert_invalid_arg(sprite_locate(sprite, 0, NULL));
+
+    ck_assert_err_none(sprite_locate(sprite, 0, &file));
+    ck_assert_uint_eq(sprite->version, 2);
+    ck_assert_uint_eq(sprite->nb_tiles, 2);
+    ck_assert_int_eq(sprite->more, 0);
+    ck_assert_uint_eq(sprite->cell_width, 64);
+    ck_assert_uint_eq(sprite->cell_height, 64);
+    ck_assert_str_eq(sprite->tiles[0].img_id, "pic1");
+    ck_assert_str_eq(sprite->tiles[1].img_id, "pic2");
+    ck_assert_ptr_eq(sprite->thumbs[0].img_id, sprite->tiles[0].img_id);
+    ck_assert_int_eq(sprite->thumbs[1].resolution, THUMB_RES);
+    // test02 has no thumbnails: they are made
+    ck_assert_int_eq(sprite->thumbs[0].resized, 1);
+    ck_assert_int_eq(sprite->thumbs[1].resized, 1);
+
+    // only the first page may be empty
+    ck_assert_invalid_arg(sprite_locate(sprite, 1, &file));
+
+    do_close(&file);
+    free(sprite);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(sprite_compose_valid)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    struct imgfs_file file;
+    struct sprite *sprite = calloc(1, sizeof(*sprite));
+    ck_assert_ptr_nonnull(sprite);
+
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_err_none(sprite_locate(sprite, 0, &file));
+
+    ck_assert_invalid_arg(sprite_compose(sprite, 0, fileno(file.file)));
+    ck_assert_invalid_arg(sprite_compose(sprite, SPRITE_MAX_COLS + 1, fileno(file.file)));
+
+    // one thumbnail per row
+    ck_assert_err_none(sprite_compose(sprite, 1, fileno(file.file)));
+    ck_assert_ptr_nonnull(sprite->jpeg);
+    ck_assert_uint_eq(sprite->width, 64);
+    ck_assert_uint_eq(sprite->height, 128);
+    for (size_t i = 0; i < 2; ++i) {
+        const struct sprite_tile *const tile = &sprite->tiles[i];
+        ck_assert(tile->width > 0);
+        ck_assert(tile->x + tile->width <= 64);
+        ck_assert(tile->y >= 64 * i && tile->y + tile->height <= 64 * (i + 1));
+    }
+    sprite_free(sprite);
+    ck_assert_ptr_null(sprite->jpeg);
+
+    // both on one row
+    ck_assert_err_none(sprite_compose(sprite, 10, fileno(file.file)));
+    ck_assert_uint_eq(sprite->width, 128);
+    ck_assert_uint_eq(sprite->height, 64);
+    ck_assert(sprite->tiles[1].x >= 64);
+    sprite_free(sprite);
+
+    do_close(&file);
+    free(sprite);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+Suite *imgfs_sprite_test_suite()
+{
+    Suite *s = suite_create("Tests sprite implementation");
+
+    Add_Test(s, sprite_locate_valid);
+    Add_Test(s, sprite_compose_valid);
+
+    return s;
+}
+
+TEST_SUITE_VIPS(imgfs_sprite_test_suite)
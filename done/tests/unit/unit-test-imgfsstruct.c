@@ -4,13 +4,20 @@
 // ======================================================================
 #define SIZE_imgfs_header 64
 #define SIZE_img_metadata 216
-#define SIZE_imgfs_file   80
+#define SIZE_imgfs_file   136
+#define SIZE_imgfs_extent 16
+#define SIZE_imgfs_ext_header 24
+#define SIZE_imgfs_resolution 24
+#define SIZE_img_variant      16
+#define SIZE_img_metadata_ext 192
 
 #define OFFSET_imgfs_header_name        0
 #define OFFSET_imgfs_header_version     32
 #define OFFSET_imgfs_header_nb_files    36
 #define OFFSET_imgfs_header_max_files   40
 #define OFFSET_imgfs_header_resized_res 44
+#define OFFSET_imgfs_header_checksum    52
+#define OFFSET_imgfs_header_last_extent 56
 
 #define OFFSET_img_metadata_img_id   0
 #define OFFSET_img_metadata_SHA      128
@@ -18,10 +25,39 @@
 #define OFFSET_img_metadata_size     168
 #define OFFSET_img_metadata_offset   184
 #define OFFSET_img_metadata_is_valid 208
+#define OFFSET_img_metadata_checksum 212
 
 #define OFFSET_imgfs_file_file     0
 #define OFFSET_imgfs_file_header   8
 #define OFFSET_imgfs_file_metadata 72
+#define OFFSET_imgfs_file_ext      80
+#define OFFSET_imgfs_file_segments 88
+#define OFFSET_imgfs_file_nb_segments 96
+#define OFFSET_imgfs_file_journal  104
+#define OFFSET_imgfs_file_durability 112
+#define OFFSET_imgfs_file_sync_interval 116
+#define OFFSET_imgfs_file_flusher  120
+#define OFFSET_imgfs_file_nb_quarantined 128
+
+#define OFFSET_imgfs_extent_previous   0
+#define OFFSET_imgfs_extent_nb_entries 8
+
+#define OFFSET_imgfs_ext_header_magic      0
+#define OFFSET_imgfs_ext_header_version    8
+#define OFFSET_imgfs_ext_header_entry_size 12
+#define OFFSET_imgfs_ext_header_nb_entries 16
+#define OFFSET_imgfs_ext_header_nb_resolutions 20
+
+#define OFFSET_imgfs_resolution_name   0
+#define OFFSET_imgfs_resolution_width  16
+#define OFFSET_imgfs_resolution_height 18
+
+#define OFFSET_img_variant_offset 0
+#define OFFSET_img_variant_size   8
+
+#define OFFSET_img_metadata_ext_SHA         0
+#define OFFSET_img_metadata_ext_placeholder 32
+#define OFFSET_img_metadata_ext_variants    64
 
 // ======================================================================
 #define test_member(T, M)                                                                                              \
@@ -57,6 +93,13 @@ START_TEST(imgfs_header)
     test_member(imgfs_header, nb_files);
     test_member(imgfs_header, max_files);
     test_member(imgfs_header, resized_res);
+    test_member(imgfs_header, checksum);
+    test_member(imgfs_header, last_extent);
+
+    test_size(imgfs_extent);
+
+    test_member(imgfs_extent, previous);
+    test_member(imgfs_extent, nb_entries);
 
     end_test_print;
 }
@@ -75,6 +118,7 @@ START_TEST(img_metadata)
     test_member(img_metadata, size);
     test_member(img_metadata, offset);
     test_member(img_metadata, is_valid);
+    test_member(img_metadata, checksum);
 
     end_test_print;
 }
@@ -90,6 +134,48 @@ START_TEST(imgfs_file)
     test_member(imgfs_file, file);
     test_member(imgfs_file, header);
     test_member(imgfs_file, metadata);
+    test_member(imgfs_file, ext);
+    test_member(imgfs_file, segments);
+    test_member(imgfs_file, nb_segments);
+    test_member(imgfs_file, journal);
+    test_member(imgfs_file, durability);
+    test_member(imgfs_file, sync_interval);
+    test_member(imgfs_file, flusher);
+    test_member(imgfs_file, nb_quarantined);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(imgfs_ext)
+{
+    start_test_print;
+
+    test_size(imgfs_ext_header);
+
+    test_member(imgfs_ext_header, magic);
+    test_member(imgfs_ext_header, version);
+    test_member(imgfs_ext_header, entry_size);
+    test_member(imgfs_ext_header, nb_entries);
+    test_member(imgfs_ext_header, nb_resolutions);
+
+    test_size(imgfs_resolution);
+
+    test_member(imgfs_resolution, name);
+    test_member(imgfs_resolution, width);
+    test_member(imgfs_resolution, height);
+
+    test_size(img_variant);
+
+    test_member(img_variant, offset);
+    test_member(img_variant, size);
+
+    test_size(img_metadata_ext);
+
+    test_member(img_metadata_ext, SHA);
+    test_member(img_metadata_ext, placeholder);
+    test_member(img_metadata_ext, variants);
 
     end_test_print;
 }
@@ -103,6 +189,7 @@ Suite *imgfs_structures_test_suite()
     Add_Test(s, imgfs_header);
     Add_Test(s, img_metadata);
     Add_Test(s, imgfs_file);
+    Add_Test(s, imgfs_ext);
 
     return s;
 }
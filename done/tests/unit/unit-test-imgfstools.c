@@ -111,6 +111,124 @@ START_TEST(do_open_correct_metadata)
 }
 END_TEST
 
+// ======================================================================
+START_TEST(placeholder_extension)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    char dump_ext[4096 + sizeof(IMGFS_EXT_SUFFIX)] = {0};
+    strcat(strcat(dump_ext, dump), IMGFS_EXT_SUFFIX);
+    remove(dump_ext); // left by a former run
+
+    struct imgfs_file file;
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_ptr_nonnull(file.ext);
+    ck_assert_ptr_null(file.ext->file);
+    ck_assert_ptr_null(imgfs_placeholder(&file, 0));
+
+    // The extension file is created next to the imgFS file, which is left as it was
+    ck_assert_err_none(imgfs_set_placeholder(&file, 1, "LEHV6nWB2yk8pyo0adR*.7kCMdnj"));
+    ck_assert_str_eq(imgfs_placeholder(&file, 1), "LEHV6nWB2yk8pyo0adR*.7kCMdnj");
+    ck_assert_ptr_null(imgfs_placeholder(&file, 0));
+    ck_assert_int_eq(fseek(file.file, 0, SEEK_END), 0);
+    ck_assert_int_eq(ftell(file.file), 192659);
+    ck_assert_int_eq(fseek(file.ext->file, 0, SEEK_END), 0);
+    // (with no resolutions, the entries have no variants)
+    ck_assert_int_eq(ftell(file.ext->file),
+                     sizeof(struct imgfs_ext_header) + 100 * offsetof(struct img_metadata_ext, variants));
+    do_close(&file);
+
+    ck_assert_err_none(do_open(dump, "rb", &file));
+    ck_assert_str_eq(imgfs_placeholder(&file, 1), "LEHV6nWB2yk8pyo0adR*.7kCMdnj");
+    ck_assert_ptr_null(imgfs_placeholder(&file, 0));
+    ck_assert_err(imgfs_set_placeholder(&file, 0, "L00000fQfQfQfQfQfQfQfQfQfQfQ"), ERR_IO); // read only
+
+    // A placeholder belongs to the content it was computed from
+    file.metadata[1].SHA[0] ^= 1;
+    ck_assert_ptr_null(imgfs_placeholder(&file, 1));
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
+// ======================================================================
+START_TEST(resolution_extension)
+{
+    start_test_print;
+
+    DECLARE_DUMP;
+    DUPLICATE_FILE(dump, IMGFS("test02"));
+    char dump_ext[4096 + sizeof(IMGFS_EXT_SUFFIX)] = {0};
+    strcat(strcat(dump_ext, dump), IMGFS_EXT_SUFFIX);
+    remove(dump_ext); // left by a former run
+
+    struct imgfs_file file;
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    ck_assert_int_eq(imgfs_nb_resolutions(&file), NB_RES);
+    ck_assert_int_eq(imgfs_resolution_atoi("thumbnail", &file), THUMB_RES);
+    ck_assert_int_eq(imgfs_resolution_atoi("w320", &file), -1);
+    ck_assert_str_eq(imgfs_resolution_name(&file, ORIG_RES), "orig");
+    ck_assert_ptr_null(imgfs_resolution_name(&file, NB_RES));
+
+    ck_assert_invalid_arg(imgfs_add_resolution(&file, "", 320, 240));
+    ck_assert_invalid_arg(imgfs_add_resolution(&file, "small", 320, 240));
+    ck_assert_invalid_arg(imgfs_add_resolution(&file, "w 320", 320, 240));
+    ck_assert_invalid_arg(imgfs_add_resolution(&file, "a_much_too_long_name", 320, 240));
+    ck_assert_err(imgfs_add_resolution(&file, "w320", 0, 240), ERR_RESOLUTIONS);
+
+    // Adding resolutions keeps the details of the images
+    ck_assert_err_none(imgfs_set_placeholder(&file, 1, "LEHV6nWB2yk8pyo0adR*.7kCMdnj"));
+    ck_assert_err_none(imgfs_add_resolution(&file, "w320", 320, 240));
+    ck_assert_err_none(imgfs_add_resolution(&file, "w640", 640, 480));
+    ck_assert_invalid_arg(imgfs_add_resolution(&file, "w640", 640, 640));
+    ck_assert_int_eq(imgfs_nb_resolutions(&file), NB_RES + 2);
+    ck_assert_int_eq(imgfs_resolution_atoi("w640", &file), NB_RES + 1);
+    ck_assert_str_eq(imgfs_resolution_name(&file, NB_RES), "w320");
+    ck_assert_str_eq(imgfs_placeholder(&file, 1), "LEHV6nWB2yk8pyo0adR*.7kCMdnj");
+
+    uint64_t offset = 1;
+    uint32_t size = 1;
+    ck_assert_err_none(imgfs_variant(&file, 1, NB_RES, &offset, &size));
+    ck_assert_uint_eq(offset, 0);
+    ck_assert_uint_eq(size, 0);
+    ck_assert_err(imgfs_variant(&file, 1, NB_RES + 2, &offset, &size), ERR_RESOLUTIONS);
+    ck_assert_err_none(imgfs_set_variant(&file, 1, NB_RES + 1, 192659, 1234));
+    ck_assert_int_eq(fseek(file.ext->file, 0, SEEK_END), 0);
+    ck_assert_int_eq(ftell(file.ext->file),
+                     sizeof(struct imgfs_ext_header) + 2 * sizeof(struct imgfs_resolution) +
+                     100 * (offsetof(struct img_metadata_ext, variants) + 2 * sizeof(struct img_variant)));
+    do_close(&file);
+
+    ck_assert_err_none(do_open(dump, "rb", &file));
+    ck_assert_int_eq(imgfs_resolution_atoi("w320", &file), NB_RES);
+    ck_assert_err_none(imgfs_variant(&file, 1, NB_RES + 1, &offset, &size));
+    ck_assert_uint_eq(offset, 192659);
+    ck_assert_uint_eq(size, 1234);
+    ck_assert_str_eq(imgfs_placeholder(&file, 1), "LEHV6nWB2yk8pyo0adR*.7kCMdnj");
+
+    // A variant belongs to the content it was resized from
+    file.metadata[1].SHA[0] ^= 1;
+    ck_assert_err_none(imgfs_variant(&file, 1, NB_RES + 1, &offset, &size));
+    ck_assert_uint_eq(offset, 0);
+    do_close(&file);
+
+    // There is room for MAX_EXTRA_RES of them
+    ck_assert_err_none(do_open(dump, "rb+", &file));
+    char name[] = "extra0";
+    for (int i = 2; i < MAX_EXTRA_RES; ++i) {
+        name[5] = (char) ('0' + i);
+        ck_assert_err_none(imgfs_add_resolution(&file, name, 100, 100));
+    }
+    ck_assert_err(imgfs_add_resolution(&file, "extra", 100, 100), ERR_RESOLUTIONS);
+    do_close(&file);
+
+    end_test_print;
+}
+END_TEST
+
 // ======================================================================
 START_TEST(do_close_null_param)
 {
@@ -130,6 +248,10 @@ START_TEST(do_close_null_file)
     struct imgfs_file file;
     file.file = NULL;
     file.metadata = malloc(sizeof(struct img_metadata));
+    file.ext = NULL;
+    file.segments = NULL;
+    file.journal = NULL;
+    file.flusher = NULL;
 
     do_close(&file);
 
@@ -147,6 +269,8 @@ Suite *imgfs_tools_suite_RES()
     Add_Test(s, do_open_invalid_mode);
     Add_Test(s, do_open_correct_header);
     Add_Test(s, do_open_correct_metadata);
+    Add_Test(s, placeholder_extension);
+    Add_Test(s, resolution_extension);
 
     Add_Test(s, do_close_null_param);
     Add_Test(s, do_close_null_file);